@@ -20,19 +20,39 @@
 
 #import <Foundation/Foundation.h>
 
+@class METDocumentKey;
+@class METDocumentChangeDetails;
 @class METMethodInvocation;
+@class METDataUpdate;
 
 NS_ASSUME_NONNULL_BEGIN
 
+// Keeps the fields last received from the server for a document as a base layer,
+// and the changes performed by the stub of each method invocation affecting it
+// as separate patch layers on top of that
 @interface METBufferedDocument : NSObject
 
+- (instancetype)initWithDocumentKey:(METDocumentKey *)documentKey fields:(nullable NSDictionary *)fields NS_DESIGNATED_INITIALIZER;
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (copy, nonatomic, readonly) METDocumentKey *documentKey;
+
+// Documents are assigned increasing epochs when they start being buffered
+@property (assign, nonatomic) uint64_t epoch;
+@property (assign, nonatomic, readonly, getter=isFlushed) BOOL flushed;
+
+// Fields of the base layer, updated as data updates are received from the server
 @property (nullable, copy, nonatomic) NSDictionary *fields;
 
-- (void)addMethodInvocationWaitingUntilUpdatesAreDone:(METMethodInvocation *)methodInvocation;
-- (void)removeMethodInvocationWaitingUntilUpdatesAreDone:(METMethodInvocation *)methodInvocation;
-@property (assign, nonatomic, readonly) NSUInteger numberOfSentMethodInvocationsWaitingUntilUpdatesAreDone;
+- (void)addMethodInvocation:(METMethodInvocation *)methodInvocation withChangesPerformedByStub:(METDocumentChangeDetails *)documentChangeDetails;
+@property (assign, nonatomic, readonly) NSUInteger numberOfMethodInvocations;
+
+// Drops the patch layer of the method invocation and returns the update needed to bring
+// the local cache in line with the remaining layers, or nil if nothing changed
+- (nullable METDataUpdate *)dataUpdateByRemovingMethodInvocation:(METMethodInvocation *)methodInvocation;
+
+@property (nullable, copy, nonatomic, readonly) NSDictionary *composedFields;
 
-- (void)waitUntilFlushedWithGroup:(dispatch_group_t)group;
 - (void)didFlush;
 
 @end
@@ -21,49 +21,96 @@
 #import "METBufferedDocument.h"
 
 #import "METMethodInvocation.h"
+#import "METDocumentKey.h"
+#import "METDocumentChangeDetails.h"
+#import "METDataUpdate.h"
+#import "NSDictionary+METAdditions.h"
 
 @implementation METBufferedDocument {
-  NSMutableArray *_methodInvocationsWaitingUntilUpdatesAreDone;
-  NSMutableArray *_groupsWaitingUntilFlushed;
+  NSMutableArray *_methodInvocations;
+  NSMutableArray *_patches;
+  NSDictionary *_fieldsInLocalCache;
 }
 
-- (instancetype)init {
+- (instancetype)initWithDocumentKey:(METDocumentKey *)documentKey fields:(NSDictionary *)fields {
   self = [super init];
   if (self) {
-    _methodInvocationsWaitingUntilUpdatesAreDone = [[NSMutableArray alloc] init];
-    _groupsWaitingUntilFlushed = [[NSMutableArray alloc] init];
+    _documentKey = [documentKey copy];
+    _fields = [fields copy];
+    _fieldsInLocalCache = _fields;
+    _methodInvocations = [[NSMutableArray alloc] init];
+    _patches = [[NSMutableArray alloc] init];
   }
   return self;
 }
 
-- (void)addMethodInvocationWaitingUntilUpdatesAreDone:(METMethodInvocation *)methodInvocation {
-  [_methodInvocationsWaitingUntilUpdatesAreDone addObject:methodInvocation];
+- (void)addMethodInvocation:(METMethodInvocation *)methodInvocation withChangesPerformedByStub:(METDocumentChangeDetails *)documentChangeDetails {
+  [_methodInvocations addObject:methodInvocation];
+  [_patches addObject:documentChangeDetails];
+  _fieldsInLocalCache = documentChangeDetails.fieldsAfterChanges;
 }
 
-- (void)removeMethodInvocationWaitingUntilUpdatesAreDone:(METMethodInvocation *)methodInvocation {
-  [_methodInvocationsWaitingUntilUpdatesAreDone removeObject:methodInvocation];
+- (NSUInteger)numberOfMethodInvocations {
+  return _methodInvocations.count;
 }
 
-- (NSUInteger)numberOfSentMethodInvocationsWaitingUntilUpdatesAreDone {
-  NSUInteger count = 0;
-  for (METMethodInvocation *methodInvocation in _methodInvocationsWaitingUntilUpdatesAreDone) {
-    if (methodInvocation.messageSent && !methodInvocation.updatesDone) {
-      count++;
+- (NSDictionary *)composedFields {
+  NSDictionary *fields = _fields;
+  for (METDocumentChangeDetails *patch in _patches) {
+    switch (patch.changeType) {
+      case METDocumentChangeTypeAdd:
+        fields = patch.fieldsAfterChanges;
+        break;
+      case METDocumentChangeTypeUpdate:
+        // A stub update to a document that has since been removed on the server doesn't resurrect it
+        fields = [fields fieldsByApplyingChangedFields:patch.changedFields];
+        break;
+      case METDocumentChangeTypeRemove:
+        fields = nil;
+        break;
     }
   }
-  return count;
+  return fields;
 }
 
-- (void)waitUntilFlushedWithGroup:(dispatch_group_t)group {
-  dispatch_group_enter(group);
-  [_groupsWaitingUntilFlushed addObject:group];
+- (METDataUpdate *)dataUpdateByRemovingMethodInvocation:(METMethodInvocation *)methodInvocation {
+  // A method invocation that has been amended has a patch for every time its stub was performed
+  NSIndexSet *indexes = [_methodInvocations indexesOfObjectsPassingTest:^BOOL(id object, NSUInteger index, BOOL *stop) {
+    return object == methodInvocation;
+  }];
+  if (indexes.count < 1) {
+    return nil;
+  }
+  
+  [_methodInvocations removeObjectsAtIndexes:indexes];
+  [_patches removeObjectsAtIndexes:indexes];
+  
+  METDocumentChangeDetails *changeDetails = [[METDocumentChangeDetails alloc] initWithDocumentKey:_documentKey];
+  changeDetails.fieldsBeforeChanges = _fieldsInLocalCache;
+  changeDetails.fieldsAfterChanges = [self composedFields];
+  _fieldsInLocalCache = changeDetails.fieldsAfterChanges;
+  
+  if (changeDetails.fieldsBeforeChanges == nil && changeDetails.fieldsAfterChanges == nil) {
+    return nil;
+  }
+  
+  switch (changeDetails.changeType) {
+    case METDocumentChangeTypeAdd:
+      return [[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeAdd documentKey:_documentKey fields:changeDetails.fieldsAfterChanges];
+    case METDocumentChangeTypeUpdate: {
+      NSDictionary *changedFields = changeDetails.changedFields;
+      if (changedFields.count < 1) {
+        return nil;
+      }
+      return [[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeChange documentKey:_documentKey fields:changedFields];
+    }
+    case METDocumentChangeTypeRemove:
+      return [[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeRemove documentKey:_documentKey fields:nil];
+  }
 }
 
 - (void)didFlush {
-  for (dispatch_group_t group in _groupsWaitingUntilFlushed) {
-    dispatch_group_leave(group);
-  }
-  [_groupsWaitingUntilFlushed removeAllObjects];
+  _flushed = YES;
 }
 
 @end
@@ -0,0 +1,209 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#import "METChangeDeliveryScheduler.h"
+#import "METChangeDeliveryScheduler_Testing.h"
+
+#import "METDatabase.h"
+#import "METDatabase_Internal.h"
+#import "METDatabaseChanges.h"
+#import "METDatabaseChanges_Internal.h"
+#import "METDocumentChangeDetails.h"
+#import "METMonotonicTime.h"
+
+// Weight given to the most recent slice when estimating the time it takes to deliver a single document change
+static const double METChangeDeliverySmoothingFactor = 0.2;
+
+@implementation METChangeDeliveryScheduler {
+  METChangeDeliveryHandler _handler;
+  id _databaseObserver;
+  
+  METDatabaseChanges *_pendingChanges;
+  BOOL _deliveryScheduled;
+  BOOL _invalidated;
+}
+
+- (instancetype)initWithDatabase:(METDatabase *)database handler:(METChangeDeliveryHandler)handler {
+  NSParameterAssert(handler);
+  
+  self = [super init];
+  if (self) {
+    _database = database;
+    _handler = [handler copy];
+    _timeBudget = 0.008;
+    _initialSliceSize = 100;
+    _maximumSliceSize = 10000;
+    _pendingChanges = [[METDatabaseChanges alloc] init];
+    
+    _timeSource = ^NSTimeInterval{
+      return METMonotonicTime();
+    };
+    _scheduleBlock = ^(dispatch_block_t block) {
+      dispatch_async(dispatch_get_main_queue(), block);
+    };
+    
+    if (database) {
+      __weak METChangeDeliveryScheduler *weakSelf = self;
+      _databaseObserver = [[NSNotificationCenter defaultCenter] addObserverForName:METDatabaseDidChangeNotification object:database queue:nil usingBlock:^(NSNotification *notification) {
+        [weakSelf enqueueDatabaseChanges:notification.userInfo[METDatabaseChangesKey]];
+      }];
+    }
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [_database setNumberOfUndeliveredChanges:0 forConsumer:self];
+  
+  if (_databaseObserver) {
+    [[NSNotificationCenter defaultCenter] removeObserver:_databaseObserver];
+  }
+}
+
+- (void)invalidate {
+  @synchronized(self) {
+    _invalidated = YES;
+    [_pendingChanges removeAllDocumentChangeDetails];
+    [_database setNumberOfUndeliveredChanges:0 forConsumer:self];
+  }
+  
+  if (_databaseObserver) {
+    [[NSNotificationCenter defaultCenter] removeObserver:_databaseObserver];
+    _databaseObserver = nil;
+  }
+}
+
+- (NSUInteger)numberOfPendingDocumentChanges {
+  @synchronized(self) {
+    return [_pendingChanges numberOfDocumentChanges];
+  }
+}
+
+- (void)enqueueDatabaseChanges:(METDatabaseChanges *)databaseChanges {
+  BOOL shouldScheduleDelivery = NO;
+  
+  @synchronized(self) {
+    if (_invalidated) {
+      return;
+    }
+    
+    // Changes to documents that haven't been delivered yet are merged, so consumers only see the latest state
+    [_pendingChanges addDatabaseChanges:databaseChanges];
+    [_database setNumberOfUndeliveredChanges:[_pendingChanges numberOfDocumentChanges] forConsumer:self];
+    
+    if (!_deliveryScheduled && [_pendingChanges hasChanges]) {
+      _deliveryScheduled = YES;
+      shouldScheduleDelivery = YES;
+    }
+  }
+  
+  if (shouldScheduleDelivery) {
+    [self scheduleDelivery];
+  }
+}
+
+- (void)scheduleDelivery {
+  __weak METChangeDeliveryScheduler *weakSelf = self;
+  _scheduleBlock(^{
+    [weakSelf deliverNextSlice];
+  });
+}
+
+- (void)deliverNextSlice {
+  METDatabaseChanges *slice = [[METDatabaseChanges alloc] init];
+  __block NSUInteger numberOfDocumentChanges = 0;
+  
+  @synchronized(self) {
+    if (_invalidated) {
+      _deliveryScheduled = NO;
+      return;
+    }
+    
+    NSUInteger sliceSize = [self sliceSize];
+    
+    for (NSString *collectionName in [_pendingChanges loadedCollectionNames]) {
+      [slice didLoadCollectionWithName:collectionName];
+    }
+    [_pendingChanges removeAllLoadedCollectionNames];
+    
+    [_pendingChanges enumerateDocumentChangeDetailsUsingBlock:^(METDocumentChangeDetails *documentChangeDetails, BOOL *stop) {
+      [slice addDocumentChangeDetails:documentChangeDetails];
+      numberOfDocumentChanges++;
+      if (numberOfDocumentChanges >= sliceSize) {
+        *stop = YES;
+      }
+    }];
+    
+    for (METDocumentKey *documentKey in [slice affectedDocumentKeys]) {
+      [_pendingChanges removeChangeDetailsForDocumentWithKey:documentKey];
+    }
+    
+    // Changes count as delivered as soon as they are handed off, so the database can let more through while this slice is being handled
+    [_database setNumberOfUndeliveredChanges:[_pendingChanges numberOfDocumentChanges] forConsumer:self];
+  }
+  
+  if ([slice hasChanges]) {
+    NSTimeInterval startTime = _timeSource();
+    _handler(slice);
+    NSTimeInterval elapsedTime = _timeSource() - startTime;
+    
+    if (numberOfDocumentChanges > 0) {
+      [self updateEstimatedDeliveryTimePerDocumentChangeWithTime:elapsedTime / numberOfDocumentChanges];
+    }
+  }
+  
+  BOOL shouldScheduleDelivery = NO;
+  @synchronized(self) {
+    if ([_pendingChanges hasChanges] && !_invalidated) {
+      shouldScheduleDelivery = YES;
+    } else {
+      _deliveryScheduled = NO;
+    }
+  }
+  
+  // Remaining changes are delivered in a later run loop iteration, so we don't block the main thread
+  if (shouldScheduleDelivery) {
+    [self scheduleDelivery];
+  }
+}
+
+#pragma mark - Helper Methods
+
+- (NSUInteger)sliceSize {
+  if (_estimatedDeliveryTimePerDocumentChange <= 0) {
+    return MAX(_initialSliceSize, 1);
+  }
+  
+  // Clamped before converting, because a tiny estimate can make the quotient too large to fit
+  double sliceSize = fmin(_timeBudget / _estimatedDeliveryTimePerDocumentChange, (double)MAX(_maximumSliceSize, 1));
+  return MAX((NSUInteger)sliceSize, 1);
+}
+
+- (void)updateEstimatedDeliveryTimePerDocumentChangeWithTime:(NSTimeInterval)time {
+  @synchronized(self) {
+    if (_estimatedDeliveryTimePerDocumentChange <= 0) {
+      _estimatedDeliveryTimePerDocumentChange = time;
+    } else {
+      _estimatedDeliveryTimePerDocumentChange = METChangeDeliverySmoothingFactor * time + (1 - METChangeDeliverySmoothingFactor) * _estimatedDeliveryTimePerDocumentChange;
+    }
+  }
+}
+
+@end
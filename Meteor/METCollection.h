@@ -44,9 +44,22 @@ NS_ASSUME_NONNULL_BEGIN
 - (id)insertDocumentWithFields:(NSDictionary *)fields;
 - (id)insertDocumentWithFields:(NSDictionary *)fields completionHandler:(nullable METMethodCompletionHandler)completionHandler;
 
+// Inserts are performed as a single batch, and the IDs of the new documents are returned in the same order,
+// with NSNull at the positions of inserts that didn't produce an ID
+- (NSArray *)insertDocumentsWithFields:(NSArray *)arrayOfFields;
+- (NSArray *)insertDocumentsWithFields:(NSArray *)arrayOfFields completionHandler:(nullable METMethodBatchCompletionHandler)completionHandler;
+
 - (id)updateDocumentWithID:(id)documentID changedFields:(NSDictionary *)fields;
 - (id)updateDocumentWithID:(id)documentID changedFields:(NSDictionary *)fields completionHandler:(nullable METMethodCompletionHandler)completionHandler;
 
+// When set, updates to a document that are made within this interval of each other are sent as a single
+// method invocation with a merged modifier. The local cache is still updated right away. Defaults to 0.
+@property (assign, nonatomic) NSTimeInterval updateCoalescingInterval;
+
+// Changes to nested values are sent as dotted paths (like "profile.address.city") instead of whole top-level
+// values, unless a field would need more than this number of paths. Set to 0 to always send whole values.
+@property (assign, nonatomic) NSUInteger maximumNumberOfNestedUpdatePaths;
+
 - (id)removeDocumentWithID:(id)documentID;
 - (id)removeDocumentWithID:(id)documentID completionHandler:(nullable METMethodCompletionHandler)completionHandler;
 
@@ -23,7 +23,6 @@
 
 #import "METDatabase.h"
 #import "METDatabase_Internal.h"
-#import "METDocumentCache.h"
 #import "METDocumentKey.h"
 #import "METDocument.h"
 #import "METFetchRequest.h"
@@ -34,11 +33,29 @@
 #import "METRandomStream.h"
 #import "METRandomValueGenerator.h"
 #import "METDataUpdate.h"
+#import "METMethodInvocation.h"
+#import "METMethodInvocationCoordinator.h"
+
+@interface METCoalescedUpdate : NSObject
+
+@property (strong, nonatomic) METMethodInvocation *methodInvocation;
+@property (nullable, copy, nonatomic) NSDictionary *fieldsBeforeUpdates;
+@property (strong, nonatomic) NSMutableDictionary *changedFields;
+@property (strong, nonatomic) NSMutableArray *completionHandlers;
+
+@end
+
+@implementation METCoalescedUpdate
+
+@end
 
 @interface METCollection ()
 @end
 
 @implementation METCollection {
+  NSTimeInterval _updateCoalescingInterval;
+  NSUInteger _maximumNumberOfNestedUpdatePaths;
+  NSMutableDictionary *_coalescedUpdatesByDocumentID;
 }
 
 - (instancetype)initWithName:(NSString *)name database:(METDatabase *)database {
@@ -46,6 +63,8 @@
   if (self) {
     _name = [name copy];
     _database = database;
+    _coalescedUpdatesByDocumentID = [[NSMutableDictionary alloc] init];
+    _maximumNumberOfNestedUpdatePaths = 16;
     
     [self defineStubsForMutationMethods];
   }
@@ -65,12 +84,7 @@
       documentID = [self generateNewDocumentID];
     }
     
-    __block BOOL success = NO;
-    [_database performUpdatesInLocalCache:^(METDocumentCache *localCache) {
-      success = [localCache addDocumentWithKey:[self keyWithID:documentID] fields:fields];
-    }];
-    
-    if (success) {
+    if ([_database addDocumentWithKey:[self keyWithID:documentID] fields:fields]) {
       return documentID;
     } else {
       return nil;
@@ -82,19 +96,19 @@
     NSDictionary *modifier = parameters[1];
     
     id documentID = [self documentIDFromSelector:selector];
+    METDocumentKey *documentKey = [self keyWithID:documentID];
     
-    NSMutableDictionary *fields = modifier[@"$set"];
-    NSArray *clearedFields = modifier[@"$unset"];
-    for (NSString *field in clearedFields) {
-      fields[field] = [NSNull null];
-    }
-    
-    __block BOOL success = NO;
-    [_database performUpdatesInLocalCache:^(METDocumentCache *localCache) {
-      success = [localCache updateDocumentWithKey:[self keyWithID:documentID] changedFields:fields];
+    // Modifiers may contain dotted paths, which are applied to the current value of the top-level field
+    NSDictionary *currentFields = [_database documentWithKey:documentKey].fields;
+    NSMutableDictionary *fields = [[NSMutableDictionary alloc] init];
+    [modifier[@"$set"] enumerateKeysAndObjectsUsingBlock:^(NSString *path, id value, BOOL *stop) {
+      [self setValue:value atPath:path inChangedFields:fields currentFields:currentFields];
     }];
+    for (NSString *path in modifier[@"$unset"]) {
+      [self setValue:nil atPath:path inChangedFields:fields currentFields:currentFields];
+    }
     
-    if (success) {
+    if ([_database updateDocumentWithKey:documentKey changedFields:fields]) {
       return @1;
     } else {
       return @0;
@@ -105,12 +119,7 @@
     id selector = parameters[0];
     id documentID = [self documentIDFromSelector:selector];
     
-    __block BOOL success = NO;
-    [_database performUpdatesInLocalCache:^(METDocumentCache *localCache) {
-      success = [localCache removeDocumentWithKey:[self keyWithID:documentID]];
-    }];
-    
-    if (success) {
+    if ([_database removeDocumentWithKey:[self keyWithID:documentID]]) {
       return @1;
     } else {
       return @0;
@@ -118,6 +127,68 @@
   }];
 }
 
+- (void)setValue:(id)value atPath:(NSString *)path inChangedFields:(NSMutableDictionary *)changedFields currentFields:(NSDictionary *)currentFields {
+  NSArray *pathComponents = [path componentsSeparatedByString:@"."];
+  NSString *field = pathComponents[0];
+  
+  if (pathComponents.count == 1) {
+    changedFields[field] = value ?: [NSNull null];
+    return;
+  }
+  
+  id currentValue = changedFields[field] ?: currentFields[field];
+  if (currentValue == [NSNull null]) {
+    currentValue = nil;
+  }
+  
+  id newValue = [self valueBySettingValue:value atPathComponents:[pathComponents subarrayWithRange:NSMakeRange(1, pathComponents.count - 1)] inValue:currentValue];
+  if (newValue) {
+    changedFields[field] = newValue;
+  }
+}
+
+// Follows MongoDB semantics: numeric components index into arrays, missing embedded documents are created
+// when setting, and unsetting an array element sets it to null
+- (id)valueBySettingValue:(id)value atPathComponents:(NSArray *)pathComponents inValue:(id)container {
+  NSString *component = pathComponents[0];
+  NSArray *remainingPathComponents = pathComponents.count > 1 ? [pathComponents subarrayWithRange:NSMakeRange(1, pathComponents.count - 1)] : nil;
+  
+  if ([container isKindOfClass:[NSArray class]] && [self isArrayIndexPathComponent:component]) {
+    NSMutableArray *array = [container mutableCopy];
+    NSUInteger index = (NSUInteger)component.integerValue;
+    id element = index < array.count ? array[index] : nil;
+    id newElement = remainingPathComponents ? [self valueBySettingValue:value atPathComponents:remainingPathComponents inValue:element] : value;
+    if (!newElement && !value && index >= array.count) {
+      return container;
+    }
+    while (array.count <= index) {
+      [array addObject:[NSNull null]];
+    }
+    array[index] = newElement ?: [NSNull null];
+    return array;
+  }
+  
+  if (![container isKindOfClass:[NSDictionary class]]) {
+    if (!value) {
+      return container;
+    }
+    container = @{};
+  }
+  
+  NSMutableDictionary *dictionary = [container mutableCopy];
+  id newValue = remainingPathComponents ? [self valueBySettingValue:value atPathComponents:remainingPathComponents inValue:dictionary[component]] : value;
+  if (newValue) {
+    dictionary[component] = newValue;
+  } else {
+    [dictionary removeObjectForKey:component];
+  }
+  return dictionary;
+}
+
+- (BOOL)isArrayIndexPathComponent:(NSString *)component {
+  return component.length > 0 && [component rangeOfCharacterFromSet:[[NSCharacterSet decimalDigitCharacterSet] invertedSet]].location == NSNotFound;
+}
+
 - (id)documentIDFromSelector:(id)selector {
   if ([selector isKindOfClass:[NSDictionary class]]) {
     return selector[@"_id"];
@@ -177,6 +248,24 @@
   return newDocumentID;
 }
 
+- (NSArray *)insertDocumentsWithFields:(NSArray *)arrayOfFields {
+  return [self insertDocumentsWithFields:arrayOfFields completionHandler:nil];
+}
+
+- (NSArray *)insertDocumentsWithFields:(NSArray *)arrayOfFields completionHandler:(METMethodBatchCompletionHandler)completionHandler {
+  NSMutableArray *newDocumentIDs = [[NSMutableArray alloc] initWithCapacity:arrayOfFields.count];
+  
+  [_database.client performMethodCallsInBatch:^{
+    for (NSDictionary *fields in arrayOfFields) {
+      id newDocumentID = [self insertDocumentWithFields:fields completionHandler:nil];
+      // Keep positions aligned with the array of fields, even if an insert didn't produce an ID
+      [newDocumentIDs addObject:newDocumentID ?: [NSNull null]];
+    }
+  } completionHandler:completionHandler];
+  
+  return newDocumentIDs;
+}
+
 - (id)updateDocumentWithID:(id)documentID changedFields:(NSDictionary *)changedFields {
   return [self updateDocumentWithID:documentID changedFields:changedFields completionHandler:nil];
 }
@@ -184,18 +273,185 @@
 - (id)updateDocumentWithID:(id)documentID changedFields:(NSDictionary *)changedFields completionHandler:(METMethodCompletionHandler)completionHandler {
   NSParameterAssert(documentID);
   
-  NSArray *clearedFields = [changedFields allKeysForObject:[NSNull null]];
+  NSDictionary *modifiers = [self modifiersForChangingFields:[self documentWithID:documentID].fields toChangedFields:changedFields];
   
-  NSMutableDictionary *modifiers = [[NSMutableDictionary alloc] init];
-  modifiers[@"$set"] = [changedFields dictionaryByRemovingObjectsForKeys:clearedFields];
-  if (clearedFields.count != 0) {
-    modifiers[@"$unset"] = [NSDictionary dictionaryWithObject:@"" forKeys:clearedFields];
+  NSString *methodName = [self methodNameForUpdateType:@"update"];
+  
+  // Updates from within a stub are only simulated, so there is nothing to coalesce
+  if (self.updateCoalescingInterval > 0 && !_database.client.currentMethodInvocationContext) {
+    return [self coalesceUpdateWithMethodName:methodName documentID:documentID changedFields:changedFields modifiers:modifiers completionHandler:completionHandler];
   }
   
-  NSString *methodName = [self methodNameForUpdateType:@"update"];
   return [_database.client callMethodWithName:methodName parameters:@[@{@"_id": documentID}, modifiers] options:METMethodCallOptionsReturnStubValue completionHandler:completionHandler];
 }
 
+// Changes inside nested values are sent as dotted paths, unless that would take more paths than the maximum
+- (NSDictionary *)modifiersForChangingFields:(NSDictionary *)fields toChangedFields:(NSDictionary *)changedFields {
+  NSUInteger maximumNumberOfNestedUpdatePaths = self.maximumNumberOfNestedUpdatePaths;
+  NSMutableDictionary *setFields = [[NSMutableDictionary alloc] init];
+  NSMutableDictionary *unsetFields = [[NSMutableDictionary alloc] init];
+  
+  [changedFields enumerateKeysAndObjectsUsingBlock:^(NSString *field, id value, BOOL *stop) {
+    if (value == [NSNull null]) {
+      unsetFields[field] = @"";
+      return;
+    }
+    
+    NSMutableDictionary *nestedSetFields = [[NSMutableDictionary alloc] init];
+    NSMutableDictionary *nestedUnsetFields = [[NSMutableDictionary alloc] init];
+    if (maximumNumberOfNestedUpdatePaths > 0 && [self addPathsForChangingNestedValue:fields[field] toValue:value atPath:field setFields:nestedSetFields unsetFields:nestedUnsetFields]) {
+      NSUInteger numberOfPaths = nestedSetFields.count + nestedUnsetFields.count;
+      if (numberOfPaths > 0 && numberOfPaths <= maximumNumberOfNestedUpdatePaths) {
+        [setFields addEntriesFromDictionary:nestedSetFields];
+        [unsetFields addEntriesFromDictionary:nestedUnsetFields];
+        return;
+      }
+    }
+    
+    setFields[field] = value;
+  }];
+  
+  return [self modifiersWithSetFields:setFields unsetFields:unsetFields];
+}
+
+// Returns NO if the change can't be expressed as paths into the old value
+- (BOOL)addPathsForChangingNestedValue:(id)oldValue toValue:(id)newValue atPath:(NSString *)path setFields:(NSMutableDictionary *)setFields unsetFields:(NSMutableDictionary *)unsetFields {
+  if ([oldValue isKindOfClass:[NSDictionary class]] && [newValue isKindOfClass:[NSDictionary class]]) {
+    NSMutableSet *keys = [NSMutableSet setWithArray:[oldValue allKeys]];
+    [keys addObjectsFromArray:[newValue allKeys]];
+    for (NSString *key in keys) {
+      if (![key isKindOfClass:[NSString class]] || key.length < 1 || [key rangeOfString:@"."].location != NSNotFound || [key hasPrefix:@"$"]) {
+        return NO;
+      }
+      
+      NSString *nestedPath = [NSString stringWithFormat:@"%@.%@", path, key];
+      id nestedOldValue = oldValue[key];
+      id nestedNewValue = newValue[key];
+      if (!nestedNewValue) {
+        unsetFields[nestedPath] = @"";
+      } else if (![nestedOldValue isEqual:nestedNewValue] && ![self addPathsForChangingNestedValue:nestedOldValue toValue:nestedNewValue atPath:nestedPath setFields:setFields unsetFields:unsetFields]) {
+        setFields[nestedPath] = nestedNewValue;
+      }
+    }
+    return YES;
+  } else if ([oldValue isKindOfClass:[NSArray class]] && [newValue isKindOfClass:[NSArray class]] && [oldValue count] == [newValue count]) {
+    [oldValue enumerateObjectsUsingBlock:^(id nestedOldValue, NSUInteger index, BOOL *stop) {
+      id nestedNewValue = newValue[index];
+      NSString *nestedPath = [NSString stringWithFormat:@"%@.%lu", path, (unsigned long)index];
+      if (![nestedOldValue isEqual:nestedNewValue] && ![self addPathsForChangingNestedValue:nestedOldValue toValue:nestedNewValue atPath:nestedPath setFields:setFields unsetFields:unsetFields]) {
+        setFields[nestedPath] = nestedNewValue;
+      }
+    }];
+    return YES;
+  }
+  
+  return NO;
+}
+
+- (NSDictionary *)modifiersWithSetFields:(NSDictionary *)setFields unsetFields:(NSDictionary *)unsetFields {
+  NSMutableDictionary *modifiers = [[NSMutableDictionary alloc] init];
+  modifiers[@"$set"] = setFields;
+  if (unsetFields.count != 0) {
+    modifiers[@"$unset"] = unsetFields;
+  }
+  return modifiers;
+}
+
+- (NSTimeInterval)updateCoalescingInterval {
+  @synchronized(self) {
+    return _updateCoalescingInterval;
+  }
+}
+
+- (void)setUpdateCoalescingInterval:(NSTimeInterval)updateCoalescingInterval {
+  @synchronized(self) {
+    _updateCoalescingInterval = updateCoalescingInterval;
+  }
+}
+
+- (NSUInteger)maximumNumberOfNestedUpdatePaths {
+  @synchronized(self) {
+    return _maximumNumberOfNestedUpdatePaths;
+  }
+}
+
+- (void)setMaximumNumberOfNestedUpdatePaths:(NSUInteger)maximumNumberOfNestedUpdatePaths {
+  @synchronized(self) {
+    _maximumNumberOfNestedUpdatePaths = maximumNumberOfNestedUpdatePaths;
+  }
+}
+
+// The first update to a document is held back for the coalescing interval. Later updates within that interval
+// have their stub performed right away, but are folded into the held method invocation instead of being sent.
+- (id)coalesceUpdateWithMethodName:(NSString *)methodName documentID:(id)documentID changedFields:(NSDictionary *)changedFields modifiers:(NSDictionary *)modifiers completionHandler:(METMethodCompletionHandler)completionHandler {
+  METMethodInvocationCoordinator *methodInvocationCoordinator = _database.client.methodInvocationCoordinator;
+  NSDictionary *selector = @{@"_id": documentID};
+  id resultFromStub;
+  
+  // The coordinator isn't called while holding the lock, because stubs may call back into the collection
+  METCoalescedUpdate *coalescedUpdate;
+  @synchronized(self) {
+    coalescedUpdate = _coalescedUpdatesByDocumentID[documentID];
+  }
+  
+  if (coalescedUpdate) {
+    // Amends of the same update are serialized, so the last modifiers to be combined are also the last to be applied
+    BOOL amended;
+    @synchronized(coalescedUpdate) {
+      NSDictionary *combinedModifiers;
+      @synchronized(self) {
+        // Diffing against the fields from before the first update keeps nested paths from different updates from conflicting
+        [coalescedUpdate.changedFields addEntriesFromDictionary:changedFields];
+        combinedModifiers = [self modifiersForChangingFields:coalescedUpdate.fieldsBeforeUpdates toChangedFields:coalescedUpdate.changedFields];
+      }
+      amended = [methodInvocationCoordinator amendHeldMethodInvocation:coalescedUpdate.methodInvocation withParameters:@[selector, combinedModifiers] stubParameters:@[selector, modifiers] completionHandler:completionHandler resultFromStub:&resultFromStub];
+    }
+    
+    if (amended) {
+      if (completionHandler) {
+        @synchronized(coalescedUpdate.completionHandlers) {
+          [coalescedUpdate.completionHandlers addObject:[completionHandler copy]];
+        }
+      }
+    }
+    return resultFromStub;
+  }
+  
+  coalescedUpdate = [[METCoalescedUpdate alloc] init];
+  coalescedUpdate.fieldsBeforeUpdates = [self documentWithID:documentID].fields;
+  coalescedUpdate.changedFields = [changedFields mutableCopy];
+  coalescedUpdate.completionHandlers = [[NSMutableArray alloc] init];
+  if (completionHandler) {
+    [coalescedUpdate.completionHandlers addObject:[completionHandler copy]];
+  }
+  
+  NSMutableArray *completionHandlers = coalescedUpdate.completionHandlers;
+  coalescedUpdate.methodInvocation = [methodInvocationCoordinator holdMethodInvocationWithName:methodName parameters:@[selector, modifiers] completionHandler:^(id result, NSError *error) {
+    NSArray *completionHandlersToInvoke;
+    @synchronized(completionHandlers) {
+      completionHandlersToInvoke = [completionHandlers copy];
+    }
+    for (METMethodCompletionHandler completionHandler in completionHandlersToInvoke) {
+      completionHandler(result, error);
+    }
+  } resultFromStub:&resultFromStub];
+  
+  @synchronized(self) {
+    _coalescedUpdatesByDocumentID[documentID] = coalescedUpdate;
+  }
+  
+  dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.updateCoalescingInterval * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+    @synchronized(self) {
+      if (_coalescedUpdatesByDocumentID[documentID] == coalescedUpdate) {
+        [_coalescedUpdatesByDocumentID removeObjectForKey:documentID];
+      }
+    }
+    [methodInvocationCoordinator releaseHeldMethodInvocation:coalescedUpdate.methodInvocation];
+  });
+  
+  return resultFromStub;
+}
+
 - (id)removeDocumentWithID:(id)documentID {
   return [self removeDocumentWithID:documentID completionHandler:nil];
 }
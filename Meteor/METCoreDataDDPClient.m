@@ -74,6 +74,14 @@
   }];
 }
 
+- (void)reclaimMemory {
+  [super reclaimMemory];
+  METIncrementalStore *persistentStore = _persistentStore;
+  [_persistentStoreCoordinator performBlock:^{
+    [persistentStore removeCachedNodes];
+  }];
+}
+
 - (NSManagedObjectID *)objectIDForDocumentKey:(METDocumentKey *)documentKey {
   return [_persistentStore objectIDForDocumentKey:documentKey];
 }
@@ -24,6 +24,10 @@
 
 @class METDDPConnection;
 @class METDatabase;
+@class METHistogram;
+@class METSubscriptionRetentionPolicy;
+@class METSubscriptionLoadStatistics;
+@class METMethodResultCache;
 @protocol METDDPClientDelegate;
 @class METAccount;
 
@@ -48,6 +52,7 @@ extern NSString * const METDDPClientDidChangeAccountNotification;
 
 typedef id __nullable (^METMethodStub)(NSArray *parameters);
 typedef void (^METMethodCompletionHandler)(id __nullable result, NSError * __nullable error);
+typedef void (^METMethodBatchCompletionHandler)(NSError * __nullable error);
 
 typedef void (^METLogInCompletionHandler)(NSError * __nullable error);
 typedef void (^METLogOutCompletionHandler)(NSError * __nullable error);
@@ -87,6 +92,13 @@ typedef void (^METLogOutCompletionHandler)(NSError * __nullable error);
 
 @property (strong, nonatomic, readonly) METDatabase *database;
 
+/// @name Reclaiming Memory
+
+/**
+ Removes subscriptions that are no longer in use right away instead of waiting for their timeout, and compacts caches in the background. This is done automatically when the application receives a memory warning.
+ */
+- (void)reclaimMemory;
+
 #pragma mark - Subscriptions
 /// @name Managing Subscriptions
 
@@ -96,6 +108,26 @@ typedef void (^METLogOutCompletionHandler)(NSError * __nullable error);
 - (METSubscription *)addSubscriptionWithName:(NSString *)name parameters:(nullable NSArray *)parameters completionHandler:(nullable METSubscriptionCompletionHandler)completionHandler;
 - (void)removeSubscription:(METSubscription *)subscription;
 
+/**
+ The maximum number of subscriptions that are resubscribed at the same time after reconnecting, in order of their priority. Lower priority subscriptions always wait until higher priority ones are ready. Zero, the default, means no limit.
+ */
+@property (assign, nonatomic) NSUInteger maximumNumberOfConcurrentResubscriptions;
+
+/// @name Retaining Subscriptions
+
+/**
+ Determines how long subscriptions are kept around after they're no longer in use, so they can be reused without resubscribing. By default, they're kept for a fixed 180 seconds.
+ */
+@property (copy, nonatomic) METSubscriptionRetentionPolicy *subscriptionRetentionPolicy;
+- (NSTimeInterval)notInUseTimeoutForSubscriptionWithName:(NSString *)name;
+@property (assign, nonatomic, readonly) NSUInteger numberOfSubscriptionReuseHits;
+@property (assign, nonatomic, readonly) NSUInteger numberOfSubscriptionReuseMisses;
+
+/**
+ Distributions of time to ready, data messages, bytes received and time spent applying data messages for subscriptions with the given name, or nil if none have become ready yet.
+ */
+- (nullable METSubscriptionLoadStatistics *)loadStatisticsForSubscriptionWithName:(NSString *)name;
+
 #pragma mark - Method Invocations
 /// @name Defining Method Stubs
 
@@ -106,6 +138,38 @@ typedef void (^METLogOutCompletionHandler)(NSError * __nullable error);
 - (nullable id)callMethodWithName:(NSString *)methodName parameters:(nullable NSArray *)parameters completionHandler:(nullable METMethodCompletionHandler)completionHandler;
 - (nullable id)callMethodWithName:(NSString *)methodName parameters:(nullable NSArray *)parameters;
 
+/**
+ Performs the method calls made from the block as a single batch. Stubs are simulated in one database update, so only one change notification is posted, and the method invocations are only scheduled once the block returns. The completion handler is invoked once all method invocations in the batch have completed, with the first error that occurred, if any.
+ */
+- (void)performMethodCallsInBatch:(void (^)())block completionHandler:(nullable METMethodBatchCompletionHandler)completionHandler;
+- (void)performMethodCallsInBatch:(void (^)())block;
+
+/// @name Caching Method Results
+
+/**
+ Marks a read-only method as cacheable. Identical calls to it that are made while an earlier call is in flight share a single method invocation, and results are cached for the specified time. A time to live of zero only coalesces calls that are in flight. Cached results are invalidated when reconnecting and when the account changes. Every caller receives an immutable copy of the result. Calls with `METMethodCallOptionsReturnStubValue` bypass the cache, because the stub is only run for calls that are actually sent.
+ */
+- (void)defineCacheableMethodWithName:(NSString *)methodName timeToLive:(NSTimeInterval)timeToLive;
+@property (strong, nonatomic, readonly) METMethodResultCache *methodResultCache;
+
+/// @name Scheduling Method Invocations
+
+/**
+ The maximum number of method invocations that have been sent to the server but haven't completed yet. Zero, the default, means no limit.
+ */
+@property (assign, nonatomic) NSUInteger maximumNumberOfExecutingMethodInvocations;
+- (void)setMaximumNumberOfExecutingMethodInvocations:(NSUInteger)maximumNumberOfExecutingMethodInvocations forMethodWithName:(NSString *)methodName;
+
+/**
+ Method invocations with a higher priority are sent first, but never ahead of an earlier barrier such as logging in or out.
+ */
+- (void)setPriority:(NSOperationQueuePriority)priority forMethodWithName:(NSString *)methodName;
+- (METHistogram *)queueWaitTimeHistogramForPriority:(NSOperationQueuePriority)priority;
+
+/// @name Persisting Pending Method Invocations
+
+- (BOOL)openMethodInvocationLogAtURL:(NSURL *)URL error:(NSError **)error;
+
 #pragma mark - Accounts
 /// @name Accessing Account Status
 
@@ -35,6 +35,8 @@
 #import "METSubscriptionManager.h"
 #import "METMethodInvocation.h"
 #import "METMethodInvocationCoordinator.h"
+#import "METMethodInvocationLog.h"
+#import "METMethodResultCache.h"
 #import "METRandomStream.h"
 #import "METRandomValueGenerator.h"
 #import "METAccount.h"
@@ -44,6 +46,8 @@ NSString * const METDDPErrorDomain = @"com.meteor.DDPClient.ErrorDomain";
 NSString * const METDDPClientDidChangeConnectionStatusNotification = @"METDDPClientDidChangeConnectionStatusNotification";
 NSString * const METDDPClientDidChangeAccountNotification = @"METDDPClientDidChangeAccountNotification";
 
+static const NSUInteger METDDPClientDeferredMessagesBatchSize = 100;
+
 @interface METDDPClient ()
 
 @property (nonatomic, copy) void (^pendingLoginResumeHandler)();
@@ -69,6 +73,9 @@ NSString * const METDDPClientDidChangeAccountNotification = @"METDDPClientDidCha
   
   METDDPHeartbeat *_heartbeat;
   
+  BOOL _receivingMessagesPaused;
+  NSMutableArray *_deferredMessages;
+  
   METSubscriptionManager *_subscriptionManager;
   METMethodInvocationCoordinator *_methodInvocationCoordinator;
 }
@@ -111,6 +118,9 @@ NSString * const METDDPClientDidChangeAccountNotification = @"METDDPClientDidCha
     
     _keepAliveBackgroundTask = UIBackgroundTaskInvalid;
     
+    _deferredMessages = [[NSMutableArray alloc] init];
+    _maximumNumberOfDeferredMessages = 10000;
+    
     _supportedProtocolVersions = @[@"1", @"pre2", @"pre1"];
     _suggestedProtocolVersion = @"1";
     
@@ -122,9 +132,11 @@ NSString * const METDDPClientDidChangeAccountNotification = @"METDDPClientDidCha
     _subscriptionManager.defaultNotInUseTimeout = 180;
     
     _methodInvocationCoordinator = [[METMethodInvocationCoordinator alloc] initWithClient:self];
+    _methodResultCache = [[METMethodResultCache alloc] init];
     
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(applicationDidEnterBackground:) name:UIApplicationDidEnterBackgroundNotification object:nil];
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(applicationWillEnterForeground:) name:UIApplicationWillEnterForegroundNotification object:nil];
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(applicationDidReceiveMemoryWarning:) name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
   }
   return self;
 }
@@ -155,6 +167,17 @@ NSString * const METDDPClientDidChangeAccountNotification = @"METDDPClientDidCha
   [self connect];
 }
 
+- (void)applicationDidReceiveMemoryWarning:(NSNotification *)notification {
+  [self reclaimMemory];
+}
+
+#pragma mark - Reclaiming Memory
+
+- (void)reclaimMemory {
+  [_subscriptionManager removeSubscriptionsNotInUse];
+  [_database reclaimMemory];
+}
+
 #pragma mark - Connecting
 
 - (NSURL *)serverURL {
@@ -244,10 +267,27 @@ NSString * const METDDPClientDidChangeAccountNotification = @"METDDPClientDidCha
 #pragma mark - METDDPConnectionDelegate
 
 - (void)connectionDidOpen:(METDDPConnection *)connection {
+  // Messages deferred on a previous connection belong to a session that no longer exists, and the database decides whether to pause the new one after it has been reset
+  [_deferredMessages removeAllObjects];
+  _receivingMessagesPaused = NO;
+  
   [self establishConnection];
 }
 
 - (void)connection:(METDDPConnection *)connection didReceiveMessage:(NSDictionary *)message {
+  // Heartbeat messages are handled right away, so pausing doesn't make the connection time out
+  if ((_receivingMessagesPaused || _deferredMessages.count > 0) && ![self isHeartbeatMessage:message]) {
+    [_deferredMessages addObject:message];
+    
+    // Deferred messages are kept in memory, so rather than letting them pile up indefinitely we stop pausing
+    if (_receivingMessagesPaused && _deferredMessages.count > _maximumNumberOfDeferredMessages) {
+      NSLog(@"Resuming receiving messages because more than %lu messages have been deferred", (unsigned long)_maximumNumberOfDeferredMessages);
+      _receivingMessagesPaused = NO;
+      [self handleDeferredMessages];
+    }
+    return;
+  }
+  
   [self handleReceivedMessage:message];
 }
 
@@ -309,6 +349,11 @@ NSString * const METDDPClientDidChangeAccountNotification = @"METDDPClientDidCha
   }
 }
 
+- (BOOL)isHeartbeatMessage:(NSDictionary *)message {
+  NSString *messageType = message[@"msg"];
+  return [messageType isEqualToString:@"ping"] || [messageType isEqualToString:@"pong"];
+}
+
 - (void)didReceiveErrorMessage:(NSDictionary *)message {
   NSString *reason = message[@"reason"];
   // NSString *offendingMessage = message[@"offendingMessage"];
@@ -321,6 +366,59 @@ NSString * const METDDPClientDidChangeAccountNotification = @"METDDPClientDidCha
   }
 }
 
+#pragma mark - Flow Control
+
+// The underlying web socket doesn't allow us to stop reading, so while paused received messages are deferred instead of handled, which keeps them from turning into data updates
+- (void)pauseReceivingMessages {
+  dispatch_async(_queue, ^{
+    _receivingMessagesPaused = YES;
+  });
+}
+
+- (void)resumeReceivingMessages {
+  dispatch_async(_queue, ^{
+    _receivingMessagesPaused = NO;
+    [self handleDeferredMessages];
+  });
+}
+
+- (BOOL)isReceivingMessagesPaused {
+  __block BOOL receivingMessagesPaused;
+  dispatch_sync(_queue, ^{
+    receivingMessagesPaused = _receivingMessagesPaused;
+  });
+  return receivingMessagesPaused;
+}
+
+- (NSUInteger)numberOfDeferredMessages {
+  __block NSUInteger numberOfDeferredMessages;
+  dispatch_sync(_queue, ^{
+    numberOfDeferredMessages = _deferredMessages.count;
+  });
+  return numberOfDeferredMessages;
+}
+
+- (uint64_t)numberOfBytesReceived {
+  return _connection.numberOfBytesReceived;
+}
+
+- (void)handleDeferredMessages {
+  NSUInteger numberOfHandledMessages = 0;
+  while (!_receivingMessagesPaused && _deferredMessages.count > 0 && numberOfHandledMessages < METDDPClientDeferredMessagesBatchSize) {
+    NSDictionary *message = _deferredMessages[0];
+    [_deferredMessages removeObjectAtIndex:0];
+    [self handleReceivedMessage:message];
+    numberOfHandledMessages++;
+  }
+  
+  // Deferred messages are handled in batches, so we can be paused again before all of them have been handled
+  if (!_receivingMessagesPaused && _deferredMessages.count > 0) {
+    dispatch_async(_queue, ^{
+      [self handleDeferredMessages];
+    });
+  }
+}
+
 #pragma mark - Establishing a Connection
 
 - (void)establishConnection {
@@ -335,6 +433,9 @@ NSString * const METDDPClientDidChangeAccountNotification = @"METDDPClientDidCha
 }
 
 - (void)handleReconnecting {
+  // Results may depend on server state we missed while disconnected
+  [_methodResultCache invalidate];
+  
   [_methodInvocationCoordinator resetWhileAddingMethodInvocationsToTheFrontOfTheQueueUsingBlock:^{
     if (_pendingLoginResumeHandler) {
       _pendingLoginResumeHandler();
@@ -480,6 +581,7 @@ NSString * const METDDPClientDidChangeAccountNotification = @"METDDPClientDidCha
 }
 
 - (void)processDataUpdate:(METDataUpdate *)update {
+  [_subscriptionManager didReceiveDataUpdateWithType:update.updateType];
   if (![_methodInvocationCoordinator applyDataUpdate:update]) {
     [_database applyDataUpdate:update];
   }
@@ -523,6 +625,38 @@ NSString * const METDDPClientDidChangeAccountNotification = @"METDDPClientDidCha
   [_subscriptionManager removeSubscription:subscription];
 }
 
+- (NSUInteger)maximumNumberOfConcurrentResubscriptions {
+  return _subscriptionManager.maximumNumberOfConcurrentResubscriptions;
+}
+
+- (void)setMaximumNumberOfConcurrentResubscriptions:(NSUInteger)maximumNumberOfConcurrentResubscriptions {
+  _subscriptionManager.maximumNumberOfConcurrentResubscriptions = maximumNumberOfConcurrentResubscriptions;
+}
+
+- (METSubscriptionRetentionPolicy *)subscriptionRetentionPolicy {
+  return _subscriptionManager.retentionPolicy;
+}
+
+- (void)setSubscriptionRetentionPolicy:(METSubscriptionRetentionPolicy *)subscriptionRetentionPolicy {
+  _subscriptionManager.retentionPolicy = subscriptionRetentionPolicy;
+}
+
+- (NSTimeInterval)notInUseTimeoutForSubscriptionWithName:(NSString *)name {
+  return [_subscriptionManager notInUseTimeoutForSubscriptionWithName:name];
+}
+
+- (NSUInteger)numberOfSubscriptionReuseHits {
+  return _subscriptionManager.numberOfReuseHits;
+}
+
+- (NSUInteger)numberOfSubscriptionReuseMisses {
+  return _subscriptionManager.numberOfReuseMisses;
+}
+
+- (METSubscriptionLoadStatistics *)loadStatisticsForSubscriptionWithName:(NSString *)name {
+  return [_subscriptionManager loadStatisticsForSubscriptionWithName:name];
+}
+
 - (void)sendUnsubMessageForSubscription:(METSubscription *)subscription {
   NSParameterAssert(subscription);
   
@@ -567,7 +701,95 @@ NSString * const METDDPClientDidChangeAccountNotification = @"METDDPClientDidCha
 }
 
 - (id)callMethodWithName:(NSString *)methodName parameters:(NSArray *)parameters options:(METMethodCallOptions)options receivedResultHandler:(METMethodCompletionHandler)receivedResultHandler completionHandler:(METMethodCompletionHandler)completionHandler {
-  return [_methodInvocationCoordinator callMethodWithName:methodName parameters:[self convertParameters:parameters] options:options receivedResultHandler:receivedResultHandler completionHandler:completionHandler];
+  parameters = [self convertParameters:parameters];
+  
+  // Calls made from a stub are only simulated, so they never go through the cache. Calls that need the
+  // stub's return value bypass it as well, because cached and coalesced calls don't run the stub.
+  if (!(options & (METMethodCallOptionsBarrier | METMethodCallOptionsReturnStubValue)) && !self.currentMethodInvocationContext && [_methodResultCache isCacheableMethodWithName:methodName]) {
+    return [self callCacheableMethodWithName:methodName parameters:parameters options:options receivedResultHandler:receivedResultHandler completionHandler:completionHandler];
+  }
+  
+  return [_methodInvocationCoordinator callMethodWithName:methodName parameters:parameters options:options receivedResultHandler:receivedResultHandler completionHandler:completionHandler];
+}
+
+- (id)callCacheableMethodWithName:(NSString *)methodName parameters:(NSArray *)parameters options:(METMethodCallOptions)options receivedResultHandler:(METMethodCompletionHandler)receivedResultHandler completionHandler:(METMethodCompletionHandler)completionHandler {
+  id cachedResult;
+  if ([_methodResultCache getResult:&cachedResult forMethodWithName:methodName parameters:parameters]) {
+    if (receivedResultHandler || completionHandler) {
+      // Handlers are never invoked before the call returns, even when the result is cached
+      dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        if (receivedResultHandler) {
+          receivedResultHandler(cachedResult, nil);
+        }
+        if (completionHandler) {
+          completionHandler(cachedResult, nil);
+        }
+      });
+    }
+    return nil;
+  }
+  
+  NSUInteger generation;
+  if ([_methodResultCache addReceivedResultHandler:receivedResultHandler completionHandler:completionHandler forInFlightCallWithMethodName:methodName parameters:parameters generation:&generation]) {
+    return nil;
+  }
+  
+  METMethodResultCache *methodResultCache = _methodResultCache;
+  return [_methodInvocationCoordinator callMethodWithName:methodName parameters:parameters options:options receivedResultHandler:^(id result, NSError *error) {
+    [methodResultCache didReceiveResultForCallWithMethodName:methodName parameters:parameters generation:generation result:result error:error];
+  } completionHandler:^(id result, NSError *error) {
+    [methodResultCache didCompleteCallWithMethodName:methodName parameters:parameters generation:generation result:result error:error];
+  }];
+}
+
+- (void)defineCacheableMethodWithName:(NSString *)methodName timeToLive:(NSTimeInterval)timeToLive {
+  NSParameterAssert(methodName);
+  [_methodResultCache setTimeToLive:timeToLive forMethodWithName:methodName];
+}
+
+- (void)performMethodCallsInBatch:(void (^)())block {
+  [self performMethodCallsInBatch:block completionHandler:nil];
+}
+
+- (void)performMethodCallsInBatch:(void (^)())block completionHandler:(METMethodBatchCompletionHandler)completionHandler {
+  NSParameterAssert(block);
+  [_methodInvocationCoordinator performMethodInvocationsInBatch:block completionHandler:completionHandler];
+}
+
+- (NSUInteger)maximumNumberOfExecutingMethodInvocations {
+  return _methodInvocationCoordinator.maximumNumberOfExecutingMethodInvocations;
+}
+
+- (void)setMaximumNumberOfExecutingMethodInvocations:(NSUInteger)maximumNumberOfExecutingMethodInvocations {
+  _methodInvocationCoordinator.maximumNumberOfExecutingMethodInvocations = maximumNumberOfExecutingMethodInvocations;
+}
+
+- (void)setMaximumNumberOfExecutingMethodInvocations:(NSUInteger)maximumNumberOfExecutingMethodInvocations forMethodWithName:(NSString *)methodName {
+  NSParameterAssert(methodName);
+  [_methodInvocationCoordinator setMaximumNumberOfExecutingMethodInvocations:maximumNumberOfExecutingMethodInvocations forMethodWithName:methodName];
+}
+
+- (void)setPriority:(NSOperationQueuePriority)priority forMethodWithName:(NSString *)methodName {
+  NSParameterAssert(methodName);
+  [_methodInvocationCoordinator setPriority:priority forMethodWithName:methodName];
+}
+
+- (METHistogram *)queueWaitTimeHistogramForPriority:(NSOperationQueuePriority)priority {
+  return [_methodInvocationCoordinator queueWaitTimeHistogramForPriority:priority];
+}
+
+- (BOOL)openMethodInvocationLogAtURL:(NSURL *)URL error:(NSError **)error {
+  NSParameterAssert(URL);
+  NSAssert(_methodInvocationCoordinator.methodInvocationLog == nil, @"A method invocation log has already been opened");
+  
+  METMethodInvocationLog *methodInvocationLog = [[METMethodInvocationLog alloc] initWithURL:URL];
+  if (![methodInvocationLog openWithError:error]) {
+    return NO;
+  }
+  
+  // Stubs should be defined before opening the log, so they can restore the local effects of replayed invocations
+  [_methodInvocationCoordinator replayMethodInvocationsFromLog:methodInvocationLog];
+  return YES;
 }
 
 - (METMethodInvocationContext *)currentMethodInvocationContext {
@@ -618,6 +840,7 @@ NSString * const METDDPClientDidChangeAccountNotification = @"METDDPClientDidCha
   if (_account != account) {
     _account = account;
     [METAccount setDefaultAccount:_account];
+    [_methodResultCache invalidate];
     [[NSNotificationCenter defaultCenter] postNotificationName:METDDPClientDidChangeAccountNotification object:self userInfo:nil];
   }
 }
@@ -54,6 +54,14 @@ typedef NS_OPTIONS(NSInteger, METMethodCallOptions) {
 
 - (void)processDataUpdate:(METDataUpdate *)update;
 
+- (void)pauseReceivingMessages;
+- (void)resumeReceivingMessages;
+@property (assign, nonatomic, readonly, getter=isReceivingMessagesPaused) BOOL receivingMessagesPaused;
+@property (assign, nonatomic, readonly) NSUInteger numberOfDeferredMessages;
+// Receiving messages is resumed when more messages than this have been deferred, defaults to 10000
+@property (assign, nonatomic) NSUInteger maximumNumberOfDeferredMessages;
+@property (assign, nonatomic, readonly) uint64_t numberOfBytesReceived;
+
 - (void)sendSubMessageForSubscription:(METSubscription *)subscription;
 - (void)sendUnsubMessageForSubscription:(METSubscription *)subscription;
 - (void)allSubscriptionsToBeRevivedAfterReconnectAreDone;
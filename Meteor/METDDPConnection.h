@@ -43,6 +43,9 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (void)sendMessage:(NSDictionary *)message;
 
+@property (assign, nonatomic, readonly) uint64_t numberOfBytesSent;
+@property (assign, nonatomic, readonly) uint64_t numberOfBytesReceived;
+
 @end
 
 @protocol METDDPConnectionDelegate <NSObject>
@@ -37,6 +37,8 @@ NS_INLINE BOOL METShouldLogDDPMessages() {
 @implementation METDDPConnection {
   PSWebSocket *_webSocket;
   NSTimeInterval _timeoutInterval;
+  uint64_t _numberOfBytesSent;
+  uint64_t _numberOfBytesReceived;
 }
 
 - (instancetype)initWithServerURL:(NSURL *)serverURL {
@@ -81,12 +83,27 @@ NS_INLINE BOOL METShouldLogDDPMessages() {
     if (METShouldLogDDPMessages()) {
       NSLog(@"> %@", message);
     }
+    @synchronized(self) {
+      _numberOfBytesSent += data.length;
+    }
     [_webSocket send:data];
   } else {
     [_delegate connection:self didFailWithError:error];
   }
 }
 
+- (uint64_t)numberOfBytesSent {
+  @synchronized(self) {
+    return _numberOfBytesSent;
+  }
+}
+
+- (uint64_t)numberOfBytesReceived {
+  @synchronized(self) {
+    return _numberOfBytesReceived;
+  }
+}
+
 #pragma mark - PSWebSocketDelegate
 
 - (void)webSocketDidOpen:(PSWebSocket *)webSocket {
@@ -97,6 +114,9 @@ NS_INLINE BOOL METShouldLogDDPMessages() {
   if ([data isKindOfClass:[NSString class]]) {
     data = [(NSString *)data dataUsingEncoding:NSUTF8StringEncoding];
   }
+  @synchronized(self) {
+    _numberOfBytesReceived += [(NSData *)data length];
+  }
   NSError *error;
   NSMutableDictionary *message = [NSJSONSerialization JSONObjectWithData:data options:NSJSONReadingMutableContainers error:&error];
   if (message) {
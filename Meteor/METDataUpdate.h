@@ -40,6 +40,8 @@ typedef NS_ENUM(NSInteger, METDataUpdateType) {
 - (instancetype)initWithUpdateType:(METDataUpdateType)updateType documentKey:(METDocumentKey *)documentKey fields:(nullable NSDictionary *)fields NS_DESIGNATED_INITIALIZER;
 - (instancetype)init NS_UNAVAILABLE;
 
+- (nullable METDataUpdate *)dataUpdateByFoldingDataUpdate:(METDataUpdate *)update;
+
 @end
 
 NS_ASSUME_NONNULL_END
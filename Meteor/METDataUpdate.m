@@ -21,6 +21,7 @@
 #import "METDataUpdate.h"
 
 #import "METDocumentKey.h"
+#import "NSDictionary+METAdditions.h"
 
 @implementation METDataUpdate
 
@@ -34,6 +35,50 @@
   return self;
 }
 
+// Returns nil if the net effect of both updates depends on whether the document existed before the receiver was applied
+- (METDataUpdate *)dataUpdateByFoldingDataUpdate:(METDataUpdate *)update {
+  NSParameterAssert([_documentKey isEqual:update.documentKey]);
+  
+  switch (update.updateType) {
+    case METDataUpdateTypeAdd:
+      if (_updateType == METDataUpdateTypeRemove || (_updateType == METDataUpdateTypeReplace && _fields == nil)) {
+        return [[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeReplace documentKey:_documentKey fields:update.fields];
+      } else if (_updateType == METDataUpdateTypeAdd || _updateType == METDataUpdateTypeReplace) {
+        // Adding a document that already exists fails
+        return self;
+      } else {
+        return nil;
+      }
+    case METDataUpdateTypeChange:
+      switch (_updateType) {
+        case METDataUpdateTypeAdd:
+          return [[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeAdd documentKey:_documentKey fields:[_fields fieldsByApplyingChangedFields:update.fields]];
+        case METDataUpdateTypeChange:
+          return [[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeChange documentKey:_documentKey fields:[_fields dictionaryByAddingEntriesFromDictionary:update.fields]];
+        case METDataUpdateTypeReplace:
+          if (_fields == nil) {
+            return self;
+          }
+          return [[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeReplace documentKey:_documentKey fields:[_fields fieldsByApplyingChangedFields:update.fields]];
+        case METDataUpdateTypeRemove:
+          // Changing a document that doesn't exist fails
+          return self;
+      }
+    case METDataUpdateTypeReplace:
+      return update;
+    case METDataUpdateTypeRemove:
+      switch (_updateType) {
+        case METDataUpdateTypeAdd:
+        case METDataUpdateTypeReplace:
+          return [[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeReplace documentKey:_documentKey fields:nil];
+        case METDataUpdateTypeChange:
+          return update;
+        case METDataUpdateTypeRemove:
+          return self;
+      }
+  }
+}
+
 #pragma mark - NSObject
 
 - (BOOL)isEqual:(id)object {
@@ -0,0 +1,107 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#import "METDataUpdateBuffer.h"
+
+#import "METDataUpdate.h"
+#import "METDocumentKey.h"
+
+@implementation METDataUpdateBuffer {
+  NSMutableArray *_documentKeys;
+  NSMutableDictionary *_dataUpdatesByDocumentKey;
+  NSMutableSet *_collectionNames;
+}
+
+- (instancetype)init {
+  self = [super init];
+  if (self) {
+    _documentKeys = [[NSMutableArray alloc] init];
+    _dataUpdatesByDocumentKey = [[NSMutableDictionary alloc] init];
+    _collectionNames = [[NSMutableSet alloc] init];
+  }
+  return self;
+}
+
+- (void)addDataUpdate:(METDataUpdate *)update {
+  NSParameterAssert(update);
+  
+  _numberOfAddedDataUpdates++;
+  
+  METDocumentKey *documentKey = update.documentKey;
+  NSMutableArray *dataUpdates = _dataUpdatesByDocumentKey[documentKey];
+  if (!dataUpdates) {
+    dataUpdates = [[NSMutableArray alloc] initWithObjects:update, nil];
+    _dataUpdatesByDocumentKey[documentKey] = dataUpdates;
+    [_documentKeys addObject:documentKey];
+    [_collectionNames addObject:documentKey.collectionName];
+    _count++;
+    return;
+  }
+  
+  // Only the last update for a document can be folded, because updates that couldn't be folded before depend on the state of the document
+  METDataUpdate *foldedUpdate = [dataUpdates.lastObject dataUpdateByFoldingDataUpdate:update];
+  if (foldedUpdate) {
+    dataUpdates[dataUpdates.count - 1] = foldedUpdate;
+    _numberOfFoldedDataUpdates++;
+  } else {
+    [dataUpdates addObject:update];
+    _count++;
+  }
+}
+
+- (void)enumerateDataUpdatesUsingBlock:(void (^)(METDataUpdate *update, BOOL *stop))block {
+  BOOL stop = NO;
+  for (METDocumentKey *documentKey in _documentKeys) {
+    for (METDataUpdate *update in _dataUpdatesByDocumentKey[documentKey]) {
+      block(update, &stop);
+      if (stop) return;
+    }
+  }
+}
+
+- (void)removeAllDataUpdates {
+  [_documentKeys removeAllObjects];
+  [_dataUpdatesByDocumentKey removeAllObjects];
+  [_collectionNames removeAllObjects];
+  _count = 0;
+}
+
+- (BOOL)containsDataUpdatesForCollectionWithName:(NSString *)collectionName {
+  return [_collectionNames containsObject:collectionName];
+}
+
+- (NSUInteger)numberOfDocumentKeys {
+  return _documentKeys.count;
+}
+
+- (double)foldRatio {
+  if (_numberOfAddedDataUpdates == 0) {
+    return 0;
+  }
+  return (double)_numberOfFoldedDataUpdates / _numberOfAddedDataUpdates;
+}
+
+#pragma mark - NSObject
+
+- (NSString *)description {
+  return [NSString stringWithFormat:@"<METDataUpdateBuffer, count: %lu, documentKeys: %lu, foldRatio: %f>", (unsigned long)_count, (unsigned long)_documentKeys.count, self.foldRatio];
+}
+
+@end
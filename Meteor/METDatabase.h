@@ -25,12 +25,24 @@
 @class METDocumentKey;
 @class METFetchRequest;
 @class METCollection;
+@class METDatabaseChanges;
+@class METDocumentChangeDetails;
+@class METDatabaseChangeLog;
+@class METDatabaseFlushPolicy;
+@class METDocumentSnapshot;
+@class METHistogram;
 
 NS_ASSUME_NONNULL_BEGIN
 
 extern NSString * const METDatabaseDidChangeNotification;
 extern NSString * const METDatabaseChangesKey;
 
+extern NSString * const METDatabaseErrorDomain;
+typedef NS_ENUM(NSInteger, METDatabaseErrorType) {
+  METDatabaseResyncRequiredError = 0,
+  METDatabaseInvalidSnapshotError = 1,
+};
+
 @interface METDatabase : NSObject
 
 - (instancetype)initWithClient:(nullable METDDPClient *)client NS_DESIGNATED_INITIALIZER;
@@ -46,6 +58,36 @@ extern NSString * const METDatabaseChangesKey;
 - (void)enumerateCollectionsUsingBlock:(void (^)(METCollection *collection, BOOL *stop))block;
 - (METCollection *)collectionWithName:(NSString *)collectionName;
 
+- (id<NSObject>)addObserverForChangesToCollectionWithName:(NSString *)collectionName queue:(nullable dispatch_queue_t)queue usingBlock:(void (^)(METDatabaseChanges *databaseChanges))block;
+- (id<NSObject>)addObserverForChangesToDocumentWithKey:(METDocumentKey *)documentKey queue:(nullable dispatch_queue_t)queue usingBlock:(void (^)(METDocumentChangeDetails *documentChangeDetails))block;
+- (void)removeObserver:(id)observer;
+
+@property (strong, nonatomic, readonly) METDatabaseChangeLog *changeLog;
+
+- (BOOL)openSnapshotAtURL:(NSURL *)URL error:(NSError **)error;
+@property (nullable, strong, nonatomic, readonly) METDocumentSnapshot *snapshot;
+@property (assign, nonatomic, readonly, getter=isReconcilingSnapshot) BOOL reconcilingSnapshot;
+// Restored documents the server hasn't sent are removed once no subscription has been loading for the grace period,
+// or earlier if the app calls finishReconcilingSnapshot after adding all the subscriptions it needs
+@property (assign, nonatomic) NSTimeInterval snapshotReconciliationGracePeriod;
+- (void)finishReconcilingSnapshot;
+
+// When enabled, documents added to empty collections while subscriptions are loading are added in bulk once no
+// subscription is loading anymore. Change notifications for these collections only contain loadedCollectionNames,
+// not per-document changes. Defaults to NO.
+@property (assign, nonatomic) BOOL loadsCollectionsInBulk;
+
+@property (copy, nonatomic) METDatabaseFlushPolicy *flushPolicy;
+@property (strong, nonatomic, readonly) METHistogram *flushSizeHistogram;
+@property (strong, nonatomic, readonly) METHistogram *flushDurationHistogram;
+
+@property (assign, nonatomic, readonly) NSUInteger numberOfPendingChanges;
+@property (assign, nonatomic, readonly, getter=isUnderBackpressure) BOOL underBackpressure;
+@property (assign, nonatomic, readonly, getter=isReceivingMessagesPaused) BOOL receivingMessagesPaused;
+@property (assign, nonatomic, readonly) NSUInteger numberOfTimesHighWaterMarkWasReached;
+@property (assign, nonatomic, readonly) NSUInteger numberOfTimesReceivingMessagesWasPaused;
+@property (assign, nonatomic, readonly) NSTimeInterval timeSpentWithReceivingMessagesPaused;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -21,19 +21,45 @@
 #import "METDatabase.h"
 #import "METDatabase_Internal.h"
 
+#import "METDDPClient.h"
+#import "METDDPClient_Internal.h"
+
 #import "METDocumentCache.h"
+#import "METDocumentKey.h"
 #import "METCollection.h"
 #import "METCollection_Internal.h"
 #import "METDataUpdate.h"
+#import "METDataUpdateBuffer.h"
 #import "METDatabaseChanges.h"
 #import "METDatabaseChanges_Internal.h"
+#import "METDatabaseChangeObserverRegistry.h"
+#import "METDatabaseChangeLog.h"
+#import "METDatabaseChangeLog_Internal.h"
+#import "METDatabaseFlushPolicy.h"
+#import "METDocument.h"
+#import "METDocumentChangeDetails.h"
+#import "METDocumentSnapshot.h"
+#import "METDatabaseTransaction.h"
+#import "METDynamicVariable.h"
+#import "METFetchRequest.h"
+#import "METHistogram.h"
+#import "METTimer.h"
 #import "NSDictionary+METAdditions.h"
+#import "METMonotonicTime.h"
 
 NSString * const METDatabaseDidChangeNotification = @"METDatabaseDidChangeNotification";
 NSString * const METDatabaseChangesKey = @"METDatabaseChangesKey";
+NSString * const METDatabaseErrorDomain = @"com.meteor.Database.ErrorDomain";
+
+static const NSTimeInterval METDatabaseMinimumAdaptiveFlushLatency = 0.001;
+
+// After this many conflicts, a transaction is performed while holding the write lock so it is guaranteed to commit
+static const NSUInteger METDatabaseMaximumNumberOfOptimisticTransactionAttempts = 5;
 
 @interface METDatabase () <METDocumentCacheDelegate>
 
+@property (assign, readwrite) NSTimeInterval timeSpentApplyingDataUpdates;
+
 @end
 
 @implementation METDatabase {
@@ -48,11 +74,46 @@ NSString * const METDatabaseChangesKey = @"METDatabaseChangesKey";
   METDatabaseChanges *_currentChanges;
   METDatabaseChanges *_changes;
   
+  METDynamicVariable *_transactionDynamicVariable;
+  NSUInteger _numberOfActiveTransactions;
+  uint64_t _modificationSequenceNumber;
+  // Only kept while transactions are active, to detect conflicts when committing them
+  NSMutableDictionary *_modificationSequenceNumbersByDocumentKey;
+  NSMutableDictionary *_modificationSequenceNumbersByCollectionName;
+  NSMutableDictionary *_loadSequenceNumbersByCollectionName;
+  
+  METDatabaseChangeObserverRegistry *_changeObserverRegistry;
+  
   dispatch_queue_t _dataUpdatesQueue;
-  NSMutableArray *_bufferedDataUpdates;
+  METDataUpdateBuffer *_bufferedDataUpdates;
   dispatch_source_t _bufferedDataUpdatesSource;
   dispatch_block_t _pendingAfterFlushBlock;
   BOOL _removeExistingDocumentsBeforeNextFlush;
+  
+  BOOL _loadsCollectionsInBulk;
+  BOOL _detectsBulkLoading;
+  NSMutableDictionary *_fieldsByDocumentIDByBulkLoadingCollectionName;
+  NSMutableDictionary *_fieldsByDocumentIDByBulkLoadedCollectionName;
+  
+  BOOL _reconcilingSnapshot;
+  BOOL _finishReconcilingSnapshotBeforeNextFlush;
+  NSMutableSet *_confirmedDocumentKeys;
+  NSMutableSet *_documentKeysWithUnconfirmedChanges;
+  
+  METDatabaseFlushPolicy *_flushPolicy;
+  METTimer *_flushTimer;
+  NSTimeInterval _oldestBufferedDataUpdateTime;
+  NSTimeInterval _lastFlushTime;
+  NSTimeInterval _adaptiveFlushLatency;
+  
+  NSMutableDictionary *_numbersOfUndeliveredChangesByConsumer;
+  NSUInteger _numberOfUndeliveredChanges;
+  BOOL _underBackpressure;
+  BOOL _receivingMessagesPaused;
+  NSTimeInterval _receivingMessagesPausedTime;
+  NSUInteger _numberOfTimesHighWaterMarkWasReached;
+  NSUInteger _numberOfTimesReceivingMessagesWasPaused;
+  NSTimeInterval _timeSpentWithReceivingMessagesPaused;
 }
 
 - (instancetype)initWithClient:(METDDPClient *)client {
@@ -69,14 +130,33 @@ NSString * const METDatabaseChangesKey = @"METDatabaseChangesKey";
     
     _trackingChanges = YES;
     _changes = [[METDatabaseChanges alloc] init];
+    
+    _transactionDynamicVariable = [[METDynamicVariable alloc] init];
+    _modificationSequenceNumbersByDocumentKey = [[NSMutableDictionary alloc] init];
+    _modificationSequenceNumbersByCollectionName = [[NSMutableDictionary alloc] init];
+    _loadSequenceNumbersByCollectionName = [[NSMutableDictionary alloc] init];
+    
+    _changeObserverRegistry = [[METDatabaseChangeObserverRegistry alloc] initWithDatabase:self];
+    _changeLog = [[METDatabaseChangeLog alloc] initWithMaximumNumberOfEntriesPerCollection:1000];
 
     _dataUpdatesQueue = dispatch_queue_create("com.meteor.Database.dataUpdatesQueue", DISPATCH_QUEUE_SERIAL);
     dispatch_set_target_queue(_dataUpdatesQueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
-    _bufferedDataUpdates = [[NSMutableArray alloc] init];
+    _bufferedDataUpdates = [[METDataUpdateBuffer alloc] init];
+    _fieldsByDocumentIDByBulkLoadingCollectionName = [[NSMutableDictionary alloc] init];
+    _fieldsByDocumentIDByBulkLoadedCollectionName = [[NSMutableDictionary alloc] init];
+    _confirmedDocumentKeys = [[NSMutableSet alloc] init];
+    _documentKeysWithUnconfirmedChanges = [[NSMutableSet alloc] init];
+    _snapshotReconciliationGracePeriod = 10;
+    
+    _flushPolicy = [[METDatabaseFlushPolicy alloc] init];
+    _flushSizeHistogram = [[METHistogram alloc] initWithBaseValue:1 numberOfBuckets:24];
+    _flushDurationHistogram = [[METHistogram alloc] initWithBaseValue:0.0001 numberOfBuckets:24];
+    
+    _numbersOfUndeliveredChangesByConsumer = [[NSMutableDictionary alloc] init];
     
     _bufferedDataUpdatesSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_DATA_ADD, 0, 0, _dataUpdatesQueue);
     dispatch_source_set_event_handler(_bufferedDataUpdatesSource, ^{
-      [self flushDataUpdatesOnQueue];
+      [self flushDataUpdatesOnQueueIfNeeded];
     });
     dispatch_resume(_bufferedDataUpdatesSource);
   }
@@ -84,10 +164,18 @@ NSString * const METDatabaseChangesKey = @"METDatabaseChangesKey";
 }
 
 - (NSArray *)executeFetchRequest:(METFetchRequest *)fetchRequest {
+  METDatabaseTransaction *transaction = [_transactionDynamicVariable currentValue];
+  if (transaction) {
+    return [transaction executeFetchRequest:fetchRequest];
+  }
   return [_localCache executeFetchRequest:fetchRequest];
 }
 
 - (METDocument *)documentWithKey:(METDocumentKey *)documentKey {
+  METDatabaseTransaction *transaction = [_transactionDynamicVariable currentValue];
+  if (transaction) {
+    return [transaction documentWithKey:documentKey];
+  }
   return [_localCache documentWithKey:documentKey];
 }
 
@@ -115,10 +203,141 @@ NSString * const METDatabaseChangesKey = @"METDatabaseChangesKey";
   return collection;
 }
 
+- (id<NSObject>)addObserverForChangesToCollectionWithName:(NSString *)collectionName queue:(dispatch_queue_t)queue usingBlock:(void (^)(METDatabaseChanges *databaseChanges))block {
+  return [_changeObserverRegistry addObserverForChangesToCollectionWithName:collectionName queue:queue usingBlock:block];
+}
+
+- (id<NSObject>)addObserverForChangesToDocumentWithKey:(METDocumentKey *)documentKey queue:(dispatch_queue_t)queue usingBlock:(void (^)(METDocumentChangeDetails *documentChangeDetails))block {
+  return [_changeObserverRegistry addObserverForChangesToDocumentWithKey:documentKey queue:queue usingBlock:block];
+}
+
+- (void)removeObserver:(id)observer {
+  [_changeObserverRegistry removeObserver:observer];
+}
+
 - (void)applyDataUpdate:(METDataUpdate *)update {
   dispatch_async(_dataUpdatesQueue, ^{
-    [_bufferedDataUpdates addObject:update];
+    if ([self applyDataUpdateToBulkLoadingCollection:update]) {
+      return;
+    }
+    
+    if (_oldestBufferedDataUpdateTime == 0) {
+      _oldestBufferedDataUpdateTime = METMonotonicTime();
+    }
+    
+    // While waiting for quiescence, updates to the same document are folded together so we only apply their net effect
+    [_bufferedDataUpdates addDataUpdate:update];
     dispatch_source_merge_data(_bufferedDataUpdatesSource, 1);
+    
+    [self updateBackpressureStateOnQueue];
+  });
+}
+
+- (BOOL)applyDataUpdateToBulkLoadingCollection:(METDataUpdate *)update {
+  METDocumentKey *documentKey = update.documentKey;
+  NSString *collectionName = documentKey.collectionName;
+  
+  NSMutableDictionary *fieldsByDocumentID = _fieldsByDocumentIDByBulkLoadingCollectionName[collectionName];
+  if (!fieldsByDocumentID) {
+    if (!_detectsBulkLoading || update.updateType != METDataUpdateTypeAdd) {
+      return NO;
+    }
+    
+    // A collection is only considered to be bulk loaded if the first update we receive for it adds a document to an otherwise empty collection
+    if (_fieldsByDocumentIDByBulkLoadedCollectionName[collectionName] || [_bufferedDataUpdates containsDataUpdatesForCollectionWithName:collectionName] || [_localCache numberOfDocumentsInCollectionWithName:collectionName] > 0) {
+      return NO;
+    }
+    
+    fieldsByDocumentID = [[NSMutableDictionary alloc] init];
+    _fieldsByDocumentIDByBulkLoadingCollectionName[collectionName] = fieldsByDocumentID;
+  }
+  
+  id documentID = documentKey.documentID;
+  NSDictionary *existingFields = fieldsByDocumentID[documentID];
+  switch (update.updateType) {
+    case METDataUpdateTypeAdd:
+      if (existingFields) {
+        NSLog(@"Couldn't add document because a document with the same key already exists: %@", documentKey);
+      } else {
+        fieldsByDocumentID[documentID] = update.fields;
+      }
+      break;
+    case METDataUpdateTypeChange:
+      if (existingFields) {
+        fieldsByDocumentID[documentID] = [existingFields fieldsByApplyingChangedFields:update.fields];
+      } else {
+        NSLog(@"Couldn't update document because no document with the specified ID exists: %@", documentKey);
+      }
+      break;
+    case METDataUpdateTypeReplace:
+      if (update.fields) {
+        fieldsByDocumentID[documentID] = update.fields;
+      } else {
+        [fieldsByDocumentID removeObjectForKey:documentID];
+      }
+      break;
+    case METDataUpdateTypeRemove:
+      if (existingFields) {
+        [fieldsByDocumentID removeObjectForKey:documentID];
+      } else {
+        NSLog(@"Couldn't remove document because no document with the specified ID exists: %@", documentKey);
+      }
+      break;
+  }
+  
+  return YES;
+}
+
+- (void)beginBulkLoadingCollectionWithName:(NSString *)collectionName {
+  NSParameterAssert(collectionName);
+  
+  dispatch_async(_dataUpdatesQueue, ^{
+    if (_fieldsByDocumentIDByBulkLoadingCollectionName[collectionName] || _fieldsByDocumentIDByBulkLoadedCollectionName[collectionName]) {
+      return;
+    }
+    
+    _fieldsByDocumentIDByBulkLoadingCollectionName[collectionName] = [[NSMutableDictionary alloc] init];
+  });
+}
+
+- (void)finishBulkLoading {
+  dispatch_async(_dataUpdatesQueue, ^{
+    if (_fieldsByDocumentIDByBulkLoadingCollectionName.count < 1) {
+      return;
+    }
+    
+    // Bulk loaded collections are added to the local cache on the next flush, so they are subject to the same rules as other buffered updates
+    [_fieldsByDocumentIDByBulkLoadedCollectionName addEntriesFromDictionary:_fieldsByDocumentIDByBulkLoadingCollectionName];
+    [_fieldsByDocumentIDByBulkLoadingCollectionName removeAllObjects];
+    dispatch_source_merge_data(_bufferedDataUpdatesSource, 1);
+  });
+}
+
+- (BOOL)loadsCollectionsInBulk {
+  __block BOOL loadsCollectionsInBulk;
+  dispatch_sync(_dataUpdatesQueue, ^{
+    loadsCollectionsInBulk = _loadsCollectionsInBulk;
+  });
+  return loadsCollectionsInBulk;
+}
+
+- (void)setLoadsCollectionsInBulk:(BOOL)loadsCollectionsInBulk {
+  dispatch_async(_dataUpdatesQueue, ^{
+    _loadsCollectionsInBulk = loadsCollectionsInBulk;
+  });
+}
+
+- (BOOL)detectsBulkLoading {
+  __block BOOL detectsBulkLoading;
+  dispatch_sync(_dataUpdatesQueue, ^{
+    detectsBulkLoading = _detectsBulkLoading;
+  });
+  return detectsBulkLoading;
+}
+
+- (void)setDetectsBulkLoading:(BOOL)detectsBulkLoading {
+  dispatch_async(_dataUpdatesQueue, ^{
+    _detectsBulkLoading = detectsBulkLoading;
   });
 }
 
@@ -128,30 +347,160 @@ NSString * const METDatabaseChangesKey = @"METDatabaseChangesKey";
   });
 }
 
+- (void)flushDataUpdatesKeepingExistingDocuments {
+  dispatch_sync(_dataUpdatesQueue, ^{
+    [self flushDataUpdatesOnQueueRemovingExistingDocuments:NO];
+  });
+}
+
+- (METDatabaseFlushPolicy *)flushPolicy {
+  __block METDatabaseFlushPolicy *flushPolicy;
+  dispatch_sync(_dataUpdatesQueue, ^{
+    flushPolicy = [_flushPolicy copy];
+  });
+  return flushPolicy;
+}
+
+- (void)setFlushPolicy:(METDatabaseFlushPolicy *)flushPolicy {
+  NSParameterAssert(flushPolicy);
+  
+  flushPolicy = [flushPolicy copy];
+  dispatch_async(_dataUpdatesQueue, ^{
+    _flushPolicy = flushPolicy;
+    _adaptiveFlushLatency = 0;
+    [self updateBackpressureStateOnQueue];
+    
+    // Buffered updates may have to be flushed earlier under the new policy
+    dispatch_source_merge_data(_bufferedDataUpdatesSource, 1);
+  });
+}
+
+- (void)flushDataUpdatesOnQueueIfNeeded {
+  // The flush timer isn't suspended while waiting for quiescence, but resuming the source will trigger another attempt
+  if (_waitingForQuiescence) {
+    return;
+  }
+  
+  NSTimeInterval timeIntervalUntilNextFlush = [self timeIntervalUntilNextFlush];
+  if (timeIntervalUntilNextFlush > 0) {
+    if (!_flushTimer) {
+      _flushTimer = [[METTimer alloc] initWithQueue:_dataUpdatesQueue block:^{
+        [self flushDataUpdatesOnQueueIfNeeded];
+      }];
+      _flushTimer.tolerance = 0;
+    }
+    [_flushTimer startWithTimeInterval:timeIntervalUntilNextFlush];
+  } else {
+    [self flushDataUpdatesOnQueue];
+  }
+}
+
+- (NSTimeInterval)timeIntervalUntilNextFlush {
+  NSUInteger numberOfBufferedDataUpdates = _bufferedDataUpdates.count;
+  
+  // Reaching the maximum batch size overrides the other settings, and if there is nothing to batch we might as well flush right away
+  if (numberOfBufferedDataUpdates == 0 || (numberOfBufferedDataUpdates >= _flushPolicy.maximumBatchSize && !_underBackpressure)) {
+    return 0;
+  }
+  
+  NSTimeInterval latency = _flushPolicy.adaptive ? _adaptiveFlushLatency : _flushPolicy.maximumLatency;
+  
+  // While consumers are behind, updates are held back longer so more of them are folded together per document
+  if (_underBackpressure) {
+    latency = fmax(latency, _flushPolicy.backpressureLatency);
+  }
+  
+  NSTimeInterval nextFlushTime = fmax(_oldestBufferedDataUpdateTime + latency, _lastFlushTime + _flushPolicy.minimumInterval);
+  return nextFlushTime - METMonotonicTime();
+}
+
 - (void)flushDataUpdatesOnQueue {
+  [self flushDataUpdatesOnQueueRemovingExistingDocuments:YES];
+}
+
+- (void)flushDataUpdatesOnQueueRemovingExistingDocuments:(BOOL)removeExistingDocuments {
   NSAssert(!_waitingForQuiescence, @"flushDataUpdates invoked while waiting for quiescence");
   
+  [_flushTimer stop];
+  
+  NSUInteger numberOfDataUpdates = _bufferedDataUpdates.count;
+  BOOL hasBulkLoadedDocuments = _fieldsByDocumentIDByBulkLoadedCollectionName.count > 0;
+  NSTimeInterval startTime = METMonotonicTime();
+  
   [self performUpdatesInLocalCache:^(METDocumentCache *localCache) {
-    if (_removeExistingDocumentsBeforeNextFlush) {
-      [_localCache removeAllDocuments];
+    if (_removeExistingDocumentsBeforeNextFlush && removeExistingDocuments) {
+      // Documents from before the reset that have been flushed since are kept
+      [_localCache removeAllDocumentsExceptDocumentsWithKeys:_confirmedDocumentKeys];
+      [_confirmedDocumentKeys removeAllObjects];
       _removeExistingDocumentsBeforeNextFlush = NO;
     }
     
-    for (METDataUpdate *update in _bufferedDataUpdates) {
-      [localCache applyDataUpdate:update];
+    // Until existing documents are removed, updates are applied on top of them and the documents they touch are remembered
+    BOOL confirmingDocuments = _reconcilingSnapshot || _removeExistingDocumentsBeforeNextFlush;
+    
+    [_fieldsByDocumentIDByBulkLoadedCollectionName enumerateKeysAndObjectsUsingBlock:^(NSString *collectionName, NSDictionary *fieldsByDocumentID, BOOL *stop) {
+      [localCache loadDocumentsWithFieldsByDocumentID:fieldsByDocumentID intoCollectionWithName:collectionName];
+      if (confirmingDocuments) {
+        for (id documentID in fieldsByDocumentID) {
+          [_confirmedDocumentKeys addObject:[METDocumentKey keyWithCollectionName:collectionName documentID:documentID]];
+        }
+      }
+    }];
+    [_fieldsByDocumentIDByBulkLoadedCollectionName removeAllObjects];
+    
+    [_bufferedDataUpdates enumerateDataUpdatesUsingBlock:^(METDataUpdate *update, BOOL *stop) {
+      if (confirmingDocuments) {
+        [self applyDataUpdate:update toLocalCacheConfirmingDocument:localCache];
+      } else {
+        [localCache applyDataUpdate:update];
+      }
+    }];
+    [_bufferedDataUpdates removeAllDataUpdates];
+    
+    if (_finishReconcilingSnapshotBeforeNextFlush) {
+      // Documents restored from the snapshot that the server hasn't sent us since are no longer part of any subscription
+      [localCache removeAllDocumentsExceptDocumentsWithKeys:_confirmedDocumentKeys];
+      [_confirmedDocumentKeys removeAllObjects];
+      _reconcilingSnapshot = NO;
+      _finishReconcilingSnapshotBeforeNextFlush = NO;
     }
-    [_bufferedDataUpdates removeAllObjects];
   }];
   
-  if (_pendingAfterFlushBlock) {
+  NSTimeInterval endTime = METMonotonicTime();
+  if (numberOfDataUpdates > 0) {
+    [_flushSizeHistogram recordValue:numberOfDataUpdates];
+    [_flushDurationHistogram recordValue:endTime - startTime];
+  }
+  if (numberOfDataUpdates > 0 || hasBulkLoadedDocuments) {
+    self.timeSpentApplyingDataUpdates += endTime - startTime;
+  }
+  _oldestBufferedDataUpdateTime = 0;
+  _lastFlushTime = endTime;
+  
+  if (_flushPolicy.adaptive) {
+    // Widen the batching window while updates arrive faster than we flush them, and shrink it again when they don't
+    if (numberOfDataUpdates > 1) {
+      _adaptiveFlushLatency = fmin(_flushPolicy.maximumLatency, fmax(_adaptiveFlushLatency * 2, METDatabaseMinimumAdaptiveFlushLatency));
+    } else {
+      _adaptiveFlushLatency /= 2;
+      if (_adaptiveFlushLatency < METDatabaseMinimumAdaptiveFlushLatency) {
+        _adaptiveFlushLatency = 0;
+      }
+    }
+  }
+  
+  // Documents of collections that are still being loaded in bulk haven't been added yet
+  if (_pendingAfterFlushBlock && _fieldsByDocumentIDByBulkLoadingCollectionName.count < 1) {
     _pendingAfterFlushBlock();
     _pendingAfterFlushBlock = nil;
   }
+  
+  [self updateBackpressureStateOnQueue];
 }
 
 - (void)performAfterBufferedUpdatesAreFlushed:(void (^)())block {
   dispatch_async(_dataUpdatesQueue, ^{
-    if (_bufferedDataUpdates.count > 0) {
+    if (_bufferedDataUpdates.count > 0 || _fieldsByDocumentIDByBulkLoadingCollectionName.count > 0 || _fieldsByDocumentIDByBulkLoadedCollectionName.count > 0) {
       dispatch_block_t existingPendingAfterFlushBlock = _pendingAfterFlushBlock;
       if (existingPendingAfterFlushBlock) {
         _pendingAfterFlushBlock = ^{
@@ -167,6 +516,26 @@ NSString * const METDatabaseChangesKey = @"METDatabaseChangesKey";
   });
 }
 
+- (NSUInteger)numberOfBufferedDataUpdates {
+  __block NSUInteger numberOfBufferedDataUpdates;
+  dispatch_sync(_dataUpdatesQueue, ^{
+    numberOfBufferedDataUpdates = _bufferedDataUpdates.count;
+  });
+  return numberOfBufferedDataUpdates;
+}
+
+- (NSUInteger)numberOfDocuments {
+  return _localCache.numberOfDocuments;
+}
+
+- (double)bufferedDataUpdatesFoldRatio {
+  __block double foldRatio;
+  dispatch_sync(_dataUpdatesQueue, ^{
+    foldRatio = _bufferedDataUpdates.foldRatio;
+  });
+  return foldRatio;
+}
+
 - (void)setWaitingForQuiescence:(BOOL)waitingForQuiescence {
   if (_waitingForQuiescence != waitingForQuiescence) {
     _waitingForQuiescence = waitingForQuiescence;
@@ -175,9 +544,127 @@ NSString * const METDatabaseChangesKey = @"METDatabaseChangesKey";
     } else {
       dispatch_resume(_bufferedDataUpdatesSource);
     }
+    
+    dispatch_async(_dataUpdatesQueue, ^{
+      [self updateBackpressureStateOnQueue];
+      
+      // A flush attempt made while waiting was dropped, and resuming only triggers the source if updates arrived in the meantime
+      if (!waitingForQuiescence && [self hasPendingFlushOnQueue]) {
+        dispatch_source_merge_data(_bufferedDataUpdatesSource, 1);
+      }
+    });
   }
 }
 
+- (BOOL)hasPendingFlushOnQueue {
+  return _bufferedDataUpdates.count > 0 || _fieldsByDocumentIDByBulkLoadedCollectionName.count > 0 || _pendingAfterFlushBlock != nil || _removeExistingDocumentsBeforeNextFlush || _finishReconcilingSnapshotBeforeNextFlush;
+}
+
+#pragma mark - Backpressure
+
+- (void)setNumberOfUndeliveredChanges:(NSUInteger)numberOfUndeliveredChanges forConsumer:(id)consumer {
+  NSParameterAssert(consumer);
+  
+  // Consumers are not retained, so they can reset their count from dealloc
+  NSValue *consumerKey = [NSValue valueWithNonretainedObject:consumer];
+  
+  dispatch_async(_dataUpdatesQueue, ^{
+    NSNumber *previousNumberOfUndeliveredChanges = _numbersOfUndeliveredChangesByConsumer[consumerKey];
+    _numberOfUndeliveredChanges -= previousNumberOfUndeliveredChanges.unsignedIntegerValue;
+    _numberOfUndeliveredChanges += numberOfUndeliveredChanges;
+    
+    if (numberOfUndeliveredChanges > 0) {
+      _numbersOfUndeliveredChangesByConsumer[consumerKey] = @(numberOfUndeliveredChanges);
+    } else {
+      [_numbersOfUndeliveredChangesByConsumer removeObjectForKey:consumerKey];
+    }
+    
+    [self updateBackpressureStateOnQueue];
+  });
+}
+
+- (NSUInteger)numberOfPendingChangesOnQueue {
+  return _bufferedDataUpdates.count + _numberOfUndeliveredChanges;
+}
+
+- (void)updateBackpressureStateOnQueue {
+  NSUInteger numberOfPendingChanges = [self numberOfPendingChangesOnQueue];
+  
+  // Backpressure is only relieved when we're well below the high-water mark, to avoid toggling back and forth
+  if (!_underBackpressure && numberOfPendingChanges >= _flushPolicy.highWaterMark) {
+    _underBackpressure = YES;
+    _numberOfTimesHighWaterMarkWasReached++;
+  } else if (_underBackpressure && numberOfPendingChanges < _flushPolicy.highWaterMark / 2) {
+    _underBackpressure = NO;
+    
+    // Updates that were being held back can be flushed under the regular policy again
+    dispatch_source_merge_data(_bufferedDataUpdatesSource, 1);
+  }
+  
+  // We never pause while waiting for quiescence, because that would keep us from receiving the messages that end it
+  if (!_receivingMessagesPaused && numberOfPendingChanges >= _flushPolicy.pauseThreshold && !_waitingForQuiescence) {
+    _receivingMessagesPaused = YES;
+    _receivingMessagesPausedTime = METMonotonicTime();
+    _numberOfTimesReceivingMessagesWasPaused++;
+    [_client pauseReceivingMessages];
+  } else if (_receivingMessagesPaused && (!_underBackpressure || _waitingForQuiescence)) {
+    _receivingMessagesPaused = NO;
+    _timeSpentWithReceivingMessagesPaused += METMonotonicTime() - _receivingMessagesPausedTime;
+    [_client resumeReceivingMessages];
+  }
+}
+
+- (NSUInteger)numberOfPendingChanges {
+  __block NSUInteger numberOfPendingChanges;
+  dispatch_sync(_dataUpdatesQueue, ^{
+    numberOfPendingChanges = [self numberOfPendingChangesOnQueue];
+  });
+  return numberOfPendingChanges;
+}
+
+- (BOOL)isUnderBackpressure {
+  __block BOOL underBackpressure;
+  dispatch_sync(_dataUpdatesQueue, ^{
+    underBackpressure = _underBackpressure;
+  });
+  return underBackpressure;
+}
+
+- (BOOL)isReceivingMessagesPaused {
+  __block BOOL receivingMessagesPaused;
+  dispatch_sync(_dataUpdatesQueue, ^{
+    receivingMessagesPaused = _receivingMessagesPaused;
+  });
+  return receivingMessagesPaused;
+}
+
+- (NSUInteger)numberOfTimesHighWaterMarkWasReached {
+  __block NSUInteger numberOfTimesHighWaterMarkWasReached;
+  dispatch_sync(_dataUpdatesQueue, ^{
+    numberOfTimesHighWaterMarkWasReached = _numberOfTimesHighWaterMarkWasReached;
+  });
+  return numberOfTimesHighWaterMarkWasReached;
+}
+
+- (NSUInteger)numberOfTimesReceivingMessagesWasPaused {
+  __block NSUInteger numberOfTimesReceivingMessagesWasPaused;
+  dispatch_sync(_dataUpdatesQueue, ^{
+    numberOfTimesReceivingMessagesWasPaused = _numberOfTimesReceivingMessagesWasPaused;
+  });
+  return numberOfTimesReceivingMessagesWasPaused;
+}
+
+- (NSTimeInterval)timeSpentWithReceivingMessagesPaused {
+  __block NSTimeInterval timeSpentWithReceivingMessagesPaused;
+  dispatch_sync(_dataUpdatesQueue, ^{
+    timeSpentWithReceivingMessagesPaused = _timeSpentWithReceivingMessagesPaused;
+    if (_receivingMessagesPaused) {
+      timeSpentWithReceivingMessagesPaused += METMonotonicTime() - _receivingMessagesPausedTime;
+    }
+  });
+  return timeSpentWithReceivingMessagesPaused;
+}
+
 - (void)performUpdates:(void (^)())block {
   [_writeLock lock];
   _writeLockRecursionCount++;
@@ -193,25 +680,152 @@ NSString * const METDatabaseChangesKey = @"METDatabaseChangesKey";
 }
 
 - (METDatabaseChanges *)performUpdatesAndReturnChanges:(void (^)())block {
-  NSAssert(_currentChanges == nil, @"performUpdatesAndReturnChanges: is not reentrant");
-  
-  METDatabaseChanges *changes = [[METDatabaseChanges alloc] init];
-  _currentChanges = changes;
+  return [self performUpdatesAndReturnChanges:block whenCommitted:nil];
+}
+
+- (METDatabaseChanges *)performUpdatesAndReturnChanges:(void (^)())block whenCommitted:(void (^)(METDatabaseChanges *changes))committedBlock {
+  NSAssert([_transactionDynamicVariable currentValue] == nil, @"performUpdatesAndReturnChanges: is not reentrant");
   
   [self performUpdates:^{
     if (!_waitingForQuiescence) {
       [self flushDataUpdates];
     }
+  }];
+  
+  for (NSUInteger attempt = 1; ; attempt++) {
+    BOOL optimistic = attempt < METDatabaseMaximumNumberOfOptimisticTransactionAttempts;
+    if (!optimistic) {
+      [_writeLock lock];
+    }
     
-    block();
+    METDatabaseTransaction *transaction = [self beginTransaction];
+    [_transactionDynamicVariable performBlock:block withValue:transaction];
     
-    [_changes addDatabaseChanges:changes];
-    _currentChanges = nil;
-  }];
+    __block METDatabaseChanges *changes;
+    [self performUpdates:^{
+      changes = [self commitTransaction:transaction];
+      if (changes && committedBlock) {
+        committedBlock(changes);
+      }
+    }];
+    
+    if (!optimistic) {
+      [_writeLock unlock];
+    }
+    
+    if (changes) {
+      return changes;
+    }
+  }
+}
+
+- (METDatabaseTransaction *)beginTransaction {
+  [_writeLock lock];
+  _numberOfActiveTransactions++;
+  METDatabaseTransaction *transaction = [[METDatabaseTransaction alloc] initWithLocalCache:_localCache sequenceNumber:_modificationSequenceNumber];
+  [_writeLock unlock];
+  return transaction;
+}
+
+// Returns nil if the transaction conflicts with modifications made since it started
+- (METDatabaseChanges *)commitTransaction:(METDatabaseTransaction *)transaction {
+  METDatabaseChanges *changes = nil;
+  
+  if (![self transactionHasConflicts:transaction]) {
+    changes = [[METDatabaseChanges alloc] init];
+    if (transaction.hasChanges) {
+      _currentChanges = changes;
+      [transaction applyChangesToLocalCache:_localCache];
+      _currentChanges = nil;
+      [_changes addDatabaseChanges:changes];
+    }
+  }
+  
+  _numberOfActiveTransactions--;
+  if (_numberOfActiveTransactions == 0) {
+    [_modificationSequenceNumbersByDocumentKey removeAllObjects];
+    [_modificationSequenceNumbersByCollectionName removeAllObjects];
+    [_loadSequenceNumbersByCollectionName removeAllObjects];
+  }
   
   return changes;
 }
 
+- (BOOL)transactionHasConflicts:(METDatabaseTransaction *)transaction {
+  uint64_t sequenceNumber = transaction.sequenceNumber;
+  if (_modificationSequenceNumber == sequenceNumber) {
+    return NO;
+  }
+  
+  for (METDocumentKey *documentKey in transaction.accessedDocumentKeys) {
+    if ([_modificationSequenceNumbersByDocumentKey[documentKey] unsignedLongLongValue] > sequenceNumber) {
+      return YES;
+    }
+    // Loading documents into a collection doesn't report changes to individual documents
+    if ([_loadSequenceNumbersByCollectionName[documentKey.collectionName] unsignedLongLongValue] > sequenceNumber) {
+      return YES;
+    }
+  }
+  for (NSString *collectionName in transaction.accessedCollectionNames) {
+    if ([_modificationSequenceNumbersByCollectionName[collectionName] unsignedLongLongValue] > sequenceNumber) {
+      return YES;
+    }
+  }
+  return NO;
+}
+
+- (void)recordModificationOfDocumentWithKey:(METDocumentKey *)documentKey collectionName:(NSString *)collectionName {
+  _modificationSequenceNumber++;
+  if (_numberOfActiveTransactions > 0) {
+    NSNumber *sequenceNumber = @(_modificationSequenceNumber);
+    if (documentKey) {
+      _modificationSequenceNumbersByDocumentKey[documentKey] = sequenceNumber;
+    } else {
+      _loadSequenceNumbersByCollectionName[collectionName] = sequenceNumber;
+    }
+    _modificationSequenceNumbersByCollectionName[collectionName] = sequenceNumber;
+  }
+}
+
+- (BOOL)addDocumentWithKey:(METDocumentKey *)documentKey fields:(NSDictionary *)fields {
+  METDatabaseTransaction *transaction = [_transactionDynamicVariable currentValue];
+  if (transaction) {
+    return [transaction addDocumentWithKey:documentKey fields:fields];
+  }
+  
+  __block BOOL success = NO;
+  [self performUpdatesInLocalCache:^(METDocumentCache *localCache) {
+    success = [localCache addDocumentWithKey:documentKey fields:fields];
+  }];
+  return success;
+}
+
+- (BOOL)updateDocumentWithKey:(METDocumentKey *)documentKey changedFields:(NSDictionary *)changedFields {
+  METDatabaseTransaction *transaction = [_transactionDynamicVariable currentValue];
+  if (transaction) {
+    return [transaction updateDocumentWithKey:documentKey changedFields:changedFields];
+  }
+  
+  __block BOOL success = NO;
+  [self performUpdatesInLocalCache:^(METDocumentCache *localCache) {
+    success = [localCache updateDocumentWithKey:documentKey changedFields:changedFields];
+  }];
+  return success;
+}
+
+- (BOOL)removeDocumentWithKey:(METDocumentKey *)documentKey {
+  METDatabaseTransaction *transaction = [_transactionDynamicVariable currentValue];
+  if (transaction) {
+    return [transaction removeDocumentWithKey:documentKey];
+  }
+  
+  __block BOOL success = NO;
+  [self performUpdatesInLocalCache:^(METDocumentCache *localCache) {
+    success = [localCache removeDocumentWithKey:documentKey];
+  }];
+  return success;
+}
+
 - (void)performUpdatesInLocalCache:(void (^)(METDocumentCache *localCache))block {
   [self performUpdates:^{
     block(_localCache);
@@ -226,17 +840,141 @@ NSString * const METDatabaseChangesKey = @"METDatabaseChangesKey";
   }];
 }
 
+- (void)reclaimMemory {
+  // This is called on the main thread when a memory warning is received, so it shouldn't wait for a flush to finish
+  dispatch_async(_dataUpdatesQueue, ^{
+    [_localCache compact];
+  });
+}
+
 - (void)reset {
   [self performUpdatesInLocalCache:^(METDocumentCache *localCache) {
-    [_bufferedDataUpdates removeAllObjects];
+    [_bufferedDataUpdates removeAllDataUpdates];
+    [_fieldsByDocumentIDByBulkLoadingCollectionName removeAllObjects];
+    [_fieldsByDocumentIDByBulkLoadedCollectionName removeAllObjects];
+    _oldestBufferedDataUpdateTime = 0;
     _pendingAfterFlushBlock = nil;
-    _removeExistingDocumentsBeforeNextFlush = YES;
+    
+    // With a snapshot, existing documents are kept around and reconciled against the data we receive from the server
+    if (_snapshot) {
+      _reconcilingSnapshot = YES;
+      _finishReconcilingSnapshotBeforeNextFlush = NO;
+      [_confirmedDocumentKeys removeAllObjects];
+    } else {
+      _removeExistingDocumentsBeforeNextFlush = YES;
+      [_confirmedDocumentKeys removeAllObjects];
+    }
   }];
+  
+  dispatch_async(_dataUpdatesQueue, ^{
+    // Receiving messages isn't paused on a new connection, so we decide whether to pause it again from scratch
+    if (_receivingMessagesPaused) {
+      _receivingMessagesPaused = NO;
+      _timeSpentWithReceivingMessagesPaused += METMonotonicTime() - _receivingMessagesPausedTime;
+    }
+    [self updateBackpressureStateOnQueue];
+  });
+}
+
+#pragma mark - Snapshots
+
+- (BOOL)openSnapshotAtURL:(NSURL *)URL error:(NSError **)error {
+  NSParameterAssert(URL);
+  NSAssert(_snapshot == nil, @"A snapshot has already been opened");
+  
+  METDocumentSnapshot *snapshot = [[METDocumentSnapshot alloc] initWithURL:URL];
+  if (![snapshot openWithError:error]) {
+    return NO;
+  }
+  
+  [self performUpdatesInLocalCacheWithoutTrackingChanges:^(METDocumentCache *localCache) {
+    [localCache loadSnapshot:snapshot];
+    _snapshot = snapshot;
+  }];
+  
+  return YES;
+}
+
+- (BOOL)isReconcilingSnapshot {
+  __block BOOL reconcilingSnapshot;
+  dispatch_sync(_dataUpdatesQueue, ^{
+    reconcilingSnapshot = _reconcilingSnapshot;
+  });
+  return reconcilingSnapshot;
+}
+
+- (void)applyDataUpdate:(METDataUpdate *)update toLocalCacheConfirmingDocument:(METDocumentCache *)localCache {
+  METDocumentKey *documentKey = update.documentKey;
+  [_confirmedDocumentKeys addObject:documentKey];
+  
+  if (update.updateType == METDataUpdateTypeAdd) {
+    METDocument *existingDocument = [localCache documentWithKey:documentKey];
+    if (existingDocument) {
+      // Existing documents are only replaced when they differ from the version the server sends us
+      if (![existingDocument.fields isEqualToDictionary:update.fields]) {
+        [localCache replaceDocumentWithKey:documentKey fields:update.fields];
+      }
+      return;
+    }
+  }
+  
+  [localCache applyDataUpdate:update];
+}
+
+- (void)finishReconcilingSnapshot {
+  dispatch_async(_dataUpdatesQueue, ^{
+    if (!_reconcilingSnapshot) {
+      return;
+    }
+    
+    _finishReconcilingSnapshotBeforeNextFlush = YES;
+    dispatch_source_merge_data(_bufferedDataUpdatesSource, 1);
+  });
+}
+
+- (void)writeDatabaseChangesToSnapshot:(METDatabaseChanges *)databaseChanges {
+  // Documents with changes performed by stubs keep their last confirmed version in the snapshot until the server is done with them
+  @synchronized(_documentKeysWithUnconfirmedChanges) {
+    [databaseChanges enumerateDocumentChangeDetailsUsingBlock:^(METDocumentChangeDetails *documentChangeDetails, BOOL *stop) {
+      if (![_documentKeysWithUnconfirmedChanges containsObject:documentChangeDetails.documentKey]) {
+        [_snapshot writeFields:documentChangeDetails.fieldsAfterChanges forDocumentWithKey:documentChangeDetails.documentKey];
+      }
+    }];
+    
+    // Collections that have been loaded in bulk don't contain change details, so we write all of their documents
+    for (NSString *collectionName in [databaseChanges loadedCollectionNames]) {
+      for (METDocument *document in [_localCache executeFetchRequest:[[METFetchRequest alloc] initWithCollectionName:collectionName]]) {
+        if (![_documentKeysWithUnconfirmedChanges containsObject:document.key]) {
+          [_snapshot writeFields:document.fields forDocumentWithKey:document.key];
+        }
+      }
+    }
+  }
+}
+
+- (void)didBufferUnconfirmedChangesToDocumentWithKey:(METDocumentKey *)documentKey {
+  @synchronized(_documentKeysWithUnconfirmedChanges) {
+    [_documentKeysWithUnconfirmedChanges addObject:documentKey];
+  }
+}
+
+- (void)didConfirmFields:(NSDictionary *)fields forDocumentWithKey:(METDocumentKey *)documentKey {
+  @synchronized(_documentKeysWithUnconfirmedChanges) {
+    if (![_documentKeysWithUnconfirmedChanges containsObject:documentKey]) {
+      return;
+    }
+    [_documentKeysWithUnconfirmedChanges removeObject:documentKey];
+    
+    // Rolling back to the confirmed version may not result in any changes, so we write it here
+    [_snapshot writeFields:fields forDocumentWithKey:documentKey];
+  }
 }
 
 #pragma mark - METDocumentCacheDelegate
 
 - (void)documentCache:(METDocumentCache *)cache willChangeDocumentWithKey:(METDocumentKey *)documentKey fieldsBeforeChanges:(NSDictionary *)fieldsBeforeChanges {
+  [self recordModificationOfDocumentWithKey:documentKey collectionName:documentKey.collectionName];
+  
   if (_trackingChanges) {
     METDatabaseChanges *changes = _currentChanges ? _currentChanges : _changes;
     [changes willChangeDocumentWithKey:documentKey fieldsBeforeChanges:fieldsBeforeChanges];
@@ -250,15 +988,33 @@ NSString * const METDatabaseChangesKey = @"METDatabaseChangesKey";
   }
 }
 
+- (void)documentCache:(METDocumentCache *)cache didLoadDocumentsIntoCollectionWithName:(NSString *)collectionName {
+  [self recordModificationOfDocumentWithKey:nil collectionName:collectionName];
+  
+  if (_trackingChanges) {
+    METDatabaseChanges *changes = _currentChanges ? _currentChanges : _changes;
+    [changes didLoadCollectionWithName:collectionName];
+  }
+}
+
 #pragma mark - Change Notifications
 
 - (void)postDidChangeNotificationIfNeeded {
   METDatabaseChanges *databaseChanges = _changes;
   if ([databaseChanges hasChanges]) {
     _changes = [[METDatabaseChanges alloc] init];
+    
+    // Changes are recorded before they are posted, so consumers that are notified can pull them right away
+    [_changeLog recordDatabaseChanges:databaseChanges];
+    
+    if (_snapshot) {
+      [self writeDatabaseChangesToSnapshot:databaseChanges];
+    }
 
     NSDictionary *userInfo = @{METDatabaseChangesKey: databaseChanges};
     [[NSNotificationCenter defaultCenter] postNotificationName:METDatabaseDidChangeNotification object:self userInfo:userInfo];
+    
+    [_changeObserverRegistry notifyObserversOfDatabaseChanges:databaseChanges];
   }
 }
 
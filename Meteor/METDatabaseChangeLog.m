@@ -0,0 +1,151 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#import "METDatabaseChangeLog.h"
+#import "METDatabaseChangeLog_Internal.h"
+
+#import "METDatabase.h"
+#import "METDatabaseChanges.h"
+#import "METDatabaseChanges_Internal.h"
+#import "METDocumentKey.h"
+#import "METDocumentChangeDetails.h"
+
+@interface METDatabaseChangeLogEntry : NSObject
+
+@property (assign, nonatomic) uint64_t sequenceNumber;
+// Entries without change details record that the whole collection has been loaded in bulk
+@property (strong, nonatomic) METDocumentChangeDetails *documentChangeDetails;
+
+@end
+
+@implementation METDatabaseChangeLogEntry
+
+@end
+
+@implementation METDatabaseChangeLog {
+  NSMutableDictionary *_entriesByCollectionName;
+  // Keeps track of the highest sequence number that has been discarded for each collection
+  NSMutableDictionary *_truncatedSequenceNumbersByCollectionName;
+}
+
+- (instancetype)initWithMaximumNumberOfEntriesPerCollection:(NSUInteger)maximumNumberOfEntriesPerCollection {
+  NSParameterAssert(maximumNumberOfEntriesPerCollection > 0);
+  
+  self = [super init];
+  if (self) {
+    _maximumNumberOfEntriesPerCollection = maximumNumberOfEntriesPerCollection;
+    _entriesByCollectionName = [[NSMutableDictionary alloc] init];
+    _truncatedSequenceNumbersByCollectionName = [[NSMutableDictionary alloc] init];
+  }
+  return self;
+}
+
+- (uint64_t)currentSequenceNumber {
+  @synchronized(self) {
+    return _currentSequenceNumber;
+  }
+}
+
+- (void)recordDatabaseChanges:(METDatabaseChanges *)databaseChanges {
+  @synchronized(self) {
+    uint64_t sequenceNumber = ++_currentSequenceNumber;
+    
+    [databaseChanges enumerateDocumentChangeDetailsUsingBlock:^(METDocumentChangeDetails *documentChangeDetails, BOOL *stop) {
+      METDatabaseChangeLogEntry *entry = [[METDatabaseChangeLogEntry alloc] init];
+      entry.sequenceNumber = sequenceNumber;
+      entry.documentChangeDetails = documentChangeDetails;
+      [self addEntry:entry toCollectionWithName:documentChangeDetails.documentKey.collectionName];
+    }];
+    
+    for (NSString *collectionName in [databaseChanges loadedCollectionNames]) {
+      METDatabaseChangeLogEntry *entry = [[METDatabaseChangeLogEntry alloc] init];
+      entry.sequenceNumber = sequenceNumber;
+      [self addEntry:entry toCollectionWithName:collectionName];
+    }
+  }
+}
+
+- (METDatabaseChanges *)changesToCollectionWithName:(NSString *)collectionName sinceSequenceNumber:(uint64_t)sequenceNumber latestSequenceNumber:(uint64_t *)latestSequenceNumber error:(NSError **)error {
+  NSParameterAssert(collectionName);
+  
+  @synchronized(self) {
+    uint64_t truncatedSequenceNumber = [_truncatedSequenceNumbersByCollectionName[collectionName] unsignedLongLongValue];
+    if (sequenceNumber < truncatedSequenceNumber || sequenceNumber > _currentSequenceNumber) {
+      if (error) {
+        *error = [NSError errorWithDomain:METDatabaseErrorDomain code:METDatabaseResyncRequiredError userInfo:@{NSLocalizedDescriptionKey: [NSString stringWithFormat:@"Changes to collection %@ since sequence number %llu are no longer available", collectionName, sequenceNumber]}];
+      }
+      return nil;
+    }
+    
+    if (latestSequenceNumber) {
+      *latestSequenceNumber = _currentSequenceNumber;
+    }
+    
+    METDatabaseChanges *databaseChanges = [[METDatabaseChanges alloc] init];
+    NSArray *entries = _entriesByCollectionName[collectionName];
+    NSUInteger index = [self indexOfFirstEntryInEntries:entries withSequenceNumberGreaterThan:sequenceNumber];
+    for (; index < entries.count; index++) {
+      METDatabaseChangeLogEntry *entry = entries[index];
+      METDocumentChangeDetails *documentChangeDetails = entry.documentChangeDetails;
+      if (documentChangeDetails) {
+        [databaseChanges willChangeDocumentWithKey:documentChangeDetails.documentKey fieldsBeforeChanges:documentChangeDetails.fieldsBeforeChanges];
+        [databaseChanges didChangeDocumentWithKey:documentChangeDetails.documentKey fieldsAfterChanges:documentChangeDetails.fieldsAfterChanges];
+      } else {
+        [databaseChanges didLoadCollectionWithName:collectionName];
+      }
+    }
+    return databaseChanges;
+  }
+}
+
+#pragma mark - Helper Methods
+
+- (void)addEntry:(METDatabaseChangeLogEntry *)entry toCollectionWithName:(NSString *)collectionName {
+  NSMutableArray *entries = _entriesByCollectionName[collectionName];
+  if (!entries) {
+    entries = [[NSMutableArray alloc] init];
+    _entriesByCollectionName[collectionName] = entries;
+  }
+  [entries addObject:entry];
+  
+  if (entries.count > _maximumNumberOfEntriesPerCollection) {
+    NSUInteger numberOfEntriesToDiscard = entries.count - _maximumNumberOfEntriesPerCollection;
+    METDatabaseChangeLogEntry *lastDiscardedEntry = entries[numberOfEntriesToDiscard - 1];
+    _truncatedSequenceNumbersByCollectionName[collectionName] = @(lastDiscardedEntry.sequenceNumber);
+    [entries removeObjectsInRange:NSMakeRange(0, numberOfEntriesToDiscard)];
+  }
+}
+
+- (NSUInteger)indexOfFirstEntryInEntries:(NSArray *)entries withSequenceNumberGreaterThan:(uint64_t)sequenceNumber {
+  // Entries are ordered by sequence number, so we can use a binary search
+  NSUInteger low = 0;
+  NSUInteger high = entries.count;
+  while (low < high) {
+    NSUInteger middle = low + (high - low) / 2;
+    if ([entries[middle] sequenceNumber] <= sequenceNumber) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+@end
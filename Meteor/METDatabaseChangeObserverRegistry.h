@@ -0,0 +1,46 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+@class METDatabase;
+@class METDatabaseChanges;
+@class METDocumentKey;
+@class METDocumentChangeDetails;
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface METDatabaseChangeObserverRegistry : NSObject
+
+- (instancetype)initWithDatabase:(METDatabase *)database NS_DESIGNATED_INITIALIZER;
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (weak, nonatomic, readonly) METDatabase *database;
+
+- (id<NSObject>)addObserverForChangesToCollectionWithName:(NSString *)collectionName queue:(nullable dispatch_queue_t)queue usingBlock:(void (^)(METDatabaseChanges *databaseChanges))block;
+- (id<NSObject>)addObserverForChangesToDocumentWithKey:(METDocumentKey *)documentKey queue:(nullable dispatch_queue_t)queue usingBlock:(void (^)(METDocumentChangeDetails *documentChangeDetails))block;
+- (void)removeObserver:(id)observer;
+
+- (void)notifyObserversOfDatabaseChanges:(METDatabaseChanges *)databaseChanges;
+@property (assign, nonatomic, readonly) NSUInteger numberOfUndeliveredChanges;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,251 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#import "METDatabaseChangeObserverRegistry.h"
+
+#import "METDatabase.h"
+#import "METDatabase_Internal.h"
+#import "METDatabaseChanges.h"
+#import "METDatabaseChanges_Internal.h"
+#import "METDocument.h"
+#import "METDocumentKey.h"
+#import "METDocumentChangeDetails.h"
+
+@interface METDatabaseChangeObserver : NSObject
+
+@property (copy, nonatomic) NSString *collectionName;
+@property (copy, nonatomic) METDocumentKey *documentKey;
+@property (strong, nonatomic) dispatch_queue_t queue;
+@property (copy, nonatomic) void (^collectionBlock)(METDatabaseChanges *databaseChanges);
+@property (copy, nonatomic) void (^documentBlock)(METDocumentChangeDetails *documentChangeDetails);
+
+@end
+
+@implementation METDatabaseChangeObserver
+
+@end
+
+@implementation METDatabaseChangeObserverRegistry {
+  NSMutableDictionary *_observersByCollectionName;
+  NSMutableDictionary *_observersByDocumentKey;
+  NSUInteger _numberOfUndeliveredChanges;
+}
+
+- (instancetype)initWithDatabase:(METDatabase *)database {
+  self = [super init];
+  if (self) {
+    _database = database;
+    _observersByCollectionName = [[NSMutableDictionary alloc] init];
+    _observersByDocumentKey = [[NSMutableDictionary alloc] init];
+  }
+  return self;
+}
+
+- (id<NSObject>)addObserverForChangesToCollectionWithName:(NSString *)collectionName queue:(dispatch_queue_t)queue usingBlock:(void (^)(METDatabaseChanges *databaseChanges))block {
+  NSParameterAssert(collectionName);
+  NSParameterAssert(block);
+  
+  METDatabaseChangeObserver *observer = [[METDatabaseChangeObserver alloc] init];
+  observer.collectionName = collectionName;
+  observer.queue = queue;
+  observer.collectionBlock = block;
+  
+  @synchronized(self) {
+    [self addObserver:observer forKey:collectionName toDictionary:_observersByCollectionName];
+  }
+  
+  return observer;
+}
+
+- (id<NSObject>)addObserverForChangesToDocumentWithKey:(METDocumentKey *)documentKey queue:(dispatch_queue_t)queue usingBlock:(void (^)(METDocumentChangeDetails *documentChangeDetails))block {
+  NSParameterAssert(documentKey);
+  NSParameterAssert(block);
+  
+  METDatabaseChangeObserver *observer = [[METDatabaseChangeObserver alloc] init];
+  observer.documentKey = documentKey;
+  observer.queue = queue;
+  observer.documentBlock = block;
+  
+  @synchronized(self) {
+    [self addObserver:observer forKey:documentKey toDictionary:_observersByDocumentKey];
+  }
+  
+  return observer;
+}
+
+- (void)removeObserver:(id)observer {
+  if (![observer isKindOfClass:[METDatabaseChangeObserver class]]) {
+    return;
+  }
+  
+  METDatabaseChangeObserver *changeObserver = observer;
+  @synchronized(self) {
+    if (changeObserver.collectionName) {
+      [self removeObserver:changeObserver forKey:changeObserver.collectionName fromDictionary:_observersByCollectionName];
+    } else {
+      [self removeObserver:changeObserver forKey:changeObserver.documentKey fromDictionary:_observersByDocumentKey];
+    }
+  }
+}
+
+- (void)notifyObserversOfDatabaseChanges:(METDatabaseChanges *)databaseChanges {
+  NSDictionary *observersByCollectionName;
+  NSDictionary *observersByDocumentKey;
+  
+  // Observers are copied so they can be added or removed from within a block without affecting this round of notifications
+  @synchronized(self) {
+    if (_observersByCollectionName.count < 1 && _observersByDocumentKey.count < 1) {
+      return;
+    }
+    observersByCollectionName = [self copyOfObserversInDictionary:_observersByCollectionName];
+    observersByDocumentKey = [self copyOfObserversInDictionary:_observersByDocumentKey];
+  }
+  
+  // Partition changes in a single pass, only keeping track of collections and documents that are being observed
+  NSMutableDictionary *databaseChangesByCollectionName = [[NSMutableDictionary alloc] init];
+  NSMutableDictionary *documentChangeDetailsByDocumentKey = [[NSMutableDictionary alloc] init];
+  
+  [databaseChanges enumerateDocumentChangeDetailsUsingBlock:^(METDocumentChangeDetails *documentChangeDetails, BOOL *stop) {
+    METDocumentKey *documentKey = documentChangeDetails.documentKey;
+    NSString *collectionName = documentKey.collectionName;
+    
+    if (observersByCollectionName[collectionName]) {
+      [[self databaseChangesForCollectionWithName:collectionName inDictionary:databaseChangesByCollectionName] addDocumentChangeDetails:documentChangeDetails];
+    }
+    
+    if (observersByDocumentKey[documentKey]) {
+      documentChangeDetailsByDocumentKey[documentKey] = documentChangeDetails;
+    }
+  }];
+  
+  NSSet *loadedCollectionNames = [databaseChanges loadedCollectionNames];
+  for (NSString *collectionName in loadedCollectionNames) {
+    if (observersByCollectionName[collectionName]) {
+      [[self databaseChangesForCollectionWithName:collectionName inDictionary:databaseChangesByCollectionName] didLoadCollectionWithName:collectionName];
+    }
+  }
+  
+  // Collections that have been loaded in bulk don't contain change details, so we report observed documents as added
+  if (loadedCollectionNames.count > 0) {
+    METDatabase *database = _database;
+    for (METDocumentKey *documentKey in observersByDocumentKey) {
+      if (documentChangeDetailsByDocumentKey[documentKey] || ![loadedCollectionNames containsObject:documentKey.collectionName]) {
+        continue;
+      }
+      
+      METDocument *document = [database documentWithKey:documentKey];
+      if (document) {
+        METDocumentChangeDetails *documentChangeDetails = [[METDocumentChangeDetails alloc] initWithDocumentKey:documentKey];
+        documentChangeDetails.fieldsAfterChanges = document.fields;
+        documentChangeDetailsByDocumentKey[documentKey] = documentChangeDetails;
+      }
+    }
+  }
+  
+  [databaseChangesByCollectionName enumerateKeysAndObjectsUsingBlock:^(NSString *collectionName, METDatabaseChanges *databaseChanges, BOOL *stop) {
+    for (METDatabaseChangeObserver *observer in observersByCollectionName[collectionName]) {
+      void (^block)(METDatabaseChanges *) = observer.collectionBlock;
+      [self performBlock:^{
+        block(databaseChanges);
+      } forObserver:observer numberOfChanges:[databaseChanges numberOfDocumentChanges]];
+    }
+  }];
+  
+  [documentChangeDetailsByDocumentKey enumerateKeysAndObjectsUsingBlock:^(METDocumentKey *documentKey, METDocumentChangeDetails *documentChangeDetails, BOOL *stop) {
+    for (METDatabaseChangeObserver *observer in observersByDocumentKey[documentKey]) {
+      void (^block)(METDocumentChangeDetails *) = observer.documentBlock;
+      [self performBlock:^{
+        block(documentChangeDetails);
+      } forObserver:observer numberOfChanges:1];
+    }
+  }];
+}
+
+- (NSUInteger)numberOfUndeliveredChanges {
+  @synchronized(self) {
+    return _numberOfUndeliveredChanges;
+  }
+}
+
+#pragma mark - Helper Methods
+
+- (void)performBlock:(void (^)())block forObserver:(METDatabaseChangeObserver *)observer numberOfChanges:(NSUInteger)numberOfChanges {
+  if (!observer.queue) {
+    block();
+    return;
+  }
+  
+  // Changes dispatched to an observer's queue count as undelivered until its block has run, so slow observers exert backpressure
+  [self addNumberOfUndeliveredChanges:numberOfChanges];
+  dispatch_async(observer.queue, ^{
+    block();
+    [self removeNumberOfUndeliveredChanges:numberOfChanges];
+  });
+}
+
+- (void)addNumberOfUndeliveredChanges:(NSUInteger)numberOfChanges {
+  @synchronized(self) {
+    _numberOfUndeliveredChanges += numberOfChanges;
+    [_database setNumberOfUndeliveredChanges:_numberOfUndeliveredChanges forConsumer:self];
+  }
+}
+
+- (void)removeNumberOfUndeliveredChanges:(NSUInteger)numberOfChanges {
+  @synchronized(self) {
+    _numberOfUndeliveredChanges -= numberOfChanges;
+    [_database setNumberOfUndeliveredChanges:_numberOfUndeliveredChanges forConsumer:self];
+  }
+}
+
+- (void)addObserver:(METDatabaseChangeObserver *)observer forKey:(id<NSCopying>)key toDictionary:(NSMutableDictionary *)observersByKey {
+  NSMutableArray *observers = observersByKey[key];
+  if (!observers) {
+    observers = [[NSMutableArray alloc] init];
+    observersByKey[key] = observers;
+  }
+  [observers addObject:observer];
+}
+
+- (void)removeObserver:(METDatabaseChangeObserver *)observer forKey:(id<NSCopying>)key fromDictionary:(NSMutableDictionary *)observersByKey {
+  NSMutableArray *observers = observersByKey[key];
+  [observers removeObjectIdenticalTo:observer];
+  if (observers.count < 1) {
+    [observersByKey removeObjectForKey:key];
+  }
+}
+
+- (NSDictionary *)copyOfObserversInDictionary:(NSDictionary *)observersByKey {
+  NSMutableDictionary *copy = [[NSMutableDictionary alloc] initWithCapacity:observersByKey.count];
+  [observersByKey enumerateKeysAndObjectsUsingBlock:^(id key, NSArray *observers, BOOL *stop) {
+    copy[key] = [observers copy];
+  }];
+  return copy;
+}
+
+- (METDatabaseChanges *)databaseChangesForCollectionWithName:(NSString *)collectionName inDictionary:(NSMutableDictionary *)databaseChangesByCollectionName {
+  METDatabaseChanges *databaseChanges = databaseChangesByCollectionName[collectionName];
+  if (!databaseChanges) {
+    databaseChanges = [[METDatabaseChanges alloc] init];
+    databaseChangesByCollectionName[collectionName] = databaseChanges;
+  }
+  return databaseChanges;
+}
+
+@end
@@ -33,6 +33,9 @@ NS_ASSUME_NONNULL_BEGIN
 - (void)removeChangeDetailsForDocumentWithKey:(METDocumentKey *)documentKey;
 - (void)removeAllDocumentChangeDetails;
 
+// Collections that have been loaded in bulk are not reported as individual document changes
+- (NSSet *)loadedCollectionNames;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -25,18 +25,24 @@
 
 @implementation METDatabaseChanges {
   NSMutableDictionary *_changeDetailsByDocumentKey;
+  NSMutableSet *_loadedCollectionNames;
 }
 
 - (instancetype)init {
   self = [super init];
   if (self) {
     _changeDetailsByDocumentKey = [[NSMutableDictionary alloc] init];
+    _loadedCollectionNames = [[NSMutableSet alloc] init];
   }
   return self;
 }
 
 - (BOOL)hasChanges {
-  return _changeDetailsByDocumentKey.count > 0;
+  return _changeDetailsByDocumentKey.count > 0 || _loadedCollectionNames.count > 0;
+}
+
+- (NSUInteger)numberOfDocumentChanges {
+  return _changeDetailsByDocumentKey.count;
 }
 
 - (NSSet *)affectedDocumentKeys {
@@ -61,6 +67,22 @@
   [_changeDetailsByDocumentKey removeAllObjects];
 }
 
+- (NSSet *)loadedCollectionNames {
+  return [_loadedCollectionNames copy];
+}
+
+- (void)addDocumentChangeDetails:(METDocumentChangeDetails *)documentChangeDetails {
+  _changeDetailsByDocumentKey[documentChangeDetails.documentKey] = documentChangeDetails;
+}
+
+- (void)didLoadCollectionWithName:(NSString *)collectionName {
+  [_loadedCollectionNames addObject:collectionName];
+}
+
+- (void)removeAllLoadedCollectionNames {
+  [_loadedCollectionNames removeAllObjects];
+}
+
 - (void)willChangeDocumentWithKey:(METDocumentKey *)documentKey fieldsBeforeChanges:(NSDictionary *)fieldsBeforeChanges {
   METDocumentChangeDetails *changeDetails = _changeDetailsByDocumentKey[documentKey];
   
@@ -92,11 +114,16 @@
     [self willChangeDocumentWithKey:documentKey fieldsBeforeChanges:documentChangeDetails.fieldsBeforeChanges];
     [self didChangeDocumentWithKey:documentKey fieldsAfterChanges:documentChangeDetails.fieldsAfterChanges];
   }];
+  
+  [_loadedCollectionNames unionSet:[databaseChanges loadedCollectionNames]];
 }
 
 #pragma mark - NSObject
 
 - (NSString *)description {
+  if (_loadedCollectionNames.count > 0) {
+    return [NSString stringWithFormat:@"%@, loaded collections: %@", [[_changeDetailsByDocumentKey allValues] description], [_loadedCollectionNames allObjects]];
+  }
   return [[_changeDetailsByDocumentKey allValues] description];
 }
 
@@ -27,10 +27,15 @@ NS_ASSUME_NONNULL_BEGIN
 @interface METDatabaseChanges ()
 
 - (BOOL)hasChanges;
+- (NSUInteger)numberOfDocumentChanges;
 
 - (void)willChangeDocumentWithKey:(METDocumentKey *)documentKey fieldsBeforeChanges:(nullable NSDictionary *)fieldsBeforeChanges;
 - (void)didChangeDocumentWithKey:(METDocumentKey *)documentKey fieldsAfterChanges:(nullable NSDictionary *)fieldsAfterChanges;
 
+- (void)addDocumentChangeDetails:(METDocumentChangeDetails *)documentChangeDetails;
+- (void)didLoadCollectionWithName:(NSString *)collectionName;
+- (void)removeAllLoadedCollectionNames;
+
 - (void)addDatabaseChanges:(METDatabaseChanges *)databaseChanges;
 
 @end
@@ -0,0 +1,62 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#import "METDatabaseFlushPolicy.h"
+
+@implementation METDatabaseFlushPolicy
+
+- (instancetype)init {
+  self = [super init];
+  if (self) {
+    // The default policy flushes as soon as updates come in
+    _maximumLatency = 0;
+    _maximumBatchSize = NSUIntegerMax;
+    _minimumInterval = 0;
+    _adaptive = NO;
+    
+    // Backpressure only kicks in when consumers fall far behind
+    _highWaterMark = 10000;
+    _pauseThreshold = 50000;
+    _backpressureLatency = 0.1;
+  }
+  return self;
+}
+
+#pragma mark - NSCopying
+
+- (id)copyWithZone:(NSZone *)zone {
+  METDatabaseFlushPolicy *copy = [[[self class] allocWithZone:zone] init];
+  copy.maximumLatency = _maximumLatency;
+  copy.maximumBatchSize = _maximumBatchSize;
+  copy.minimumInterval = _minimumInterval;
+  copy.adaptive = _adaptive;
+  copy.highWaterMark = _highWaterMark;
+  copy.pauseThreshold = _pauseThreshold;
+  copy.backpressureLatency = _backpressureLatency;
+  return copy;
+}
+
+#pragma mark - NSObject
+
+- (NSString *)description {
+  return [NSString stringWithFormat:@"<METDatabaseFlushPolicy, maximumLatency: %f, maximumBatchSize: %lu, minimumInterval: %f, adaptive: %@, highWaterMark: %lu, pauseThreshold: %lu, backpressureLatency: %f>", _maximumLatency, (unsigned long)_maximumBatchSize, _minimumInterval, _adaptive ? @"YES" : @"NO", (unsigned long)_highWaterMark, (unsigned long)_pauseThreshold, _backpressureLatency];
+}
+
+@end
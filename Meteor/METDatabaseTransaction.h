@@ -0,0 +1,60 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#import <Foundation/Foundation.h>
+
+@class METDocumentCache;
+@class METDocument;
+@class METDocumentKey;
+@class METFetchRequest;
+@class METDatabaseChanges;
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Collects changes on top of a view of the local cache without locking it, so transactions
+// can run concurrently. Documents and collections that were accessed are recorded, so
+// the database can detect conflicting modifications before committing.
+@interface METDatabaseTransaction : NSObject
+
+- (instancetype)initWithLocalCache:(METDocumentCache *)localCache sequenceNumber:(uint64_t)sequenceNumber NS_DESIGNATED_INITIALIZER;
+- (instancetype)init NS_UNAVAILABLE;
+
+// Modifications with a higher sequence number were made after the transaction started
+@property (assign, nonatomic, readonly) uint64_t sequenceNumber;
+
+@property (copy, nonatomic, readonly) NSSet *accessedDocumentKeys;
+@property (copy, nonatomic, readonly) NSSet *accessedCollectionNames;
+
+- (NSArray *)executeFetchRequest:(METFetchRequest *)fetchRequest;
+- (nullable METDocument *)documentWithKey:(METDocumentKey *)documentKey;
+
+- (BOOL)addDocumentWithKey:(METDocumentKey *)documentKey fields:(NSDictionary *)fields;
+- (BOOL)updateDocumentWithKey:(METDocumentKey *)documentKey changedFields:(NSDictionary *)changedFields;
+- (BOOL)removeDocumentWithKey:(METDocumentKey *)documentKey;
+
+@property (assign, nonatomic, readonly) BOOL hasChanges;
+
+// Should be called while holding the database write lock
+- (void)applyChangesToLocalCache:(METDocumentCache *)localCache;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,155 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#import "METDatabaseTransaction.h"
+
+#import "METDocumentCache.h"
+#import "METDocument.h"
+#import "METDocumentKey.h"
+#import "METFetchRequest.h"
+#import "METDataUpdate.h"
+#import "NSDictionary+METAdditions.h"
+
+@implementation METDatabaseTransaction {
+  METDocumentCache *_localCache;
+  NSMutableSet *_accessedDocumentKeys;
+  NSMutableSet *_accessedCollectionNames;
+  // Contains NSNull for documents removed in this transaction
+  NSMutableDictionary *_fieldsByDocumentKey;
+  NSMutableArray *_dataUpdates;
+}
+
+- (instancetype)initWithLocalCache:(METDocumentCache *)localCache sequenceNumber:(uint64_t)sequenceNumber {
+  self = [super init];
+  if (self) {
+    _localCache = localCache;
+    _sequenceNumber = sequenceNumber;
+    _accessedDocumentKeys = [[NSMutableSet alloc] init];
+    _accessedCollectionNames = [[NSMutableSet alloc] init];
+    _fieldsByDocumentKey = [[NSMutableDictionary alloc] init];
+    _dataUpdates = [[NSMutableArray alloc] init];
+  }
+  return self;
+}
+
+- (NSSet *)accessedDocumentKeys {
+  return [_accessedDocumentKeys copy];
+}
+
+- (NSSet *)accessedCollectionNames {
+  return [_accessedCollectionNames copy];
+}
+
+#pragma mark - Reading
+
+- (NSArray *)executeFetchRequest:(METFetchRequest *)fetchRequest {
+  NSString *collectionName = fetchRequest.collectionName;
+  [_accessedCollectionNames addObject:collectionName];
+  
+  NSArray *documents = [_localCache executeFetchRequest:fetchRequest];
+  if (_fieldsByDocumentKey.count < 1) {
+    return documents;
+  }
+  
+  NSMutableDictionary *documentsByKey = [[NSMutableDictionary alloc] initWithCapacity:documents.count];
+  for (METDocument *document in documents) {
+    documentsByKey[document.key] = document;
+  }
+  [_fieldsByDocumentKey enumerateKeysAndObjectsUsingBlock:^(METDocumentKey *documentKey, id fields, BOOL *stop) {
+    if (![documentKey.collectionName isEqualToString:collectionName]) return;
+    
+    if (fields == [NSNull null]) {
+      [documentsByKey removeObjectForKey:documentKey];
+    } else {
+      documentsByKey[documentKey] = [[METDocument alloc] initWithKey:documentKey fields:fields];
+    }
+  }];
+  return [documentsByKey allValues];
+}
+
+- (METDocument *)documentWithKey:(METDocumentKey *)documentKey {
+  [_accessedDocumentKeys addObject:documentKey];
+  
+  id fields = _fieldsByDocumentKey[documentKey];
+  if (fields == [NSNull null]) {
+    return nil;
+  } else if (fields) {
+    return [[METDocument alloc] initWithKey:documentKey fields:fields];
+  } else {
+    return [_localCache documentWithKey:documentKey];
+  }
+}
+
+#pragma mark - Writing
+
+- (BOOL)addDocumentWithKey:(METDocumentKey *)documentKey fields:(NSDictionary *)fields {
+  NSParameterAssert(documentKey);
+  NSParameterAssert(fields);
+  
+  if ([self documentWithKey:documentKey]) {
+    NSLog(@"Couldn't add document because a document with the same key already exists: %@", documentKey);
+    return NO;
+  }
+  
+  _fieldsByDocumentKey[documentKey] = [fields copy];
+  [_dataUpdates addObject:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeAdd documentKey:documentKey fields:fields]];
+  return YES;
+}
+
+- (BOOL)updateDocumentWithKey:(METDocumentKey *)documentKey changedFields:(NSDictionary *)changedFields {
+  NSParameterAssert(documentKey);
+  NSParameterAssert(changedFields);
+  
+  METDocument *existingDocument = [self documentWithKey:documentKey];
+  if (!existingDocument) {
+    NSLog(@"Couldn't update document because no document with the specified ID exists: %@", documentKey);
+    return NO;
+  }
+  
+  _fieldsByDocumentKey[documentKey] = [existingDocument.fields fieldsByApplyingChangedFields:changedFields];
+  [_dataUpdates addObject:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeChange documentKey:documentKey fields:changedFields]];
+  return YES;
+}
+
+- (BOOL)removeDocumentWithKey:(METDocumentKey *)documentKey {
+  NSParameterAssert(documentKey);
+  
+  if (![self documentWithKey:documentKey]) {
+    NSLog(@"Couldn't remove document because no document with the specified ID exists: %@", documentKey);
+    return NO;
+  }
+  
+  _fieldsByDocumentKey[documentKey] = [NSNull null];
+  [_dataUpdates addObject:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeRemove documentKey:documentKey fields:nil]];
+  return YES;
+}
+
+- (BOOL)hasChanges {
+  return _dataUpdates.count > 0;
+}
+
+- (void)applyChangesToLocalCache:(METDocumentCache *)localCache {
+  for (METDataUpdate *update in _dataUpdates) {
+    [localCache applyDataUpdate:update];
+  }
+}
+
+@end
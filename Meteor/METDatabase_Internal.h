@@ -23,6 +23,7 @@
 @class METDocumentCache;
 @class METDataUpdate;
 @class METDatabaseChanges;
+@class METDocumentKey;
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -30,16 +31,45 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (void)applyDataUpdate:(METDataUpdate *)update;
 - (void)flushDataUpdates;
+// Documents from before a reset are kept until a regular flush, unless the server has sent them again in the meantime
+- (void)flushDataUpdatesKeepingExistingDocuments;
 @property (assign, nonatomic, getter=isWaitingForQuiescence) BOOL waitingForQuiescence;
 
+@property (assign, nonatomic) BOOL detectsBulkLoading;
+- (void)beginBulkLoadingCollectionWithName:(NSString *)collectionName;
+- (void)finishBulkLoading;
+
+// The block is performed in a transaction that isn't holding the write lock, and is retried if it conflicts
+// with changes committed in the meantime. The committed block is invoked while still holding the write lock.
 - (METDatabaseChanges *)performUpdatesAndReturnChanges:(void (^)())block;
+- (METDatabaseChanges *)performUpdatesAndReturnChanges:(void (^)())block whenCommitted:(nullable void (^)(METDatabaseChanges *changes))committedBlock;
 - (void)performUpdatesInLocalCache:(void (^)(METDocumentCache *localCache))block;
 - (void)performUpdatesInLocalCacheWithoutTrackingChanges:(void (^)(METDocumentCache *localCache))block;
 
+// These write to the transaction of the current thread if there is one, and to the local cache otherwise
+- (BOOL)addDocumentWithKey:(METDocumentKey *)documentKey fields:(NSDictionary *)fields;
+- (BOOL)updateDocumentWithKey:(METDocumentKey *)documentKey changedFields:(NSDictionary *)changedFields;
+- (BOOL)removeDocumentWithKey:(METDocumentKey *)documentKey;
+
 - (void)performAfterBufferedUpdatesAreFlushed:(void (^)())block;
+@property (assign, nonatomic, readonly) NSUInteger numberOfBufferedDataUpdates;
+// Number of documents in the local cache, not including buffered data updates
+@property (assign, nonatomic, readonly) NSUInteger numberOfDocuments;
+@property (assign, nonatomic, readonly) double bufferedDataUpdatesFoldRatio;
+// Total time spent applying flushed data updates to the local cache, can be read from any thread
+@property (assign, readonly) NSTimeInterval timeSpentApplyingDataUpdates;
+
+- (void)setNumberOfUndeliveredChanges:(NSUInteger)numberOfUndeliveredChanges forConsumer:(id)consumer;
 
 - (void)reset;
 
+// Changes to documents the method invocation coordinator is buffering are only written to the snapshot once the server has confirmed them
+- (void)didBufferUnconfirmedChangesToDocumentWithKey:(METDocumentKey *)documentKey;
+- (void)didConfirmFields:(nullable NSDictionary *)fields forDocumentWithKey:(METDocumentKey *)documentKey;
+
+// Compacts the local cache asynchronously
+- (void)reclaimMemory;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -25,6 +25,7 @@
 @class METDocumentKey;
 @class METFetchRequest;
 @class METDataUpdate;
+@class METDocumentSnapshot;
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -40,9 +41,20 @@ NS_ASSUME_NONNULL_BEGIN
 - (void)replaceDocumentWithKey:(METDocumentKey *)documentKey fields:(NSDictionary *)fields;
 - (BOOL)removeDocumentWithKey:(METDocumentKey *)documentKey;
 - (void)removeAllDocuments;
+- (void)removeAllDocumentsExceptDocumentsWithKeys:(NSSet *)documentKeys;
+
+- (NSUInteger)numberOfDocumentsInCollectionWithName:(NSString *)collectionName;
+// Collections that haven't been materialized from the snapshot yet are counted without decoding them
+@property (assign, nonatomic, readonly) NSUInteger numberOfDocuments;
+
+// Drops collections that no longer contain documents and rebuilds the ones that have shrunk
+- (void)compact;
+- (void)loadDocumentsWithFieldsByDocumentID:(NSDictionary *)fieldsByDocumentID intoCollectionWithName:(NSString *)collectionName;
 
 - (void)applyDataUpdate:(METDataUpdate *)update;
 
+- (void)loadSnapshot:(METDocumentSnapshot *)snapshot;
+
 @end
 
 @protocol METDocumentCacheDelegate <NSObject>
@@ -50,6 +62,9 @@ NS_ASSUME_NONNULL_BEGIN
 - (void)documentCache:(METDocumentCache *)cache willChangeDocumentWithKey:(METDocumentKey *)documentKey fieldsBeforeChanges:(nullable NSDictionary *)fieldsBeforeChanges;
 - (void)documentCache:(METDocumentCache *)cache didChangeDocumentWithKey:(METDocumentKey *)documentKey fieldsAfterChanges:(nullable NSDictionary *)fieldsAfterChanges;
 
+@optional
+- (void)documentCache:(METDocumentCache *)cache didLoadDocumentsIntoCollectionWithName:(NSString *)collectionName;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -24,11 +24,17 @@
 #import "METDocument.h"
 #import "METFetchRequest.h"
 #import "METDataUpdate.h"
+#import "METDocumentSnapshot.h"
 #import "NSDictionary+METAdditions.h"
 
 @implementation METDocumentCache {
   dispatch_queue_t _queue;
   NSMutableDictionary *_documentsByCollectionNameByDocumentID;
+  // Size of the largest collection since the last compaction, so compacting can be skipped if no collection has shrunk
+  NSUInteger _peakNumberOfDocumentsInCollection;
+  
+  METDocumentSnapshot *_snapshot;
+  NSMutableSet *_unmaterializedCollectionNames;
 }
 
 - (instancetype)init {
@@ -41,6 +47,8 @@
 }
 
 - (NSArray *)executeFetchRequest:(METFetchRequest *)fetchRequest {
+  [self materializeCollectionWithNameIfNeeded:fetchRequest.collectionName];
+  
   __block NSArray *result;
   dispatch_sync(_queue, ^{
     result = [_documentsByCollectionNameByDocumentID[fetchRequest.collectionName] allValues];
@@ -49,6 +57,8 @@
 }
 
 - (METDocument *)documentWithKey:(METDocumentKey *)documentKey {
+  [self materializeCollectionWithNameIfNeeded:documentKey.collectionName];
+  
   __block METDocument *document;
   dispatch_sync(_queue, ^{
     document = [self loadDocumentWithKey:documentKey];
@@ -62,6 +72,8 @@
   
   __block BOOL result = NO;
   dispatch_barrier_sync(_queue, ^{
+    [self materializeCollectionWithNameOnQueueIfNeeded:documentKey.collectionName];
+    
     METDocument *existingDocument = [self loadDocumentWithKey:documentKey];
     if (existingDocument) {
       NSLog(@"Couldn't add document because a document with the same key already exists: %@", documentKey);
@@ -84,6 +96,8 @@
   
   __block BOOL result = NO;
   dispatch_barrier_sync(_queue, ^{
+    [self materializeCollectionWithNameOnQueueIfNeeded:documentKey.collectionName];
+    
     METDocument *existingDocument = [self loadDocumentWithKey:documentKey];
     if (!existingDocument) {
       NSLog(@"Couldn't update document because no document with the specified ID exists: %@", documentKey);
@@ -104,6 +118,8 @@
   NSParameterAssert(documentKey);
   
   dispatch_barrier_sync(_queue, ^{
+    [self materializeCollectionWithNameOnQueueIfNeeded:documentKey.collectionName];
+    
     METDocument *existingDocument = [self loadDocumentWithKey:documentKey];
     [_delegate documentCache:self willChangeDocumentWithKey:documentKey fieldsBeforeChanges:existingDocument.fields];
     if (fields) {
@@ -122,6 +138,8 @@
   
   __block BOOL result = NO;
   dispatch_barrier_sync(_queue, ^{
+    [self materializeCollectionWithNameOnQueueIfNeeded:documentKey.collectionName];
+    
     METDocument *existingDocument = [self loadDocumentWithKey:documentKey];
     if (!existingDocument) {
       NSLog(@"Couldn't remove document because no document with the specified ID exists: %@", documentKey);
@@ -139,6 +157,8 @@
 
 - (void)removeAllDocuments {
   dispatch_barrier_sync(_queue, ^{
+    [self materializeAllCollectionsOnQueue];
+    
     [self enumerateDocumentsUsingBlock:^(METDocument *document, BOOL *stop) {
       [_delegate documentCache:self willChangeDocumentWithKey:document.key fieldsBeforeChanges:document.fields];
       [_delegate documentCache:self didChangeDocumentWithKey:document.key fieldsAfterChanges:nil];
@@ -148,6 +168,110 @@
   });
 }
 
+- (void)removeAllDocumentsExceptDocumentsWithKeys:(NSSet *)documentKeys {
+  NSParameterAssert(documentKeys);
+  
+  dispatch_barrier_sync(_queue, ^{
+    [self materializeAllCollectionsOnQueue];
+    
+    NSMutableArray *documentsToRemove = [[NSMutableArray alloc] init];
+    [self enumerateDocumentsUsingBlock:^(METDocument *document, BOOL *stop) {
+      if (![documentKeys containsObject:document.key]) {
+        [documentsToRemove addObject:document];
+      }
+    }];
+    
+    for (METDocument *document in documentsToRemove) {
+      METDocumentKey *documentKey = document.key;
+      [_delegate documentCache:self willChangeDocumentWithKey:documentKey fieldsBeforeChanges:document.fields];
+      [_documentsByCollectionNameByDocumentID[documentKey.collectionName] removeObjectForKey:documentKey.documentID];
+      [_delegate documentCache:self didChangeDocumentWithKey:documentKey fieldsAfterChanges:nil];
+    }
+  });
+}
+
+- (NSUInteger)numberOfDocumentsInCollectionWithName:(NSString *)collectionName {
+  NSParameterAssert(collectionName);
+  
+  [self materializeCollectionWithNameIfNeeded:collectionName];
+  
+  __block NSUInteger numberOfDocuments;
+  dispatch_sync(_queue, ^{
+    numberOfDocuments = [_documentsByCollectionNameByDocumentID[collectionName] count];
+  });
+  return numberOfDocuments;
+}
+
+- (NSUInteger)numberOfDocuments {
+  __block NSUInteger numberOfDocuments = 0;
+  dispatch_sync(_queue, ^{
+    for (NSDictionary *documentsByID in [_documentsByCollectionNameByDocumentID objectEnumerator]) {
+      numberOfDocuments += documentsByID.count;
+    }
+    for (NSString *collectionName in _unmaterializedCollectionNames) {
+      numberOfDocuments += [_snapshot numberOfDocumentsInCollectionWithName:collectionName];
+    }
+  });
+  return numberOfDocuments;
+}
+
+- (void)compact {
+  dispatch_barrier_sync(_queue, ^{
+    NSMutableDictionary *documentsByCollectionNameByDocumentID = [[NSMutableDictionary alloc] initWithCapacity:_documentsByCollectionNameByDocumentID.count];
+    __block NSUInteger peakNumberOfDocumentsInCollection = 0;
+    [_documentsByCollectionNameByDocumentID enumerateKeysAndObjectsUsingBlock:^(NSString *collectionName, NSMutableDictionary *documentsByID, BOOL *stop) {
+      NSUInteger numberOfDocuments = documentsByID.count;
+      if (numberOfDocuments == 0) return;
+      
+      if (numberOfDocuments < _peakNumberOfDocumentsInCollection) {
+        documentsByID = [[NSMutableDictionary alloc] initWithDictionary:documentsByID];
+      }
+      documentsByCollectionNameByDocumentID[collectionName] = documentsByID;
+      peakNumberOfDocumentsInCollection = MAX(peakNumberOfDocumentsInCollection, numberOfDocuments);
+    }];
+    _documentsByCollectionNameByDocumentID = documentsByCollectionNameByDocumentID;
+    _peakNumberOfDocumentsInCollection = peakNumberOfDocumentsInCollection;
+  });
+}
+
+- (void)loadDocumentsWithFieldsByDocumentID:(NSDictionary *)fieldsByDocumentID intoCollectionWithName:(NSString *)collectionName {
+  NSParameterAssert(fieldsByDocumentID);
+  NSParameterAssert(collectionName);
+  
+  dispatch_barrier_sync(_queue, ^{
+    [self materializeCollectionWithNameOnQueueIfNeeded:collectionName];
+    
+    NSMutableDictionary *documentsByID = _documentsByCollectionNameByDocumentID[collectionName];
+    if (!documentsByID) {
+      documentsByID = [[NSMutableDictionary alloc] initWithCapacity:fieldsByDocumentID.count];
+      _documentsByCollectionNameByDocumentID[collectionName] = documentsByID;
+    }
+    
+    __block BOOL loadedDocuments = NO;
+    [fieldsByDocumentID enumerateKeysAndObjectsUsingBlock:^(id documentID, NSDictionary *fields, BOOL *stop) {
+      METDocumentKey *documentKey = [METDocumentKey keyWithCollectionName:collectionName documentID:documentID];
+      METDocument *existingDocument = documentsByID[documentID];
+      METDocument *document = [[METDocument alloc] initWithKey:documentKey fields:fields];
+      
+      // Documents that were added to the collection in the meantime are replaced and reported as individual changes
+      if (existingDocument) {
+        [_delegate documentCache:self willChangeDocumentWithKey:documentKey fieldsBeforeChanges:existingDocument.fields];
+        documentsByID[documentID] = document;
+        [_delegate documentCache:self didChangeDocumentWithKey:documentKey fieldsAfterChanges:fields];
+      } else {
+        documentsByID[documentID] = document;
+        loadedDocuments = YES;
+      }
+    }];
+    
+    _peakNumberOfDocumentsInCollection = MAX(_peakNumberOfDocumentsInCollection, documentsByID.count);
+    
+    if (loadedDocuments && [_delegate respondsToSelector:@selector(documentCache:didLoadDocumentsIntoCollectionWithName:)]) {
+      [_delegate documentCache:self didLoadDocumentsIntoCollectionWithName:collectionName];
+    }
+  });
+}
+
 - (void)applyDataUpdate:(METDataUpdate *)update {
   METDocumentKey *documentKey = update.documentKey;
   switch (update.updateType) {
@@ -166,6 +290,62 @@
   }
 }
 
+#pragma mark - Snapshots
+
+- (void)loadSnapshot:(METDocumentSnapshot *)snapshot {
+  NSParameterAssert(snapshot);
+  
+  dispatch_barrier_sync(_queue, ^{
+    NSAssert(_snapshot == nil, @"A snapshot has already been loaded");
+    
+    // Documents in the snapshot are only decoded when their collection is first accessed
+    _snapshot = snapshot;
+    _unmaterializedCollectionNames = [[snapshot collectionNames] mutableCopy];
+  });
+}
+
+- (void)materializeCollectionWithNameIfNeeded:(NSString *)collectionName {
+  if (!_snapshot) {
+    return;
+  }
+  
+  __block BOOL needsMaterialization;
+  dispatch_sync(_queue, ^{
+    needsMaterialization = [_unmaterializedCollectionNames containsObject:collectionName];
+  });
+  
+  if (needsMaterialization) {
+    dispatch_barrier_sync(_queue, ^{
+      [self materializeCollectionWithNameOnQueueIfNeeded:collectionName];
+    });
+  }
+}
+
+- (void)materializeCollectionWithNameOnQueueIfNeeded:(NSString *)collectionName {
+  if (![_unmaterializedCollectionNames containsObject:collectionName]) {
+    return;
+  }
+  [_unmaterializedCollectionNames removeObject:collectionName];
+  
+  NSDictionary *fieldsByDocumentID = [_snapshot fieldsByDocumentIDForCollectionWithName:collectionName];
+  if (fieldsByDocumentID.count < 1) {
+    return;
+  }
+  
+  NSMutableDictionary *documentsByID = [[NSMutableDictionary alloc] initWithCapacity:fieldsByDocumentID.count];
+  [fieldsByDocumentID enumerateKeysAndObjectsUsingBlock:^(id documentID, NSDictionary *fields, BOOL *stop) {
+    METDocumentKey *documentKey = [METDocumentKey keyWithCollectionName:collectionName documentID:documentID];
+    documentsByID[documentID] = [[METDocument alloc] initWithKey:documentKey fields:fields];
+  }];
+  _documentsByCollectionNameByDocumentID[collectionName] = documentsByID;
+}
+
+- (void)materializeAllCollectionsOnQueue {
+  for (NSString *collectionName in [_unmaterializedCollectionNames copy]) {
+    [self materializeCollectionWithNameOnQueueIfNeeded:collectionName];
+  }
+}
+
 #pragma mark - Helper Methods
 
 - (METDocument *)loadDocumentWithKey:(METDocumentKey *)documentKey {
@@ -179,6 +359,7 @@
     _documentsByCollectionNameByDocumentID[documentKey.collectionName] = documentsByID;
   }
   documentsByID[documentKey.documentID] = document;
+  _peakNumberOfDocumentsInCollection = MAX(_peakNumberOfDocumentsInCollection, documentsByID.count);
 }
 
 - (void)enumerateDocumentsUsingBlock:(void (^)(METDocument *document, BOOL *stop))block {
@@ -0,0 +1,52 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#import <Foundation/Foundation.h>
+
+@class METDocumentKey;
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface METDocumentSnapshot : NSObject
+
+- (instancetype)initWithURL:(NSURL *)URL NS_DESIGNATED_INITIALIZER;
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (copy, nonatomic, readonly) NSURL *URL;
+
+- (BOOL)openWithError:(NSError **)error;
+- (void)close;
+
+- (NSSet *)collectionNames;
+- (nullable NSDictionary *)fieldsByDocumentIDForCollectionWithName:(NSString *)collectionName;
+@property (assign, nonatomic, readonly) NSUInteger numberOfDocuments;
+- (NSUInteger)numberOfDocumentsInCollectionWithName:(NSString *)collectionName;
+
+- (void)writeFields:(nullable NSDictionary *)fields forDocumentWithKey:(METDocumentKey *)documentKey;
+- (void)synchronize;
+
+- (BOOL)compactWithError:(NSError **)error;
+@property (assign, nonatomic, readonly) NSUInteger numberOfRecords;
+@property (assign, nonatomic, readonly) unsigned long long fileSize;
+
+@end
+
+NS_ASSUME_NONNULL_END
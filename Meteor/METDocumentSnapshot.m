@@ -0,0 +1,466 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#import "METDocumentSnapshot.h"
+
+#import "METDatabase.h"
+#import "METDocumentKey.h"
+#import "METEJSONSerialization.h"
+
+// A snapshot file starts with a header, followed by records that are only ever appended:
+// | length (uint32) | type (uint8) | key length (uint32) | key JSON | fields JSON |
+// The length covers everything after the length field itself, and all integers are little-endian
+static const char METDocumentSnapshotMagic[4] = {'M', 'E', 'T', 'S'};
+static const uint32_t METDocumentSnapshotVersion = 1;
+static const NSUInteger METDocumentSnapshotHeaderLength = 8;
+static const NSUInteger METDocumentSnapshotRecordHeaderLength = 9;
+
+// Compaction only pays off when a substantial part of the file consists of superseded records
+static const NSUInteger METDocumentSnapshotMinimumNumberOfRecordsForCompaction = 1000;
+
+typedef NS_ENUM(uint8_t, METDocumentSnapshotRecordType) {
+  METDocumentSnapshotRecordTypePut = 1,
+  METDocumentSnapshotRecordTypeRemove = 2
+};
+
+static uint32_t METReadUInt32(const uint8_t *bytes) {
+  uint32_t value;
+  memcpy(&value, bytes, sizeof(value));
+  return CFSwapInt32LittleToHost(value);
+}
+
+static void METAppendUInt32(NSMutableData *data, uint32_t value) {
+  value = CFSwapInt32HostToLittle(value);
+  [data appendBytes:&value length:sizeof(value)];
+}
+
+@implementation METDocumentSnapshot {
+  dispatch_queue_t _queue;
+  NSData *_data;
+  NSFileHandle *_fileHandle;
+  unsigned long long _fileLength;
+  NSMutableDictionary *_recordRangesByDocumentIDByCollectionName;
+}
+
+- (instancetype)initWithURL:(NSURL *)URL {
+  NSParameterAssert(URL);
+  
+  self = [super init];
+  if (self) {
+    _URL = [URL copy];
+    _queue = dispatch_queue_create("com.meteor.DocumentSnapshot", DISPATCH_QUEUE_SERIAL);
+    _recordRangesByDocumentIDByCollectionName = [[NSMutableDictionary alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [_fileHandle closeFile];
+}
+
+#pragma mark - Opening and Closing
+
+- (BOOL)openWithError:(NSError **)error {
+  __block BOOL success;
+  __block NSError *openingError;
+  dispatch_sync(_queue, ^{
+    success = [self openOnQueueWithError:&openingError];
+  });
+  if (!success && error) {
+    *error = openingError;
+  }
+  return success;
+}
+
+- (BOOL)openOnQueueWithError:(NSError **)error {
+  NSAssert(_fileHandle == nil, @"Snapshot has already been opened");
+  
+  if (![[NSFileManager defaultManager] fileExistsAtPath:_URL.path]) {
+    if (![[self headerData] writeToURL:_URL options:NSDataWritingAtomic error:error]) {
+      return NO;
+    }
+  }
+  
+  // The file is mapped into memory, so fields are only read from disk when a collection is first accessed
+  NSData *data = [NSData dataWithContentsOfURL:_URL options:NSDataReadingMappedIfSafe error:error];
+  if (!data) {
+    return NO;
+  }
+  
+  if (![self isValidHeaderInData:data]) {
+    if (error) {
+      *error = [NSError errorWithDomain:METDatabaseErrorDomain code:METDatabaseInvalidSnapshotError userInfo:@{NSLocalizedDescriptionKey: @"Snapshot file has an invalid header", NSURLErrorKey: _URL}];
+    }
+    return NO;
+  }
+  
+  NSUInteger validLength = [self indexRecordsInData:data];
+  
+  NSFileHandle *fileHandle = [NSFileHandle fileHandleForWritingToURL:_URL error:error];
+  if (!fileHandle) {
+    return NO;
+  }
+  
+  // A partially written record can be left behind if we were terminated while writing, so we discard it
+  if (validLength < data.length) {
+    NSLog(@"Discarding %lu bytes at the end of snapshot: %@", (unsigned long)(data.length - validLength), _URL);
+    [fileHandle truncateFileAtOffset:validLength];
+  }
+  [fileHandle seekToEndOfFile];
+  
+  _data = data;
+  _fileHandle = fileHandle;
+  _fileLength = validLength;
+  return YES;
+}
+
+- (void)close {
+  dispatch_sync(_queue, ^{
+    [_fileHandle synchronizeFile];
+    [_fileHandle closeFile];
+    _fileHandle = nil;
+    _data = nil;
+  });
+}
+
+#pragma mark - Reading
+
+- (NSSet *)collectionNames {
+  __block NSSet *collectionNames;
+  dispatch_sync(_queue, ^{
+    collectionNames = [NSSet setWithArray:_recordRangesByDocumentIDByCollectionName.allKeys];
+  });
+  return collectionNames;
+}
+
+- (NSDictionary *)fieldsByDocumentIDForCollectionWithName:(NSString *)collectionName {
+  NSParameterAssert(collectionName);
+  
+  __block NSMutableDictionary *fieldsByDocumentID;
+  dispatch_sync(_queue, ^{
+    NSDictionary *recordRangesByDocumentID = _recordRangesByDocumentIDByCollectionName[collectionName];
+    if (!recordRangesByDocumentID || !_fileHandle) {
+      return;
+    }
+    
+    // Records that were appended after the file was mapped are only visible after mapping it again
+    if (_data.length < _fileLength) {
+      NSData *data = [NSData dataWithContentsOfURL:_URL options:NSDataReadingMappedIfSafe error:nil];
+      if (data) {
+        _data = data;
+      }
+    }
+    
+    fieldsByDocumentID = [[NSMutableDictionary alloc] initWithCapacity:recordRangesByDocumentID.count];
+    [recordRangesByDocumentID enumerateKeysAndObjectsUsingBlock:^(id documentID, NSValue *recordRangeValue, BOOL *stop) {
+      NSDictionary *fields = [self fieldsFromRecordWithRange:recordRangeValue.rangeValue];
+      if (fields) {
+        fieldsByDocumentID[documentID] = fields;
+      } else {
+        NSLog(@"Couldn't read fields for document from snapshot: %@", [METDocumentKey keyWithCollectionName:collectionName documentID:documentID]);
+      }
+    }];
+  });
+  return fieldsByDocumentID;
+}
+
+- (NSUInteger)numberOfDocuments {
+  __block NSUInteger numberOfDocuments = 0;
+  dispatch_sync(_queue, ^{
+    numberOfDocuments = [self numberOfDocumentsOnQueue];
+  });
+  return numberOfDocuments;
+}
+
+- (NSUInteger)numberOfDocumentsInCollectionWithName:(NSString *)collectionName {
+  NSParameterAssert(collectionName);
+  
+  __block NSUInteger numberOfDocuments;
+  dispatch_sync(_queue, ^{
+    numberOfDocuments = [_recordRangesByDocumentIDByCollectionName[collectionName] count];
+  });
+  return numberOfDocuments;
+}
+
+- (NSUInteger)numberOfDocumentsOnQueue {
+  NSUInteger numberOfDocuments = 0;
+  for (NSDictionary *recordRangesByDocumentID in [_recordRangesByDocumentIDByCollectionName objectEnumerator]) {
+    numberOfDocuments += recordRangesByDocumentID.count;
+  }
+  return numberOfDocuments;
+}
+
+- (NSUInteger)numberOfRecords {
+  __block NSUInteger numberOfRecords;
+  dispatch_sync(_queue, ^{
+    numberOfRecords = _numberOfRecords;
+  });
+  return numberOfRecords;
+}
+
+- (unsigned long long)fileSize {
+  __block unsigned long long fileSize;
+  dispatch_sync(_queue, ^{
+    fileSize = _fileLength;
+  });
+  return fileSize;
+}
+
+#pragma mark - Writing
+
+- (void)writeFields:(NSDictionary *)fields forDocumentWithKey:(METDocumentKey *)documentKey {
+  NSParameterAssert(documentKey);
+  
+  dispatch_async(_queue, ^{
+    if (!_fileHandle) {
+      return;
+    }
+    
+    METDocumentSnapshotRecordType recordType = fields ? METDocumentSnapshotRecordTypePut : METDocumentSnapshotRecordTypeRemove;
+    NSData *recordData = [self recordDataWithType:recordType documentKey:documentKey fields:fields];
+    if (!recordData) {
+      NSLog(@"Couldn't write document to snapshot: %@", documentKey);
+      return;
+    }
+    
+    // -writeData: raises on I/O errors (e.g. a full disk), in which case we stop persisting rather than crash
+    @try {
+      [_fileHandle writeData:recordData];
+    } @catch (NSException *exception) {
+      NSLog(@"Couldn't write to snapshot, disabling persistence: %@", exception);
+      [_fileHandle closeFile];
+      _fileHandle = nil;
+      return;
+    }
+    NSRange recordRange = NSMakeRange((NSUInteger)_fileLength, recordData.length);
+    _fileLength += recordData.length;
+    [self indexRecordWithType:recordType range:recordRange forDocumentKey:documentKey];
+    
+    [self compactIfNeeded];
+  });
+}
+
+- (void)synchronize {
+  dispatch_sync(_queue, ^{
+    [_fileHandle synchronizeFile];
+  });
+}
+
+#pragma mark - Compaction
+
+- (BOOL)compactWithError:(NSError **)error {
+  __block BOOL success;
+  __block NSError *compactionError;
+  dispatch_sync(_queue, ^{
+    success = [self compactOnQueueWithError:&compactionError];
+  });
+  if (!success && error) {
+    *error = compactionError;
+  }
+  return success;
+}
+
+- (void)compactIfNeeded {
+  if (_numberOfRecords < METDocumentSnapshotMinimumNumberOfRecordsForCompaction || _numberOfRecords < 2 * [self numberOfDocumentsOnQueue]) {
+    return;
+  }
+  
+  NSError *error;
+  if (![self compactOnQueueWithError:&error]) {
+    NSLog(@"Couldn't compact snapshot: %@", error);
+  }
+}
+
+- (BOOL)compactOnQueueWithError:(NSError **)error {
+  if (!_fileHandle) {
+    return YES;
+  }
+  
+  [_fileHandle synchronizeFile];
+  NSData *data = [NSData dataWithContentsOfURL:_URL options:NSDataReadingMappedIfSafe error:error];
+  if (!data) {
+    return NO;
+  }
+  
+  // Only the latest record for every document is kept, and records are copied without decoding them
+  NSMutableData *compactedData = [self headerData];
+  NSMutableDictionary *compactedRecordRangesByDocumentIDByCollectionName = [[NSMutableDictionary alloc] initWithCapacity:_recordRangesByDocumentIDByCollectionName.count];
+  [_recordRangesByDocumentIDByCollectionName enumerateKeysAndObjectsUsingBlock:^(NSString *collectionName, NSDictionary *recordRangesByDocumentID, BOOL *outerStop) {
+    NSMutableDictionary *compactedRecordRangesByDocumentID = [[NSMutableDictionary alloc] initWithCapacity:recordRangesByDocumentID.count];
+    [recordRangesByDocumentID enumerateKeysAndObjectsUsingBlock:^(id documentID, NSValue *recordRangeValue, BOOL *innerStop) {
+      NSRange recordRange = recordRangeValue.rangeValue;
+      compactedRecordRangesByDocumentID[documentID] = [NSValue valueWithRange:NSMakeRange(compactedData.length, recordRange.length)];
+      [compactedData appendBytes:(const uint8_t *)data.bytes + recordRange.location length:recordRange.length];
+    }];
+    compactedRecordRangesByDocumentIDByCollectionName[collectionName] = compactedRecordRangesByDocumentID;
+  }];
+  
+  if (![compactedData writeToURL:_URL options:NSDataWritingAtomic error:error]) {
+    return NO;
+  }
+  
+  NSFileHandle *fileHandle = [NSFileHandle fileHandleForWritingToURL:_URL error:error];
+  if (!fileHandle) {
+    return NO;
+  }
+  [fileHandle seekToEndOfFile];
+  
+  [_fileHandle closeFile];
+  _fileHandle = fileHandle;
+  _data = [NSData dataWithContentsOfURL:_URL options:NSDataReadingMappedIfSafe error:nil] ?: compactedData;
+  _fileLength = compactedData.length;
+  _recordRangesByDocumentIDByCollectionName = compactedRecordRangesByDocumentIDByCollectionName;
+  _numberOfRecords = [self numberOfDocumentsOnQueue];
+  return YES;
+}
+
+#pragma mark - Helper Methods
+
+- (NSMutableData *)headerData {
+  NSMutableData *data = [[NSMutableData alloc] initWithCapacity:METDocumentSnapshotHeaderLength];
+  [data appendBytes:METDocumentSnapshotMagic length:sizeof(METDocumentSnapshotMagic)];
+  METAppendUInt32(data, METDocumentSnapshotVersion);
+  return data;
+}
+
+- (BOOL)isValidHeaderInData:(NSData *)data {
+  if (data.length < METDocumentSnapshotHeaderLength) {
+    return NO;
+  }
+  
+  const uint8_t *bytes = data.bytes;
+  return memcmp(bytes, METDocumentSnapshotMagic, sizeof(METDocumentSnapshotMagic)) == 0 && METReadUInt32(bytes + sizeof(METDocumentSnapshotMagic)) == METDocumentSnapshotVersion;
+}
+
+- (NSUInteger)indexRecordsInData:(NSData *)data {
+  const uint8_t *bytes = data.bytes;
+  NSUInteger length = data.length;
+  NSUInteger offset = METDocumentSnapshotHeaderLength;
+  
+  // Only document keys are decoded while indexing, fields are left alone until they're needed
+  while (offset + METDocumentSnapshotRecordHeaderLength <= length) {
+    NSUInteger recordLength = sizeof(uint32_t) + METReadUInt32(bytes + offset);
+    if (recordLength < METDocumentSnapshotRecordHeaderLength || offset + recordLength > length) {
+      break;
+    }
+    
+    METDocumentSnapshotRecordType recordType = bytes[offset + sizeof(uint32_t)];
+    NSUInteger keyLength = METReadUInt32(bytes + offset + sizeof(uint32_t) + 1);
+    if (keyLength > recordLength - METDocumentSnapshotRecordHeaderLength) {
+      break;
+    }
+    
+    NSData *keyData = [NSData dataWithBytesNoCopy:(void *)(bytes + offset + METDocumentSnapshotRecordHeaderLength) length:keyLength freeWhenDone:NO];
+    METDocumentKey *documentKey = [self documentKeyFromData:keyData];
+    if (!documentKey) {
+      break;
+    }
+    
+    NSRange recordRange = NSMakeRange(offset, recordLength);
+    [self indexRecordWithType:recordType range:recordRange forDocumentKey:documentKey];
+    offset = NSMaxRange(recordRange);
+  }
+  
+  return offset;
+}
+
+- (void)indexRecordWithType:(METDocumentSnapshotRecordType)recordType range:(NSRange)recordRange forDocumentKey:(METDocumentKey *)documentKey {
+  NSString *collectionName = documentKey.collectionName;
+  NSMutableDictionary *recordRangesByDocumentID = _recordRangesByDocumentIDByCollectionName[collectionName];
+  
+  switch (recordType) {
+    case METDocumentSnapshotRecordTypePut:
+      if (!recordRangesByDocumentID) {
+        recordRangesByDocumentID = [[NSMutableDictionary alloc] init];
+        _recordRangesByDocumentIDByCollectionName[collectionName] = recordRangesByDocumentID;
+      }
+      recordRangesByDocumentID[documentKey.documentID] = [NSValue valueWithRange:recordRange];
+      break;
+    case METDocumentSnapshotRecordTypeRemove:
+      [recordRangesByDocumentID removeObjectForKey:documentKey.documentID];
+      if (recordRangesByDocumentID.count < 1) {
+        [_recordRangesByDocumentIDByCollectionName removeObjectForKey:collectionName];
+      }
+      break;
+  }
+  
+  _numberOfRecords++;
+}
+
+- (NSData *)recordDataWithType:(METDocumentSnapshotRecordType)recordType documentKey:(METDocumentKey *)documentKey fields:(NSDictionary *)fields {
+  id EJSONDocumentID = [METEJSONSerialization EJSONObjectFromObject:documentKey.documentID error:nil];
+  NSData *keyData = [NSJSONSerialization dataWithJSONObject:@[documentKey.collectionName, EJSONDocumentID] options:0 error:nil];
+  if (!keyData) {
+    return nil;
+  }
+  
+  NSData *fieldsData;
+  if (recordType == METDocumentSnapshotRecordTypePut) {
+    id EJSONFields = [METEJSONSerialization EJSONObjectFromObject:fields error:nil];
+    fieldsData = [NSJSONSerialization dataWithJSONObject:EJSONFields options:0 error:nil];
+    if (!fieldsData) {
+      return nil;
+    }
+  }
+  
+  NSMutableData *recordData = [[NSMutableData alloc] initWithCapacity:METDocumentSnapshotRecordHeaderLength + keyData.length + fieldsData.length];
+  METAppendUInt32(recordData, (uint32_t)(METDocumentSnapshotRecordHeaderLength - sizeof(uint32_t) + keyData.length + fieldsData.length));
+  [recordData appendBytes:&recordType length:sizeof(recordType)];
+  METAppendUInt32(recordData, (uint32_t)keyData.length);
+  [recordData appendData:keyData];
+  if (fieldsData) {
+    [recordData appendData:fieldsData];
+  }
+  return recordData;
+}
+
+- (METDocumentKey *)documentKeyFromData:(NSData *)keyData {
+  NSArray *key = [NSJSONSerialization JSONObjectWithData:keyData options:0 error:nil];
+  if (![key isKindOfClass:[NSArray class]] || key.count != 2 || ![key[0] isKindOfClass:[NSString class]]) {
+    return nil;
+  }
+  
+  id documentID = [METEJSONSerialization objectFromEJSONObject:key[1] error:nil];
+  if (!documentID) {
+    return nil;
+  }
+  
+  return [METDocumentKey keyWithCollectionName:key[0] documentID:documentID];
+}
+
+- (NSDictionary *)fieldsFromRecordWithRange:(NSRange)recordRange {
+  if (NSMaxRange(recordRange) > _data.length) {
+    return nil;
+  }
+  
+  const uint8_t *bytes = (const uint8_t *)_data.bytes + recordRange.location;
+  NSUInteger keyLength = METReadUInt32(bytes + sizeof(uint32_t) + 1);
+  NSUInteger fieldsOffset = METDocumentSnapshotRecordHeaderLength + keyLength;
+  NSData *fieldsData = [NSData dataWithBytesNoCopy:(void *)(bytes + fieldsOffset) length:recordRange.length - fieldsOffset freeWhenDone:NO];
+  
+  id EJSONFields = [NSJSONSerialization JSONObjectWithData:fieldsData options:0 error:nil];
+  if (![EJSONFields isKindOfClass:[NSDictionary class]]) {
+    return nil;
+  }
+  return [METEJSONSerialization objectFromEJSONObject:EJSONFields error:nil];
+}
+
+@end
@@ -22,9 +22,10 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
+// Values are bound per thread, so blocks performed concurrently on different threads don't see each other's values
 @interface METDynamicVariable : NSObject
 
-- (id)currentValue;
+- (nullable id)currentValue;
 - (void)performBlock:(void (^)())block withValue:(id)value;
 
 @end
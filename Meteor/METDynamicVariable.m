@@ -21,18 +21,27 @@
 #import "METDynamicVariable.h"
 
 @implementation METDynamicVariable {
-  id _currentValue;
+  NSString *_key;
+}
+
+- (instancetype)init {
+  self = [super init];
+  if (self) {
+    _key = [NSString stringWithFormat:@"com.meteor.DynamicVariable.%@", [[NSUUID UUID] UUIDString]];
+  }
+  return self;
 }
 
 - (id)currentValue {
-  return _currentValue;
+  return [NSThread currentThread].threadDictionary[_key];
 }
 
 - (void)performBlock:(void (^)())block withValue:(id)value {
-  id originalValue = _currentValue;
-  _currentValue = value;
+  NSMutableDictionary *threadDictionary = [NSThread currentThread].threadDictionary;
+  id originalValue = threadDictionary[_key];
+  threadDictionary[_key] = value;
   block();
-  _currentValue = originalValue;
+  threadDictionary[_key] = originalValue;
 }
 
 @end
@@ -0,0 +1,161 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#import "METHistogram.h"
+
+@implementation METHistogram {
+  NSUInteger *_bucketCounts;
+}
+
+- (instancetype)initWithBaseValue:(double)baseValue numberOfBuckets:(NSUInteger)numberOfBuckets {
+  NSParameterAssert(baseValue > 0);
+  NSParameterAssert(numberOfBuckets > 0);
+  
+  self = [super init];
+  if (self) {
+    _baseValue = baseValue;
+    _numberOfBuckets = numberOfBuckets;
+    _bucketCounts = calloc(numberOfBuckets, sizeof(NSUInteger));
+  }
+  return self;
+}
+
+- (void)dealloc {
+  free(_bucketCounts);
+}
+
+- (void)recordValue:(double)value {
+  @synchronized(self) {
+    _bucketCounts[[self bucketIndexForValue:value]]++;
+    
+    if (_count == 0 || value < _minimum) {
+      _minimum = value;
+    }
+    if (_count == 0 || value > _maximum) {
+      _maximum = value;
+    }
+    _count++;
+    _sum += value;
+  }
+}
+
+- (void)reset {
+  @synchronized(self) {
+    memset(_bucketCounts, 0, _numberOfBuckets * sizeof(NSUInteger));
+    _count = 0;
+    _sum = 0;
+    _minimum = 0;
+    _maximum = 0;
+  }
+}
+
+- (NSUInteger)count {
+  @synchronized(self) {
+    return _count;
+  }
+}
+
+- (double)sum {
+  @synchronized(self) {
+    return _sum;
+  }
+}
+
+- (double)minimum {
+  @synchronized(self) {
+    return _minimum;
+  }
+}
+
+- (double)maximum {
+  @synchronized(self) {
+    return _maximum;
+  }
+}
+
+- (double)mean {
+  @synchronized(self) {
+    return _count > 0 ? _sum / _count : 0;
+  }
+}
+
+- (NSUInteger)countForBucketAtIndex:(NSUInteger)index {
+  NSParameterAssert(index < _numberOfBuckets);
+  
+  @synchronized(self) {
+    return _bucketCounts[index];
+  }
+}
+
+- (double)upperBoundForBucketAtIndex:(NSUInteger)index {
+  NSParameterAssert(index < _numberOfBuckets);
+  
+  // The last bucket also contains all values that exceed its nominal upper bound
+  if (index == _numberOfBuckets - 1) {
+    return DBL_MAX;
+  }
+  return ldexp(_baseValue, (int)index);
+}
+
+- (double)valueAtPercentile:(double)percentile {
+  NSParameterAssert(percentile >= 0 && percentile <= 100);
+  
+  @synchronized(self) {
+    if (_count == 0) {
+      return 0;
+    }
+    
+    NSUInteger rank = (NSUInteger)ceil(percentile / 100 * _count);
+    NSUInteger cumulativeCount = 0;
+    for (NSUInteger index = 0; index < _numberOfBuckets; index++) {
+      cumulativeCount += _bucketCounts[index];
+      if (cumulativeCount >= rank && cumulativeCount > 0) {
+        // Reporting the upper bound of a bucket could exceed the largest value we've actually seen
+        return fmin([self upperBoundForBucketAtIndex:index], _maximum);
+      }
+    }
+    return _maximum;
+  }
+}
+
+#pragma mark - Helper Methods
+
+- (NSUInteger)bucketIndexForValue:(double)value {
+  // Bucket 0 contains values up to the base value, and every following bucket doubles the upper bound of the previous one
+  if (value <= _baseValue) {
+    return 0;
+  }
+  
+  double index = ceil(log2(value / _baseValue));
+  if (index >= _numberOfBuckets - 1) {
+    return _numberOfBuckets - 1;
+  }
+  return (NSUInteger)index;
+}
+
+#pragma mark - NSObject
+
+- (NSString *)description {
+  @synchronized(self) {
+    return [NSString stringWithFormat:@"<METHistogram, count: %lu, mean: %f, minimum: %f, maximum: %f>", (unsigned long)_count, self.mean, _minimum, _maximum];
+  }
+}
+
+@end
@@ -39,6 +39,9 @@ extern NSString * const METIncrementalStoreObjectsDidChangeNotification;
 - (NSManagedObjectID *)objectIDForDocumentKey:(METDocumentKey *)documentKey;
 - (METDocumentKey *)documentKeyForObjectID:(NSManagedObjectID *)objectID;
 
+// Nodes are recreated from the client's database when needed again
+- (void)removeCachedNodes;
+
 @end
 
 NS_ASSUME_NONNULL_END
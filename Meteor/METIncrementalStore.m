@@ -557,6 +557,24 @@ NSString * const METIncrementalStoreObjectsDidChangeNotification = @"METIncremen
     }
   }];
   
+  // Collections that have been loaded in bulk don't report individual document changes, so all of their documents are reported as inserted, and objects they could have relationships with as updated
+  for (NSString *collectionName in [databaseChanges loadedCollectionNames]) {
+    NSEntityDescription *entity = [self entityForCollectionName:collectionName];
+    if (!entity) {
+      continue;
+    }
+    
+    for (METDocument *document in [self documentsForEntity:entity]) {
+      [insertedObjects addObject:[self objectIDForDocument:document]];
+    }
+    
+    for (NSRelationshipDescription *relationship in [entity.relationshipsByName allValues]) {
+      for (METDocument *document in [self documentsForEntity:relationship.destinationEntity]) {
+        [updatedObjects addObject:[self objectIDForDocument:document]];
+      }
+    }
+  }
+  
   // Inserted or deleted objects should not also be reported as updated
   [updatedObjects minusSet:insertedObjects];
   [updatedObjects minusSet:deletedObjects];
@@ -580,6 +598,10 @@ NSString * const METIncrementalStoreObjectsDidChangeNotification = @"METIncremen
   return node;
 }
 
+- (void)removeCachedNodes {
+  [_nodesByObjectID removeAllObjects];
+}
+
 - (NSUInteger)numberOfCachedNodes {
   return _nodesByObjectID.count;
 }
@@ -22,6 +22,7 @@
 #import "METMethodInvocation_Internal.h"
 
 #import "METMethodInvocationCoordinator.h"
+#import "METMethodInvocationScheduler.h"
 #import "METDDPClient.h"
 #import "METDDPClient_Internal.h"
 
@@ -65,6 +66,8 @@
   _finished = YES;
   [self didChangeValueForKey:@"isExecuting"];
   [self didChangeValueForKey:@"isFinished"];
+  
+  [_scheduler methodInvocationDidFinish:self];
 }
 
 
@@ -73,6 +76,7 @@
     [self willChangeValueForKey:@"isFinished"];
     _finished = YES;
     [self didChangeValueForKey:@"isFinished"];
+    [_scheduler methodInvocationDidFinish:self];
     return;
   }
   
@@ -139,6 +143,7 @@
   copy.parameters = _parameters;
   copy.randomSeed = _randomSeed;
   copy.barrier = _barrier;
+  copy.queuePriority = self.queuePriority;
   copy.receivedResultHandler = _receivedResultHandler;
   copy.completionHandler = _completionHandler;
   return copy;
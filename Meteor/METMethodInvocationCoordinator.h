@@ -25,6 +25,8 @@
 @class METMethodInvocation;
 @class METDocumentKey;
 @class METDataUpdate;
+@class METMethodInvocationLog;
+@class METHistogram;
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -41,10 +43,24 @@ NS_ASSUME_NONNULL_BEGIN
 
 @property(strong, nonatomic, readonly) METMethodInvocationContext *currentMethodInvocationContext;
 
+- (void)performMethodInvocationsInBatch:(void (^)())block completionHandler:(nullable METMethodBatchCompletionHandler)completionHandler;
+
 @property (getter=isSuspended) BOOL suspended;
 
+@property (assign, nonatomic) NSUInteger maximumNumberOfExecutingMethodInvocations;
+- (void)setMaximumNumberOfExecutingMethodInvocations:(NSUInteger)maximumNumberOfExecutingMethodInvocations forMethodWithName:(NSString *)methodName;
+- (void)setPriority:(NSOperationQueuePriority)priority forMethodWithName:(NSString *)methodName;
+- (METHistogram *)queueWaitTimeHistogramForPriority:(NSOperationQueuePriority)priority;
+
 - (void)addMethodInvocation:(METMethodInvocation *)methodInvocation;
 
+- (METMethodInvocation *)holdMethodInvocationWithName:(NSString *)methodName parameters:(NSArray *)parameters completionHandler:(nullable METMethodCompletionHandler)completionHandler resultFromStub:(id __nullable * __nullable)resultFromStub;
+- (BOOL)amendHeldMethodInvocation:(METMethodInvocation *)methodInvocation withParameters:(NSArray *)parameters stubParameters:(NSArray *)stubParameters completionHandler:(nullable METMethodCompletionHandler)completionHandler resultFromStub:(id __nullable * __nullable)resultFromStub;
+- (void)releaseHeldMethodInvocation:(METMethodInvocation *)methodInvocation;
+
+@property (nullable, strong, nonatomic, readonly) METMethodInvocationLog *methodInvocationLog;
+- (void)replayMethodInvocationsFromLog:(METMethodInvocationLog *)methodInvocationLog;
+
 - (void)didReceiveResult:(id)result error:(NSError *)error forMethodID:(NSString *)methodID;
 - (void)didReceiveUpdatesDoneForMethodID:(NSString *)methodID;
 
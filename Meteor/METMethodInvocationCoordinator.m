@@ -26,6 +26,8 @@
 #import "METMethodInvocation.h"
 #import "METMethodInvocation_Internal.h"
 #import "METMethodInvocationContext.h"
+#import "METMethodInvocationLog.h"
+#import "METRandomStream.h"
 #import "METRandomValueGenerator.h"
 #import "METDatabase.h"
 #import "METDatabase_Internal.h"
@@ -34,9 +36,12 @@
 #import "METDocumentChangeDetails.h"
 #import "METDocumentKey.h"
 #import "METBufferedDocument.h"
+#import "METMethodInvocationScheduler.h"
 #import "METDataUpdate.h"
 #import "NSDictionary+METAdditions.h"
+#import "NSObject+METAdditions.h"
 #import "METDynamicVariable.h"
+#import "METHistogram.h"
 
 @interface METMethodInvocationCoordinator ()
 
@@ -45,9 +50,28 @@
 @implementation METMethodInvocationCoordinator {
   NSMutableDictionary *_methodStubsByName;
   METDynamicVariable *_methodInvocationContextDynamicVariable;
-  NSOperationQueue *_operationQueue;
+  METDynamicVariable *_batchDynamicVariable;
+  METMethodInvocationScheduler *_scheduler;
+  
+  // Scheduling configuration is kept here because a new scheduler is created after every reset
+  NSUInteger _maximumNumberOfExecutingMethodInvocations;
+  NSMutableDictionary *_maximumNumberOfExecutingMethodInvocationsByMethodName;
+  NSMutableDictionary *_prioritiesByMethodName;
+  NSDictionary *_queueWaitTimeHistogramsByPriority;
+  
   NSMutableDictionary *_methodInvocationsByMethodID;
+  // In the order they were held, because they have to be sent in that order
+  NSMutableArray *_heldMethodInvocations;
+  // Method invocations that are added during a reset go to the front of the queue, so they don't release held ones
+  BOOL _resetting;
   NSMutableDictionary *_bufferedDocumentsByKey;
+  
+  // Buffered documents are flushed out of order, but only removed from this list once they reach
+  // the front, so the front always has the lowest epoch of all documents that are still buffered
+  uint64_t _nextBufferingEpoch;
+  NSMutableArray *_bufferedDocumentsInEpochOrder;
+  NSMutableArray *_blocksWaitingUntilFlushed;
+  NSMutableArray *_epochsOfBlocksWaitingUntilFlushed;
 }
 
 - (instancetype)initWithClient:(METDDPClient *)client {
@@ -57,10 +81,23 @@
     
     _methodStubsByName = [[NSMutableDictionary alloc] init];
     _methodInvocationContextDynamicVariable = [[METDynamicVariable alloc] init];
-    _operationQueue = [[NSOperationQueue alloc] init];
-    _operationQueue.suspended = YES;
+    _batchDynamicVariable = [[METDynamicVariable alloc] init];
+    
+    _maximumNumberOfExecutingMethodInvocationsByMethodName = [[NSMutableDictionary alloc] init];
+    _prioritiesByMethodName = [[NSMutableDictionary alloc] init];
+    NSMutableDictionary *queueWaitTimeHistogramsByPriority = [[NSMutableDictionary alloc] init];
+    for (NSNumber *priority in @[@(NSOperationQueuePriorityVeryLow), @(NSOperationQueuePriorityLow), @(NSOperationQueuePriorityNormal), @(NSOperationQueuePriorityHigh), @(NSOperationQueuePriorityVeryHigh)]) {
+      queueWaitTimeHistogramsByPriority[priority] = [[METHistogram alloc] initWithBaseValue:0.001 numberOfBuckets:24];
+    }
+    _queueWaitTimeHistogramsByPriority = queueWaitTimeHistogramsByPriority;
+    
+    _scheduler = [self newScheduler];
     _methodInvocationsByMethodID = [[NSMutableDictionary alloc] init];
+    _heldMethodInvocations = [[NSMutableArray alloc] init];
     _bufferedDocumentsByKey = [[NSMutableDictionary alloc] init];
+    _bufferedDocumentsInEpochOrder = [[NSMutableArray alloc] init];
+    _blocksWaitingUntilFlushed = [[NSMutableArray alloc] init];
+    _epochsOfBlocksWaitingUntilFlushed = [[NSMutableArray alloc] init];
   }
   return self;
 }
@@ -71,52 +108,264 @@
   }
 }
 
-- (id)callMethodWithName:(NSString *)methodName parameters:(NSArray *)parameters options:(METMethodCallOptions)options receivedResultHandler:(METMethodCompletionHandler)receivedResultHandler completionHandler:(METMethodCompletionHandler)completionHandler {
+- (METMethodStub)stubForMethodWithName:(NSString *)methodName {
   @synchronized(self) {
-    METMethodInvocationContext *enclosingMethodInvocationContext = [_methodInvocationContextDynamicVariable currentValue];
-    BOOL alreadyInSimulation = enclosingMethodInvocationContext != nil;
+    return _methodStubsByName[methodName];
+  }
+}
+
+// Stubs are not performed while holding the coordinator lock, so calls from different threads can simulate concurrently
+- (id)callMethodWithName:(NSString *)methodName parameters:(NSArray *)parameters options:(METMethodCallOptions)options receivedResultHandler:(METMethodCompletionHandler)receivedResultHandler completionHandler:(METMethodCompletionHandler)completionHandler {
+  // Method invocation contexts are bound per thread
+  METMethodInvocationContext *enclosingMethodInvocationContext = [_methodInvocationContextDynamicVariable currentValue];
+  BOOL alreadyInSimulation = enclosingMethodInvocationContext != nil;
+  
+  METMethodStub stub = [self stubForMethodWithName:methodName];
+  __block id resultFromStub;
+  
+  if (!alreadyInSimulation) {
+    METMethodInvocation *methodInvocation = [self newMethodInvocationWithName:methodName parameters:parameters options:options];
+    methodInvocation.receivedResultHandler = receivedResultHandler;
+    methodInvocation.completionHandler = completionHandler;
     
-    METMethodStub stub = _methodStubsByName[methodName];
-    __block id resultFromStub;
+    // Barrier invocations are used for logging in and out, which shouldn't be repeated after a restart
+    BOOL appendToLog = !methodInvocation.barrier;
     
-    if (!alreadyInSimulation) {
-      METMethodInvocation *methodInvocation = [[METMethodInvocation alloc] init];
-      methodInvocation.client = _client;
-      methodInvocation.methodName = methodName;
-      methodInvocation.parameters = parameters;
-      // Setting NSOperation name can be useful for debug purposes
-      methodInvocation.name = parameters ? [NSString stringWithFormat:@"%@(%@)", methodName, parameters] : methodName;
-      methodInvocation.barrier = options & METMethodCallOptionsBarrier;
-      methodInvocation.receivedResultHandler = receivedResultHandler;
-      methodInvocation.completionHandler = completionHandler;
-      
+    if (stub) {
+      METMethodInvocationContext *methodInvocationContext = [[METMethodInvocationContext alloc] initWithMethodName:methodName enclosingMethodInvocationContext:nil];
+      resultFromStub = [self performStub:stub forMethodInvocation:methodInvocation withMethodInvocationContext:methodInvocationContext appendingToLog:appendToLog];
+    } else {
+      [self addMethodInvocation:methodInvocation appendingToLog:appendToLog];
+    }
+  } else if (stub) {
+    METMethodInvocationContext *methodInvocationContext = [[METMethodInvocationContext alloc] initWithMethodName:methodName enclosingMethodInvocationContext:enclosingMethodInvocationContext];
+    
+    [_methodInvocationContextDynamicVariable performBlock:^{
+      resultFromStub = stub(parameters);
+    } withValue:methodInvocationContext];
+  }
+  
+  if (alreadyInSimulation || (options & METMethodCallOptionsReturnStubValue)) {
+    return resultFromStub;
+  } else {
+    return nil;
+  }
+}
+
+- (METMethodInvocation *)newMethodInvocationWithName:(NSString *)methodName parameters:(NSArray *)parameters options:(METMethodCallOptions)options {
+  METMethodInvocation *methodInvocation = [[METMethodInvocation alloc] init];
+  methodInvocation.client = _client;
+  methodInvocation.methodName = methodName;
+  methodInvocation.parameters = parameters;
+  // Setting NSOperation name can be useful for debug purposes
+  methodInvocation.name = parameters ? [NSString stringWithFormat:@"%@(%@)", methodName, parameters] : methodName;
+  methodInvocation.barrier = options & METMethodCallOptionsBarrier;
+  methodInvocation.queuePriority = [self priorityForMethodWithName:methodName];
+  return methodInvocation;
+}
+
+#pragma mark - Holding Method Invocations
+
+// A held method invocation has its stub performed and its changes buffered like any other, but it isn't
+// scheduled or logged until it is released, so its parameters can still be amended. It is released early
+// when another method invocation is scheduled, because that one has to be sent after it.
+- (METMethodInvocation *)holdMethodInvocationWithName:(NSString *)methodName parameters:(NSArray *)parameters completionHandler:(METMethodCompletionHandler)completionHandler resultFromStub:(id *)resultFromStub {
+  METMethodInvocation *methodInvocation = [self newMethodInvocationWithName:methodName parameters:parameters options:0];
+  methodInvocation.completionHandler = completionHandler;
+  
+  METMethodStub stub = [self stubForMethodWithName:methodName];
+  if (stub) {
+    METMethodInvocationContext *methodInvocationContext = [[METMethodInvocationContext alloc] initWithMethodName:methodName enclosingMethodInvocationContext:nil];
+    id result = [self performStub:stub forMethodInvocation:methodInvocation withMethodInvocationContext:methodInvocationContext appendingToLog:NO holding:YES];
+    if (resultFromStub) {
+      *resultFromStub = result;
+    }
+  } else {
+    @synchronized(self) {
+      [self registerMethodInvocation:methodInvocation appendingToLog:NO];
+      [_heldMethodInvocations addObject:methodInvocation];
+    }
+  }
+  
+  return methodInvocation;
+}
+
+// Performs the stub with stubParameters and folds its changes into the held method invocation, which will
+// be sent with the new parameters. Returns NO if the method invocation has been released in the meantime,
+// in which case a separate method invocation with stubParameters is added instead.
+- (BOOL)amendHeldMethodInvocation:(METMethodInvocation *)methodInvocation withParameters:(NSArray *)parameters stubParameters:(NSArray *)stubParameters completionHandler:(METMethodCompletionHandler)completionHandler resultFromStub:(id *)resultFromStub {
+  NSString *methodName = methodInvocation.methodName;
+  METMethodStub stub = [self stubForMethodWithName:methodName];
+  METMethodInvocationContext *methodInvocationContext = [[METMethodInvocationContext alloc] initWithMethodName:methodName enclosingMethodInvocationContext:nil];
+  __block id result;
+  __block BOOL amended = NO;
+  
+  [_methodInvocationContextDynamicVariable performBlock:^{
+    [_client.database performUpdatesAndReturnChanges:^{
       if (stub) {
-        METMethodInvocationContext *methodInvocationContext = [[METMethodInvocationContext alloc] initWithMethodName:methodName enclosingMethodInvocationContext:nil];
-        
-        [_methodInvocationContextDynamicVariable performBlock:^{
-          METDatabaseChanges *changesPerformedByStub = [_client.database performUpdatesAndReturnChanges:^{
-            NSArray *deepCopyOfParameters = [NSKeyedUnarchiver unarchiveObjectWithData:[NSKeyedArchiver archivedDataWithRootObject:parameters]];
-            resultFromStub = stub(deepCopyOfParameters);
-          }];
-          methodInvocation.changesPerformedByStub = changesPerformedByStub;
-        } withValue:methodInvocationContext];
-        
-        methodInvocation.randomSeed = methodInvocationContext.randomSeed;
+        result = stub([stubParameters deepImmutableCopy]);
+      }
+    } whenCommitted:^(METDatabaseChanges *changes) {
+      @synchronized(self) {
+        if ([_heldMethodInvocations indexOfObjectIdenticalTo:methodInvocation] != NSNotFound) {
+          METDatabaseChanges *combinedChanges = [[METDatabaseChanges alloc] init];
+          if (methodInvocation.changesPerformedByStub) {
+            [combinedChanges addDatabaseChanges:methodInvocation.changesPerformedByStub];
+          }
+          [combinedChanges addDatabaseChanges:changes];
+          methodInvocation.changesPerformedByStub = combinedChanges;
+          methodInvocation.parameters = parameters;
+          methodInvocation.name = [NSString stringWithFormat:@"%@(%@)", methodName, parameters];
+          [self bufferChangesPerformedByStub:changes forMethodInvocation:methodInvocation];
+          amended = YES;
+        } else {
+          METMethodInvocation *separateMethodInvocation = [self newMethodInvocationWithName:methodName parameters:stubParameters options:0];
+          separateMethodInvocation.completionHandler = completionHandler;
+          separateMethodInvocation.changesPerformedByStub = changes;
+          [self addMethodInvocation:separateMethodInvocation appendingToLog:YES];
+        }
+      }
+    }];
+  } withValue:methodInvocationContext];
+  
+  if (resultFromStub) {
+    *resultFromStub = result;
+  }
+  return amended;
+}
+
+- (void)releaseHeldMethodInvocation:(METMethodInvocation *)methodInvocation {
+  @synchronized(self) {
+    NSUInteger index = [_heldMethodInvocations indexOfObjectIdenticalTo:methodInvocation];
+    if (index == NSNotFound) return;
+    
+    // Earlier held method invocations have to be sent first
+    for (METMethodInvocation *heldMethodInvocation in [_heldMethodInvocations subarrayWithRange:NSMakeRange(0, index + 1)]) {
+      [_methodInvocationLog appendMethodInvocation:heldMethodInvocation];
+      [_scheduler addMethodInvocation:heldMethodInvocation];
+    }
+    [_heldMethodInvocations removeObjectsInRange:NSMakeRange(0, index + 1)];
+  }
+}
+
+- (void)releaseAllHeldMethodInvocations {
+  if (_heldMethodInvocations.count < 1) return;
+  [self releaseHeldMethodInvocation:_heldMethodInvocations.lastObject];
+}
+
+- (id)performStub:(METMethodStub)stub forMethodInvocation:(METMethodInvocation *)methodInvocation withMethodInvocationContext:(METMethodInvocationContext *)methodInvocationContext appendingToLog:(BOOL)appendToLog {
+  return [self performStub:stub forMethodInvocation:methodInvocation withMethodInvocationContext:methodInvocationContext appendingToLog:appendToLog holding:NO];
+}
+
+// Performs the stub in a database transaction and adds or holds the method invocation once the changes have been committed
+- (id)performStub:(METMethodStub)stub forMethodInvocation:(METMethodInvocation *)methodInvocation withMethodInvocationContext:(METMethodInvocationContext *)methodInvocationContext appendingToLog:(BOOL)appendToLog holding:(BOOL)hold {
+  __block id resultFromStub;
+  id parameters = methodInvocation.parameters;
+  
+  [_methodInvocationContextDynamicVariable performBlock:^{
+    [_client.database performUpdatesAndReturnChanges:^{
+      // The transaction may be retried after a conflict, so make sure it generates the same random values
+      NSString *randomSeed = methodInvocationContext.randomSeed;
+      if (randomSeed) {
+        methodInvocationContext.randomStream = [[METRandomStream alloc] initWithSeeds:@[randomSeed]];
       }
       
-      [self addMethodInvocation:methodInvocation];
-    } else if (stub) {
-      METMethodInvocationContext *methodInvocationContext = [[METMethodInvocationContext alloc] initWithMethodName:methodName enclosingMethodInvocationContext:enclosingMethodInvocationContext];
-      
-      [_methodInvocationContextDynamicVariable performBlock:^{
-        resultFromStub = stub(parameters);
-      } withValue:methodInvocationContext];
+      // Stubs get their own copy of the parameters, so they can't affect what will be sent to the server
+      resultFromStub = stub([parameters deepImmutableCopy]);
+    } whenCommitted:^(METDatabaseChanges *changes) {
+      // Adding the method invocation before other transactions can commit keeps buffered documents consistent
+      methodInvocation.changesPerformedByStub = changes;
+      methodInvocation.randomSeed = methodInvocationContext.randomSeed;
+      if (hold) {
+        // Held under the same lock its changes are buffered with, so no other method invocation can be scheduled in between
+        @synchronized(self) {
+          [self registerMethodInvocation:methodInvocation appendingToLog:appendToLog];
+          [_heldMethodInvocations addObject:methodInvocation];
+        }
+      } else {
+        [self addMethodInvocation:methodInvocation appendingToLog:appendToLog];
+      }
+    }];
+  } withValue:methodInvocationContext];
+  
+  return resultFromStub;
+}
+
+// The whole batch runs in a single database update, so stubs commit without posting their own notifications.
+// Method invocations are registered as their stubs commit, but only handed to the scheduler at the end.
+- (void)performMethodInvocationsInBatch:(void (^)())block completionHandler:(METMethodBatchCompletionHandler)completionHandler {
+  NSMutableArray *methodInvocations = [[NSMutableArray alloc] init];
+  
+  [_client.database performUpdates:^{
+    [_batchDynamicVariable performBlock:block withValue:methodInvocations];
+    
+    if (completionHandler) {
+      [self performBlock:completionHandler afterMethodInvocationsHaveCompleted:methodInvocations];
     }
     
-    if (alreadyInSimulation || (options & METMethodCallOptionsReturnStubValue)) {
-      return resultFromStub;
+    // Nested batches are scheduled as part of the enclosing batch
+    NSMutableArray *enclosingBatch = [_batchDynamicVariable currentValue];
+    @synchronized(self) {
+      if (enclosingBatch) {
+        [enclosingBatch addObjectsFromArray:methodInvocations];
+      } else {
+        if (!_resetting) {
+          [self releaseAllHeldMethodInvocations];
+        }
+        [_scheduler addMethodInvocations:methodInvocations];
+      }
+    }
+  }];
+}
+
+- (void)performBlock:(METMethodBatchCompletionHandler)block afterMethodInvocationsHaveCompleted:(NSArray *)methodInvocations {
+  dispatch_group_t group = dispatch_group_create();
+  __block NSError *firstError;
+  
+  for (METMethodInvocation *methodInvocation in methodInvocations) {
+    dispatch_group_enter(group);
+    METMethodCompletionHandler completionHandler = methodInvocation.completionHandler;
+    methodInvocation.completionHandler = ^(id result, NSError *error) {
+      if (completionHandler) {
+        completionHandler(result, error);
+      }
+      @synchronized(group) {
+        if (error && !firstError) {
+          firstError = error;
+        }
+      }
+      dispatch_group_leave(group);
+    };
+  }
+  
+  dispatch_group_notify(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+    block(firstError);
+  });
+}
+
+- (void)replayMethodInvocationsFromLog:(METMethodInvocationLog *)methodInvocationLog {
+  NSParameterAssert(methodInvocationLog);
+  
+  @synchronized(self) {
+    _methodInvocationLog = methodInvocationLog;
+  }
+  
+  for (METMethodInvocation *methodInvocation in [methodInvocationLog pendingMethodInvocations]) {
+    methodInvocation.client = _client;
+    methodInvocation.queuePriority = [self priorityForMethodWithName:methodInvocation.methodName];
+    methodInvocation.name = methodInvocation.parameters ? [NSString stringWithFormat:@"%@(%@)", methodInvocation.methodName, methodInvocation.parameters] : methodInvocation.methodName;
+    
+    // Running the stub again with the original random seed restores its local effects, including the IDs of inserted documents
+    METMethodStub stub = [self stubForMethodWithName:methodInvocation.methodName];
+    if (stub) {
+      METMethodInvocationContext *methodInvocationContext = [[METMethodInvocationContext alloc] initWithMethodName:methodInvocation.methodName enclosingMethodInvocationContext:nil];
+      NSString *randomSeed = methodInvocation.randomSeed;
+      if (randomSeed) {
+        methodInvocationContext.randomSeed = randomSeed;
+      }
+      [self performStub:stub forMethodInvocation:methodInvocation withMethodInvocationContext:methodInvocationContext appendingToLog:NO];
     } else {
-      return nil;
+      [self addMethodInvocation:methodInvocation];
     }
   }
 }
@@ -125,56 +374,128 @@
   return _methodInvocationContextDynamicVariable.currentValue;
 }
 
+- (METMethodInvocationScheduler *)newScheduler {
+  __weak METMethodInvocationCoordinator *weakSelf = self;
+  METMethodInvocationScheduler *scheduler = [[METMethodInvocationScheduler alloc] initWithFinishedHandler:^(METMethodInvocation *methodInvocation) {
+    [weakSelf methodInvocationDidFinish:methodInvocation];
+  }];
+  
+  @synchronized(self) {
+    scheduler.maximumNumberOfExecutingMethodInvocations = _maximumNumberOfExecutingMethodInvocations;
+    [_maximumNumberOfExecutingMethodInvocationsByMethodName enumerateKeysAndObjectsUsingBlock:^(NSString *methodName, NSNumber *maximumNumberOfExecutingMethodInvocations, BOOL *stop) {
+      [scheduler setMaximumNumberOfExecutingMethodInvocations:maximumNumberOfExecutingMethodInvocations.unsignedIntegerValue forMethodWithName:methodName];
+    }];
+    [_queueWaitTimeHistogramsByPriority enumerateKeysAndObjectsUsingBlock:^(NSNumber *priority, METHistogram *histogram, BOOL *stop) {
+      [scheduler setQueueWaitTimeHistogram:histogram forPriority:priority.integerValue];
+    }];
+  }
+  
+  return scheduler;
+}
+
+- (NSUInteger)maximumNumberOfExecutingMethodInvocations {
+  @synchronized(self) {
+    return _maximumNumberOfExecutingMethodInvocations;
+  }
+}
+
+- (void)setMaximumNumberOfExecutingMethodInvocations:(NSUInteger)maximumNumberOfExecutingMethodInvocations {
+  @synchronized(self) {
+    _maximumNumberOfExecutingMethodInvocations = maximumNumberOfExecutingMethodInvocations;
+    _scheduler.maximumNumberOfExecutingMethodInvocations = maximumNumberOfExecutingMethodInvocations;
+  }
+}
+
+- (void)setMaximumNumberOfExecutingMethodInvocations:(NSUInteger)maximumNumberOfExecutingMethodInvocations forMethodWithName:(NSString *)methodName {
+  @synchronized(self) {
+    _maximumNumberOfExecutingMethodInvocationsByMethodName[methodName] = @(maximumNumberOfExecutingMethodInvocations);
+    [_scheduler setMaximumNumberOfExecutingMethodInvocations:maximumNumberOfExecutingMethodInvocations forMethodWithName:methodName];
+  }
+}
+
+- (void)setPriority:(NSOperationQueuePriority)priority forMethodWithName:(NSString *)methodName {
+  @synchronized(self) {
+    _prioritiesByMethodName[methodName] = @(priority);
+  }
+}
+
+- (NSOperationQueuePriority)priorityForMethodWithName:(NSString *)methodName {
+  @synchronized(self) {
+    return [_prioritiesByMethodName[methodName] integerValue];
+  }
+}
+
+- (METHistogram *)queueWaitTimeHistogramForPriority:(NSOperationQueuePriority)priority {
+  return _queueWaitTimeHistogramsByPriority[@(priority)];
+}
+
 - (BOOL)isSuspended {
-  return _operationQueue.isSuspended;
+  return _scheduler.isSuspended;
 }
 
 - (void)setSuspended:(BOOL)suspended {
-  _operationQueue.suspended = suspended;
+  _scheduler.suspended = suspended;
 }
 
 - (void)addMethodInvocation:(METMethodInvocation *)methodInvocation {
-  NSAssert(methodInvocation.queuePriority == NSOperationQueuePriorityNormal, @"Operation priorities not supported due to implementation of barrier semantics");
+  [self addMethodInvocation:methodInvocation appendingToLog:NO];
+}
+
+// The log record has to be written before the method invocation can be sent, or a fast result could try to remove it first
+- (void)addMethodInvocation:(METMethodInvocation *)methodInvocation appendingToLog:(BOOL)appendToLog {
+  NSMutableArray *batch = [_batchDynamicVariable currentValue];
   
   @synchronized(self) {
-    NSString *methodID = methodInvocation.methodID;
-    if (!methodID) {
-      methodID = [[METRandomValueGenerator defaultRandomValueGenerator] randomIdentifier];
-      methodInvocation.methodID = methodID;
-    }
-    
-    _methodInvocationsByMethodID[methodID] = methodInvocation;
-    
-    NSOperationQueue *operationQueue = _operationQueue;
-    methodInvocation.completionBlock = ^{
-      // Make sure there hasn't been a reset
-      if (_operationQueue == operationQueue) {
-        [_methodInvocationsByMethodID removeObjectForKey:methodID];
-      }
-    };
+    [self registerMethodInvocation:methodInvocation appendingToLog:appendToLog];
     
-    for (METMethodInvocation *otherMethodInvocation in _operationQueue.operations.reverseObjectEnumerator) {
-      if (otherMethodInvocation.barrier) {
-        [methodInvocation addDependency:otherMethodInvocation];
-        break;
-      }
-      if (methodInvocation.barrier) {
-        [methodInvocation addDependency:otherMethodInvocation];
+    if (batch) {
+      [batch addObject:methodInvocation];
+    } else {
+      if (!_resetting) {
+        [self releaseAllHeldMethodInvocations];
       }
+      [_scheduler addMethodInvocation:methodInvocation];
+    }
+  }
+}
+
+- (void)registerMethodInvocation:(METMethodInvocation *)methodInvocation appendingToLog:(BOOL)appendToLog {
+  NSString *methodID = methodInvocation.methodID;
+  if (!methodID) {
+    methodID = [[METRandomValueGenerator defaultRandomValueGenerator] randomIdentifier];
+    methodInvocation.methodID = methodID;
+  }
+  
+  _methodInvocationsByMethodID[methodID] = methodInvocation;
+  
+  if (appendToLog) {
+    [_methodInvocationLog appendMethodInvocation:methodInvocation];
+  }
+  
+  [self bufferChangesPerformedByStub:methodInvocation.changesPerformedByStub forMethodInvocation:methodInvocation];
+}
+
+- (void)bufferChangesPerformedByStub:(METDatabaseChanges *)changes forMethodInvocation:(METMethodInvocation *)methodInvocation {
+  [changes enumerateDocumentChangeDetailsUsingBlock:^(METDocumentChangeDetails *documentChangeDetails, BOOL *stop) {
+    METDocumentKey *documentKey = documentChangeDetails.documentKey;
+    METBufferedDocument *bufferedDocument = _bufferedDocumentsByKey[documentKey];
+    if (!bufferedDocument) {
+      bufferedDocument = [[METBufferedDocument alloc] initWithDocumentKey:documentKey fields:documentChangeDetails.fieldsBeforeChanges];
+      bufferedDocument.epoch = _nextBufferingEpoch++;
+      _bufferedDocumentsByKey[documentKey] = bufferedDocument;
+      [_bufferedDocumentsInEpochOrder addObject:bufferedDocument];
+      [_client.database didBufferUnconfirmedChangesToDocumentWithKey:documentKey];
+    }
+    [bufferedDocument addMethodInvocation:methodInvocation withChangesPerformedByStub:documentChangeDetails];
+  }];
+}
+
+- (void)methodInvocationDidFinish:(METMethodInvocation *)methodInvocation {
+  @synchronized(self) {
+    // Make sure this is still the same invocation, because a copy may have been added after a reset
+    if (_methodInvocationsByMethodID[methodInvocation.methodID] == methodInvocation) {
+      [_methodInvocationsByMethodID removeObjectForKey:methodInvocation.methodID];
     }
-    
-    [methodInvocation.changesPerformedByStub enumerateDocumentChangeDetailsUsingBlock:^(METDocumentChangeDetails *documentChangeDetails, BOOL *stop) {
-      METDocumentKey *documentKey = documentChangeDetails.documentKey;
-      METBufferedDocument *bufferedDocument = _bufferedDocumentsByKey[documentKey];
-      if (!bufferedDocument) {
-        bufferedDocument = [[METBufferedDocument alloc] init];
-        bufferedDocument.fields = documentChangeDetails.fieldsBeforeChanges;
-        _bufferedDocumentsByKey[documentKey] = bufferedDocument;
-      }
-      [bufferedDocument addMethodInvocationWaitingUntilUpdatesAreDone:methodInvocation];
-    }];
-    
-    [_operationQueue addOperation:methodInvocation];
   }
 }
 
@@ -192,6 +513,9 @@
     }
     
     [methodInvocation didReceiveResult:result error:error];
+    
+    // Once we have a result, the server has executed the method, so it must not be sent again after a restart
+    [_methodInvocationLog removeMethodInvocationWithID:methodID];
   }
 }
 
@@ -214,47 +538,81 @@
       METDocumentKey *documentKey = documentChangeDetails.documentKey;
       METBufferedDocument *bufferedDocument = _bufferedDocumentsByKey[documentKey];
       
-      [bufferedDocument removeMethodInvocationWaitingUntilUpdatesAreDone:methodInvocation];
-      
-      if (bufferedDocument.numberOfSentMethodInvocationsWaitingUntilUpdatesAreDone < 1) {
-        METDataUpdate *update = [[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeReplace documentKey:documentKey fields:bufferedDocument.fields];
+      // Only roll back the changes performed by this stub, keeping those of other pending method invocations
+      METDataUpdate *update = [bufferedDocument dataUpdateByRemovingMethodInvocation:methodInvocation];
+      if (update) {
         [_client.database applyDataUpdate:update];
+      }
+      
+      if (bufferedDocument.numberOfMethodInvocations < 1) {
         [_bufferedDocumentsByKey removeObjectForKey:documentKey];
         [bufferedDocument didFlush];
+        [_client.database didConfirmFields:bufferedDocument.fields forDocumentWithKey:documentKey];
       }
     }];
     
+    [self performBlocksWaitingUntilFlushedIfPossible];
+    
     [self performAfterAllCurrentlyBufferedDocumentsAreFlushed:^{
       [methodInvocation didFlushUpdates];
     }];
+    
+    [_methodInvocationLog compactIfNeeded];
   }
 }
 
 - (void)performAfterAllCurrentlyBufferedDocumentsAreFlushed:(void (^)())block {
-  @synchronized(self) {    
-    if (_bufferedDocumentsByKey.count < 1) {
+  @synchronized(self) {
+    [self removeFlushedDocumentsFromTheFrontOfTheEpochOrder];
+    
+    if (_bufferedDocumentsInEpochOrder.count < 1) {
       [_client.database performAfterBufferedUpdatesAreFlushed:block];
       return;
     }
     
-    dispatch_group_t group = dispatch_group_create();
-    [_bufferedDocumentsByKey enumerateKeysAndObjectsUsingBlock:^(METDocumentKey *documentKey, METBufferedDocument *bufferedDocument, BOOL *stop) {
-      [bufferedDocument waitUntilFlushedWithGroup:group];
-    }];
-    dispatch_group_notify(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-      [_client.database performAfterBufferedUpdatesAreFlushed:block];
-    });
+    // All documents buffered so far have an epoch below the next one
+    [_blocksWaitingUntilFlushed addObject:[block copy]];
+    [_epochsOfBlocksWaitingUntilFlushed addObject:@(_nextBufferingEpoch)];
+  }
+}
+
+- (void)removeFlushedDocumentsFromTheFrontOfTheEpochOrder {
+  while (_bufferedDocumentsInEpochOrder.count > 0 && [_bufferedDocumentsInEpochOrder[0] isFlushed]) {
+    [_bufferedDocumentsInEpochOrder removeObjectAtIndex:0];
+  }
+}
+
+- (void)performBlocksWaitingUntilFlushedIfPossible {
+  [self removeFlushedDocumentsFromTheFrontOfTheEpochOrder];
+  
+  uint64_t lowestBufferedEpoch = _bufferedDocumentsInEpochOrder.count > 0 ? [_bufferedDocumentsInEpochOrder[0] epoch] : _nextBufferingEpoch;
+  
+  while (_blocksWaitingUntilFlushed.count > 0 && [_epochsOfBlocksWaitingUntilFlushed[0] unsignedLongLongValue] <= lowestBufferedEpoch) {
+    [_client.database performAfterBufferedUpdatesAreFlushed:_blocksWaitingUntilFlushed[0]];
+    [_blocksWaitingUntilFlushed removeObjectAtIndex:0];
+    [_epochsOfBlocksWaitingUntilFlushed removeObjectAtIndex:0];
   }
 }
 
 - (void)resetWhileAddingMethodInvocationsToTheFrontOfTheQueueUsingBlock:(void (^)())block {
   @synchronized(self) {
-    NSArray *methodInvocations = [_operationQueue.operations copy];
-    [_operationQueue cancelAllOperations];
+    NSArray *methodInvocations = _scheduler.methodInvocations;
+    [_scheduler invalidate];
+    
+    // Nothing is buffered anymore after a reset, so blocks waiting for buffered documents can go ahead
+    for (METBufferedDocument *bufferedDocument in _bufferedDocumentsInEpochOrder) {
+      [bufferedDocument didFlush];
+    }
+    // The last versions we received from the server are the best confirmed state we have
+    [_bufferedDocumentsByKey enumerateKeysAndObjectsUsingBlock:^(METDocumentKey *documentKey, METBufferedDocument *bufferedDocument, BOOL *stop) {
+      [_client.database didConfirmFields:bufferedDocument.fields forDocumentWithKey:documentKey];
+    }];
     [_bufferedDocumentsByKey removeAllObjects];
+    [self performBlocksWaitingUntilFlushedIfPossible];
+    
+    _scheduler = [self newScheduler];
     
-    _operationQueue = [[NSOperationQueue alloc] init];
-    _operationQueue.suspended = YES;
+    _resetting = YES;
     
     if (block) {
       block();
@@ -269,6 +627,13 @@
         }];
       }
     }
+    
+    // Held method invocations were never handed to the scheduler, so they stay held, but their changes have to be buffered again
+    for (METMethodInvocation *methodInvocation in _heldMethodInvocations) {
+      [self bufferChangesPerformedByStub:methodInvocation.changesPerformedByStub forMethodInvocation:methodInvocation];
+    }
+    
+    _resetting = NO;
   }
 }
 
@@ -313,11 +678,11 @@
 #pragma mark - Testing
 
 - (METMethodInvocation *)lastMethodInvocation {
-  return [_operationQueue.operations lastObject];
+  return [_scheduler.methodInvocations lastObject];
 }
 
 - (METMethodInvocation *)methodInvocationWithName:(NSString *)name {
-  for (METMethodInvocation *methodInvocation in _operationQueue.operations) {
+  for (METMethodInvocation *methodInvocation in _scheduler.methodInvocations) {
     if ([methodInvocation.name isEqualToString:name]) {
       return methodInvocation;
     }
@@ -21,12 +21,13 @@
 #import "METMethodInvocationCoordinator.h"
 
 @class METBufferedDocument;
+@class METMethodInvocationScheduler;
 
 NS_ASSUME_NONNULL_BEGIN
 
 @interface METMethodInvocationCoordinator ()
 
-@property (strong, nonatomic, readonly) NSOperationQueue *operationQueue;
+@property (strong, nonatomic, readonly) METMethodInvocationScheduler *scheduler;
 
 - (METMethodInvocation *)lastMethodInvocation;
 - (METMethodInvocation *)methodInvocationWithName:(NSString *)name;
@@ -0,0 +1,377 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#import "METMethodInvocationLog.h"
+
+#import "METMethodInvocation.h"
+#import "METEJSONSerialization.h"
+
+// Records are length-prefixed JSON objects, the length being a little-endian uint32
+static const NSUInteger METMethodInvocationLogRecordHeaderLength = 4;
+
+// Compaction only pays off when a substantial part of the log consists of records that have been superseded
+static const NSUInteger METMethodInvocationLogMinimumNumberOfRecordsForCompaction = 64;
+
+static NSString * const METMethodInvocationLogAddOperation = @"add";
+static NSString * const METMethodInvocationLogRemoveOperation = @"remove";
+
+@implementation METMethodInvocationLog {
+  dispatch_queue_t _queue;
+  NSFileHandle *_fileHandle;
+  BOOL _synchronizationScheduled;
+  NSMutableArray *_pendingMethodIDs;
+  NSMutableDictionary *_recordsByMethodID;
+}
+
+- (instancetype)initWithURL:(NSURL *)URL {
+  NSParameterAssert(URL);
+  
+  self = [super init];
+  if (self) {
+    _URL = [URL copy];
+    _queue = dispatch_queue_create("com.meteor.MethodInvocationLog", DISPATCH_QUEUE_SERIAL);
+    _synchronizationInterval = 0.05;
+    _pendingMethodIDs = [[NSMutableArray alloc] init];
+    _recordsByMethodID = [[NSMutableDictionary alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [_fileHandle synchronizeFile];
+  [_fileHandle closeFile];
+}
+
+#pragma mark - Opening and Closing
+
+- (BOOL)openWithError:(NSError **)error {
+  __block BOOL success;
+  __block NSError *openingError;
+  dispatch_sync(_queue, ^{
+    success = [self openOnQueueWithError:&openingError];
+  });
+  if (!success && error) {
+    *error = openingError;
+  }
+  return success;
+}
+
+- (BOOL)openOnQueueWithError:(NSError **)error {
+  NSAssert(_fileHandle == nil, @"Method invocation log has already been opened");
+  
+  if (![[NSFileManager defaultManager] fileExistsAtPath:_URL.path]) {
+    if (![[NSData data] writeToURL:_URL options:NSDataWritingAtomic error:error]) {
+      return NO;
+    }
+  }
+  
+  NSData *data = [NSData dataWithContentsOfURL:_URL options:NSDataReadingMappedIfSafe error:error];
+  if (!data) {
+    return NO;
+  }
+  
+  NSUInteger validLength = [self readRecordsInData:data];
+  
+  NSFileHandle *fileHandle = [NSFileHandle fileHandleForWritingToURL:_URL error:error];
+  if (!fileHandle) {
+    return NO;
+  }
+  
+  // A partially written record can be left behind if we were terminated while writing, so we discard it
+  if (validLength < data.length) {
+    NSLog(@"Discarding %lu bytes at the end of method invocation log: %@", (unsigned long)(data.length - validLength), _URL);
+    [fileHandle truncateFileAtOffset:validLength];
+  }
+  [fileHandle seekToEndOfFile];
+  
+  _fileHandle = fileHandle;
+  return YES;
+}
+
+- (void)close {
+  dispatch_sync(_queue, ^{
+    [_fileHandle synchronizeFile];
+    [_fileHandle closeFile];
+    _fileHandle = nil;
+  });
+}
+
+#pragma mark - Reading
+
+- (NSArray *)pendingMethodInvocations {
+  __block NSMutableArray *methodInvocations;
+  dispatch_sync(_queue, ^{
+    methodInvocations = [[NSMutableArray alloc] initWithCapacity:_pendingMethodIDs.count];
+    for (NSString *methodID in _pendingMethodIDs) {
+      METMethodInvocation *methodInvocation = [self methodInvocationFromRecord:_recordsByMethodID[methodID]];
+      if (methodInvocation) {
+        [methodInvocations addObject:methodInvocation];
+      }
+    }
+  });
+  return methodInvocations;
+}
+
+- (NSUInteger)numberOfPendingMethodInvocations {
+  __block NSUInteger numberOfPendingMethodInvocations;
+  dispatch_sync(_queue, ^{
+    numberOfPendingMethodInvocations = _pendingMethodIDs.count;
+  });
+  return numberOfPendingMethodInvocations;
+}
+
+- (NSUInteger)numberOfRecords {
+  __block NSUInteger numberOfRecords;
+  dispatch_sync(_queue, ^{
+    numberOfRecords = _numberOfRecords;
+  });
+  return numberOfRecords;
+}
+
+- (NSUInteger)numberOfSynchronizations {
+  __block NSUInteger numberOfSynchronizations;
+  dispatch_sync(_queue, ^{
+    numberOfSynchronizations = _numberOfSynchronizations;
+  });
+  return numberOfSynchronizations;
+}
+
+#pragma mark - Writing
+
+- (void)appendMethodInvocation:(METMethodInvocation *)methodInvocation {
+  NSParameterAssert(methodInvocation.methodID);
+  NSParameterAssert(methodInvocation.methodName);
+  
+  NSMutableDictionary *record = [[NSMutableDictionary alloc] init];
+  record[@"op"] = METMethodInvocationLogAddOperation;
+  record[@"id"] = methodInvocation.methodID;
+  record[@"method"] = methodInvocation.methodName;
+  if (methodInvocation.parameters) {
+    record[@"params"] = [METEJSONSerialization EJSONObjectFromObject:methodInvocation.parameters error:nil];
+  }
+  if (methodInvocation.randomSeed) {
+    record[@"randomSeed"] = methodInvocation.randomSeed;
+  }
+  
+  dispatch_async(_queue, ^{
+    [self writeRecord:record];
+  });
+}
+
+- (void)removeMethodInvocationWithID:(NSString *)methodID {
+  NSParameterAssert(methodID);
+  
+  dispatch_async(_queue, ^{
+    // Only invocations that have been logged need a record to remove them
+    if (!_recordsByMethodID[methodID]) {
+      return;
+    }
+    
+    [self writeRecord:@{@"op": METMethodInvocationLogRemoveOperation, @"id": methodID}];
+  });
+}
+
+- (void)writeRecord:(NSDictionary *)record {
+  if (!_fileHandle) {
+    return;
+  }
+  
+  NSData *recordData = [self dataForRecord:record];
+  if (!recordData) {
+    NSLog(@"Couldn't write record to method invocation log: %@", record);
+    return;
+  }
+  
+  // -writeData: raises on I/O errors (e.g. a full disk), in which case we stop persisting rather than crash
+  @try {
+    [_fileHandle writeData:recordData];
+  } @catch (NSException *exception) {
+    NSLog(@"Couldn't write to method invocation log, disabling persistence: %@", exception);
+    [_fileHandle closeFile];
+    _fileHandle = nil;
+    return;
+  }
+  [self applyRecord:record];
+  [self scheduleSynchronization];
+}
+
+- (void)scheduleSynchronization {
+  if (_synchronizationScheduled) {
+    return;
+  }
+  _synchronizationScheduled = YES;
+  
+  // Records written in quick succession share a single fsync
+  dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(_synchronizationInterval * NSEC_PER_SEC)), _queue, ^{
+    [self synchronizeOnQueue];
+  });
+}
+
+- (void)synchronize {
+  dispatch_sync(_queue, ^{
+    [self synchronizeOnQueue];
+  });
+}
+
+- (void)synchronizeOnQueue {
+  if (!_synchronizationScheduled) {
+    return;
+  }
+  _synchronizationScheduled = NO;
+  
+  [_fileHandle synchronizeFile];
+  _numberOfSynchronizations++;
+}
+
+#pragma mark - Compaction
+
+- (void)compactIfNeeded {
+  dispatch_async(_queue, ^{
+    if (_numberOfRecords < METMethodInvocationLogMinimumNumberOfRecordsForCompaction || _numberOfRecords < 2 * _pendingMethodIDs.count) {
+      return;
+    }
+    
+    NSError *error;
+    if (![self compactOnQueueWithError:&error]) {
+      NSLog(@"Couldn't compact method invocation log: %@", error);
+    }
+  });
+}
+
+- (BOOL)compactWithError:(NSError **)error {
+  __block BOOL success;
+  __block NSError *compactionError;
+  dispatch_sync(_queue, ^{
+    success = [self compactOnQueueWithError:&compactionError];
+  });
+  if (!success && error) {
+    *error = compactionError;
+  }
+  return success;
+}
+
+- (BOOL)compactOnQueueWithError:(NSError **)error {
+  if (!_fileHandle) {
+    return YES;
+  }
+  
+  NSMutableData *compactedData = [[NSMutableData alloc] init];
+  for (NSString *methodID in _pendingMethodIDs) {
+    NSData *recordData = [self dataForRecord:_recordsByMethodID[methodID]];
+    if (recordData) {
+      [compactedData appendData:recordData];
+    }
+  }
+  
+  // The compacted log is written atomically, so we never end up without a valid log
+  if (![compactedData writeToURL:_URL options:NSDataWritingAtomic error:error]) {
+    return NO;
+  }
+  
+  NSFileHandle *fileHandle = [NSFileHandle fileHandleForWritingToURL:_URL error:error];
+  if (!fileHandle) {
+    return NO;
+  }
+  [fileHandle seekToEndOfFile];
+  
+  [_fileHandle closeFile];
+  _fileHandle = fileHandle;
+  _numberOfRecords = _pendingMethodIDs.count;
+  return YES;
+}
+
+#pragma mark - Helper Methods
+
+- (NSUInteger)readRecordsInData:(NSData *)data {
+  const uint8_t *bytes = data.bytes;
+  NSUInteger length = data.length;
+  NSUInteger offset = 0;
+  
+  while (offset + METMethodInvocationLogRecordHeaderLength <= length) {
+    uint32_t recordLength;
+    memcpy(&recordLength, bytes + offset, sizeof(recordLength));
+    recordLength = CFSwapInt32LittleToHost(recordLength);
+    if (offset + METMethodInvocationLogRecordHeaderLength + recordLength > length) {
+      break;
+    }
+    
+    NSData *recordData = [NSData dataWithBytesNoCopy:(void *)(bytes + offset + METMethodInvocationLogRecordHeaderLength) length:recordLength freeWhenDone:NO];
+    NSDictionary *record = [NSJSONSerialization JSONObjectWithData:recordData options:0 error:nil];
+    if (![record isKindOfClass:[NSDictionary class]] || ![record[@"id"] isKindOfClass:[NSString class]]) {
+      break;
+    }
+    
+    [self applyRecord:record];
+    offset += METMethodInvocationLogRecordHeaderLength + recordLength;
+  }
+  
+  return offset;
+}
+
+- (void)applyRecord:(NSDictionary *)record {
+  NSString *methodID = record[@"id"];
+  NSString *operation = record[@"op"];
+  
+  if ([operation isEqualToString:METMethodInvocationLogAddOperation]) {
+    if (!_recordsByMethodID[methodID]) {
+      [_pendingMethodIDs addObject:methodID];
+    }
+    _recordsByMethodID[methodID] = record;
+  } else if ([operation isEqualToString:METMethodInvocationLogRemoveOperation]) {
+    if (_recordsByMethodID[methodID]) {
+      [_pendingMethodIDs removeObject:methodID];
+      [_recordsByMethodID removeObjectForKey:methodID];
+    }
+  }
+  
+  _numberOfRecords++;
+}
+
+- (NSData *)dataForRecord:(NSDictionary *)record {
+  NSData *JSONData = [NSJSONSerialization dataWithJSONObject:record options:0 error:nil];
+  if (!JSONData) {
+    return nil;
+  }
+  
+  NSMutableData *recordData = [[NSMutableData alloc] initWithCapacity:METMethodInvocationLogRecordHeaderLength + JSONData.length];
+  uint32_t recordLength = CFSwapInt32HostToLittle((uint32_t)JSONData.length);
+  [recordData appendBytes:&recordLength length:sizeof(recordLength)];
+  [recordData appendData:JSONData];
+  return recordData;
+}
+
+- (METMethodInvocation *)methodInvocationFromRecord:(NSDictionary *)record {
+  NSString *methodName = record[@"method"];
+  if (![methodName isKindOfClass:[NSString class]]) {
+    return nil;
+  }
+  
+  METMethodInvocation *methodInvocation = [[METMethodInvocation alloc] init];
+  methodInvocation.methodID = record[@"id"];
+  methodInvocation.methodName = methodName;
+  if (record[@"params"]) {
+    methodInvocation.parameters = [METEJSONSerialization objectFromEJSONObject:record[@"params"] error:nil];
+  }
+  methodInvocation.randomSeed = record[@"randomSeed"];
+  return methodInvocation;
+}
+
+@end
@@ -0,0 +1,65 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#import <Foundation/Foundation.h>
+
+@class METMethodInvocation;
+@class METHistogram;
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef void (^METMethodInvocationFinishedHandler)(METMethodInvocation *methodInvocation);
+
+// Starts method invocations in the order they were added. Regular invocations run concurrently,
+// but a barrier invocation waits for all earlier invocations to finish and blocks later ones until
+// it has finished itself. Between barriers, invocations with a higher queue priority start first,
+// and the number of invocations executing at the same time can be limited.
+@interface METMethodInvocationScheduler : NSObject
+
+- (instancetype)initWithFinishedHandler:(nullable METMethodInvocationFinishedHandler)finishedHandler NS_DESIGNATED_INITIALIZER;
+- (instancetype)init;
+
+@property (assign, nonatomic, getter=isSuspended) BOOL suspended;
+
+// Zero means no limit
+@property (assign, nonatomic) NSUInteger maximumNumberOfExecutingMethodInvocations;
+- (void)setMaximumNumberOfExecutingMethodInvocations:(NSUInteger)maximumNumberOfExecutingMethodInvocations forMethodWithName:(NSString *)methodName;
+- (NSUInteger)maximumNumberOfExecutingMethodInvocationsForMethodWithName:(NSString *)methodName;
+
+// Records how long invocations with the specified priority waited between being added and being started
+- (void)setQueueWaitTimeHistogram:(nullable METHistogram *)histogram forPriority:(NSOperationQueuePriority)priority;
+
+- (void)addMethodInvocation:(METMethodInvocation *)methodInvocation;
+- (void)addMethodInvocations:(NSArray *)methodInvocations;
+
+// Method invocations that haven't finished yet, in the order they were added
+@property (copy, nonatomic, readonly) NSArray *methodInvocations;
+@property (assign, nonatomic, readonly) NSUInteger numberOfMethodInvocations;
+@property (assign, nonatomic, readonly) NSUInteger numberOfExecutingMethodInvocations;
+
+- (void)methodInvocationDidFinish:(METMethodInvocation *)methodInvocation;
+
+// Cancels all method invocations and stops scheduling
+- (void)invalidate;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,395 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#import "METMethodInvocationScheduler.h"
+
+#import "METMethodInvocation.h"
+#import "METMethodInvocation_Internal.h"
+#import "METHistogram.h"
+#import "METMonotonicTime.h"
+
+// Queue priorities range from very low (-8) to very high (8) in steps of 4
+static const NSUInteger METNumberOfPriorityClasses = 5;
+
+static NSUInteger METPriorityClassForQueuePriority(NSOperationQueuePriority priority) {
+  NSInteger priorityClass = (NSInteger)priority / 4 + 2;
+  return (NSUInteger)MIN(MAX(priorityClass, 0), (NSInteger)METNumberOfPriorityClasses - 1);
+}
+
+@implementation METMethodInvocationScheduler {
+  dispatch_queue_t _queue;
+  METMethodInvocationFinishedHandler _finishedHandler;
+  
+  // Contains all unfinished invocations in the order they were added. Finished invocations are only
+  // removed once they reach the front, so both adding and finishing take amortized constant time.
+  NSMutableArray *_methodInvocations;
+  NSHashTable *_finishedMethodInvocations;
+  
+  // Invocations that can start as soon as the limits allow, with one queue per priority class
+  NSArray *_waitingMethodInvocationsByPriorityClass;
+  NSUInteger _numberOfWaitingMethodInvocations;
+  
+  // Waiting invocations of methods that have reached their limit are parked per method name and priority class,
+  // so they don't have to be skipped over again every time another invocation starts
+  NSMutableDictionary *_parkedMethodInvocationsByMethodName;
+  
+  // A barrier and everything added after it stay here until all earlier invocations have finished
+  NSMutableArray *_methodInvocationsBehindBarrier;
+  
+  NSMutableDictionary *_maximumNumberOfExecutingMethodInvocationsByMethodName;
+  NSCountedSet *_executingMethodNames;
+  NSMutableDictionary *_queueWaitTimeHistogramsByPriorityClass;
+  
+  NSUInteger _numberOfExecutingMethodInvocations;
+  uint64_t _nextEnqueueSequenceNumber;
+  BOOL _executingBarrier;
+  BOOL _invalidated;
+}
+
+- (instancetype)initWithFinishedHandler:(METMethodInvocationFinishedHandler)finishedHandler {
+  self = [super init];
+  if (self) {
+    _queue = dispatch_queue_create("com.meteor.MethodInvocationScheduler", DISPATCH_QUEUE_SERIAL);
+    _finishedHandler = [finishedHandler copy];
+    _methodInvocations = [[NSMutableArray alloc] init];
+    _finishedMethodInvocations = [NSHashTable hashTableWithOptions:NSPointerFunctionsObjectPointerPersonality];
+    
+    NSMutableArray *waitingMethodInvocationsByPriorityClass = [[NSMutableArray alloc] initWithCapacity:METNumberOfPriorityClasses];
+    for (NSUInteger priorityClass = 0; priorityClass < METNumberOfPriorityClasses; priorityClass++) {
+      [waitingMethodInvocationsByPriorityClass addObject:[[NSMutableArray alloc] init]];
+    }
+    _waitingMethodInvocationsByPriorityClass = waitingMethodInvocationsByPriorityClass;
+    _methodInvocationsBehindBarrier = [[NSMutableArray alloc] init];
+    
+    _parkedMethodInvocationsByMethodName = [[NSMutableDictionary alloc] init];
+    
+    _maximumNumberOfExecutingMethodInvocationsByMethodName = [[NSMutableDictionary alloc] init];
+    _executingMethodNames = [[NSCountedSet alloc] init];
+    _queueWaitTimeHistogramsByPriorityClass = [[NSMutableDictionary alloc] init];
+    _suspended = YES;
+  }
+  return self;
+}
+
+- (instancetype)init {
+  return [self initWithFinishedHandler:nil];
+}
+
+- (BOOL)isSuspended {
+  @synchronized(self) {
+    return _suspended;
+  }
+}
+
+- (void)setSuspended:(BOOL)suspended {
+  @synchronized(self) {
+    _suspended = suspended;
+    [self startMethodInvocationsIfPossible];
+  }
+}
+
+#pragma mark - Limits
+
+- (NSUInteger)maximumNumberOfExecutingMethodInvocations {
+  @synchronized(self) {
+    return _maximumNumberOfExecutingMethodInvocations;
+  }
+}
+
+- (void)setMaximumNumberOfExecutingMethodInvocations:(NSUInteger)maximumNumberOfExecutingMethodInvocations {
+  @synchronized(self) {
+    _maximumNumberOfExecutingMethodInvocations = maximumNumberOfExecutingMethodInvocations;
+    [self startMethodInvocationsIfPossible];
+  }
+}
+
+- (void)setMaximumNumberOfExecutingMethodInvocations:(NSUInteger)maximumNumberOfExecutingMethodInvocations forMethodWithName:(NSString *)methodName {
+  @synchronized(self) {
+    if (maximumNumberOfExecutingMethodInvocations > 0) {
+      _maximumNumberOfExecutingMethodInvocationsByMethodName[methodName] = @(maximumNumberOfExecutingMethodInvocations);
+    } else {
+      [_maximumNumberOfExecutingMethodInvocationsByMethodName removeObjectForKey:methodName];
+    }
+    [self unparkMethodInvocationsWithName:methodName];
+    [self startMethodInvocationsIfPossible];
+  }
+}
+
+- (NSUInteger)maximumNumberOfExecutingMethodInvocationsForMethodWithName:(NSString *)methodName {
+  @synchronized(self) {
+    return [_maximumNumberOfExecutingMethodInvocationsByMethodName[methodName] unsignedIntegerValue];
+  }
+}
+
+- (void)setQueueWaitTimeHistogram:(METHistogram *)histogram forPriority:(NSOperationQueuePriority)priority {
+  @synchronized(self) {
+    _queueWaitTimeHistogramsByPriorityClass[@(METPriorityClassForQueuePriority(priority))] = histogram;
+  }
+}
+
+#pragma mark - Adding Method Invocations
+
+- (void)addMethodInvocation:(METMethodInvocation *)methodInvocation {
+  @synchronized(self) {
+    if (_invalidated) return;
+    
+    [self enqueueMethodInvocation:methodInvocation];
+    [self startMethodInvocationsIfPossible];
+  }
+}
+
+- (void)addMethodInvocations:(NSArray *)methodInvocations {
+  @synchronized(self) {
+    if (_invalidated) return;
+    
+    for (METMethodInvocation *methodInvocation in methodInvocations) {
+      [self enqueueMethodInvocation:methodInvocation];
+    }
+    [self startMethodInvocationsIfPossible];
+  }
+}
+
+- (void)enqueueMethodInvocation:(METMethodInvocation *)methodInvocation {
+  methodInvocation.scheduler = self;
+  methodInvocation.enqueueTime = METMonotonicTime();
+  methodInvocation.enqueueSequenceNumber = _nextEnqueueSequenceNumber++;
+  [_methodInvocations addObject:methodInvocation];
+  
+  if (methodInvocation.barrier || _methodInvocationsBehindBarrier.count > 0) {
+    [_methodInvocationsBehindBarrier addObject:methodInvocation];
+  } else {
+    [self addWaitingMethodInvocation:methodInvocation];
+  }
+}
+
+- (void)addWaitingMethodInvocation:(METMethodInvocation *)methodInvocation {
+  [_waitingMethodInvocationsByPriorityClass[METPriorityClassForQueuePriority(methodInvocation.queuePriority)] addObject:methodInvocation];
+  _numberOfWaitingMethodInvocations++;
+}
+
+#pragma mark - Accessing Method Invocations
+
+- (NSArray *)methodInvocations {
+  @synchronized(self) {
+    NSMutableArray *methodInvocations = [[NSMutableArray alloc] initWithCapacity:_methodInvocations.count];
+    for (METMethodInvocation *methodInvocation in _methodInvocations) {
+      if (![_finishedMethodInvocations containsObject:methodInvocation]) {
+        [methodInvocations addObject:methodInvocation];
+      }
+    }
+    return methodInvocations;
+  }
+}
+
+- (NSUInteger)numberOfMethodInvocations {
+  @synchronized(self) {
+    return _methodInvocations.count - _finishedMethodInvocations.count;
+  }
+}
+
+- (NSUInteger)numberOfExecutingMethodInvocations {
+  @synchronized(self) {
+    return _numberOfExecutingMethodInvocations;
+  }
+}
+
+#pragma mark - Starting and Finishing
+
+- (void)startMethodInvocationsIfPossible {
+  if (_suspended) return;
+  
+  while (!_executingBarrier) {
+    if (_numberOfWaitingMethodInvocations < 1) {
+      if (_methodInvocationsBehindBarrier.count < 1 || _numberOfExecutingMethodInvocations > 0) return;
+      
+      METMethodInvocation *barrierMethodInvocation = _methodInvocationsBehindBarrier[0];
+      [_methodInvocationsBehindBarrier removeObjectAtIndex:0];
+      
+      // Invocations up to the next barrier can start in priority order once this barrier has finished
+      while (_methodInvocationsBehindBarrier.count > 0 && ![_methodInvocationsBehindBarrier[0] isBarrier]) {
+        [self addWaitingMethodInvocation:_methodInvocationsBehindBarrier[0]];
+        [_methodInvocationsBehindBarrier removeObjectAtIndex:0];
+      }
+      
+      _executingBarrier = YES;
+      [self startMethodInvocation:barrierMethodInvocation];
+      return;
+    }
+    
+    if (_maximumNumberOfExecutingMethodInvocations > 0 && _numberOfExecutingMethodInvocations >= _maximumNumberOfExecutingMethodInvocations) return;
+    
+    METMethodInvocation *methodInvocation = [self dequeueNextStartableMethodInvocation];
+    if (!methodInvocation) return;
+    [self startMethodInvocation:methodInvocation];
+  }
+}
+
+// Returns the earliest waiting invocation of the highest priority class that isn't held back by a per-method limit
+- (METMethodInvocation *)dequeueNextStartableMethodInvocation {
+  for (NSInteger priorityClass = METNumberOfPriorityClasses - 1; priorityClass >= 0; priorityClass--) {
+    NSMutableArray *waitingMethodInvocations = _waitingMethodInvocationsByPriorityClass[priorityClass];
+    while (waitingMethodInvocations.count > 0) {
+      METMethodInvocation *methodInvocation = waitingMethodInvocations[0];
+      [waitingMethodInvocations removeObjectAtIndex:0];
+      if ([self canStartMethodInvocationWithName:methodInvocation.methodName]) {
+        _numberOfWaitingMethodInvocations--;
+        return methodInvocation;
+      }
+      [self parkMethodInvocation:methodInvocation inPriorityClass:priorityClass];
+    }
+  }
+  return nil;
+}
+
+// Parked invocations still count as waiting, so a later barrier keeps waiting for them
+- (void)parkMethodInvocation:(METMethodInvocation *)methodInvocation inPriorityClass:(NSUInteger)priorityClass {
+  NSString *methodName = methodInvocation.methodName;
+  NSArray *parkedMethodInvocationsByPriorityClass = _parkedMethodInvocationsByMethodName[methodName];
+  if (!parkedMethodInvocationsByPriorityClass) {
+    NSMutableArray *array = [[NSMutableArray alloc] initWithCapacity:METNumberOfPriorityClasses];
+    for (NSUInteger index = 0; index < METNumberOfPriorityClasses; index++) {
+      [array addObject:[[NSMutableArray alloc] init]];
+    }
+    parkedMethodInvocationsByPriorityClass = array;
+    _parkedMethodInvocationsByMethodName[methodName] = parkedMethodInvocationsByPriorityClass;
+  }
+  [parkedMethodInvocationsByPriorityClass[priorityClass] addObject:methodInvocation];
+}
+
+// Moves as many parked invocations back as the limit for the method allows to start
+- (void)unparkMethodInvocationsWithName:(NSString *)methodName {
+  NSArray *parkedMethodInvocationsByPriorityClass = _parkedMethodInvocationsByMethodName[methodName];
+  if (!parkedMethodInvocationsByPriorityClass) return;
+  
+  NSUInteger maximumNumberOfExecutingMethodInvocations = [_maximumNumberOfExecutingMethodInvocationsByMethodName[methodName] unsignedIntegerValue];
+  NSUInteger numberOfExecutingMethodInvocations = [_executingMethodNames countForObject:methodName];
+  NSUInteger numberOfMethodInvocationsToUnpark = maximumNumberOfExecutingMethodInvocations == 0 ? NSUIntegerMax : maximumNumberOfExecutingMethodInvocations - MIN(numberOfExecutingMethodInvocations, maximumNumberOfExecutingMethodInvocations);
+  
+  NSUInteger numberOfRemainingParkedMethodInvocations = 0;
+  for (NSInteger priorityClass = METNumberOfPriorityClasses - 1; priorityClass >= 0; priorityClass--) {
+    NSMutableArray *parkedMethodInvocations = parkedMethodInvocationsByPriorityClass[priorityClass];
+    while (parkedMethodInvocations.count > 0 && numberOfMethodInvocationsToUnpark > 0) {
+      [self insertUnparkedMethodInvocation:parkedMethodInvocations[0] inPriorityClass:priorityClass];
+      [parkedMethodInvocations removeObjectAtIndex:0];
+      numberOfMethodInvocationsToUnpark--;
+    }
+    numberOfRemainingParkedMethodInvocations += parkedMethodInvocations.count;
+  }
+  
+  if (numberOfRemainingParkedMethodInvocations == 0) {
+    [_parkedMethodInvocationsByMethodName removeObjectForKey:methodName];
+  }
+}
+
+// Waiting queues stay ordered by sequence number, so an unparked invocation can be put back in its place with a binary search
+- (void)insertUnparkedMethodInvocation:(METMethodInvocation *)methodInvocation inPriorityClass:(NSUInteger)priorityClass {
+  NSMutableArray *waitingMethodInvocations = _waitingMethodInvocationsByPriorityClass[priorityClass];
+  NSUInteger index = [waitingMethodInvocations indexOfObject:methodInvocation inSortedRange:NSMakeRange(0, waitingMethodInvocations.count) options:NSBinarySearchingInsertionIndex usingComparator:^NSComparisonResult(METMethodInvocation *methodInvocation1, METMethodInvocation *methodInvocation2) {
+    if (methodInvocation1.enqueueSequenceNumber < methodInvocation2.enqueueSequenceNumber) {
+      return NSOrderedAscending;
+    } else if (methodInvocation1.enqueueSequenceNumber > methodInvocation2.enqueueSequenceNumber) {
+      return NSOrderedDescending;
+    } else {
+      return NSOrderedSame;
+    }
+  }];
+  [waitingMethodInvocations insertObject:methodInvocation atIndex:index];
+}
+
+- (BOOL)canStartMethodInvocationWithName:(NSString *)methodName {
+  if (!methodName) return YES;
+  
+  NSUInteger maximumNumberOfExecutingMethodInvocations = [_maximumNumberOfExecutingMethodInvocationsByMethodName[methodName] unsignedIntegerValue];
+  return maximumNumberOfExecutingMethodInvocations == 0 || [_executingMethodNames countForObject:methodName] < maximumNumberOfExecutingMethodInvocations;
+}
+
+- (void)startMethodInvocation:(METMethodInvocation *)methodInvocation {
+  _numberOfExecutingMethodInvocations++;
+  if (methodInvocation.methodName) {
+    [_executingMethodNames addObject:methodInvocation.methodName];
+  }
+  
+  METHistogram *queueWaitTimeHistogram = _queueWaitTimeHistogramsByPriorityClass[@(METPriorityClassForQueuePriority(methodInvocation.queuePriority))];
+  [queueWaitTimeHistogram recordValue:METMonotonicTime() - methodInvocation.enqueueTime];
+  
+  // Starting sends a message, which shouldn't happen while holding the lock
+  dispatch_async(_queue, ^{
+    [methodInvocation start];
+  });
+}
+
+- (void)methodInvocationDidFinish:(METMethodInvocation *)methodInvocation {
+  @synchronized(self) {
+    if (_invalidated || methodInvocation.scheduler != self) return;
+    methodInvocation.scheduler = nil;
+    
+    _numberOfExecutingMethodInvocations--;
+    if (methodInvocation.methodName) {
+      [_executingMethodNames removeObject:methodInvocation.methodName];
+      [self unparkMethodInvocationsWithName:methodInvocation.methodName];
+    }
+    if (methodInvocation.barrier) {
+      _executingBarrier = NO;
+    }
+    
+    [_finishedMethodInvocations addObject:methodInvocation];
+    while (_methodInvocations.count > 0 && [_finishedMethodInvocations containsObject:_methodInvocations[0]]) {
+      [_finishedMethodInvocations removeObject:_methodInvocations[0]];
+      [_methodInvocations removeObjectAtIndex:0];
+    }
+    
+    [self startMethodInvocationsIfPossible];
+    
+    METMethodInvocationFinishedHandler finishedHandler = _finishedHandler;
+    if (finishedHandler) {
+      dispatch_async(_queue, ^{
+        finishedHandler(methodInvocation);
+      });
+    }
+  }
+}
+
+- (void)invalidate {
+  NSArray *methodInvocations;
+  @synchronized(self) {
+    _invalidated = YES;
+    _finishedHandler = nil;
+    methodInvocations = [_methodInvocations copy];
+    [_methodInvocations removeAllObjects];
+    [_finishedMethodInvocations removeAllObjects];
+    for (NSMutableArray *waitingMethodInvocations in _waitingMethodInvocationsByPriorityClass) {
+      [waitingMethodInvocations removeAllObjects];
+    }
+    [_parkedMethodInvocationsByMethodName removeAllObjects];
+    _numberOfWaitingMethodInvocations = 0;
+    [_methodInvocationsBehindBarrier removeAllObjects];
+    [_executingMethodNames removeAllObjects];
+    _numberOfExecutingMethodInvocations = 0;
+    _executingBarrier = NO;
+  }
+  
+  for (METMethodInvocation *methodInvocation in methodInvocations) {
+    methodInvocation.scheduler = nil;
+    [methodInvocation cancel];
+  }
+}
+
+@end
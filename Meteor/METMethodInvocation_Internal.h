@@ -20,11 +20,17 @@
 
 #import "METMethodInvocation.h"
 
+@class METMethodInvocationScheduler;
+
 NS_ASSUME_NONNULL_BEGIN
 
 @interface METMethodInvocation ()
 
 @property (strong, nonatomic) NSSet *documentKeysAffectedByStub;
+@property (nullable, weak, nonatomic) METMethodInvocationScheduler *scheduler;
+@property (assign, nonatomic) NSTimeInterval enqueueTime;
+// Orders invocations by when they were enqueued, even if their enqueue times are equal
+@property (assign, nonatomic) uint64_t enqueueSequenceNumber;
 
 - (void)didReceiveResult:(nullable id)result error:(nullable NSError *)error;
 - (void)didReceiveUpdatesDone;
@@ -0,0 +1,59 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+#import "METDDPClient.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ Keeps results of read-only methods that have been marked as cacheable. Identical calls that are made while an earlier call is still in flight share its result instead of being sent again. Results are kept for a limited time, and the least recently used ones are evicted once the cache is full.
+ */
+@interface METMethodResultCache : NSObject
+
+@property (assign, nonatomic) NSUInteger maximumNumberOfResults;
+
+- (void)setTimeToLive:(NSTimeInterval)timeToLive forMethodWithName:(NSString *)methodName;
+- (BOOL)isCacheableMethodWithName:(NSString *)methodName;
+
+// Returns YES and sets result if an unexpired result is cached for these parameters
+- (BOOL)getResult:(id __nullable * __nonnull)result forMethodWithName:(NSString *)methodName parameters:(nullable NSArray *)parameters;
+
+// Returns YES if an identical call is already in flight, in which case the handlers will be invoked with
+// its result. Otherwise, the caller is responsible for making the call and reporting back with the generation
+// returned here. Results are handed to every caller as an immutable copy.
+- (BOOL)addReceivedResultHandler:(nullable METMethodCompletionHandler)receivedResultHandler completionHandler:(nullable METMethodCompletionHandler)completionHandler forInFlightCallWithMethodName:(NSString *)methodName parameters:(nullable NSArray *)parameters generation:(NSUInteger *)generation;
+- (void)didReceiveResultForCallWithMethodName:(NSString *)methodName parameters:(nullable NSArray *)parameters generation:(NSUInteger)generation result:(nullable id)result error:(nullable NSError *)error;
+- (void)didCompleteCallWithMethodName:(NSString *)methodName parameters:(nullable NSArray *)parameters generation:(NSUInteger)generation result:(nullable id)result error:(nullable NSError *)error;
+
+// Removes all cached results. Calls that are in flight will still complete, but later identical calls won't
+// share their results and their results won't be cached.
+- (void)invalidate;
+
+@property (assign, nonatomic, readonly) NSUInteger numberOfCachedResults;
+@property (assign, nonatomic, readonly) NSUInteger numberOfHits;
+@property (assign, nonatomic, readonly) NSUInteger numberOfMisses;
+@property (assign, nonatomic, readonly) NSUInteger numberOfCoalescedCalls;
+@property (assign, nonatomic, readonly) double hitRate;
+
+@end
+
+NS_ASSUME_NONNULL_END
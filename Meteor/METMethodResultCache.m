@@ -0,0 +1,293 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#import "METMethodResultCache.h"
+
+#import "METNameAndParametersKey.h"
+#import "METMonotonicTime.h"
+#import "NSObject+METAdditions.h"
+
+@interface METMethodResultCacheEntry : NSObject
+
+@property (strong, nonatomic) id result;
+@property (assign, nonatomic) NSTimeInterval expiryTime;
+
+@end
+
+@implementation METMethodResultCacheEntry
+
+@end
+
+@interface METMethodResultCacheInFlightCall : NSObject
+
+@property (strong, nonatomic, readonly) NSMutableArray *receivedResultHandlers;
+@property (strong, nonatomic, readonly) NSMutableArray *completionHandlers;
+@property (assign, nonatomic) BOOL receivedResult;
+@property (strong, nonatomic) id result;
+@property (strong, nonatomic) NSError *error;
+
+@end
+
+@implementation METMethodResultCacheInFlightCall
+
+- (instancetype)init {
+  self = [super init];
+  if (self) {
+    _receivedResultHandlers = [[NSMutableArray alloc] init];
+    _completionHandlers = [[NSMutableArray alloc] init];
+  }
+  return self;
+}
+
+@end
+
+@implementation METMethodResultCache {
+  NSMutableDictionary *_timesToLiveByMethodName;
+  NSMutableDictionary *_entriesByKey;
+  // Least recently used keys first
+  NSMutableOrderedSet *_keysInOrderOfUse;
+  // Incremented on every invalidation, so calls made before that aren't coalesced with later ones or cached
+  NSUInteger _generation;
+  // In-flight calls are kept per generation, because calls from before an invalidation still have to complete
+  NSMutableDictionary *_inFlightCallsByKeyByGeneration;
+}
+
+- (instancetype)init {
+  self = [super init];
+  if (self) {
+    _maximumNumberOfResults = 100;
+    _timesToLiveByMethodName = [[NSMutableDictionary alloc] init];
+    _entriesByKey = [[NSMutableDictionary alloc] init];
+    _keysInOrderOfUse = [[NSMutableOrderedSet alloc] init];
+    _inFlightCallsByKeyByGeneration = [[NSMutableDictionary alloc] init];
+  }
+  return self;
+}
+
+- (NSUInteger)maximumNumberOfResults {
+  @synchronized(self) {
+    return _maximumNumberOfResults;
+  }
+}
+
+- (void)setMaximumNumberOfResults:(NSUInteger)maximumNumberOfResults {
+  @synchronized(self) {
+    _maximumNumberOfResults = maximumNumberOfResults;
+    [self evictResultsIfNeeded];
+  }
+}
+
+- (void)setTimeToLive:(NSTimeInterval)timeToLive forMethodWithName:(NSString *)methodName {
+  @synchronized(self) {
+    _timesToLiveByMethodName[methodName] = @(timeToLive);
+  }
+}
+
+- (BOOL)isCacheableMethodWithName:(NSString *)methodName {
+  @synchronized(self) {
+    return _timesToLiveByMethodName[methodName] != nil;
+  }
+}
+
+#pragma mark - Looking Up Results
+
+- (BOOL)getResult:(id *)result forMethodWithName:(NSString *)methodName parameters:(NSArray *)parameters {
+  METNameAndParametersKey *key = [METNameAndParametersKey keyWithName:methodName parameters:parameters];
+  
+  @synchronized(self) {
+    METMethodResultCacheEntry *entry = _entriesByKey[key];
+    if (entry && entry.expiryTime <= METMonotonicTime()) {
+      [self removeEntryForKey:key];
+      entry = nil;
+    }
+    
+    if (!entry) {
+      _numberOfMisses++;
+      return NO;
+    }
+    
+    _numberOfHits++;
+    [_keysInOrderOfUse removeObject:key];
+    [_keysInOrderOfUse addObject:key];
+    *result = entry.result;
+    return YES;
+  }
+}
+
+#pragma mark - Coalescing Calls
+
+- (BOOL)addReceivedResultHandler:(METMethodCompletionHandler)receivedResultHandler completionHandler:(METMethodCompletionHandler)completionHandler forInFlightCallWithMethodName:(NSString *)methodName parameters:(NSArray *)parameters generation:(NSUInteger *)generation {
+  METNameAndParametersKey *key = [METNameAndParametersKey keyWithName:methodName parameters:parameters];
+  BOOL inFlight;
+  BOOL receivedResult = NO;
+  id result;
+  NSError *error;
+  
+  @synchronized(self) {
+    *generation = _generation;
+    
+    NSMutableDictionary *inFlightCallsByKey = _inFlightCallsByKeyByGeneration[@(_generation)];
+    if (!inFlightCallsByKey) {
+      inFlightCallsByKey = [[NSMutableDictionary alloc] init];
+      _inFlightCallsByKeyByGeneration[@(_generation)] = inFlightCallsByKey;
+    }
+    
+    METMethodResultCacheInFlightCall *inFlightCall = inFlightCallsByKey[key];
+    inFlight = inFlightCall != nil;
+    
+    if (inFlight) {
+      _numberOfCoalescedCalls++;
+    } else {
+      inFlightCall = [[METMethodResultCacheInFlightCall alloc] init];
+      inFlightCallsByKey[key] = inFlightCall;
+    }
+    
+    if (completionHandler) {
+      [inFlightCall.completionHandlers addObject:[completionHandler copy]];
+    }
+    
+    // Calls that join after the result has been received get it right away, but still wait for completion
+    if (inFlightCall.receivedResult) {
+      receivedResult = YES;
+      result = inFlightCall.result;
+      error = inFlightCall.error;
+    } else if (receivedResultHandler) {
+      [inFlightCall.receivedResultHandlers addObject:[receivedResultHandler copy]];
+    }
+  }
+  
+  if (receivedResult && receivedResultHandler) {
+    // Handlers are never invoked before the call returns
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+      receivedResultHandler(result, error);
+    });
+  }
+  
+  return inFlight;
+}
+
+- (void)didReceiveResultForCallWithMethodName:(NSString *)methodName parameters:(NSArray *)parameters generation:(NSUInteger)generation result:(id)result error:(NSError *)error {
+  METNameAndParametersKey *key = [METNameAndParametersKey keyWithName:methodName parameters:parameters];
+  result = [result deepImmutableCopy];
+  NSArray *receivedResultHandlers;
+  
+  @synchronized(self) {
+    METMethodResultCacheInFlightCall *inFlightCall = _inFlightCallsByKeyByGeneration[@(generation)][key];
+    inFlightCall.receivedResult = YES;
+    inFlightCall.result = result;
+    inFlightCall.error = error;
+    receivedResultHandlers = [inFlightCall.receivedResultHandlers copy];
+    [inFlightCall.receivedResultHandlers removeAllObjects];
+  }
+  
+  for (METMethodCompletionHandler receivedResultHandler in receivedResultHandlers) {
+    receivedResultHandler(result, error);
+  }
+}
+
+- (void)didCompleteCallWithMethodName:(NSString *)methodName parameters:(NSArray *)parameters generation:(NSUInteger)generation result:(id)result error:(NSError *)error {
+  METNameAndParametersKey *key = [METNameAndParametersKey keyWithName:methodName parameters:parameters];
+  // Every caller shares the same result, so it is made immutable to keep them from affecting each other
+  result = [result deepImmutableCopy];
+  NSArray *completionHandlers;
+  
+  @synchronized(self) {
+    NSMutableDictionary *inFlightCallsByKey = _inFlightCallsByKeyByGeneration[@(generation)];
+    METMethodResultCacheInFlightCall *inFlightCall = inFlightCallsByKey[key];
+    completionHandlers = inFlightCall.completionHandlers;
+    [inFlightCallsByKey removeObjectForKey:key];
+    if (inFlightCallsByKey.count == 0) {
+      [_inFlightCallsByKeyByGeneration removeObjectForKey:@(generation)];
+    }
+    
+    BOOL sameGeneration = generation == _generation;
+    
+    NSTimeInterval timeToLive = [_timesToLiveByMethodName[methodName] doubleValue];
+    if (!error && sameGeneration && timeToLive > 0 && _maximumNumberOfResults > 0) {
+      METMethodResultCacheEntry *entry = [[METMethodResultCacheEntry alloc] init];
+      entry.result = result;
+      entry.expiryTime = METMonotonicTime() + timeToLive;
+      _entriesByKey[key] = entry;
+      [_keysInOrderOfUse removeObject:key];
+      [_keysInOrderOfUse addObject:key];
+      [self evictResultsIfNeeded];
+    }
+  }
+  
+  for (METMethodCompletionHandler completionHandler in completionHandlers) {
+    completionHandler(result, error);
+  }
+}
+
+#pragma mark - Evicting Results
+
+- (void)evictResultsIfNeeded {
+  while (_keysInOrderOfUse.count > _maximumNumberOfResults) {
+    [self removeEntryForKey:_keysInOrderOfUse.firstObject];
+  }
+}
+
+- (void)removeEntryForKey:(METNameAndParametersKey *)key {
+  [_entriesByKey removeObjectForKey:key];
+  [_keysInOrderOfUse removeObject:key];
+}
+
+- (void)invalidate {
+  @synchronized(self) {
+    [_entriesByKey removeAllObjects];
+    [_keysInOrderOfUse removeAllObjects];
+    _generation++;
+  }
+}
+
+#pragma mark - Metrics
+
+- (NSUInteger)numberOfCachedResults {
+  @synchronized(self) {
+    return _entriesByKey.count;
+  }
+}
+
+- (NSUInteger)numberOfHits {
+  @synchronized(self) {
+    return _numberOfHits;
+  }
+}
+
+- (NSUInteger)numberOfMisses {
+  @synchronized(self) {
+    return _numberOfMisses;
+  }
+}
+
+- (NSUInteger)numberOfCoalescedCalls {
+  @synchronized(self) {
+    return _numberOfCoalescedCalls;
+  }
+}
+
+- (double)hitRate {
+  @synchronized(self) {
+    NSUInteger numberOfLookups = _numberOfHits + _numberOfMisses;
+    return numberOfLookups > 0 ? (double)_numberOfHits / numberOfLookups : 0;
+  }
+}
+
+@end
@@ -0,0 +1,95 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#import "METNameAndParametersKey.h"
+
+#import "NSObject+METAdditions.h"
+
+// NSArray and NSDictionary only hash their count, so combine the hashes of their contents instead.
+// Dictionary entries are combined in a way that doesn't depend on enumeration order.
+static NSUInteger METCanonicalHash(id object) {
+  if ([object isKindOfClass:[NSArray class]]) {
+    NSUInteger hash = [object count];
+    for (id element in object) {
+      hash = hash * 31 + METCanonicalHash(element);
+    }
+    return hash;
+  } else if ([object isKindOfClass:[NSDictionary class]]) {
+    __block NSUInteger hash = [object count];
+    [object enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+      hash ^= [key hash] * 31 + METCanonicalHash(value);
+    }];
+    return hash;
+  } else {
+    return [object hash];
+  }
+}
+
+@implementation METNameAndParametersKey {
+  NSUInteger _hash;
+}
+
++ (instancetype)keyWithName:(NSString *)name parameters:(NSArray *)parameters {
+  return [[self alloc] initWithName:name parameters:parameters];
+}
+
+- (instancetype)initWithName:(NSString *)name parameters:(NSArray *)parameters {
+  self = [super init];
+  if (self) {
+    _name = [name copy];
+    _parameters = [parameters deepImmutableCopy];
+    _hash = [_name hash] ^ METCanonicalHash(_parameters);
+  }
+  return self;
+}
+
+#pragma mark - NSObject
+
+- (BOOL)isEqual:(id)object {
+  if (self == object) {
+    return YES;
+  }
+  
+  if (![object isKindOfClass:[METNameAndParametersKey class]]) {
+    return NO;
+  }
+  
+  return [self isEqualToNameAndParametersKey:(METNameAndParametersKey *)object];
+}
+
+- (BOOL)isEqualToNameAndParametersKey:(METNameAndParametersKey *)key {
+  return _hash == key->_hash && [_name isEqualToString:key.name] && (_parameters == key.parameters || [_parameters isEqual:key.parameters]);
+}
+
+- (NSUInteger)hash {
+  return _hash;
+}
+
+- (NSString *)description {
+  return [NSString stringWithFormat:@"<name: %@, parameters: %@>", _name, _parameters];
+}
+
+#pragma mark - NSCopying
+
+- (id)copyWithZone:(NSZone *)zone {
+  return self;
+}
+
+@end
@@ -45,6 +45,21 @@ typedef NS_ENUM(NSInteger, METSubscriptionStatus) {
 
 @property (assign, nonatomic) NSTimeInterval notInUseTimeout;
 
+// After reconnecting, subscriptions with a higher priority are resubscribed first, and their data is shown
+// as soon as they're ready, without waiting for lower priority subscriptions. Lower priority subscriptions are
+// only resubscribed once all higher priority ones are ready. Defaults to NSOperationQueuePriorityNormal.
+@property (assign, nonatomic) NSOperationQueuePriority priority;
+
+// Measured from sending the sub message until receiving ready. DDP doesn't tell us which subscription data messages
+// belong to, so the counts include messages for other subscriptions that were loading at the same time. When a
+// subscription is loaded again after reconnecting, the metrics of every load are added up.
+@property (assign, nonatomic, readonly) NSTimeInterval timeToReady;
+@property (assign, nonatomic, readonly) NSUInteger numberOfAddedMessages;
+@property (assign, nonatomic, readonly) NSUInteger numberOfChangedMessages;
+@property (assign, nonatomic, readonly) NSUInteger numberOfRemovedMessages;
+@property (assign, nonatomic, readonly) NSUInteger numberOfBytesReceived;
+@property (assign, nonatomic, readonly) NSTimeInterval timeSpentApplyingDataMessages;
+
 @end
 
 NS_ASSUME_NONNULL_END
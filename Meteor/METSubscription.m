@@ -76,6 +76,69 @@
   }
 }
 
+#pragma mark - Load Metrics
+
+- (METSubscriptionLoadCounters)didLoadWithLoadCounters:(METSubscriptionLoadCounters)loadCounters {
+  @synchronized(self) {
+    METSubscriptionLoadCounters loadMetrics;
+    loadMetrics.time = loadCounters.time - _loadCountersWhenSubscribed.time;
+    loadMetrics.numberOfAddedMessages = loadCounters.numberOfAddedMessages - _loadCountersWhenSubscribed.numberOfAddedMessages;
+    loadMetrics.numberOfChangedMessages = loadCounters.numberOfChangedMessages - _loadCountersWhenSubscribed.numberOfChangedMessages;
+    loadMetrics.numberOfRemovedMessages = loadCounters.numberOfRemovedMessages - _loadCountersWhenSubscribed.numberOfRemovedMessages;
+    loadMetrics.numberOfBytesReceived = loadCounters.numberOfBytesReceived - _loadCountersWhenSubscribed.numberOfBytesReceived;
+    loadMetrics.timeSpentApplyingDataMessages = 0;
+    
+    _timeToReady += loadMetrics.time;
+    _numberOfAddedMessages += (NSUInteger)loadMetrics.numberOfAddedMessages;
+    _numberOfChangedMessages += (NSUInteger)loadMetrics.numberOfChangedMessages;
+    _numberOfRemovedMessages += (NSUInteger)loadMetrics.numberOfRemovedMessages;
+    _numberOfBytesReceived += (NSUInteger)loadMetrics.numberOfBytesReceived;
+    return loadMetrics;
+  }
+}
+
+- (void)didSpendTimeApplyingDataMessages:(NSTimeInterval)timeInterval {
+  @synchronized(self) {
+    _timeSpentApplyingDataMessages += timeInterval;
+  }
+}
+
+- (NSTimeInterval)timeToReady {
+  @synchronized(self) {
+    return _timeToReady;
+  }
+}
+
+- (NSUInteger)numberOfAddedMessages {
+  @synchronized(self) {
+    return _numberOfAddedMessages;
+  }
+}
+
+- (NSUInteger)numberOfChangedMessages {
+  @synchronized(self) {
+    return _numberOfChangedMessages;
+  }
+}
+
+- (NSUInteger)numberOfRemovedMessages {
+  @synchronized(self) {
+    return _numberOfRemovedMessages;
+  }
+}
+
+- (NSUInteger)numberOfBytesReceived {
+  @synchronized(self) {
+    return _numberOfBytesReceived;
+  }
+}
+
+- (NSTimeInterval)timeSpentApplyingDataMessages {
+  @synchronized(self) {
+    return _timeSpentApplyingDataMessages;
+  }
+}
+
 #pragma mark - Usage Count
 
 - (BOOL)isInUse {
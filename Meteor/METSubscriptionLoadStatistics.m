@@ -0,0 +1,44 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#import "METSubscriptionLoadStatistics.h"
+
+#import "METHistogram.h"
+
+@implementation METSubscriptionLoadStatistics
+
+- (instancetype)init {
+  self = [super init];
+  if (self) {
+    _timeToReadyHistogram = [[METHistogram alloc] initWithBaseValue:0.001 numberOfBuckets:24];
+    _numberOfDataMessagesHistogram = [[METHistogram alloc] initWithBaseValue:1 numberOfBuckets:24];
+    _numberOfBytesReceivedHistogram = [[METHistogram alloc] initWithBaseValue:64 numberOfBuckets:24];
+    _timeSpentApplyingDataMessagesHistogram = [[METHistogram alloc] initWithBaseValue:0.0001 numberOfBuckets:24];
+  }
+  return self;
+}
+
+#pragma mark - NSObject
+
+- (NSString *)description {
+  return [NSString stringWithFormat:@"<METSubscriptionLoadStatistics, count: %lu, mean time to ready: %f, mean number of data messages: %f, mean number of bytes received: %f>", (unsigned long)_timeToReadyHistogram.count, _timeToReadyHistogram.mean, _numberOfDataMessagesHistogram.mean, _numberOfBytesReceivedHistogram.mean];
+}
+
+@end
@@ -21,7 +21,10 @@
 #import <Foundation/Foundation.h>
 
 #import "METSubscription.h"
+#import "METDataUpdate.h"
 @class METDDPClient;
+@class METSubscriptionRetentionPolicy;
+@class METSubscriptionLoadStatistics;
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -34,6 +37,18 @@ NS_ASSUME_NONNULL_BEGIN
 
 @property (assign, nonatomic) NSTimeInterval defaultNotInUseTimeout;
 
+// The maximum number of subscriptions that are resubscribed at the same time after reconnecting. Zero means no limit.
+@property (assign, nonatomic) NSUInteger maximumNumberOfConcurrentResubscriptions;
+
+@property (copy, nonatomic) METSubscriptionRetentionPolicy *retentionPolicy;
+- (NSTimeInterval)notInUseTimeoutForSubscriptionWithName:(NSString *)name;
+
+// A hit is a subscription being reused while it was kept around after no longer being in use,
+// a miss is the same subscription being added again after it had already been removed
+@property (assign, nonatomic, readonly) NSUInteger numberOfReuseHits;
+@property (assign, nonatomic, readonly) NSUInteger numberOfReuseMisses;
+@property (assign, nonatomic, readonly) NSUInteger numberOfRetainedSubscriptions;
+
 - (METSubscription *)addSubscriptionWithName:(NSString *)name parameters:(nullable NSArray *)parameters completionHandler:(nullable METSubscriptionCompletionHandler)completionHandler;
 - (void)removeSubscription:(METSubscription *)subscription;
 
@@ -42,6 +57,13 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (void)reviveReadySubscriptionsAfterReconnect;
 
+// Removes subscriptions that are no longer in use right away, instead of waiting for their timeout,
+// and returns the number of subscriptions removed
+- (NSUInteger)removeSubscriptionsNotInUse;
+
+- (void)didReceiveDataUpdateWithType:(METDataUpdateType)updateType;
+- (nullable METSubscriptionLoadStatistics *)loadStatisticsForSubscriptionWithName:(NSString *)name;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -28,6 +28,24 @@
 #import "METDatabase_Internal.h"
 #import "METMethodInvocationCoordinator.h"
 #import "METTimer.h"
+#import "METNameAndParametersKey.h"
+#import "METSubscriptionRetentionPolicy.h"
+#import "METSubscriptionLoadStatistics.h"
+#import "METHistogram.h"
+#import "METMonotonicTime.h"
+
+// Only a limited number of removed subscriptions are remembered to detect misses
+static const NSUInteger METMaximumNumberOfRememberedExpiredSubscriptions = 1000;
+
+@interface METSubscriptionRetentionStatistics : NSObject
+
+@property (assign, nonatomic) NSTimeInterval notInUseTimeout;
+
+@end
+
+@implementation METSubscriptionRetentionStatistics
+
+@end
 
 @interface METSubscriptionManager ()
 
@@ -38,7 +56,26 @@
 @implementation METSubscriptionManager {
   dispatch_queue_t _queue;
   NSMutableDictionary *_subscriptionsByID;
+  NSMutableDictionary *_subscriptionsByNameAndParameters;
   NSMutableSet *_subscriptionsToBeRevivedAfterReconnect;
+  NSMutableSet *_identifiersOfSubscriptionsAwaitingReady;
+  NSMutableArray *_pendingResubscriptions;
+  METTimer *_snapshotReconciliationTimer;
+  
+  METSubscriptionRetentionPolicy *_retentionPolicy;
+  NSMutableDictionary *_retentionStatisticsBySubscriptionName;
+  NSMutableOrderedSet *_retainedSubscriptions;
+  NSMutableDictionary *_notInUseTimesByExpiredSubscriptionKey;
+  // Oldest first, so the oldest one is forgotten when the maximum is reached
+  NSMutableOrderedSet *_expiredSubscriptionKeys;
+  // The server removes the documents of a subscription before sending nosub, so no other subscriptions are removed
+  // to stay within the document budget until then
+  NSString *_identifierOfSubscriptionRemovedForDocumentBudget;
+  NSUInteger _numberOfReuseHits;
+  NSUInteger _numberOfReuseMisses;
+  
+  METSubscriptionLoadCounters _loadCounters;
+  NSMutableDictionary *_loadStatisticsBySubscriptionName;
 }
 
 - (instancetype)initWithClient:(METDDPClient *)client {
@@ -47,6 +84,22 @@
     _client = client;
     _queue = dispatch_queue_create("com.meteor.SubscriptionManager", DISPATCH_QUEUE_SERIAL);
     _subscriptionsByID = [[NSMutableDictionary alloc] init];
+    _subscriptionsByNameAndParameters = [[NSMutableDictionary alloc] init];
+    _identifiersOfSubscriptionsAwaitingReady = [[NSMutableSet alloc] init];
+    _pendingResubscriptions = [[NSMutableArray alloc] init];
+    
+    __weak METSubscriptionManager *weakSelf = self;
+    _snapshotReconciliationTimer = [[METTimer alloc] initWithQueue:_queue block:^{
+      [weakSelf.client.database finishReconcilingSnapshot];
+    }];
+    
+    _retentionPolicy = [[METSubscriptionRetentionPolicy alloc] init];
+    _retentionStatisticsBySubscriptionName = [[NSMutableDictionary alloc] init];
+    _retainedSubscriptions = [[NSMutableOrderedSet alloc] init];
+    _notInUseTimesByExpiredSubscriptionKey = [[NSMutableDictionary alloc] init];
+    _expiredSubscriptionKeys = [[NSMutableOrderedSet alloc] init];
+    
+    _loadStatisticsBySubscriptionName = [[NSMutableDictionary alloc] init];
   }
   return self;
 }
@@ -59,6 +112,11 @@
   dispatch_sync(_queue, ^{
     subscription = [self existingSubscriptionWithName:name parameters:parameters];
     if (subscription) {
+      if ([_retainedSubscriptions containsObject:subscription]) {
+        [_retainedSubscriptions removeObject:subscription];
+        _numberOfReuseHits++;
+        [self recordReuseOfSubscriptionWithName:name afterTimeInterval:METMonotonicTime() - subscription.notInUseTime missed:NO];
+      }
       [subscription beginUse];
       [subscription.reuseTimer stop];
       if (completionHandler) {
@@ -67,17 +125,27 @@
       return;
     };
     
+    METNameAndParametersKey *key = [METNameAndParametersKey keyWithName:name parameters:parameters];
+    NSNumber *notInUseTime = _notInUseTimesByExpiredSubscriptionKey[key];
+    if (notInUseTime) {
+      [_notInUseTimesByExpiredSubscriptionKey removeObjectForKey:key];
+      [_expiredSubscriptionKeys removeObject:key];
+      _numberOfReuseMisses++;
+      [self recordReuseOfSubscriptionWithName:name afterTimeInterval:METMonotonicTime() - notInUseTime.doubleValue missed:YES];
+    }
+    
     NSString *subscriptionID = [[METRandomValueGenerator defaultRandomValueGenerator] randomIdentifier];
     subscription = [[METSubscription alloc] initWithIdentifier:subscriptionID name:name parameters:parameters];
     if (completionHandler) {
       [subscription whenDone:completionHandler];
     }
     subscription.notInUseTimeout = _defaultNotInUseTimeout;
+    subscription.loadCountersWhenSubscribed = [self currentLoadCounters];
     [subscription beginUse];
     
-    _subscriptionsByID[subscriptionID] = subscription;
+    [self addSubscription:subscription];
     if (_client.connected) {
-      [_client sendSubMessageForSubscription:subscription];
+      [self sendSubMessageForSubscription:subscription];
     }
   });
   
@@ -85,16 +153,21 @@
 }
 
 - (METSubscription *)existingSubscriptionWithName:(NSString *)name parameters:(NSArray *)parameters {
-  __block METSubscription *existingSubscription;
+  return _subscriptionsByNameAndParameters[[METNameAndParametersKey keyWithName:name parameters:parameters]];
+}
+
+- (void)addSubscription:(METSubscription *)subscription {
+  _subscriptionsByID[subscription.identifier] = subscription;
+  _subscriptionsByNameAndParameters[[METNameAndParametersKey keyWithName:subscription.name parameters:subscription.parameters]] = subscription;
+}
+
+- (void)removeSubscriptionFromIndexes:(METSubscription *)subscription {
+  [_subscriptionsByID removeObjectForKey:subscription.identifier];
   
-  [_subscriptionsByID enumerateKeysAndObjectsUsingBlock:^(NSString *subscriptionID, METSubscription *subscription, BOOL *stop) {
-    if ([subscription.name isEqualToString:name] && (subscription.parameters == parameters || [subscription.parameters isEqualToArray:parameters])) {
-      existingSubscription = subscription;
-      *stop = YES;
-    }
-  }];
-        
-  return existingSubscription;
+  METNameAndParametersKey *key = [METNameAndParametersKey keyWithName:subscription.name parameters:subscription.parameters];
+  if (_subscriptionsByNameAndParameters[key] == subscription) {
+    [_subscriptionsByNameAndParameters removeObjectForKey:key];
+  }
 }
 
 - (void)removeSubscription:(METSubscription *)subscription {
@@ -113,16 +186,176 @@
             return;
           }
           
-          [_subscriptionsByID removeObjectForKey:subscription.identifier];
+          [self expireSubscription:subscription];
           
-          if (_client.connected) {
-            [_client sendUnsubMessageForSubscription:subscription];
+          // Subscriptions that expire without being reused, like the ones for one-off screens, are kept around for less time
+          if (_retentionPolicy.adaptive) {
+            METSubscriptionRetentionStatistics *statistics = [self retentionStatisticsForSubscriptionWithName:subscription.name];
+            statistics.notInUseTimeout = [self notInUseTimeoutWithinBounds:statistics.notInUseTimeout * 0.75];
           }
         }];
       }
-      [subscription.reuseTimer startWithTimeInterval:subscription.notInUseTimeout];
+      
+      subscription.notInUseTime = METMonotonicTime();
+      [_retainedSubscriptions addObject:subscription];
+      [subscription.reuseTimer startWithTimeInterval:[self notInUseTimeoutForSubscription:subscription]];
+      
+      [self removeRetainedSubscriptionsExceedingDocumentBudget];
+    }
+  });
+}
+
+- (void)expireSubscription:(METSubscription *)subscription {
+  [_retainedSubscriptions removeObject:subscription];
+  [self removeSubscriptionFromIndexes:subscription];
+  
+  METNameAndParametersKey *key = [METNameAndParametersKey keyWithName:subscription.name parameters:subscription.parameters];
+  [_expiredSubscriptionKeys removeObject:key];
+  if (_expiredSubscriptionKeys.count >= METMaximumNumberOfRememberedExpiredSubscriptions) {
+    [_notInUseTimesByExpiredSubscriptionKey removeObjectForKey:_expiredSubscriptionKeys[0]];
+    [_expiredSubscriptionKeys removeObjectAtIndex:0];
+  }
+  _notInUseTimesByExpiredSubscriptionKey[key] = @(subscription.notInUseTime);
+  [_expiredSubscriptionKeys addObject:key];
+  
+  // There is no need to unsubscribe if we haven't resubscribed yet
+  if ([_pendingResubscriptions containsObject:subscription]) {
+    [_pendingResubscriptions removeObject:subscription];
+    return;
+  }
+  
+  [self subscriptionIsNoLongerAwaitingReady:subscription];
+  
+  if (_client.connected) {
+    [_client sendUnsubMessageForSubscription:subscription];
+  }
+}
+
+- (NSUInteger)removeSubscriptionsNotInUse {
+  __block NSUInteger numberOfRemovedSubscriptions;
+  dispatch_sync(_queue, ^{
+    NSArray *retainedSubscriptions = [_retainedSubscriptions array];
+    for (METSubscription *subscription in retainedSubscriptions) {
+      [subscription.reuseTimer stop];
+      [self expireSubscription:subscription];
     }
+    numberOfRemovedSubscriptions = retainedSubscriptions.count;
+  });
+  return numberOfRemovedSubscriptions;
+}
+
+#pragma mark - Retention
+
+- (METSubscriptionRetentionPolicy *)retentionPolicy {
+  __block METSubscriptionRetentionPolicy *retentionPolicy;
+  dispatch_sync(_queue, ^{
+    retentionPolicy = [_retentionPolicy copy];
   });
+  return retentionPolicy;
+}
+
+- (void)setRetentionPolicy:(METSubscriptionRetentionPolicy *)retentionPolicy {
+  NSParameterAssert(retentionPolicy);
+  
+  retentionPolicy = [retentionPolicy copy];
+  dispatch_async(_queue, ^{
+    _retentionPolicy = retentionPolicy;
+    [self removeRetainedSubscriptionsExceedingDocumentBudget];
+  });
+}
+
+- (NSUInteger)numberOfReuseHits {
+  __block NSUInteger numberOfReuseHits;
+  dispatch_sync(_queue, ^{
+    numberOfReuseHits = _numberOfReuseHits;
+  });
+  return numberOfReuseHits;
+}
+
+- (NSUInteger)numberOfReuseMisses {
+  __block NSUInteger numberOfReuseMisses;
+  dispatch_sync(_queue, ^{
+    numberOfReuseMisses = _numberOfReuseMisses;
+  });
+  return numberOfReuseMisses;
+}
+
+- (NSUInteger)numberOfRetainedSubscriptions {
+  __block NSUInteger numberOfRetainedSubscriptions;
+  dispatch_sync(_queue, ^{
+    numberOfRetainedSubscriptions = _retainedSubscriptions.count;
+  });
+  return numberOfRetainedSubscriptions;
+}
+
+- (NSTimeInterval)notInUseTimeoutForSubscriptionWithName:(NSString *)name {
+  NSParameterAssert(name);
+  
+  __block NSTimeInterval notInUseTimeout;
+  dispatch_sync(_queue, ^{
+    METSubscriptionRetentionStatistics *statistics = _retentionStatisticsBySubscriptionName[name];
+    notInUseTimeout = (_retentionPolicy.adaptive && statistics) ? statistics.notInUseTimeout : _defaultNotInUseTimeout;
+  });
+  return notInUseTimeout;
+}
+
+- (METSubscriptionRetentionStatistics *)retentionStatisticsForSubscriptionWithName:(NSString *)name {
+  METSubscriptionRetentionStatistics *statistics = _retentionStatisticsBySubscriptionName[name];
+  if (!statistics) {
+    statistics = [[METSubscriptionRetentionStatistics alloc] init];
+    statistics.notInUseTimeout = [self notInUseTimeoutWithinBounds:_defaultNotInUseTimeout];
+    _retentionStatisticsBySubscriptionName[name] = statistics;
+  }
+  return statistics;
+}
+
+- (NSTimeInterval)notInUseTimeoutForSubscription:(METSubscription *)subscription {
+  if (!_retentionPolicy.adaptive) {
+    return subscription.notInUseTimeout;
+  }
+  
+  return [self retentionStatisticsForSubscriptionWithName:subscription.name].notInUseTimeout;
+}
+
+- (NSTimeInterval)notInUseTimeoutWithinBounds:(NSTimeInterval)notInUseTimeout {
+  return fmin(fmax(notInUseTimeout, _retentionPolicy.minimumNotInUseTimeout), _retentionPolicy.maximumNotInUseTimeout);
+}
+
+- (void)recordReuseOfSubscriptionWithName:(NSString *)name afterTimeInterval:(NSTimeInterval)timeInterval missed:(BOOL)missed {
+  if (!_retentionPolicy.adaptive) {
+    return;
+  }
+  
+  // Aim for keeping subscriptions around twice as long as it usually takes for them to be reused.
+  // After a miss we jump there right away, after a hit we only move part of the way.
+  METSubscriptionRetentionStatistics *statistics = [self retentionStatisticsForSubscriptionWithName:name];
+  NSTimeInterval targetNotInUseTimeout = timeInterval * 2;
+  if (missed) {
+    statistics.notInUseTimeout = [self notInUseTimeoutWithinBounds:fmax(statistics.notInUseTimeout, targetNotInUseTimeout)];
+  } else {
+    statistics.notInUseTimeout = [self notInUseTimeoutWithinBounds:statistics.notInUseTimeout + (targetNotInUseTimeout - statistics.notInUseTimeout) / 4];
+  }
+}
+
+// DDP doesn't tell us which subscriptions documents belong to, so we go by the number of documents actually in the
+// local cache, and remove subscriptions one at a time until their documents have been removed
+- (void)removeRetainedSubscriptionsExceedingDocumentBudget {
+  NSUInteger maximumNumberOfDocuments = _retentionPolicy.maximumNumberOfRetainedDocuments;
+  if (maximumNumberOfDocuments == 0) {
+    return;
+  }
+  
+  METDatabase *database = _client.database;
+  while (_retainedSubscriptions.count > 0 && !_identifierOfSubscriptionRemovedForDocumentBudget && database.numberOfDocuments > maximumNumberOfDocuments) {
+    METSubscription *subscription = _retainedSubscriptions[0];
+    [subscription.reuseTimer stop];
+    [self expireSubscription:subscription];
+    
+    // Without a connection there is no nosub to wait for, and the documents are removed after reconnecting anyway
+    if (_client.connected) {
+      _identifierOfSubscriptionRemovedForDocumentBudget = subscription.identifier;
+    }
+  }
 }
 
 - (void)didReceiveReadyForSubscriptionWithID:(NSString *)subscriptionID {
@@ -136,6 +369,24 @@
     }
             
     [self removeSubscriptionToBeRevivedAfterConnect:subscription];
+    [self subscriptionIsNoLongerAwaitingReady:subscription];
+    
+    // Captured here because a resubscription can start a new load before the buffered updates have been flushed
+    NSTimeInterval timeSpentApplyingDataMessagesWhenSubscribed = subscription.loadCountersWhenSubscribed.timeSpentApplyingDataMessages;
+    METSubscriptionLoadCounters loadMetrics = [subscription didLoadWithLoadCounters:[self currentLoadCounters]];
+    
+    // Data messages received before ready may still be buffered, so the time spent applying them is only known after they have been flushed
+    METDatabase *database = _client.database;
+    [database performAfterBufferedUpdatesAreFlushed:^{
+      NSTimeInterval timeSpentApplyingDataMessages = database.timeSpentApplyingDataUpdates - timeSpentApplyingDataMessagesWhenSubscribed;
+      dispatch_async(_queue, ^{
+        [subscription didSpendTimeApplyingDataMessages:timeSpentApplyingDataMessages];
+        
+        METSubscriptionLoadCounters appliedLoadMetrics = loadMetrics;
+        appliedLoadMetrics.timeSpentApplyingDataMessages = timeSpentApplyingDataMessages;
+        [self recordLoadMetrics:appliedLoadMetrics forSubscriptionWithName:subscription.name];
+      });
+    }];
     
     [_client.methodInvocationCoordinator performAfterAllCurrentlyBufferedDocumentsAreFlushed:^{
       [subscription didChangeStatus:METSubscriptionStatusReady error:nil];
@@ -147,12 +398,22 @@
   NSParameterAssert(subscriptionID);
 
   dispatch_async(_queue, ^{
+    if ([_identifierOfSubscriptionRemovedForDocumentBudget isEqualToString:subscriptionID]) {
+      _identifierOfSubscriptionRemovedForDocumentBudget = nil;
+      [_client.database performAfterBufferedUpdatesAreFlushed:^{
+        dispatch_async(_queue, ^{
+          [self removeRetainedSubscriptionsExceedingDocumentBudget];
+        });
+      }];
+    }
+    
     METSubscription *subscription = _subscriptionsByID[subscriptionID];
     if (!subscription) {
       return;
     }
     
     [self removeSubscriptionToBeRevivedAfterConnect:subscription];
+    [self subscriptionIsNoLongerAwaitingReady:subscription];
 
     [subscription didChangeStatus:METSubscriptionStatusError error:error];
   });
@@ -161,6 +422,9 @@
 - (void)reviveReadySubscriptionsAfterReconnect {
   dispatch_sync(_queue, ^{
     _subscriptionsToBeRevivedAfterReconnect = [[NSMutableSet alloc] init];
+    [_identifiersOfSubscriptionsAwaitingReady removeAllObjects];
+    _identifierOfSubscriptionRemovedForDocumentBudget = nil;
+    [_pendingResubscriptions removeAllObjects];
     NSDictionary *existingSubscriptionsByID = _subscriptionsByID;
     _subscriptionsByID = [existingSubscriptionsByID mutableCopy];
     [existingSubscriptionsByID enumerateKeysAndObjectsUsingBlock:^(NSString *identifier, METSubscription *subscription, BOOL *stop) {
@@ -170,12 +434,25 @@
         if (subscription.ready) {
           [_subscriptionsToBeRevivedAfterReconnect addObject:subscription];
         }
-        [_client sendSubMessageForSubscription:subscription];
+        [_pendingResubscriptions addObject:subscription];
       } else {
-        [_subscriptionsByID removeObjectForKey:subscription.identifier];
+        [_retainedSubscriptions removeObject:subscription];
+        [self removeSubscriptionFromIndexes:subscription];
       }
     }];
     
+    [_pendingResubscriptions sortWithOptions:NSSortStable usingComparator:^NSComparisonResult(METSubscription *subscription1, METSubscription *subscription2) {
+      if (subscription1.priority > subscription2.priority) {
+        return NSOrderedAscending;
+      } else if (subscription1.priority < subscription2.priority) {
+        return NSOrderedDescending;
+      } else {
+        return NSOrderedSame;
+      }
+    }];
+    [self sendPendingResubscriptions];
+    [self updateSnapshotReconciliationTimer];
+    
     if (!self.waitingForSubscriptionsToBeRevivedAfterReconnect) {
       // If there are no subscriptions to be revived, there is no need to wait for quiescence
       _client.database.waitingForQuiescence = NO;
@@ -186,16 +463,152 @@
   });
 }
 
+- (void)sendSubMessageForSubscription:(METSubscription *)subscription {
+  [_identifiersOfSubscriptionsAwaitingReady addObject:subscription.identifier];
+  [_snapshotReconciliationTimer stop];
+  subscription.loadCountersWhenSubscribed = [self currentLoadCounters];
+  
+  // While subscriptions are not ready yet, documents added to empty collections can be loaded in bulk
+  if (_client.database.loadsCollectionsInBulk) {
+    _client.database.detectsBulkLoading = YES;
+  }
+  
+  [_client sendSubMessageForSubscription:subscription];
+}
+
+- (void)sendPendingResubscriptions {
+  NSUInteger maximumNumberOfConcurrentResubscriptions = _maximumNumberOfConcurrentResubscriptions;
+  while (_pendingResubscriptions.count > 0 && (maximumNumberOfConcurrentResubscriptions == 0 || _identifiersOfSubscriptionsAwaitingReady.count < maximumNumberOfConcurrentResubscriptions)) {
+    METSubscription *subscription = _pendingResubscriptions[0];
+    if ([self isAwaitingReadyForSubscriptionsWithPriorityHigherThan:subscription.priority]) {
+      break;
+    }
+    [_pendingResubscriptions removeObjectAtIndex:0];
+    [self sendSubMessageForSubscription:subscription];
+  }
+}
+
+- (void)subscriptionIsNoLongerAwaitingReady:(METSubscription *)subscription {
+  if (![_identifiersOfSubscriptionsAwaitingReady containsObject:subscription.identifier]) {
+    return;
+  }
+  
+  [_identifiersOfSubscriptionsAwaitingReady removeObject:subscription.identifier];
+  
+  // Subscriptions waiting to be resubscribed keep us from considering the data complete
+  [self sendPendingResubscriptions];
+  if (_identifiersOfSubscriptionsAwaitingReady.count < 1) {
+    _client.database.detectsBulkLoading = NO;
+    
+    // We don't know which collections a subscription publishes, so collections are only considered complete once no subscription is still loading
+    [_client.database finishBulkLoading];
+  }
+  
+  [self updateSnapshotReconciliationTimer];
+}
+
+// Subscriptions being ready doesn't mean the app has added all the subscriptions it needs yet, so we only consider the
+// restored documents we haven't received to be gone once no subscription has been loading for the grace period
+- (void)updateSnapshotReconciliationTimer {
+  METDatabase *database = _client.database;
+  if (database.snapshot && _identifiersOfSubscriptionsAwaitingReady.count < 1) {
+    [_snapshotReconciliationTimer startWithTimeInterval:database.snapshotReconciliationGracePeriod];
+  } else {
+    [_snapshotReconciliationTimer stop];
+  }
+}
+
+#pragma mark - Load Metrics
+
+- (void)didReceiveDataUpdateWithType:(METDataUpdateType)updateType {
+  @synchronized(self) {
+    switch (updateType) {
+      case METDataUpdateTypeAdd:
+        _loadCounters.numberOfAddedMessages++;
+        break;
+      case METDataUpdateTypeChange:
+      case METDataUpdateTypeReplace:
+        _loadCounters.numberOfChangedMessages++;
+        break;
+      case METDataUpdateTypeRemove:
+        _loadCounters.numberOfRemovedMessages++;
+        break;
+    }
+  }
+}
+
+- (METSubscriptionLoadCounters)currentLoadCounters {
+  METSubscriptionLoadCounters loadCounters;
+  @synchronized(self) {
+    loadCounters = _loadCounters;
+  }
+  loadCounters.time = METMonotonicTime();
+  loadCounters.numberOfBytesReceived = _client.numberOfBytesReceived;
+  loadCounters.timeSpentApplyingDataMessages = _client.database.timeSpentApplyingDataUpdates;
+  return loadCounters;
+}
+
+- (void)recordLoadMetrics:(METSubscriptionLoadCounters)loadMetrics forSubscriptionWithName:(NSString *)name {
+  METSubscriptionLoadStatistics *loadStatistics = _loadStatisticsBySubscriptionName[name];
+  if (!loadStatistics) {
+    loadStatistics = [[METSubscriptionLoadStatistics alloc] init];
+    _loadStatisticsBySubscriptionName[name] = loadStatistics;
+  }
+  
+  [loadStatistics.timeToReadyHistogram recordValue:loadMetrics.time];
+  [loadStatistics.numberOfDataMessagesHistogram recordValue:loadMetrics.numberOfAddedMessages + loadMetrics.numberOfChangedMessages + loadMetrics.numberOfRemovedMessages];
+  [loadStatistics.numberOfBytesReceivedHistogram recordValue:loadMetrics.numberOfBytesReceived];
+  [loadStatistics.timeSpentApplyingDataMessagesHistogram recordValue:loadMetrics.timeSpentApplyingDataMessages];
+}
+
+- (METSubscriptionLoadStatistics *)loadStatisticsForSubscriptionWithName:(NSString *)name {
+  NSParameterAssert(name);
+  
+  __block METSubscriptionLoadStatistics *loadStatistics;
+  dispatch_sync(_queue, ^{
+    loadStatistics = _loadStatisticsBySubscriptionName[name];
+  });
+  return loadStatistics;
+}
+
 - (BOOL)isWaitingForSubscriptionsToBeRevivedAfterReconnect {
   return _subscriptionsToBeRevivedAfterReconnect.count > 0;
 }
 
 - (void)removeSubscriptionToBeRevivedAfterConnect:(METSubscription *)subscription {
+  BOOL wasToBeRevived = [_subscriptionsToBeRevivedAfterReconnect containsObject:subscription];
   [_subscriptionsToBeRevivedAfterReconnect removeObject:subscription];
   if (!self.waitingForSubscriptionsToBeRevivedAfterReconnect) {
     _subscriptionsToBeRevivedAfterReconnect = nil;
     [_client allSubscriptionsToBeRevivedAfterReconnectAreDone];
+  } else if (wasToBeRevived && ![self isWaitingForSubscriptionsToBeRevivedWithPriorityAtLeast:subscription.priority]) {
+    // All subscriptions in this priority group are done, so their data is shown without waiting for lower priority subscriptions.
+    // Documents of lower priority subscriptions that are still loading are only removed once all subscriptions are done.
+    _client.database.waitingForQuiescence = NO;
+    [_client.database flushDataUpdatesKeepingExistingDocuments];
+    _client.database.waitingForQuiescence = YES;
+  }
+}
+
+// Lower priority subscriptions are only resubscribed once higher priority ones are ready, so none of their data
+// is buffered yet when the data of a higher priority group is flushed
+- (BOOL)isAwaitingReadyForSubscriptionsWithPriorityHigherThan:(NSOperationQueuePriority)priority {
+  for (NSString *identifier in _identifiersOfSubscriptionsAwaitingReady) {
+    METSubscription *subscription = _subscriptionsByID[identifier];
+    if (subscription.priority > priority) {
+      return YES;
+    }
+  }
+  return NO;
+}
+
+- (BOOL)isWaitingForSubscriptionsToBeRevivedWithPriorityAtLeast:(NSOperationQueuePriority)priority {
+  for (METSubscription *subscription in _subscriptionsToBeRevivedAfterReconnect) {
+    if (subscription.priority >= priority) {
+      return YES;
+    }
   }
+  return NO;
 }
 
 @end
@@ -0,0 +1,39 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface METSubscriptionRetentionPolicy : NSObject <NSCopying>
+
+// When adaptive, the time subscriptions are kept around after they're no longer in use is learned per subscription name,
+// from how long it takes for subscriptions to be reused, and stays within the minimum and maximum
+@property (assign, nonatomic, getter=isAdaptive) BOOL adaptive;
+@property (assign, nonatomic) NSTimeInterval minimumNotInUseTimeout;
+@property (assign, nonatomic) NSTimeInterval maximumNotInUseTimeout;
+
+// Subscriptions that are no longer in use are removed early, least recently used first, while the local cache
+// contains more documents than this. Zero means no limit.
+@property (assign, nonatomic) NSUInteger maximumNumberOfRetainedDocuments;
+
+@end
+
+NS_ASSUME_NONNULL_END
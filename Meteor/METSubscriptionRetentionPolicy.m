@@ -0,0 +1,54 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#import "METSubscriptionRetentionPolicy.h"
+
+@implementation METSubscriptionRetentionPolicy
+
+- (instancetype)init {
+  self = [super init];
+  if (self) {
+    // The default policy keeps every subscription around for the fixed not in use timeout
+    _adaptive = NO;
+    _minimumNotInUseTimeout = 10;
+    _maximumNotInUseTimeout = 900;
+    _maximumNumberOfRetainedDocuments = 0;
+  }
+  return self;
+}
+
+#pragma mark - NSCopying
+
+- (id)copyWithZone:(NSZone *)zone {
+  METSubscriptionRetentionPolicy *copy = [[[self class] allocWithZone:zone] init];
+  copy.adaptive = _adaptive;
+  copy.minimumNotInUseTimeout = _minimumNotInUseTimeout;
+  copy.maximumNotInUseTimeout = _maximumNotInUseTimeout;
+  copy.maximumNumberOfRetainedDocuments = _maximumNumberOfRetainedDocuments;
+  return copy;
+}
+
+#pragma mark - NSObject
+
+- (NSString *)description {
+  return [NSString stringWithFormat:@"<METSubscriptionRetentionPolicy, adaptive: %@, minimumNotInUseTimeout: %f, maximumNotInUseTimeout: %f, maximumNumberOfRetainedDocuments: %lu>", _adaptive ? @"YES" : @"NO", _minimumNotInUseTimeout, _maximumNotInUseTimeout, (unsigned long)_maximumNumberOfRetainedDocuments];
+}
+
+@end
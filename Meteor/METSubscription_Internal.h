@@ -24,6 +24,15 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
+typedef struct {
+  NSTimeInterval time;
+  uint64_t numberOfAddedMessages;
+  uint64_t numberOfChangedMessages;
+  uint64_t numberOfRemovedMessages;
+  uint64_t numberOfBytesReceived;
+  NSTimeInterval timeSpentApplyingDataMessages;
+} METSubscriptionLoadCounters;
+
 @interface METSubscription ()
 
 @property (assign, nonatomic, readonly) METSubscriptionStatus status;
@@ -35,6 +44,12 @@ NS_ASSUME_NONNULL_BEGIN
 - (void)endUse;
 
 @property (nullable, strong, nonatomic) METTimer *reuseTimer;
+@property (assign, nonatomic) NSTimeInterval notInUseTime;
+
+@property (assign, nonatomic) METSubscriptionLoadCounters loadCountersWhenSubscribed;
+// Metrics are added to those of earlier loads, like the ones before reconnecting. Returns the metrics of this load only.
+- (METSubscriptionLoadCounters)didLoadWithLoadCounters:(METSubscriptionLoadCounters)loadCounters;
+- (void)didSpendTimeApplyingDataMessages:(NSTimeInterval)timeInterval;
 
 @end
 
@@ -20,13 +20,17 @@
 
 #import <Foundation/Foundation.h>
 
+@class METTimerWheel;
+
 NS_ASSUME_NONNULL_BEGIN
 
 @interface METTimer : NSObject
 
-- (instancetype)initWithQueue:(dispatch_queue_t)queue block:(void (^)())block NS_DESIGNATED_INITIALIZER;
+- (instancetype)initWithQueue:(dispatch_queue_t)queue block:(void (^)())block;
+- (instancetype)initWithQueue:(dispatch_queue_t)queue timerWheel:(METTimerWheel *)timerWheel block:(void (^)())block NS_DESIGNATED_INITIALIZER;
 - (instancetype)init NS_UNAVAILABLE;
 
+// Timers with a tolerance below the resolution of the timer wheel get their own dispatch source
 @property (assign, nonatomic) NSTimeInterval tolerance;
 
 - (void)startWithTimeInterval:(NSTimeInterval)timeInterval;
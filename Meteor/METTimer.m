@@ -20,45 +20,130 @@
 
 #import "METTimer.h"
 
+#import "METTimerWheel.h"
+
 @implementation METTimer {
   dispatch_queue_t _queue;
   void (^_block)();
+  METTimerWheel *_timerWheel;
+  
+  METTimerWheelEntry *_timerWheelEntry;
+  NSUInteger _generation;
   
   dispatch_source_t _timer_source;
   BOOL _started;
 }
 
 - (instancetype)initWithQueue:(dispatch_queue_t)queue block:(void (^)())block {
+  return [self initWithQueue:queue timerWheel:[METTimerWheel sharedTimerWheel] block:block];
+}
+
+- (instancetype)initWithQueue:(dispatch_queue_t)queue timerWheel:(METTimerWheel *)timerWheel block:(void (^)())block {
   self = [super init];
   if (self) {
     _queue = queue;
+    _timerWheel = timerWheel;
     _block = [block copy];
     _tolerance = 0.1;
-    _timer_source = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _queue);
-    dispatch_source_set_event_handler(_timer_source, ^{
-      if (_started) {
-        dispatch_suspend(_timer_source);
-        _started = NO;
-      }
-      _block();
-    });
   }
   return self;
 }
 
+- (void)dealloc {
+  if (_timerWheelEntry) {
+    [_timerWheel cancelEntry:_timerWheelEntry];
+  }
+  if (_timer_source) {
+    dispatch_source_cancel(_timer_source);
+    // Releasing a suspended source is not allowed
+    if (!_started) {
+      dispatch_resume(_timer_source);
+    }
+  }
+}
+
 - (void)startWithTimeInterval:(NSTimeInterval)timeInterval {
-  dispatch_source_set_timer(_timer_source, dispatch_time(DISPATCH_TIME_NOW, timeInterval * NSEC_PER_SEC), 0, _tolerance * NSEC_PER_MSEC);
+  if (_tolerance < _timerWheel.resolution) {
+    [self startTimerSourceWithTimeInterval:timeInterval];
+    return;
+  }
+  
+  // The tolerance may have changed since the timer was last started
+  [self stopTimerSource];
+  
+  @synchronized(self) {
+    if (_timerWheelEntry) {
+      [_timerWheel cancelEntry:_timerWheelEntry];
+    }
+    
+    // Firing is dispatched to the timer's queue, so a generation check filters out fires from before a restart or stop
+    NSUInteger generation = ++_generation;
+    __weak METTimer *weakSelf = self;
+    _timerWheelEntry = [_timerWheel scheduleBlock:^{
+      [weakSelf timerWheelDidFireForGeneration:generation];
+    } afterTimeInterval:timeInterval];
+  }
+}
+
+- (void)stop {
+  [self cancelTimerWheelEntry];
+  [self stopTimerSource];
+}
+
+- (void)cancelTimerWheelEntry {
+  @synchronized(self) {
+    if (_timerWheelEntry) {
+      [_timerWheel cancelEntry:_timerWheelEntry];
+      _timerWheelEntry = nil;
+    }
+    _generation++;
+  }
+}
+
+- (void)timerWheelDidFireForGeneration:(NSUInteger)generation {
+  dispatch_async(_queue, ^{
+    @synchronized(self) {
+      if (generation != _generation) {
+        return;
+      }
+      _timerWheelEntry = nil;
+      _generation++;
+    }
+    _block();
+  });
+}
+
+#pragma mark - Timer Source
+
+- (void)startTimerSourceWithTimeInterval:(NSTimeInterval)timeInterval {
+  // The tolerance may have changed since the timer was last started
+  [self cancelTimerWheelEntry];
+  
+  if (!_timer_source) {
+    _timer_source = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _queue);
+    __weak METTimer *weakSelf = self;
+    dispatch_source_set_event_handler(_timer_source, ^{
+      [weakSelf timerSourceDidFire];
+    });
+  }
+  
+  dispatch_source_set_timer(_timer_source, dispatch_time(DISPATCH_TIME_NOW, timeInterval * NSEC_PER_SEC), DISPATCH_TIME_FOREVER, _tolerance * NSEC_PER_SEC);
   if (!_started) {
     dispatch_resume(_timer_source);
     _started = YES;
   }
 }
 
-- (void)stop {
+- (void)stopTimerSource {
   if (_started) {
     dispatch_suspend(_timer_source);
     _started = NO;
   }
 }
 
+- (void)timerSourceDidFire {
+  [self stopTimerSource];
+  _block();
+}
+
 @end
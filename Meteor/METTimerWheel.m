@@ -0,0 +1,322 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#import "METTimerWheel.h"
+
+#import "METMonotonicTime.h"
+
+// 4 levels of 64 slots cover 2^24 ticks (about 46 hours at the default resolution), entries further out are cascaded repeatedly
+#define METTimerWheelNumberOfLevels 4
+#define METTimerWheelSlotBits 6
+#define METTimerWheelNumberOfSlots (1 << METTimerWheelSlotBits)
+
+static const uint64_t METTimerWheelSlotMask = METTimerWheelNumberOfSlots - 1;
+static const uint64_t METTimerWheelMaximumTickDelta = (1ULL << (METTimerWheelSlotBits * METTimerWheelNumberOfLevels)) - 1;
+static const NSTimeInterval METTimerWheelDefaultResolution = 0.01;
+
+@interface METTimerWheelEntry ()
+
+@property (copy, nonatomic) void (^block)();
+@property (assign, nonatomic) uint64_t expirationTick;
+@property (assign, nonatomic, getter=isScheduled) BOOL scheduled;
+@property (assign, nonatomic) NSUInteger level;
+@property (assign, nonatomic) NSUInteger slot;
+@property (strong, nonatomic) METTimerWheelEntry *next;
+@property (unsafe_unretained, nonatomic) METTimerWheelEntry *previous;
+
+@end
+
+@implementation METTimerWheelEntry
+
+@end
+
+@implementation METTimerWheel {
+  dispatch_queue_t _queue;
+  dispatch_source_t _timerSource;
+  NSTimeInterval _startTime;
+  
+  __strong METTimerWheelEntry *_slots[METTimerWheelNumberOfLevels][METTimerWheelNumberOfSlots];
+  uint64_t _occupiedSlots[METTimerWheelNumberOfLevels];
+  uint64_t _currentTick;
+  uint64_t _armedTick;
+  NSUInteger _numberOfScheduledEntries;
+}
+
++ (METTimerWheel *)sharedTimerWheel {
+  static METTimerWheel *sharedTimerWheel;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    sharedTimerWheel = [[METTimerWheel alloc] init];
+  });
+  return sharedTimerWheel;
+}
+
+- (instancetype)init {
+  return [self initWithResolution:METTimerWheelDefaultResolution];
+}
+
+- (instancetype)initWithResolution:(NSTimeInterval)resolution {
+  NSParameterAssert(resolution > 0);
+  
+  self = [super init];
+  if (self) {
+    _resolution = resolution;
+    _coalescingInterval = resolution;
+    _startTime = METMonotonicTime();
+    _armedTick = UINT64_MAX;
+    
+    _queue = dispatch_queue_create("com.meteor.TimerWheel", DISPATCH_QUEUE_SERIAL);
+    _timerSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _queue);
+    __weak METTimerWheel *weakSelf = self;
+    dispatch_source_set_event_handler(_timerSource, ^{
+      [weakSelf advance];
+    });
+    dispatch_source_set_timer(_timerSource, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+    dispatch_resume(_timerSource);
+  }
+  return self;
+}
+
+- (void)dealloc {
+  dispatch_source_cancel(_timerSource);
+  
+  // Unlink entries one by one to avoid releasing long chains recursively
+  for (NSUInteger level = 0; level < METTimerWheelNumberOfLevels; level++) {
+    for (NSUInteger slot = 0; slot < METTimerWheelNumberOfSlots; slot++) {
+      METTimerWheelEntry *entry = _slots[level][slot];
+      _slots[level][slot] = nil;
+      while (entry) {
+        METTimerWheelEntry *next = entry.next;
+        entry.next = nil;
+        entry = next;
+      }
+    }
+  }
+}
+
+#pragma mark - Scheduling
+
+- (METTimerWheelEntry *)scheduleBlock:(void (^)())block afterTimeInterval:(NSTimeInterval)timeInterval {
+  NSParameterAssert(block);
+  
+  METTimerWheelEntry *entry = [[METTimerWheelEntry alloc] init];
+  entry.block = block;
+  
+  @synchronized(self) {
+    NSTimeInterval now = METMonotonicTime();
+    if (_numberOfScheduledEntries == 0) {
+      _currentTick = MAX(_currentTick, [self tickForTime:now]);
+    }
+    
+    entry.expirationTick = (uint64_t)ceil((now + MAX(timeInterval, 0) - _startTime) / _resolution);
+    entry.scheduled = YES;
+    [self insertEntry:entry];
+    _numberOfScheduledEntries++;
+    
+    if (entry.expirationTick < _armedTick) {
+      [self armTimerSource];
+    }
+  }
+  
+  return entry;
+}
+
+- (void)cancelEntry:(METTimerWheelEntry *)entry {
+  NSParameterAssert(entry);
+  
+  @synchronized(self) {
+    if (!entry.scheduled) {
+      return;
+    }
+    
+    [self removeEntry:entry];
+    entry.scheduled = NO;
+    entry.block = nil;
+    _numberOfScheduledEntries--;
+  }
+}
+
+- (NSUInteger)numberOfScheduledEntries {
+  @synchronized(self) {
+    return _numberOfScheduledEntries;
+  }
+}
+
+#pragma mark - Slots
+
+- (uint64_t)tickForTime:(NSTimeInterval)time {
+  return (uint64_t)MAX((time - _startTime) / _resolution, 0);
+}
+
+- (void)insertEntry:(METTimerWheelEntry *)entry {
+  uint64_t expirationTick = MAX(entry.expirationTick, _currentTick);
+  uint64_t tickDelta = MIN(expirationTick - _currentTick, METTimerWheelMaximumTickDelta);
+  expirationTick = _currentTick + tickDelta;
+  
+  NSUInteger level = 0;
+  while (level < METTimerWheelNumberOfLevels - 1 && tickDelta >> (METTimerWheelSlotBits * (level + 1)) > 0) {
+    level++;
+  }
+  NSUInteger slot = (expirationTick >> (METTimerWheelSlotBits * level)) & METTimerWheelSlotMask;
+  
+  METTimerWheelEntry *head = _slots[level][slot];
+  entry.level = level;
+  entry.slot = slot;
+  entry.previous = nil;
+  entry.next = head;
+  head.previous = entry;
+  _slots[level][slot] = entry;
+  _occupiedSlots[level] |= 1ULL << slot;
+}
+
+- (void)removeEntry:(METTimerWheelEntry *)entry {
+  NSUInteger level = entry.level;
+  NSUInteger slot = entry.slot;
+  
+  METTimerWheelEntry *next = entry.next;
+  next.previous = entry.previous;
+  if (entry.previous) {
+    entry.previous.next = next;
+  } else {
+    _slots[level][slot] = next;
+    if (!next) {
+      _occupiedSlots[level] &= ~(1ULL << slot);
+    }
+  }
+  entry.next = nil;
+  entry.previous = nil;
+}
+
+- (METTimerWheelEntry *)detachEntriesAtLevel:(NSUInteger)level slot:(NSUInteger)slot {
+  METTimerWheelEntry *entry = _slots[level][slot];
+  _slots[level][slot] = nil;
+  _occupiedSlots[level] &= ~(1ULL << slot);
+  return entry;
+}
+
+#pragma mark - Advancing
+
+- (void)advance {
+  NSMutableArray *expiredEntries = [[NSMutableArray alloc] init];
+  
+  @synchronized(self) {
+    uint64_t targetTick = [self tickForTime:METMonotonicTime()];
+    
+    while (_currentTick <= targetTick) {
+      uint64_t tick = _currentTick;
+      if ((tick & METTimerWheelSlotMask) == 0) {
+        [self cascadeAtTick:tick];
+      }
+      [self expireEntriesAtTick:tick addingTo:expiredEntries];
+      _currentTick = tick + 1;
+      
+      // Skip ahead to the next cascade when there is nothing left on the lowest level
+      if (_occupiedSlots[0] == 0 && (_currentTick & METTimerWheelSlotMask) != 0) {
+        _currentTick = MIN((_currentTick | METTimerWheelSlotMask) + 1, targetTick + 1);
+      }
+    }
+    
+    _numberOfScheduledEntries -= expiredEntries.count;
+    [self armTimerSource];
+  }
+  
+  for (METTimerWheelEntry *entry in expiredEntries) {
+    void (^block)() = entry.block;
+    entry.block = nil;
+    block();
+  }
+}
+
+- (void)cascadeAtTick:(uint64_t)tick {
+  for (NSUInteger level = 1; level < METTimerWheelNumberOfLevels; level++) {
+    NSUInteger slot = (tick >> (METTimerWheelSlotBits * level)) & METTimerWheelSlotMask;
+    METTimerWheelEntry *entry = [self detachEntriesAtLevel:level slot:slot];
+    while (entry) {
+      METTimerWheelEntry *next = entry.next;
+      [self insertEntry:entry];
+      entry = next;
+    }
+    
+    // Higher levels only move when this level wraps around
+    if (slot != 0) {
+      break;
+    }
+  }
+}
+
+- (void)expireEntriesAtTick:(uint64_t)tick addingTo:(NSMutableArray *)expiredEntries {
+  METTimerWheelEntry *entry = [self detachEntriesAtLevel:0 slot:tick & METTimerWheelSlotMask];
+  while (entry) {
+    METTimerWheelEntry *next = entry.next;
+    if (entry.expirationTick <= tick) {
+      entry.next = nil;
+      entry.previous = nil;
+      entry.scheduled = NO;
+      [expiredEntries addObject:entry];
+    } else {
+      [self insertEntry:entry];
+    }
+    entry = next;
+  }
+}
+
+// The earliest tick at which an entry expires or has to be cascaded down a level
+- (uint64_t)nextTickToProcess {
+  uint64_t nextTick = UINT64_MAX;
+  
+  for (NSUInteger level = 0; level < METTimerWheelNumberOfLevels; level++) {
+    uint64_t occupiedSlots = _occupiedSlots[level];
+    if (occupiedSlots == 0) {
+      continue;
+    }
+    
+    NSUInteger shift = METTimerWheelSlotBits * level;
+    uint64_t levelTick = _currentTick >> shift;
+    
+    // The current slot on a higher level has already been cascaded, unless we're exactly at its boundary
+    BOOL currentSlotPending = (_currentTick & ((1ULL << shift) - 1)) == 0;
+    uint64_t firstOffset = currentSlotPending ? 0 : 1;
+    
+    NSUInteger rotation = (levelTick + firstOffset) & METTimerWheelSlotMask;
+    uint64_t rotatedSlots = rotation == 0 ? occupiedSlots : (occupiedSlots >> rotation) | (occupiedSlots << (METTimerWheelNumberOfSlots - rotation));
+    uint64_t offset = firstOffset + __builtin_ctzll(rotatedSlots);
+    
+    nextTick = MIN(nextTick, (levelTick + offset) << shift);
+  }
+  
+  return nextTick;
+}
+
+- (void)armTimerSource {
+  uint64_t nextTick = [self nextTickToProcess];
+  if (nextTick == _armedTick) {
+    return;
+  }
+  _armedTick = nextTick;
+  
+  if (nextTick == UINT64_MAX) {
+    dispatch_source_set_timer(_timerSource, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+  } else {
+    NSTimeInterval timeInterval = MAX(_startTime + nextTick * _resolution - METMonotonicTime(), 0);
+    dispatch_source_set_timer(_timerSource, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(timeInterval * NSEC_PER_SEC)), DISPATCH_TIME_FOREVER, (uint64_t)(_coalescingInterval * NSEC_PER_SEC));
+  }
+}
+
+@end
@@ -31,7 +31,15 @@ FOUNDATION_EXPORT const unsigned char MeteorVersionString[];
 #import <Meteor/METDDPClient+AccountsPassword.h>
 #import <Meteor/METDDPConnection.h>
 #import <Meteor/METSubscription.h>
+#import <Meteor/METSubscriptionRetentionPolicy.h>
+#import <Meteor/METSubscriptionLoadStatistics.h>
 #import <Meteor/METDatabase.h>
+#import <Meteor/METDatabaseChangeLog.h>
+#import <Meteor/METChangeDeliveryScheduler.h>
+#import <Meteor/METDocumentSnapshot.h>
+#import <Meteor/METDatabaseFlushPolicy.h>
+#import <Meteor/METHistogram.h>
+#import <Meteor/METMethodResultCache.h>
 #import <Meteor/METCollection.h>
 #import <Meteor/METDocument.h>
 #import <Meteor/METDocumentKey.h>
@@ -0,0 +1,172 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#import "NSObject+METAdditions.h"
+
+@implementation NSObject (METAdditions)
+
+// Objects we don't know about are copied shallowly if they support NSCopying, and returned as is otherwise
+- (id)deepImmutableCopy {
+  if ([self conformsToProtocol:@protocol(NSCopying)]) {
+    return [(id<NSCopying>)self copyWithZone:nil];
+  } else {
+    return self;
+  }
+}
+
+@end
+
+@implementation NSString (METDeepImmutableCopy)
+
+- (id)deepImmutableCopy {
+  // Copying an immutable string just retains it
+  return [self copy];
+}
+
+@end
+
+@implementation NSNumber (METDeepImmutableCopy)
+
+- (id)deepImmutableCopy {
+  return self;
+}
+
+@end
+
+@implementation NSNull (METDeepImmutableCopy)
+
+- (id)deepImmutableCopy {
+  return self;
+}
+
+@end
+
+@implementation NSDate (METDeepImmutableCopy)
+
+- (id)deepImmutableCopy {
+  return self;
+}
+
+@end
+
+@implementation NSArray (METDeepImmutableCopy)
+
+- (id)deepImmutableCopy {
+  NSUInteger count = self.count;
+  if (count == 0) {
+    return [self copy];
+  }
+  
+  // Toll-free bridged arrays claim to be mutable even when they're not, so those are always copied
+  BOOL needsCopy = [self isKindOfClass:[NSMutableArray class]];
+  
+  // The buffer is only allocated once we know a copy is needed, so immutable arrays are returned without allocating
+  __unsafe_unretained id *objects = NULL;
+  NSMutableArray *copiedObjects = nil;
+  
+  NSUInteger index = 0;
+  for (id object in self) {
+    id copiedObject = [object deepImmutableCopy];
+    if (copiedObject != object) {
+      needsCopy = YES;
+      if (!copiedObjects) {
+        copiedObjects = [[NSMutableArray alloc] init];
+      }
+      // Keep copies alive until the array has been created
+      [copiedObjects addObject:copiedObject];
+    }
+    if (needsCopy && !objects) {
+      objects = (__unsafe_unretained id *)malloc(sizeof(id) * count);
+      [self getObjects:objects range:NSMakeRange(0, index)];
+    }
+    if (objects) {
+      objects[index] = copiedObject;
+    }
+    index++;
+  }
+  
+  if (!objects) {
+    return self;
+  }
+  
+  id result = [[NSArray alloc] initWithObjects:objects count:count];
+  free(objects);
+  return result;
+}
+
+@end
+
+@implementation NSDictionary (METDeepImmutableCopy)
+
+- (id)deepImmutableCopy {
+  NSUInteger count = self.count;
+  if (count == 0) {
+    return [self copy];
+  }
+  
+  BOOL needsCopy = [self isKindOfClass:[NSMutableDictionary class]];
+  
+  // As with arrays, buffers are only allocated once we know a copy is needed
+  __unsafe_unretained id *keys = NULL;
+  __unsafe_unretained id *objects = NULL;
+  NSMutableArray *copiedObjects = nil;
+  
+  NSUInteger index = 0;
+  for (id key in self) {
+    id object = [self objectForKey:key];
+    id copiedObject = [object deepImmutableCopy];
+    if (copiedObject != object) {
+      needsCopy = YES;
+      if (!copiedObjects) {
+        copiedObjects = [[NSMutableArray alloc] init];
+      }
+      [copiedObjects addObject:copiedObject];
+    }
+    if (needsCopy && !keys) {
+      keys = (__unsafe_unretained id *)malloc(sizeof(id) * count);
+      objects = (__unsafe_unretained id *)malloc(sizeof(id) * count);
+      // Entries we've already seen were returned as is, so we only have to find them again
+      NSUInteger previousIndex = 0;
+      for (id previousKey in self) {
+        if (previousIndex == index) break;
+        keys[previousIndex] = previousKey;
+        objects[previousIndex] = [self objectForKey:previousKey];
+        previousIndex++;
+      }
+    }
+    if (keys) {
+      keys[index] = key;
+      objects[index] = copiedObject;
+    }
+    index++;
+  }
+  
+  if (!keys) {
+    return self;
+  }
+  
+  id result = [[NSDictionary alloc] initWithObjects:objects forKeys:keys count:count];
+  free(keys);
+  free(objects);
+  return result;
+}
+
+@end
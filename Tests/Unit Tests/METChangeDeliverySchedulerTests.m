@@ -0,0 +1,160 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#import <XCTest/XCTest.h>
+#import "XCTestCase+Meteor.h"
+
+#import "METChangeDeliveryScheduler.h"
+#import "METChangeDeliveryScheduler_Testing.h"
+
+#import "METDatabaseChanges.h"
+#import "METDatabaseChanges_Internal.h"
+#import "METDocumentKey.h"
+
+@interface METChangeDeliverySchedulerTests : XCTestCase
+
+@end
+
+@implementation METChangeDeliverySchedulerTests {
+  METChangeDeliveryScheduler *_scheduler;
+  NSMutableArray *_deliveredChanges;
+  NSMutableArray *_scheduledBlocks;
+  NSTimeInterval _currentTime;
+  NSTimeInterval _deliveryTimePerDocumentChange;
+}
+
+- (void)setUp {
+  [super setUp];
+  
+  _deliveredChanges = [[NSMutableArray alloc] init];
+  _scheduledBlocks = [[NSMutableArray alloc] init];
+  _currentTime = 0;
+  _deliveryTimePerDocumentChange = 0.001;
+  
+  // Handler and run loop are simulated so delivery is deterministic and doesn't depend on the main queue
+  __weak METChangeDeliverySchedulerTests *weakSelf = self;
+  _scheduler = [[METChangeDeliveryScheduler alloc] initWithDatabase:nil handler:^(METDatabaseChanges *databaseChanges) {
+    METChangeDeliverySchedulerTests *strongSelf = weakSelf;
+    [strongSelf->_deliveredChanges addObject:databaseChanges];
+    strongSelf->_currentTime += [databaseChanges affectedDocumentKeys].count * strongSelf->_deliveryTimePerDocumentChange;
+  }];
+  _scheduler.timeSource = ^NSTimeInterval{
+    return weakSelf ? weakSelf->_currentTime : 0;
+  };
+  _scheduler.scheduleBlock = ^(dispatch_block_t block) {
+    [weakSelf->_scheduledBlocks addObject:block];
+  };
+}
+
+- (void)runNextIteration {
+  dispatch_block_t block = _scheduledBlocks.firstObject;
+  [_scheduledBlocks removeObjectAtIndex:0];
+  block();
+}
+
+- (METDatabaseChanges *)databaseChangesAddingNumberOfDocuments:(NSUInteger)numberOfDocuments {
+  METDatabaseChanges *databaseChanges = [[METDatabaseChanges alloc] init];
+  for (NSUInteger i = 0; i < numberOfDocuments; i++) {
+    METDocumentKey *documentKey = [METDocumentKey keyWithCollectionName:@"players" documentID:@(i)];
+    [databaseChanges willChangeDocumentWithKey:documentKey fieldsBeforeChanges:nil];
+    [databaseChanges didChangeDocumentWithKey:documentKey fieldsAfterChanges:@{@"score": @(i)}];
+  }
+  return databaseChanges;
+}
+
+- (void)testDeliversSmallBatchInSingleSlice {
+  [_scheduler enqueueDatabaseChanges:[self databaseChangesAddingNumberOfDocuments:10]];
+  
+  XCTAssertEqual(1, _scheduledBlocks.count);
+  [self runNextIteration];
+  
+  XCTAssertEqual(1, _deliveredChanges.count);
+  XCTAssertEqual(10, [_deliveredChanges[0] affectedDocumentKeys].count);
+  XCTAssertEqual(0, _scheduledBlocks.count);
+}
+
+- (void)testDeliversLargeBatchInSlicesSizedToTimeBudget {
+  _scheduler.timeBudget = 0.008;
+  _scheduler.initialSliceSize = 4;
+  
+  [_scheduler enqueueDatabaseChanges:[self databaseChangesAddingNumberOfDocuments:100]];
+  
+  [self runNextIteration];
+  XCTAssertEqual(4, [_deliveredChanges[0] affectedDocumentKeys].count);
+  XCTAssertEqualWithAccuracy(0.001, _scheduler.estimatedDeliveryTimePerDocumentChange, 0.0001);
+  
+  // With a delivery time of 1 ms per document, a slice should contain 8 documents
+  [self runNextIteration];
+  XCTAssertEqual(8, [_deliveredChanges[1] affectedDocumentKeys].count);
+  
+  while (_scheduledBlocks.count > 0) {
+    [self runNextIteration];
+  }
+  
+  NSUInteger numberOfDeliveredDocumentChanges = 0;
+  for (METDatabaseChanges *databaseChanges in _deliveredChanges) {
+    numberOfDeliveredDocumentChanges += [databaseChanges affectedDocumentKeys].count;
+  }
+  XCTAssertEqual(100, numberOfDeliveredDocumentChanges);
+  XCTAssertEqual(0, _scheduler.numberOfPendingDocumentChanges);
+}
+
+- (void)testLimitsSliceSizeWhenDeliveryIsVeryFast {
+  _deliveryTimePerDocumentChange = 1e-300;
+  _scheduler.initialSliceSize = 4;
+  _scheduler.maximumSliceSize = 50;
+  
+  [_scheduler enqueueDatabaseChanges:[self databaseChangesAddingNumberOfDocuments:100]];
+  
+  [self runNextIteration];
+  [self runNextIteration];
+  XCTAssertEqual(50, [_deliveredChanges[1] affectedDocumentKeys].count);
+}
+
+- (void)testMergesLaterChangesIntoUndeliveredSlices {
+  METDocumentKey *documentKey = [METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"];
+  
+  METDatabaseChanges *databaseChanges = [[METDatabaseChanges alloc] init];
+  [databaseChanges willChangeDocumentWithKey:documentKey fieldsBeforeChanges:nil];
+  [databaseChanges didChangeDocumentWithKey:documentKey fieldsAfterChanges:@{@"name": @"Ada Lovelace", @"score": @25}];
+  [_scheduler enqueueDatabaseChanges:databaseChanges];
+  
+  databaseChanges = [[METDatabaseChanges alloc] init];
+  [databaseChanges willChangeDocumentWithKey:documentKey fieldsBeforeChanges:@{@"name": @"Ada Lovelace", @"score": @25}];
+  [databaseChanges didChangeDocumentWithKey:documentKey fieldsAfterChanges:@{@"name": @"Ada Lovelace", @"score": @30}];
+  [_scheduler enqueueDatabaseChanges:databaseChanges];
+  
+  XCTAssertEqual(1, _scheduledBlocks.count);
+  [self runNextIteration];
+  
+  XCTAssertEqual(1, _deliveredChanges.count);
+  [self verifyDatabaseChanges:_deliveredChanges[0] containsChangeToDocumentWithKey:documentKey changeType:METDocumentChangeTypeAdd changedFields:@{@"name": @"Ada Lovelace", @"score": @30}];
+}
+
+- (void)testDoesNotDeliverChangesAfterInvalidation {
+  [_scheduler enqueueDatabaseChanges:[self databaseChangesAddingNumberOfDocuments:10]];
+  [_scheduler invalidate];
+  
+  [self runNextIteration];
+  
+  XCTAssertEqual(0, _deliveredChanges.count);
+}
+
+@end
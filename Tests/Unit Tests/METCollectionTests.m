@@ -37,6 +37,7 @@
 #import "METMethodInvocationCoordinator.h"
 #import "METMethodInvocationCoordinator_Testing.h"
 #import "METMethodInvocation.h"
+#import "METMethodInvocationScheduler.h"
 
 @interface METCollectionTests : XCTAsyncTestCase
 
@@ -177,6 +178,68 @@
   [self waitForExpectationsWithTimeout:1.0 handler:nil];
 }
 
+#pragma mark - Inserting Documents in a Batch
+
+- (void)testInsertingDocumentsAddsThemToLocalCacheAndReturnsTheirIDs {
+  NSArray *documentIDs = [_collection insertDocumentsWithFields:@[@{@"_id": @"lovelace", @"name": @"Ada Lovelace"}, @{@"_id": @"shannon", @"name": @"Claude Shannon"}]];
+  
+  XCTAssertEqualObjects(documentIDs, (@[@"lovelace", @"shannon"]));
+  [self verifyDatabase:_database containsDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace"}];
+  [self verifyDatabase:_database containsDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"shannon"] fields:@{@"name": @"Claude Shannon"}];
+}
+
+- (void)testInsertingDocumentsReturnsNullForDocumentsThatCouldNotBeInserted {
+  [_collection insertDocumentWithID:@"lovelace" fields:@{@"name": @"Ada Lovelace"}];
+  
+  NSArray *documentIDs = [_collection insertDocumentsWithFields:@[@{@"_id": @"lovelace", @"name": @"Ada Lovelace"}, @{@"_id": @"shannon", @"name": @"Claude Shannon"}]];
+  
+  XCTAssertEqualObjects(documentIDs, (@[[NSNull null], @"shannon"]));
+}
+
+- (void)testInsertingDocumentsPostsASingleNotification {
+  __block NSUInteger numberOfNotifications = 0;
+  id observer = [[NSNotificationCenter defaultCenter] addObserverForName:METDatabaseDidChangeNotification object:_database queue:nil usingBlock:^(NSNotification *notification) {
+    numberOfNotifications++;
+  }];
+  
+  NSMutableArray *arrayOfFields = [[NSMutableArray alloc] init];
+  for (NSUInteger i = 0; i < 100; i++) {
+    [arrayOfFields addObject:@{@"score": @(i)}];
+  }
+  [_collection insertDocumentsWithFields:arrayOfFields];
+  
+  [self waitForTimeInterval:0.1];
+  [[NSNotificationCenter defaultCenter] removeObserver:observer];
+  
+  XCTAssertEqual(1, numberOfNotifications);
+  XCTAssertEqual(100, [_collection allDocuments].count);
+}
+
+- (void)testInsertingDocumentsSchedulesMethodInvocationsInOrder {
+  [_collection insertDocumentsWithFields:@[@{@"_id": @"lovelace", @"name": @"Ada Lovelace"}, @{@"_id": @"shannon", @"name": @"Claude Shannon"}]];
+  
+  NSArray *methodInvocations = [[_client methodInvocationCoordinator] scheduler].methodInvocations;
+  XCTAssertEqual(2, methodInvocations.count);
+  XCTAssertEqualObjects([methodInvocations[0] parameters][0][@"_id"], @"lovelace");
+  XCTAssertEqualObjects([methodInvocations[1] parameters][0][@"_id"], @"shannon");
+}
+
+- (void)testInsertingDocumentsInvokesCompletionHandlerOnceAllMethodInvocationsHaveCompleted {
+  NSError *expectedError = [NSError errorWithDomain:@"" code:1 userInfo:@{}];
+  
+  XCTestExpectation *expectation = [self expectationWithDescription:@"completion handler invoked"];
+  [_collection insertDocumentsWithFields:@[@{@"_id": @"lovelace", @"name": @"Ada Lovelace"}, @{@"_id": @"shannon", @"name": @"Claude Shannon"}] completionHandler:^(NSError *error) {
+    XCTAssertEqualObjects(error, expectedError);
+    [expectation fulfill];
+  }];
+  
+  NSArray *methodInvocations = [[_client methodInvocationCoordinator] scheduler].methodInvocations;
+  [methodInvocations[0] completionHandler](@[@{@"_id": @"lovelace"}], nil);
+  [methodInvocations[1] completionHandler](nil, expectedError);
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+}
+
 #pragma mark - Updating Documents
 
 - (void)testUpdatingDocumentCallsUpdateDDPMethod {
@@ -301,6 +364,150 @@
   [self waitForExpectationsWithTimeout:1.0 handler:nil];
 }
 
+#pragma mark - Updating Nested Fields
+
+- (void)testUpdatingNestedFieldCallsUpdateDDPMethodWithDottedPaths {
+  [_database performUpdatesInLocalCacheWithoutTrackingChanges:^(METDocumentCache *localCache) {
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace", @"profile": @{@"address": @{@"city": @"London", @"street": @"St James's Square"}, @"title": @"Countess"}, @"scores": @[@25, @30]}];
+  }];
+  
+  OCMExpect(([_client callMethodWithName:@"/players/update" parameters:@[@{@"_id": @"lovelace"}, @{@"$set": @{@"profile.address.city": @"Ockham", @"scores.1": @31}, @"$unset": @{@"profile.title": @""}}] options:METMethodCallOptionsReturnStubValue completionHandler:[OCMArg any]]));
+  
+  [_collection updateDocumentWithID:@"lovelace" changedFields:@{@"profile": @{@"address": @{@"city": @"Ockham", @"street": @"St James's Square"}}, @"scores": @[@25, @31]}];
+  
+  OCMVerifyAll(_client);
+}
+
+- (void)testUpdatingNestedFieldUpdatesItInLocalCache {
+  [_database performUpdatesInLocalCacheWithoutTrackingChanges:^(METDocumentCache *localCache) {
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace", @"profile": @{@"address": @{@"city": @"London", @"street": @"St James's Square"}, @"title": @"Countess"}, @"scores": @[@25, @30]}];
+  }];
+  
+  [_collection updateDocumentWithID:@"lovelace" changedFields:@{@"profile": @{@"address": @{@"city": @"Ockham", @"street": @"St James's Square"}}, @"scores": @[@25, @31]}];
+  
+  [self verifyDatabase:_database containsDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace", @"profile": @{@"address": @{@"city": @"Ockham", @"street": @"St James's Square"}}, @"scores": @[@25, @31]}];
+}
+
+- (void)testUpdatingNestedFieldSetsWholeValueWhenChangingMorePathsThanMaximum {
+  [_database performUpdatesInLocalCacheWithoutTrackingChanges:^(METDocumentCache *localCache) {
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace", @"profile": @{@"city": @"London", @"title": @"Countess"}}];
+  }];
+  _collection.maximumNumberOfNestedUpdatePaths = 1;
+  
+  OCMExpect(([_client callMethodWithName:@"/players/update" parameters:@[@{@"_id": @"lovelace"}, @{@"$set": @{@"profile": @{@"city": @"Ockham", @"title": @"Baroness"}}}] options:METMethodCallOptionsReturnStubValue completionHandler:[OCMArg any]]));
+  
+  [_collection updateDocumentWithID:@"lovelace" changedFields:@{@"profile": @{@"city": @"Ockham", @"title": @"Baroness"}}];
+  
+  OCMVerifyAll(_client);
+}
+
+- (void)testCoalescedUpdatesOfNestedFieldsAreSentAsDottedPathsRelativeToOriginalDocument {
+  [_database performUpdatesInLocalCacheWithoutTrackingChanges:^(METDocumentCache *localCache) {
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace", @"profile": @{@"city": @"London", @"title": @"Countess"}}];
+  }];
+  _collection.updateCoalescingInterval = 0.05;
+  
+  [_collection updateDocumentWithID:@"lovelace" changedFields:@{@"profile": @{@"city": @"Ockham", @"title": @"Countess"}}];
+  [_collection updateDocumentWithID:@"lovelace" changedFields:@{@"profile": @{@"city": @"Ockham", @"title": @"Baroness"}}];
+  
+  METMethodInvocationCoordinator *methodInvocationCoordinator = [_client methodInvocationCoordinator];
+  [self waitUntilAssertionsPass:^{
+    XCTAssertEqual(1, methodInvocationCoordinator.scheduler.numberOfMethodInvocations);
+  }];
+  XCTAssertEqualObjects(([methodInvocationCoordinator lastMethodInvocation].parameters), (@[@{@"_id": @"lovelace"}, @{@"$set": @{@"profile.city": @"Ockham", @"profile.title": @"Baroness"}}]));
+  [self verifyDatabase:_database containsDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace", @"profile": @{@"city": @"Ockham", @"title": @"Baroness"}}];
+}
+
+#pragma mark - Coalescing Updates
+
+- (void)testCoalescedUpdatesAreAppliedToLocalCacheRightAway {
+  [_database performUpdatesInLocalCacheWithoutTrackingChanges:^(METDocumentCache *localCache) {
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace", @"score": @25, @"color": @"blue"}];
+  }];
+  _collection.updateCoalescingInterval = 0.2;
+  
+  [_collection updateDocumentWithID:@"lovelace" changedFields:@{@"score": @26}];
+  [_collection updateDocumentWithID:@"lovelace" changedFields:@{@"score": @27, @"color": [NSNull null]}];
+  
+  [self verifyDatabase:_database containsDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace", @"score": @27}];
+}
+
+- (void)testCoalescedUpdatesAreSentAsSingleMethodInvocationWithMergedModifier {
+  [_database performUpdatesInLocalCacheWithoutTrackingChanges:^(METDocumentCache *localCache) {
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace", @"score": @25, @"color": @"blue"}];
+  }];
+  _collection.updateCoalescingInterval = 0.1;
+  
+  for (NSInteger score = 26; score <= 30; score++) {
+    [_collection updateDocumentWithID:@"lovelace" changedFields:@{@"score": @(score)}];
+  }
+  [_collection updateDocumentWithID:@"lovelace" changedFields:@{@"color": [NSNull null]}];
+  
+  METMethodInvocationCoordinator *methodInvocationCoordinator = [_client methodInvocationCoordinator];
+  XCTAssertEqual(0, methodInvocationCoordinator.scheduler.numberOfMethodInvocations);
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertEqual(1, methodInvocationCoordinator.scheduler.numberOfMethodInvocations);
+  }];
+  XCTAssertEqualObjects(([methodInvocationCoordinator lastMethodInvocation].parameters), (@[@{@"_id": @"lovelace"}, @{@"$set": @{@"score": @30}, @"$unset": @{@"color": @""}}]));
+}
+
+- (void)testCoalescedUpdateIsSentBeforeMethodsCalledAfterIt {
+  [_database performUpdatesInLocalCacheWithoutTrackingChanges:^(METDocumentCache *localCache) {
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace", @"score": @25}];
+  }];
+  _collection.updateCoalescingInterval = 10;
+  
+  [_collection updateDocumentWithID:@"lovelace" changedFields:@{@"score": @26}];
+  [_client callMethodWithName:@"logout" parameters:nil options:METMethodCallOptionsBarrier completionHandler:nil];
+  
+  METMethodInvocationCoordinator *methodInvocationCoordinator = [_client methodInvocationCoordinator];
+  NSArray *methodInvocations = methodInvocationCoordinator.scheduler.methodInvocations;
+  XCTAssertEqual(2, methodInvocations.count);
+  XCTAssertEqualObjects(@"/players/update", [methodInvocations[0] methodName]);
+  XCTAssertEqualObjects(@"logout", [methodInvocations[1] methodName]);
+}
+
+- (void)testCoalescedUpdateKeepsItsDocumentBufferedAfterReset {
+  [_database performUpdatesInLocalCacheWithoutTrackingChanges:^(METDocumentCache *localCache) {
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace", @"score": @25}];
+  }];
+  _collection.updateCoalescingInterval = 10;
+  
+  [_collection updateDocumentWithID:@"lovelace" changedFields:@{@"score": @26}];
+  
+  METMethodInvocationCoordinator *methodInvocationCoordinator = [_client methodInvocationCoordinator];
+  [methodInvocationCoordinator resetWhileAddingMethodInvocationsToTheFrontOfTheQueueUsingBlock:^{}];
+  
+  XCTAssertEqualObjects((@{@"name": @"Ada Lovelace", @"score": @25}), [methodInvocationCoordinator bufferedDocumentForKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"]].fields);
+  
+  [_client callMethodWithName:@"logout" parameters:nil options:METMethodCallOptionsBarrier completionHandler:nil];
+  
+  NSArray *methodInvocations = methodInvocationCoordinator.scheduler.methodInvocations;
+  XCTAssertEqual(2, methodInvocations.count);
+  XCTAssertEqualObjects(@"/players/update", [methodInvocations[0] methodName]);
+}
+
+- (void)testReceivingUpdatesDoneForCoalescedUpdateRollsBackAllOfItsStubChanges {
+  [_database performUpdatesInLocalCacheWithoutTrackingChanges:^(METDocumentCache *localCache) {
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace", @"score": @25}];
+  }];
+  _collection.updateCoalescingInterval = 0.05;
+  
+  [_collection updateDocumentWithID:@"lovelace" changedFields:@{@"score": @26}];
+  [_collection updateDocumentWithID:@"lovelace" changedFields:@{@"score": @27}];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertNotNil([[_client methodInvocationCoordinator] lastMethodInvocation]);
+  }];
+  
+  [self expectationForChangeToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] changeType:METDocumentChangeTypeUpdate changedFields:@{@"score": @25}];
+  
+  [self notifyDidReceiveUpdatesDoneForLastMethodInvocation];
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+}
+
 #pragma mark - Removing Documents
 
 - (void)testRemovingDocumentCallsRemoveDDPMethod {
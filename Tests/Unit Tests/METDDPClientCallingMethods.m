@@ -29,6 +29,9 @@
 
 #import "METMethodInvocation.h"
 #import "METMethodInvocationContext.h"
+#import "METMethodInvocationLog.h"
+#import "METMethodResultCache.h"
+#import "METMethodInvocationCoordinator.h"
 
 @interface METDDPClientCallingMethods : METDDPClientTestCase
 
@@ -49,6 +52,87 @@
 
 #pragma mark - Calling Methods
 
+- (void)testOpeningMethodInvocationLogReplaysPendingMethodInvocationsWithOriginalRandomSeed {
+  NSString *fileName = [NSString stringWithFormat:@"%@.log", [[NSUUID UUID] UUIDString]];
+  NSURL *URL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:fileName]];
+  
+  METMethodInvocationLog *log = [[METMethodInvocationLog alloc] initWithURL:URL];
+  XCTAssertTrue([log openWithError:nil]);
+  METMethodInvocation *methodInvocation = [[METMethodInvocation alloc] init];
+  methodInvocation.methodID = @"pending";
+  methodInvocation.methodName = @"doSomething";
+  methodInvocation.parameters = @[@"someParameter"];
+  methodInvocation.randomSeed = @"someSeed";
+  [log appendMethodInvocation:methodInvocation];
+  [log close];
+  
+  XCTestExpectation *stubExpectation = [self expectationWithDescription:@"stub invoked"];
+  [_client defineStubForMethodWithName:@"doSomething" usingBlock:^id(NSArray *parameters) {
+    XCTAssertEqualObjects(@"someSeed", _client.currentMethodInvocationContext.randomSeed);
+    [stubExpectation fulfill];
+    return nil;
+  }];
+  
+  [self expectationForSentMessageWithHandler:^(NSDictionary *message) {
+    return [message[@"msg"] isEqualToString:@"method"] && [message[@"id"] isEqualToString:@"pending"] && [message[@"randomSeed"] isEqualToString:@"someSeed"];
+  }];
+  
+  NSError *error;
+  XCTAssertTrue([_client openMethodInvocationLogAtURL:URL error:&error], @"%@", error);
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+  
+  [_connection receiveMessage:@{@"msg": @"result", @"id": @"pending"}];
+  
+  METMethodInvocationLog *openedLog = _client.methodInvocationCoordinator.methodInvocationLog;
+  [self waitUntilAssertionsPass:^{
+    XCTAssertEqual(0, openedLog.numberOfPendingMethodInvocations);
+  }];
+  
+  [openedLog close];
+  [[NSFileManager defaultManager] removeItemAtURL:URL error:nil];
+}
+
+- (void)testCallingMethodWithOpenMethodInvocationLogAppendsMethodInvocation {
+  NSString *fileName = [NSString stringWithFormat:@"%@.log", [[NSUUID UUID] UUIDString]];
+  NSURL *URL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:fileName]];
+  XCTAssertTrue([_client openMethodInvocationLogAtURL:URL error:nil]);
+  
+  [_client callMethodWithName:@"doSomething" parameters:@[@"someParameter"]];
+  
+  METMethodInvocationLog *log = _client.methodInvocationCoordinator.methodInvocationLog;
+  XCTAssertEqual(1, log.numberOfPendingMethodInvocations);
+  XCTAssertEqualObjects([self lastMethodID], [[log pendingMethodInvocations][0] methodID]);
+  
+  [log close];
+  [[NSFileManager defaultManager] removeItemAtURL:URL error:nil];
+}
+
+- (void)testReceivingResultRightAfterCallingMethodRemovesMethodInvocationFromLog {
+  NSString *fileName = [NSString stringWithFormat:@"%@.log", [[NSUUID UUID] UUIDString]];
+  NSURL *URL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:fileName]];
+  XCTAssertTrue([_client openMethodInvocationLogAtURL:URL error:nil]);
+  
+  XCTestExpectation *expectation = [self expectationWithDescription:@"completion handler invoked"];
+  [_client callMethodWithName:@"doSomething" parameters:@[@"someParameter"] completionHandler:^(id result, NSError *error) {
+    [expectation fulfill];
+  }];
+  
+  NSString *lastMethodID = [self lastMethodID];
+  [_connection receiveMessage:@{@"msg": @"result", @"id": lastMethodID, @"result": @"someResult"}];
+  [_connection receiveMessage:@{@"msg": @"updated", @"methods": @[lastMethodID]}];
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+  
+  METMethodInvocationLog *log = _client.methodInvocationCoordinator.methodInvocationLog;
+  [self waitUntilAssertionsPass:^{
+    XCTAssertEqual(0, log.numberOfPendingMethodInvocations);
+  }];
+  
+  [log close];
+  [[NSFileManager defaultManager] removeItemAtURL:URL error:nil];
+}
+
 - (void)testCallingMethodSendsMethodMessage {
   [self expectationForSentMessageWithHandler:^(NSDictionary *message) {
     XCTAssertEqualObjects(@"method", message[@"msg"]);
@@ -107,6 +191,92 @@
   [self waitForExpectationsWithTimeout:1.0 handler:nil];
 }
 
+- (void)testCallingCacheableMethodWhileIdenticalCallIsInFlightOnlySendsOneMethodMessage {
+  [_client defineCacheableMethodWithName:@"lookup" timeToLive:60];
+  
+  XCTestExpectation *expectation1 = [self expectationWithDescription:@"first completion handler invoked"];
+  [_client callMethodWithName:@"lookup" parameters:@[@"lovelace"] completionHandler:^(id result, NSError *error) {
+    XCTAssertEqualObjects(@25, result);
+    [expectation1 fulfill];
+  }];
+  NSString *methodID = [self lastMethodID];
+  
+  XCTestExpectation *expectation2 = [self expectationWithDescription:@"second completion handler invoked"];
+  [self whileNotExpectingSentMessageWithHandler:^BOOL(NSDictionary *message) {
+    return [message[@"msg"] isEqualToString:@"method"];
+  } performBlock:^{
+    [_client callMethodWithName:@"lookup" parameters:@[@"lovelace"] completionHandler:^(id result, NSError *error) {
+      XCTAssertEqualObjects(@25, result);
+      [expectation2 fulfill];
+    }];
+    [self waitForTimeInterval:0.1];
+  }];
+  
+  [_connection receiveMessage:@{@"msg": @"result", @"id": methodID, @"result": @25}];
+  [_connection receiveMessage:@{@"msg": @"updated", @"methods": @[methodID]}];
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+  XCTAssertEqual(1, _client.methodResultCache.numberOfCoalescedCalls);
+}
+
+- (void)testCallingCacheableMethodWhileIdenticalCallIsInFlightInvokesReceivedResultHandler {
+  [_client defineCacheableMethodWithName:@"lookup" timeToLive:60];
+  
+  XCTestExpectation *expectation1 = [self expectationWithDescription:@"first received result handler invoked"];
+  [_client callMethodWithName:@"lookup" parameters:@[@"lovelace"] options:0 receivedResultHandler:^(id result, NSError *error) {
+    XCTAssertEqualObjects(@25, result);
+    [expectation1 fulfill];
+  } completionHandler:nil];
+  NSString *methodID = [self lastMethodID];
+  
+  XCTestExpectation *expectation2 = [self expectationWithDescription:@"second received result handler invoked"];
+  [_client callMethodWithName:@"lookup" parameters:@[@"lovelace"] options:0 receivedResultHandler:^(id result, NSError *error) {
+    XCTAssertEqualObjects(@25, result);
+    [expectation2 fulfill];
+  } completionHandler:nil];
+  
+  [_connection receiveMessage:@{@"msg": @"result", @"id": methodID, @"result": @25}];
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+}
+
+- (void)testCallingCacheableMethodReturningStubValueBypassesCache {
+  [_client defineCacheableMethodWithName:@"lookup" timeToLive:60];
+  [_client defineStubForMethodWithName:@"lookup" usingBlock:^id(NSArray *parameters) {
+    return @"stubValue";
+  }];
+  
+  XCTAssertEqualObjects(@"stubValue", [_client callMethodWithName:@"lookup" parameters:@[@"lovelace"] options:METMethodCallOptionsReturnStubValue completionHandler:nil]);
+  XCTAssertEqualObjects(@"stubValue", [_client callMethodWithName:@"lookup" parameters:@[@"lovelace"] options:METMethodCallOptionsReturnStubValue completionHandler:nil]);
+  XCTAssertEqual(0, _client.methodResultCache.numberOfCoalescedCalls);
+}
+
+- (void)testCallingCacheableMethodWithCachedResultInvokesCompletionHandlerWithoutSendingMethodMessage {
+  [_client defineCacheableMethodWithName:@"lookup" timeToLive:60];
+  
+  XCTestExpectation *expectation = [self expectationWithDescription:@"completion handler invoked"];
+  [_client callMethodWithName:@"lookup" parameters:@[@"lovelace"] completionHandler:^(id result, NSError *error) {
+    [expectation fulfill];
+  }];
+  NSString *methodID = [self lastMethodID];
+  [_connection receiveMessage:@{@"msg": @"result", @"id": methodID, @"result": @25}];
+  [_connection receiveMessage:@{@"msg": @"updated", @"methods": @[methodID]}];
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+  
+  expectation = [self expectationWithDescription:@"completion handler invoked with cached result"];
+  [self whileNotExpectingSentMessageWithHandler:^BOOL(NSDictionary *message) {
+    return [message[@"msg"] isEqualToString:@"method"];
+  } performBlock:^{
+    [_client callMethodWithName:@"lookup" parameters:@[@"lovelace"] completionHandler:^(id result, NSError *error) {
+      XCTAssertEqualObjects(@25, result);
+      [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:1.0 handler:nil];
+  }];
+  
+  XCTAssertEqual(1, _client.methodResultCache.numberOfHits);
+}
+
 - (void)testCallingMethodInvokesStubIfDefined {
   XCTestExpectation *expectation = [self expectationWithDescription:@"stub invoked"];
   [_client defineStubForMethodWithName:@"doSomething" usingBlock:^id(NSArray *parameters) {
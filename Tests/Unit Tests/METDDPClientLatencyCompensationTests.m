@@ -102,7 +102,7 @@
   [self waitForExpectationsWithTimeout:1.0 handler:nil];
 }
 
-- (void)testReceivingUpdatedMessageAppliesBufferedDocumentsToLocalCacheWhenAllMethodsAffectingTheSameDocumentAreDone {
+- (void)testReceivingUpdatedMessageOnlyRollsBackChangesPerformedByStubOfMethodThatIsDone {
   [_database performUpdatesInLocalCacheWithoutTrackingChanges:^(METDocumentCache *localCache) {
     [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID: @"lovelace"] fields:@{@"name": @"Ada Lovelace", @"score": @25}];
   }];
@@ -128,9 +128,16 @@
   [self waitForExpectationsWithTimeout:1.0 handler:nil];
   
   [_connection receiveMessage:@{@"msg": @"changed", @"collection": @"players", @"id": @"lovelace", @"fields":@{@"score": @30}}];
+  
+  [self expectationForChangeToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] changeType:METDocumentChangeTypeUpdate changedFields:@{@"score": @30}];
+  
   [_connection receiveMessage:@{@"msg": @"updated", @"methods": @[methodID1]}];
   
-  [self expectationForChangeToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] changeType:METDocumentChangeTypeUpdate changedFields:@{@"score": @30, @"color": @"blue"}];
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+  
+  XCTAssertEqualObjects(@"green", [[_database collectionWithName:@"players"] documentWithID:@"lovelace"][@"color"]);
+  
+  [self expectationForChangeToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] changeType:METDocumentChangeTypeUpdate changedFields:@{@"color": @"blue"}];
   
   [_connection receiveMessage:@{@"msg": @"changed", @"collection": @"players", @"id": @"lovelace", @"fields":@{@"color": @"blue"}}];
   [_connection receiveMessage:@{@"msg": @"updated", @"methods": @[methodID2]}];
@@ -202,6 +209,70 @@
   [self waitForExpectationsWithTimeout:1.0 handler:nil];
 }
 
+- (void)testWaitingUntilCurrentlyBufferedDocumentsAreFlushedDoesNotWaitForDocumentsBufferedLater {
+  [_database performUpdatesInLocalCacheWithoutTrackingChanges:^(METDocumentCache *localCache) {
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID: @"lovelace"] fields:@{@"name": @"Ada Lovelace", @"score": @25}];
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID: @"gauss"] fields:@{@"name": @"Carl Friedrich Gauss", @"score": @15}];
+  }];
+  
+  [_client defineStubForMethodWithName:@"doSomething" usingBlock:^id(NSArray *parameters) {
+    [[_database collectionWithName:@"players"] updateDocumentWithID:@"lovelace" changedFields:@{@"score": @20}];
+    return nil;
+  }];
+  
+  [_client defineStubForMethodWithName:@"doSomethingElse" usingBlock:^id(NSArray *parameters) {
+    [[_database collectionWithName:@"players"] updateDocumentWithID:@"gauss" changedFields:@{@"color": @"green"}];
+    return nil;
+  }];
+  
+  [_client callMethodWithName:@"doSomething" parameters:nil];
+  NSString *methodID1 = [self lastMethodID];
+  
+  __block BOOL blockPerformed = NO;
+  [_client.methodInvocationCoordinator performAfterAllCurrentlyBufferedDocumentsAreFlushed:^{
+    blockPerformed = YES;
+  }];
+  
+  [_client callMethodWithName:@"doSomethingElse" parameters:nil];
+  
+  [self waitForTimeInterval:0.1];
+  XCTAssertFalse(blockPerformed);
+  
+  [_connection receiveMessage:@{@"msg": @"updated", @"methods": @[methodID1]}];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertTrue(blockPerformed);
+  }];
+}
+
+- (void)testSnapshotOnlyContainsChangesConfirmedByServer {
+  NSString *fileName = [NSString stringWithFormat:@"%@.snapshot", [[NSUUID UUID] UUIDString]];
+  NSURL *URL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:fileName]];
+  NSError *error;
+  XCTAssertTrue([_database openSnapshotAtURL:URL error:&error], @"%@", error);
+  
+  [_client defineStubForMethodWithName:@"addPlayer" usingBlock:^id(NSArray *parameters) {
+    [[_database collectionWithName:@"players"] insertDocumentWithID:@"lovelace" fields:@{@"name": @"Ada Lovelace", @"score": @20}];
+    return nil;
+  }];
+  
+  [_client callMethodWithName:@"addPlayer" parameters:nil];
+  
+  [_database.snapshot synchronize];
+  XCTAssertEqual(0, _database.snapshot.numberOfDocuments);
+  
+  [_connection receiveMessage:@{@"msg": @"added", @"collection": @"players", @"id": @"lovelace", @"fields": @{@"name": @"Ada Lovelace", @"score": @25}}];
+  [_connection receiveMessage:@{@"msg": @"updated", @"methods": @[[self lastMethodID]]}];
+  
+  [self waitUntilAssertionsPass:^{
+    [_database.snapshot synchronize];
+    XCTAssertEqualObjects((@{@"name": @"Ada Lovelace", @"score": @25}), [_database.snapshot fieldsByDocumentIDForCollectionWithName:@"players"][@"lovelace"]);
+  }];
+  
+  [_database.snapshot close];
+  [[NSFileManager defaultManager] removeItemAtURL:URL error:nil];
+}
+
 #pragma mark - Receiving Ready Message
 
 - (void)testReceivingReadyMessageWaitsUntilAllCurrentlyBufferedDocumentsAreFlushed {
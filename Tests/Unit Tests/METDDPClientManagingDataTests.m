@@ -105,6 +105,69 @@
   OCMVerifyAll(_database);
 }
 
+#pragma mark - Flow Control
+
+- (void)testMessagesReceivedWhilePausedAreHandledAfterResuming {
+  [_client pauseReceivingMessages];
+  XCTAssertTrue(_client.receivingMessagesPaused);
+  
+  [_connection receiveMessage:@{@"msg": @"added", @"collection": @"players", @"id": @"lovelace", @"fields": @{@"name": @"Ada Lovelace"}}];
+  [_connection receiveMessage:@{@"msg": @"removed", @"collection": @"players", @"id": @"lovelace"}];
+  
+  XCTAssertEqual(2, _client.numberOfDeferredMessages);
+  
+  [_database setExpectationOrderMatters:YES];
+  OCMExpect([_database applyDataUpdate:[OCMArg isEqual:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeAdd documentKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace"}]]]);
+  OCMExpect([_database applyDataUpdate:[OCMArg isEqual:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeRemove documentKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:nil]]]);
+  
+  [_client resumeReceivingMessages];
+  
+  XCTAssertEqual(0, _client.numberOfDeferredMessages);
+  OCMVerifyAll(_database);
+}
+
+- (void)testHeartbeatMessagesAreHandledWhilePaused {
+  [_client pauseReceivingMessages];
+  XCTAssertTrue(_client.receivingMessagesPaused);
+  
+  [self expectationForSentMessage:@{@"msg": @"pong", @"id": @"heartbeat"}];
+  
+  [_connection receiveMessage:@{@"msg": @"ping", @"id": @"heartbeat"}];
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+  XCTAssertEqual(0, _client.numberOfDeferredMessages);
+}
+
+- (void)testReceivingMessagesIsResumedWhenTooManyMessagesHaveBeenDeferred {
+  _client.maximumNumberOfDeferredMessages = 2;
+  [_client pauseReceivingMessages];
+  
+  [_connection receiveMessage:@{@"msg": @"added", @"collection": @"players", @"id": @"lovelace", @"fields": @{@"name": @"Ada Lovelace"}}];
+  [_connection receiveMessage:@{@"msg": @"added", @"collection": @"players", @"id": @"gauss", @"fields": @{@"name": @"Carl Friedrich Gauss"}}];
+  XCTAssertEqual(2, _client.numberOfDeferredMessages);
+  
+  OCMExpect([_database applyDataUpdate:[OCMArg isEqual:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeRemove documentKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:nil]]]);
+  
+  [_connection receiveMessage:@{@"msg": @"removed", @"collection": @"players", @"id": @"lovelace"}];
+  
+  XCTAssertFalse(_client.receivingMessagesPaused);
+  XCTAssertEqual(0, _client.numberOfDeferredMessages);
+  OCMVerifyAll(_database);
+}
+
+- (void)testOpeningNewConnectionDiscardsDeferredMessagesAndResumesReceivingMessages {
+  [_client pauseReceivingMessages];
+  
+  [_connection receiveMessage:@{@"msg": @"added", @"collection": @"players", @"id": @"lovelace", @"fields": @{@"name": @"Ada Lovelace"}}];
+  XCTAssertEqual(1, _client.numberOfDeferredMessages);
+  
+  [_connection close];
+  [_connection open];
+  
+  XCTAssertFalse(_client.receivingMessagesPaused);
+  XCTAssertEqual(0, _client.numberOfDeferredMessages);
+}
+
 #pragma mark - Subscribing
 
 - (void)testSubscribingWithoutParametersSendsSubMessage {
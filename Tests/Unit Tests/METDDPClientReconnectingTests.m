@@ -126,6 +126,91 @@
   [self waitForExpectationsWithTimeout:1.0 handler:nil];
 }
 
+- (void)testReconnectingResendsSubMessagesInPriorityOrderWhileRespectingConcurrencyLimit {
+  _client.maximumNumberOfConcurrentResubscriptions = 1;
+  
+  METSubscription *allPlayers = [_client addSubscriptionWithName:@"allPlayers" parameters:nil];
+  allPlayers.priority = NSOperationQueuePriorityLow;
+  METSubscription *playersWithMinimumScore = [_client addSubscriptionWithName:@"playersWithMinimumScore" parameters:@[@20]];
+  playersWithMinimumScore.priority = NSOperationQueuePriorityHigh;
+  
+  [_client disconnect];
+  
+  [self whileNotExpectingSentMessageWithHandler:^BOOL(NSDictionary *message) {
+    return [message[@"msg"] isEqualToString:@"sub"] && [message[@"name"] isEqualToString:@"allPlayers"];
+  } performBlock:^{
+    [self expectationForSentSubMessageForSubscription:playersWithMinimumScore];
+    [_client connect];
+    [self waitForExpectationsWithTimeout:1.0 handler:nil];
+  }];
+  
+  [self expectationForSentSubMessageForSubscription:allPlayers];
+  
+  [_connection receiveMessage:@{@"msg": @"ready", @"subs": @[playersWithMinimumScore.identifier]}];
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+}
+
+- (void)testReconnectingShowsDataForHigherPrioritySubscriptionsWithoutWaitingForLowerPrioritySubscriptions {
+  [_database performUpdatesInLocalCacheWithoutTrackingChanges:^(METDocumentCache *localCache) {
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace", @"score": @25}];
+  }];
+  
+  METSubscription *allPlayers = [_client addSubscriptionWithName:@"allPlayers" parameters:nil];
+  allPlayers.priority = NSOperationQueuePriorityLow;
+  [allPlayers didChangeStatus:METSubscriptionStatusReady error:nil];
+  METSubscription *playersWithMinimumScore = [_client addSubscriptionWithName:@"playersWithMinimumScore" parameters:@[@20]];
+  playersWithMinimumScore.priority = NSOperationQueuePriorityHigh;
+  [playersWithMinimumScore didChangeStatus:METSubscriptionStatusReady error:nil];
+  
+  [_client disconnect];
+  
+  [self performBlockWhileNotExpectingDatabaseDidChangeNotification:^{
+    [_client connect];
+    
+    [_connection receiveMessage:@{@"msg": @"added", @"collection": @"players", @"id": @"lovelace", @"fields": @{@"name": @"Ada Lovelace", @"score": @30}}];
+  }];
+  
+  [self expectationForDatabaseDidChangeNotificationWithHandler:^BOOL(METDatabaseChanges *databaseChanges) {
+    [self verifyDatabaseChanges:databaseChanges containsChangeToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] changeType:METDocumentChangeTypeUpdate changedFields:@{@"score": @30}];
+    return YES;
+  }];
+  
+  [_connection receiveMessage:@{@"msg": @"ready", @"subs": @[playersWithMinimumScore.identifier]}];
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+}
+
+- (void)testReconnectingKeepsDocumentsOfLowerPrioritySubscriptionsWhenShowingDataForHigherPrioritySubscriptions {
+  [_database performUpdatesInLocalCacheWithoutTrackingChanges:^(METDocumentCache *localCache) {
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace", @"score": @25}];
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"gauss"] fields:@{@"name": @"Carl Friedrich Gauss", @"score": @15}];
+  }];
+  
+  METSubscription *allPlayers = [_client addSubscriptionWithName:@"allPlayers" parameters:nil];
+  allPlayers.priority = NSOperationQueuePriorityLow;
+  [allPlayers didChangeStatus:METSubscriptionStatusReady error:nil];
+  METSubscription *playersWithMinimumScore = [_client addSubscriptionWithName:@"playersWithMinimumScore" parameters:@[@20]];
+  playersWithMinimumScore.priority = NSOperationQueuePriorityHigh;
+  [playersWithMinimumScore didChangeStatus:METSubscriptionStatusReady error:nil];
+  
+  [_client disconnect];
+  [_client connect];
+  
+  [_connection receiveMessage:@{@"msg": @"added", @"collection": @"players", @"id": @"lovelace", @"fields": @{@"name": @"Ada Lovelace", @"score": @30}}];
+  
+  [self expectationForDatabaseDidChangeNotificationWithHandler:^BOOL(METDatabaseChanges *databaseChanges) {
+    [self verifyDatabaseChanges:databaseChanges containsChangeToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] changeType:METDocumentChangeTypeUpdate changedFields:@{@"score": @30}];
+    return YES;
+  }];
+  
+  [_connection receiveMessage:@{@"msg": @"ready", @"subs": @[playersWithMinimumScore.identifier]}];
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+  
+  [self verifyDatabase:_database containsDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"gauss"] fields:@{@"name": @"Carl Friedrich Gauss", @"score": @15}];
+}
+
 - (void)testReconnectingWithNoReadySubscriptionsRemovesAllDocuments {
   [_database performUpdatesInLocalCacheWithoutTrackingChanges:^(METDocumentCache *localCache) {
     [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace", @"score": @25}];
@@ -0,0 +1,124 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#import <XCTest/XCTest.h>
+
+#import "METDataUpdateBuffer.h"
+#import "METDataUpdate.h"
+#import "METDocumentKey.h"
+
+@interface METDataUpdateBufferTests : XCTestCase
+
+@end
+
+@implementation METDataUpdateBufferTests {
+  METDataUpdateBuffer *_buffer;
+  METDocumentKey *_documentKey;
+}
+
+- (void)setUp {
+  [super setUp];
+  
+  _buffer = [[METDataUpdateBuffer alloc] init];
+  _documentKey = [METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"];
+}
+
+- (NSArray *)bufferedDataUpdates {
+  NSMutableArray *dataUpdates = [[NSMutableArray alloc] init];
+  [_buffer enumerateDataUpdatesUsingBlock:^(METDataUpdate *update, BOOL *stop) {
+    [dataUpdates addObject:update];
+  }];
+  return dataUpdates;
+}
+
+- (void)addDataUpdateWithType:(METDataUpdateType)updateType fields:(NSDictionary *)fields {
+  [_buffer addDataUpdate:[[METDataUpdate alloc] initWithUpdateType:updateType documentKey:_documentKey fields:fields]];
+}
+
+- (void)testFoldingAddAndChangeResultsInAddWithChangedFields {
+  [self addDataUpdateWithType:METDataUpdateTypeAdd fields:@{@"name": @"Ada Lovelace", @"score": @25, @"color": @"blue"}];
+  [self addDataUpdateWithType:METDataUpdateTypeChange fields:@{@"score": @30, @"color": [NSNull null]}];
+  
+  XCTAssertEqualObjects(([self bufferedDataUpdates]), (@[[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeAdd documentKey:_documentKey fields:@{@"name": @"Ada Lovelace", @"score": @30}]]));
+}
+
+- (void)testFoldingChangesResultsInChangeWithMergedFields {
+  [self addDataUpdateWithType:METDataUpdateTypeChange fields:@{@"score": @30, @"color": [NSNull null]}];
+  [self addDataUpdateWithType:METDataUpdateTypeChange fields:@{@"score": @35, @"name": @"Ada"}];
+  
+  XCTAssertEqualObjects(([self bufferedDataUpdates]), (@[[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeChange documentKey:_documentKey fields:@{@"name": @"Ada", @"score": @35, @"color": [NSNull null]}]]));
+}
+
+- (void)testFoldingAddAndRemoveResultsInReplaceWithoutFields {
+  [self addDataUpdateWithType:METDataUpdateTypeAdd fields:@{@"name": @"Ada Lovelace"}];
+  [self addDataUpdateWithType:METDataUpdateTypeRemove fields:nil];
+  
+  XCTAssertEqualObjects(([self bufferedDataUpdates]), (@[[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeReplace documentKey:_documentKey fields:nil]]));
+}
+
+- (void)testFoldingRemoveAndAddResultsInReplace {
+  [self addDataUpdateWithType:METDataUpdateTypeRemove fields:nil];
+  [self addDataUpdateWithType:METDataUpdateTypeAdd fields:@{@"name": @"Ada Lovelace"}];
+  
+  XCTAssertEqualObjects(([self bufferedDataUpdates]), (@[[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeReplace documentKey:_documentKey fields:@{@"name": @"Ada Lovelace"}]]));
+}
+
+- (void)testChangeFollowedByAddIsNotFolded {
+  [self addDataUpdateWithType:METDataUpdateTypeChange fields:@{@"score": @30}];
+  [self addDataUpdateWithType:METDataUpdateTypeAdd fields:@{@"name": @"Ada Lovelace"}];
+  
+  XCTAssertEqual(2, _buffer.count);
+  XCTAssertEqual(0, _buffer.numberOfFoldedDataUpdates);
+}
+
+- (void)testPreservesOrderOfDocumentKeys {
+  METDocumentKey *otherDocumentKey = [METDocumentKey keyWithCollectionName:@"players" documentID:@"turing"];
+  [_buffer addDataUpdate:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeAdd documentKey:otherDocumentKey fields:@{@"name": @"Alan Turing"}]];
+  [self addDataUpdateWithType:METDataUpdateTypeAdd fields:@{@"name": @"Ada Lovelace"}];
+  [_buffer addDataUpdate:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeChange documentKey:otherDocumentKey fields:@{@"score": @10}]];
+  
+  NSArray *dataUpdates = [self bufferedDataUpdates];
+  XCTAssertEqual(2, dataUpdates.count);
+  XCTAssertEqualObjects(otherDocumentKey, [dataUpdates[0] documentKey]);
+  XCTAssertEqualObjects(_documentKey, [dataUpdates[1] documentKey]);
+}
+
+- (void)testKeepsTrackOfFoldRatio {
+  [self addDataUpdateWithType:METDataUpdateTypeAdd fields:@{@"name": @"Ada Lovelace"}];
+  [self addDataUpdateWithType:METDataUpdateTypeChange fields:@{@"score": @30}];
+  [self addDataUpdateWithType:METDataUpdateTypeChange fields:@{@"score": @35}];
+  [self addDataUpdateWithType:METDataUpdateTypeChange fields:@{@"score": @40}];
+  
+  XCTAssertEqual(1, _buffer.count);
+  XCTAssertEqual(1, _buffer.numberOfDocumentKeys);
+  XCTAssertEqual(4, _buffer.numberOfAddedDataUpdates);
+  XCTAssertEqual(3, _buffer.numberOfFoldedDataUpdates);
+  XCTAssertEqualWithAccuracy(0.75, _buffer.foldRatio, 0.001);
+}
+
+- (void)testRemovingAllDataUpdates {
+  [self addDataUpdateWithType:METDataUpdateTypeAdd fields:@{@"name": @"Ada Lovelace"}];
+  [_buffer removeAllDataUpdates];
+  
+  XCTAssertEqual(0, _buffer.count);
+  XCTAssertEqual(0, [self bufferedDataUpdates].count);
+}
+
+@end
@@ -0,0 +1,123 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#import <XCTest/XCTest.h>
+#import "XCTestCase+Meteor.h"
+
+#import "METDatabaseChangeLog.h"
+#import "METDatabaseChangeLog_Internal.h"
+
+#import "METDatabase.h"
+#import "METDatabaseChanges.h"
+#import "METDatabaseChanges_Internal.h"
+#import "METDocumentKey.h"
+
+@interface METDatabaseChangeLogTests : XCTestCase
+
+@end
+
+@implementation METDatabaseChangeLogTests {
+  METDatabaseChangeLog *_changeLog;
+}
+
+- (void)setUp {
+  [super setUp];
+  
+  _changeLog = [[METDatabaseChangeLog alloc] initWithMaximumNumberOfEntriesPerCollection:3];
+}
+
+- (void)recordChangeToDocumentWithKey:(METDocumentKey *)documentKey fieldsBeforeChanges:(NSDictionary *)fieldsBeforeChanges fieldsAfterChanges:(NSDictionary *)fieldsAfterChanges {
+  METDatabaseChanges *databaseChanges = [[METDatabaseChanges alloc] init];
+  [databaseChanges willChangeDocumentWithKey:documentKey fieldsBeforeChanges:fieldsBeforeChanges];
+  [databaseChanges didChangeDocumentWithKey:documentKey fieldsAfterChanges:fieldsAfterChanges];
+  [_changeLog recordDatabaseChanges:databaseChanges];
+}
+
+- (void)testAssignsIncreasingSequenceNumbers {
+  XCTAssertEqual(0, _changeLog.currentSequenceNumber);
+  
+  [self recordChangeToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fieldsBeforeChanges:nil fieldsAfterChanges:@{@"name": @"Ada Lovelace"}];
+  [self recordChangeToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"gauss"] fieldsBeforeChanges:nil fieldsAfterChanges:@{@"name": @"Carl Friedrich Gauss"}];
+  
+  XCTAssertEqual(2, _changeLog.currentSequenceNumber);
+}
+
+- (void)testPullingChangesSinceSequenceNumberCoalescesChanges {
+  [self recordChangeToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"gauss"] fieldsBeforeChanges:nil fieldsAfterChanges:@{@"name": @"Carl Friedrich Gauss"}];
+  uint64_t cursor = _changeLog.currentSequenceNumber;
+  
+  [self recordChangeToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fieldsBeforeChanges:nil fieldsAfterChanges:@{@"name": @"Ada Lovelace", @"score": @25}];
+  [self recordChangeToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"lists" documentID:@"favorites"] fieldsBeforeChanges:nil fieldsAfterChanges:@{@"name": @"Favorites"}];
+  [self recordChangeToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fieldsBeforeChanges:@{@"name": @"Ada Lovelace", @"score": @25} fieldsAfterChanges:@{@"name": @"Ada Lovelace", @"score": @30}];
+  
+  uint64_t latestSequenceNumber = 0;
+  NSError *error;
+  METDatabaseChanges *databaseChanges = [_changeLog changesToCollectionWithName:@"players" sinceSequenceNumber:cursor latestSequenceNumber:&latestSequenceNumber error:&error];
+  
+  XCTAssertNil(error);
+  XCTAssertEqual(4, latestSequenceNumber);
+  XCTAssertEqualObjects([NSSet setWithObject:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"]], [databaseChanges affectedDocumentKeys]);
+  [self verifyDatabaseChanges:databaseChanges containsChangeToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] changeType:METDocumentChangeTypeAdd changedFields:@{@"name": @"Ada Lovelace", @"score": @30}];
+}
+
+- (void)testPullingChangesAtCurrentSequenceNumberReturnsNoChanges {
+  [self recordChangeToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fieldsBeforeChanges:nil fieldsAfterChanges:@{@"name": @"Ada Lovelace"}];
+  
+  METDatabaseChanges *databaseChanges = [_changeLog changesToCollectionWithName:@"players" sinceSequenceNumber:_changeLog.currentSequenceNumber latestSequenceNumber:NULL error:NULL];
+  
+  XCTAssertNotNil(databaseChanges);
+  XCTAssertEqual(0, [databaseChanges affectedDocumentKeys].count);
+}
+
+- (void)testPullingChangesSinceDiscardedSequenceNumberRequiresResync {
+  for (NSUInteger i = 0; i < 5; i++) {
+    [self recordChangeToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@(i)] fieldsBeforeChanges:nil fieldsAfterChanges:@{@"score": @(i)}];
+  }
+  
+  NSError *error;
+  METDatabaseChanges *databaseChanges = [_changeLog changesToCollectionWithName:@"players" sinceSequenceNumber:1 latestSequenceNumber:NULL error:&error];
+  
+  XCTAssertNil(databaseChanges);
+  XCTAssertEqualObjects(METDatabaseErrorDomain, error.domain);
+  XCTAssertEqual(METDatabaseResyncRequiredError, error.code);
+  
+  databaseChanges = [_changeLog changesToCollectionWithName:@"players" sinceSequenceNumber:2 latestSequenceNumber:NULL error:&error];
+  XCTAssertEqual(3, [databaseChanges affectedDocumentKeys].count);
+}
+
+- (void)testPullingChangesSinceUnknownSequenceNumberRequiresResync {
+  NSError *error;
+  METDatabaseChanges *databaseChanges = [_changeLog changesToCollectionWithName:@"players" sinceSequenceNumber:10 latestSequenceNumber:NULL error:&error];
+  
+  XCTAssertNil(databaseChanges);
+  XCTAssertEqual(METDatabaseResyncRequiredError, error.code);
+}
+
+- (void)testRecordsLoadedCollections {
+  METDatabaseChanges *loadedChanges = [[METDatabaseChanges alloc] init];
+  [loadedChanges didLoadCollectionWithName:@"players"];
+  [_changeLog recordDatabaseChanges:loadedChanges];
+  
+  METDatabaseChanges *databaseChanges = [_changeLog changesToCollectionWithName:@"players" sinceSequenceNumber:0 latestSequenceNumber:NULL error:NULL];
+  
+  XCTAssertEqualObjects([NSSet setWithObject:@"players"], [databaseChanges loadedCollectionNames]);
+}
+
+@end
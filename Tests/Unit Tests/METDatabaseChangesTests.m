@@ -88,4 +88,23 @@
   [self verifyDatabaseChanges:_databaseChanges containsChangeToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] changeType:METDocumentChangeTypeAdd changedFields:@{@"name": @"Ada Lovelace", @"score": @30}];
 }
 
+- (void)testLoadingCollection {
+  [_databaseChanges didLoadCollectionWithName:@"players"];
+  
+  XCTAssertTrue([_databaseChanges hasChanges]);
+  XCTAssertEqualObjects([NSSet setWithObject:@"players"], [_databaseChanges loadedCollectionNames]);
+  XCTAssertEqual(0, [_databaseChanges affectedDocumentKeys].count);
+}
+
+- (void)testAddingOtherDatabaseChangesIncludesLoadedCollections {
+  [_databaseChanges didLoadCollectionWithName:@"players"];
+  
+  METDatabaseChanges *otherDatabaseChanges = [[METDatabaseChanges alloc] init];
+  [otherDatabaseChanges didLoadCollectionWithName:@"lists"];
+  
+  [_databaseChanges addDatabaseChanges:otherDatabaseChanges];
+  
+  XCTAssertEqualObjects(([NSSet setWithObjects:@"players", @"lists", nil]), [_databaseChanges loadedCollectionNames]);
+}
+
 @end
@@ -25,9 +25,17 @@
 
 #import "METDatabase.h"
 #import "METDatabase_Internal.h"
+#import "METDDPClient.h"
+#import "METDDPClient_Internal.h"
 #import "METDocumentKey.h"
 #import "METDocumentCache.h"
 #import "METDataUpdate.h"
+#import "METDatabaseChanges.h"
+#import "METDatabaseFlushPolicy.h"
+#import "METDocument.h"
+#import "METDocumentChangeDetails.h"
+#import "METDocumentSnapshot.h"
+#import "METHistogram.h"
 #import "METMethodInvocationCoordinator.h"
 #import "METMethodInvocationCoordinator_Testing.h"
 #import "METMethodInvocation.h"
@@ -114,9 +122,380 @@
   [self waitForExpectationsWithTimeout:1.0 handler:nil];
 }
 
+- (void)testDataUpdatesAreFlushedAfterQuiescenceWhenFlushTimerFiredWhileWaiting {
+  METDatabaseFlushPolicy *flushPolicy = [[METDatabaseFlushPolicy alloc] init];
+  flushPolicy.maximumLatency = 0.1;
+  _database.flushPolicy = flushPolicy;
+  
+  [self performBlockWhileNotExpectingDatabaseDidChangeNotification:^{
+    [_database applyDataUpdate:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeAdd documentKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace"}]];
+    // Let the flush timer be armed before waiting, so it fires while the buffered updates source is suspended
+    [self waitForTimeInterval:0.05];
+    _database.waitingForQuiescence = YES;
+    [self waitForTimeInterval:0.3];
+  }];
+  
+  [self expectationForChangeToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] changeType:METDocumentChangeTypeAdd changedFields:@{@"name": @"Ada Lovelace"}];
+  
+  _database.waitingForQuiescence = NO;
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+}
+
+- (void)testDataUpdatesToTheSameDocumentAreFoldedWhenWaitingForQuiescence {
+  _database.waitingForQuiescence = YES;
+  
+  [_database performUpdatesInLocalCacheWithoutTrackingChanges:^(METDocumentCache *localCache) {
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace", @"score": @25}];
+  }];
+  
+  [_database applyDataUpdate:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeChange documentKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"score": @30}]];
+  [_database applyDataUpdate:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeChange documentKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"score": @35}]];
+  [_database applyDataUpdate:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeAdd documentKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"turing"] fields:@{@"name": @"Alan Turing"}]];
+  [_database applyDataUpdate:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeRemove documentKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"turing"] fields:nil]];
+  
+  XCTAssertEqual(2, _database.numberOfBufferedDataUpdates);
+  XCTAssertEqualWithAccuracy(0.5, _database.bufferedDataUpdatesFoldRatio, 0.001);
+  
+  [self expectationForChangeToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] changeType:METDocumentChangeTypeUpdate changedFields:@{@"score": @35}];
+  
+  _database.waitingForQuiescence = NO;
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+  
+  [self verifyDatabase:_database containsDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace", @"score": @35}];
+  XCTAssertNil([_database documentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"turing"]]);
+}
+
+- (void)testBulkLoadedCollectionIsOnlyAddedWhenFinished {
+  [_database beginBulkLoadingCollectionWithName:@"players"];
+  
+  [_database applyDataUpdate:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeAdd documentKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace", @"score": @25}]];
+  [_database applyDataUpdate:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeAdd documentKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"gauss"] fields:@{@"name": @"Carl Friedrich Gauss", @"score": @5}]];
+  [_database applyDataUpdate:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeChange documentKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"score": @30}]];
+  
+  [self performBlockWhileNotExpectingDatabaseDidChangeNotification:^{
+    [self waitForTimeInterval:0.1];
+  }];
+  
+  [self expectationForDatabaseDidChangeNotificationWithHandler:^BOOL(METDatabaseChanges *databaseChanges) {
+    XCTAssertEqualObjects([NSSet setWithObject:@"players"], [databaseChanges loadedCollectionNames]);
+    XCTAssertEqual(0, [databaseChanges affectedDocumentKeys].count);
+    return YES;
+  }];
+  
+  [_database finishBulkLoading];
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+  
+  [self verifyDatabase:_database containsDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace", @"score": @30}];
+  [self verifyDatabase:_database containsDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"gauss"] fields:@{@"name": @"Carl Friedrich Gauss", @"score": @5}];
+}
+
+- (void)testDetectsBulkLoadingOfEmptyCollection {
+  _database.detectsBulkLoading = YES;
+  
+  [_database applyDataUpdate:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeAdd documentKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace"}]];
+  
+  [self waitWhileAssertionsPass:^{
+    XCTAssertNil([_database documentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"]]);
+  }];
+  
+  [self expectationForDatabaseDidChangeNotificationWithHandler:^BOOL(METDatabaseChanges *databaseChanges) {
+    return [[databaseChanges loadedCollectionNames] containsObject:@"players"];
+  }];
+  
+  [_database finishBulkLoading];
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+}
+
+- (void)testDoesNotDetectBulkLoadingOfCollectionThatAlreadyContainsDocuments {
+  [_database performUpdatesInLocalCacheWithoutTrackingChanges:^(METDocumentCache *localCache) {
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"gauss"] fields:@{@"name": @"Carl Friedrich Gauss"}];
+  }];
+  
+  _database.detectsBulkLoading = YES;
+  
+  [self expectationForChangeToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] changeType:METDocumentChangeTypeAdd changedFields:@{@"name": @"Ada Lovelace"}];
+  
+  [_database applyDataUpdate:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeAdd documentKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace"}]];
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+}
+
+- (void)testFlushPolicyWithMaximumLatencyDelaysFlush {
+  METDatabaseFlushPolicy *flushPolicy = [[METDatabaseFlushPolicy alloc] init];
+  flushPolicy.maximumLatency = 0.3;
+  _database.flushPolicy = flushPolicy;
+  
+  [self performBlockWhileNotExpectingDatabaseDidChangeNotification:^{
+    [_database applyDataUpdate:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeAdd documentKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace"}]];
+    [self waitForTimeInterval:0.1];
+  }];
+  
+  [self expectationForChangeToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] changeType:METDocumentChangeTypeAdd changedFields:@{@"name": @"Ada Lovelace"}];
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+}
+
+- (void)testFlushPolicyWithMaximumBatchSizeFlushesWhenBatchSizeIsReached {
+  METDatabaseFlushPolicy *flushPolicy = [[METDatabaseFlushPolicy alloc] init];
+  flushPolicy.maximumLatency = 60;
+  flushPolicy.maximumBatchSize = 2;
+  _database.flushPolicy = flushPolicy;
+  
+  [self expectationForDatabaseDidChangeNotificationWithHandler:^BOOL(METDatabaseChanges *databaseChanges) {
+    return [databaseChanges affectedDocumentKeys].count == 2;
+  }];
+  
+  [_database applyDataUpdate:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeAdd documentKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace"}]];
+  [_database applyDataUpdate:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeAdd documentKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"gauss"] fields:@{@"name": @"Carl Friedrich Gauss"}]];
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+}
+
+- (void)testRecordsFlushSizesAndDurations {
+  [self expectationForChangeToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] changeType:METDocumentChangeTypeAdd changedFields:@{@"name": @"Ada Lovelace"}];
+  
+  [_database applyDataUpdate:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeAdd documentKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace"}]];
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertEqual(1, _database.flushSizeHistogram.count);
+    XCTAssertEqual(1, _database.flushSizeHistogram.sum);
+    XCTAssertEqual(1, _database.flushDurationHistogram.count);
+  }];
+}
+
 - (void)testResettingRemovesBufferedDataUpdatesAndPendingAfterFlushDataUpdatesBlocks {
 }
 
+#pragma mark - Backpressure
+
+- (void)testReachingHighWaterMarkPutsDatabaseUnderBackpressureUntilPendingChangesDrop {
+  METDatabaseFlushPolicy *flushPolicy = [[METDatabaseFlushPolicy alloc] init];
+  flushPolicy.highWaterMark = 4;
+  _database.flushPolicy = flushPolicy;
+  
+  [_database setNumberOfUndeliveredChanges:5 forConsumer:self];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertEqual(5, _database.numberOfPendingChanges);
+    XCTAssertTrue(_database.underBackpressure);
+    XCTAssertEqual(1, _database.numberOfTimesHighWaterMarkWasReached);
+  }];
+  
+  // Backpressure is only relieved below half the high-water mark
+  [_database setNumberOfUndeliveredChanges:3 forConsumer:self];
+  [self waitForTimeInterval:0.1];
+  XCTAssertTrue(_database.underBackpressure);
+  
+  [_database setNumberOfUndeliveredChanges:1 forConsumer:self];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertFalse(_database.underBackpressure);
+    XCTAssertEqual(1, _database.numberOfTimesHighWaterMarkWasReached);
+  }];
+}
+
+- (void)testDataUpdatesAreHeldBackWhileUnderBackpressure {
+  METDatabaseFlushPolicy *flushPolicy = [[METDatabaseFlushPolicy alloc] init];
+  flushPolicy.highWaterMark = 1;
+  flushPolicy.backpressureLatency = 0.3;
+  _database.flushPolicy = flushPolicy;
+  
+  [_database setNumberOfUndeliveredChanges:1 forConsumer:self];
+  
+  [self performBlockWhileNotExpectingDatabaseDidChangeNotification:^{
+    [_database applyDataUpdate:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeAdd documentKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace"}]];
+    [_database applyDataUpdate:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeChange documentKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"score": @30}]];
+    [self waitForTimeInterval:0.1];
+  }];
+  
+  [self expectationForChangeToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] changeType:METDocumentChangeTypeAdd changedFields:@{@"name": @"Ada Lovelace", @"score": @30}];
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+}
+
+- (void)testExceedingPauseThresholdPausesReceivingMessagesUntilConsumersCatchUp {
+  id client = OCMClassMock([METDDPClient class]);
+  METDatabase *database = [[METDatabase alloc] initWithClient:client];
+  
+  METDatabaseFlushPolicy *flushPolicy = [[METDatabaseFlushPolicy alloc] init];
+  flushPolicy.highWaterMark = 4;
+  flushPolicy.pauseThreshold = 8;
+  database.flushPolicy = flushPolicy;
+  
+  OCMExpect([client pauseReceivingMessages]);
+  
+  [database setNumberOfUndeliveredChanges:10 forConsumer:self];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertTrue(database.receivingMessagesPaused);
+    XCTAssertEqual(1, database.numberOfTimesReceivingMessagesWasPaused);
+  }];
+  OCMVerifyAll(client);
+  
+  OCMExpect([client resumeReceivingMessages]);
+  
+  [database setNumberOfUndeliveredChanges:0 forConsumer:self];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertFalse(database.receivingMessagesPaused);
+    XCTAssertGreaterThan(database.timeSpentWithReceivingMessagesPaused, 0);
+  }];
+  OCMVerifyAll(client);
+}
+
+- (void)testSlowObserverCountsAsPendingChanges {
+  dispatch_queue_t queue = dispatch_queue_create("com.meteor.DatabaseTests.observerQueue", DISPATCH_QUEUE_SERIAL);
+  dispatch_suspend(queue);
+  
+  id observer = [_database addObserverForChangesToCollectionWithName:@"players" queue:queue usingBlock:^(METDatabaseChanges *databaseChanges) {
+  }];
+  
+  [_database performUpdatesInLocalCache:^(METDocumentCache *localCache) {
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace"}];
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"gauss"] fields:@{@"name": @"Carl Friedrich Gauss"}];
+  }];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertEqual(2, _database.numberOfPendingChanges);
+  }];
+  
+  dispatch_resume(queue);
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertEqual(0, _database.numberOfPendingChanges);
+  }];
+  
+  [_database removeObserver:observer];
+}
+
+#pragma mark - Transactions
+
+- (void)testChangesInTransactionAreOnlyVisibleToOtherThreadsAfterCommitting {
+  METDocumentKey *documentKey = [METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"];
+  
+  __block METDocument *documentSeenFromAnotherThread;
+  METDatabaseChanges *changes = [_database performUpdatesAndReturnChanges:^{
+    [_database addDocumentWithKey:documentKey fields:@{@"name": @"Ada Lovelace"}];
+    XCTAssertNotNil([_database documentWithKey:documentKey]);
+    [self performBlockOnAnotherThreadAndWait:^{
+      documentSeenFromAnotherThread = [_database documentWithKey:documentKey];
+    }];
+  }];
+  
+  XCTAssertNil(documentSeenFromAnotherThread);
+  XCTAssertEqualObjects((@{@"name": @"Ada Lovelace"}), [_database documentWithKey:documentKey].fields);
+  XCTAssertEqual(METDocumentChangeTypeAdd, [changes changeDetailsForDocumentWithKey:documentKey].changeType);
+}
+
+- (void)testTransactionIsRetriedWhenDocumentItAccessedWasModifiedConcurrently {
+  METDocumentKey *documentKey = [METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"];
+  [_database performUpdatesInLocalCacheWithoutTrackingChanges:^(METDocumentCache *localCache) {
+    [localCache addDocumentWithKey:documentKey fields:@{@"name": @"Ada Lovelace", @"score": @25}];
+  }];
+  
+  __block NSUInteger numberOfAttempts = 0;
+  [_database performUpdatesAndReturnChanges:^{
+    numberOfAttempts++;
+    NSNumber *score = [_database documentWithKey:documentKey][@"score"];
+    
+    if (numberOfAttempts == 1) {
+      [self performBlockOnAnotherThreadAndWait:^{
+        [_database updateDocumentWithKey:documentKey changedFields:@{@"score": @30}];
+      }];
+    }
+    
+    [_database updateDocumentWithKey:documentKey changedFields:@{@"score": @(score.integerValue + 1)}];
+  }];
+  
+  XCTAssertEqual(2, numberOfAttempts);
+  XCTAssertEqualObjects(@31, [_database documentWithKey:documentKey][@"score"]);
+}
+
+- (void)testTransactionIsNotRetriedWhenOtherDocumentsWereModifiedConcurrently {
+  METDocumentKey *documentKey = [METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"];
+  METDocumentKey *otherDocumentKey = [METDocumentKey keyWithCollectionName:@"players" documentID:@"gauss"];
+  [_database performUpdatesInLocalCacheWithoutTrackingChanges:^(METDocumentCache *localCache) {
+    [localCache addDocumentWithKey:documentKey fields:@{@"name": @"Ada Lovelace", @"score": @25}];
+    [localCache addDocumentWithKey:otherDocumentKey fields:@{@"name": @"Carl Friedrich Gauss", @"score": @5}];
+  }];
+  
+  __block NSUInteger numberOfAttempts = 0;
+  [_database performUpdatesAndReturnChanges:^{
+    numberOfAttempts++;
+    
+    if (numberOfAttempts == 1) {
+      [self performBlockOnAnotherThreadAndWait:^{
+        [_database updateDocumentWithKey:otherDocumentKey changedFields:@{@"score": @10}];
+      }];
+    }
+    
+    [_database updateDocumentWithKey:documentKey changedFields:@{@"score": @30}];
+  }];
+  
+  XCTAssertEqual(1, numberOfAttempts);
+  XCTAssertEqualObjects(@30, [_database documentWithKey:documentKey][@"score"]);
+  XCTAssertEqualObjects(@10, [_database documentWithKey:otherDocumentKey][@"score"]);
+}
+
+// dispatch_sync may run blocks on the calling thread, which would see its transaction
+- (void)performBlockOnAnotherThreadAndWait:(void (^)())block {
+  dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+  NSThread *thread = [[NSThread alloc] initWithTarget:[NSBlockOperation blockOperationWithBlock:^{
+    block();
+    dispatch_semaphore_signal(semaphore);
+  }] selector:@selector(main) object:nil];
+  [thread start];
+  dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+}
+
+#pragma mark - Snapshots
+
+- (void)testReconcilingSnapshotOnlyRemovesDocumentsTheServerDidNotSend {
+  NSString *fileName = [NSString stringWithFormat:@"%@.snapshot", [[NSUUID UUID] UUIDString]];
+  NSURL *URL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:fileName]];
+  METDocumentKey *lovelaceKey = [METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"];
+  METDocumentKey *gaussKey = [METDocumentKey keyWithCollectionName:@"players" documentID:@"gauss"];
+  
+  METDocumentSnapshot *snapshot = [[METDocumentSnapshot alloc] initWithURL:URL];
+  XCTAssertTrue([snapshot openWithError:nil]);
+  [snapshot writeFields:@{@"name": @"Ada Lovelace"} forDocumentWithKey:lovelaceKey];
+  [snapshot writeFields:@{@"name": @"Carl Friedrich Gauss"} forDocumentWithKey:gaussKey];
+  [snapshot close];
+  
+  NSError *error;
+  XCTAssertTrue([_database openSnapshotAtURL:URL error:&error], @"%@", error);
+  XCTAssertEqualObjects(@{@"name": @"Ada Lovelace"}, [_database documentWithKey:lovelaceKey].fields);
+  
+  [_database reset];
+  XCTAssertTrue(_database.reconcilingSnapshot);
+  
+  [self expectationForDatabaseDidChangeNotificationWithHandler:^BOOL(METDatabaseChanges *databaseChanges) {
+    return [databaseChanges changeDetailsForDocumentWithKey:lovelaceKey] == nil && [databaseChanges changeDetailsForDocumentWithKey:gaussKey].changeType == METDocumentChangeTypeRemove;
+  }];
+  
+  [_database applyDataUpdate:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeAdd documentKey:lovelaceKey fields:@{@"name": @"Ada Lovelace"}]];
+  [_database finishReconcilingSnapshot];
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+  
+  XCTAssertFalse(_database.reconcilingSnapshot);
+  XCTAssertNotNil([_database documentWithKey:lovelaceKey]);
+  XCTAssertNil([_database documentWithKey:gaussKey]);
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertEqual(1, _database.snapshot.numberOfDocuments);
+  }];
+  
+  [_database.snapshot close];
+  [[NSFileManager defaultManager] removeItemAtURL:URL error:nil];
+}
+
 #pragma mark - Change Notifications
 
 - (void)testPerformingSeparateUpdatesPostsSeparateNotifications {
@@ -178,4 +557,75 @@
   [self waitForExpectationsWithTimeout:1.0 handler:nil];
 }
 
+
+#pragma mark - Change Observers
+
+- (void)testCollectionObserverOnlyReceivesChangesToObservedCollection {
+  XCTestExpectation *expectation = [self expectationWithDescription:@"observer invoked"];
+  id observer = [_database addObserverForChangesToCollectionWithName:@"players" queue:nil usingBlock:^(METDatabaseChanges *databaseChanges) {
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Warc-retain-cycles"
+    XCTAssertEqualObjects([NSSet setWithObject:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"]], [databaseChanges affectedDocumentKeys]);
+#pragma clang diagnostic pop
+    [expectation fulfill];
+  }];
+  
+  [_database performUpdatesInLocalCache:^(METDocumentCache *localCache) {
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace"}];
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"lists" documentID:@"favorites"] fields:@{@"name": @"Favorites"}];
+  }];
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+  
+  [_database removeObserver:observer];
+}
+
+- (void)testDocumentObserverReceivesChangeDetailsOnSpecifiedQueue {
+  dispatch_queue_t queue = dispatch_queue_create("com.meteor.DatabaseTests.observerQueue", DISPATCH_QUEUE_SERIAL);
+  static void *queueKey = &queueKey;
+  dispatch_queue_set_specific(queue, queueKey, queueKey, NULL);
+  
+  XCTestExpectation *expectation = [self expectationWithDescription:@"observer invoked"];
+  id observer = [_database addObserverForChangesToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] queue:queue usingBlock:^(METDocumentChangeDetails *documentChangeDetails) {
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Warc-retain-cycles"
+    XCTAssertTrue(dispatch_get_specific(queueKey) == queueKey);
+    XCTAssertEqual(METDocumentChangeTypeUpdate, documentChangeDetails.changeType);
+    XCTAssertEqualObjects((@{@"score": @30}), documentChangeDetails.changedFields);
+#pragma clang diagnostic pop
+    [expectation fulfill];
+  }];
+  
+  [_database performUpdatesInLocalCacheWithoutTrackingChanges:^(METDocumentCache *localCache) {
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace", @"score": @25}];
+  }];
+  
+  [_database performUpdatesInLocalCache:^(METDocumentCache *localCache) {
+    [localCache updateDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"gauss"] changedFields:@{@"score": @10}];
+    [localCache updateDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] changedFields:@{@"score": @30}];
+  }];
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+  
+  [_database removeObserver:observer];
+}
+
+- (void)testRemovedObserverIsNoLongerInvoked {
+  id observer = [_database addObserverForChangesToCollectionWithName:@"players" queue:nil usingBlock:^(METDatabaseChanges *databaseChanges) {
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Warc-retain-cycles"
+    XCTFail(@"Removed observer should not be invoked");
+#pragma clang diagnostic pop
+  }];
+  [_database removeObserver:observer];
+  
+  [self expectationForChangeToDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] changeType:METDocumentChangeTypeAdd changedFields:@{@"name": @"Ada Lovelace"}];
+  
+  [_database performUpdatesInLocalCache:^(METDocumentCache *localCache) {
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"] fields:@{@"name": @"Ada Lovelace"}];
+  }];
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+}
+
 @end
@@ -117,6 +117,48 @@
   XCTAssertFalse(result);
 }
 
+#pragma mark - Loading Documents
+
+- (void)testLoadingDocumentsIntoCollection {
+  [_documentCache loadDocumentsWithFieldsByDocumentID:@{@"apple": @{@"name": @"Apple"}, @"banana": @{@"name": @"Banana"}} intoCollectionWithName:@"fruits"];
+  
+  XCTAssertEqual(2, [_documentCache numberOfDocumentsInCollectionWithName:@"fruits"]);
+  XCTAssertEqualObjects(@{@"name": @"Banana"}, [_documentCache documentWithKey:[METDocumentKey keyWithCollectionName:@"fruits" documentID:@"banana"]].fields);
+}
+
+- (void)testLoadingDocumentsReportsLoadedCollectionAndChangesToExistingDocuments {
+  [_documentCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"fruits" documentID:@"apple"] fields:@{@"name": @"Apple"}];
+  
+  id delegate = OCMStrictProtocolMock(@protocol(METDocumentCacheDelegate));
+  _documentCache.delegate = delegate;
+  
+  OCMExpect([delegate documentCache:_documentCache willChangeDocumentWithKey:[METDocumentKey keyWithCollectionName:@"fruits" documentID:@"apple"] fieldsBeforeChanges:@{@"name": @"Apple"}]);
+  OCMExpect([delegate documentCache:_documentCache didChangeDocumentWithKey:[METDocumentKey keyWithCollectionName:@"fruits" documentID:@"apple"] fieldsAfterChanges:@{@"name": @"Green Apple"}]);
+  OCMExpect([delegate documentCache:_documentCache didLoadDocumentsIntoCollectionWithName:@"fruits"]);
+  
+  [_documentCache loadDocumentsWithFieldsByDocumentID:@{@"apple": @{@"name": @"Green Apple"}, @"banana": @{@"name": @"Banana"}} intoCollectionWithName:@"fruits"];
+  
+  OCMVerifyAll(delegate);
+}
+
+#pragma mark - Compacting
+
+- (void)testCompactingAfterRemovingDocumentsKeepsRemainingDocuments {
+  [_documentCache loadDocumentsWithFieldsByDocumentID:@{@"apple": @{@"name": @"Apple"}, @"banana": @{@"name": @"Banana"}} intoCollectionWithName:@"fruits"];
+  [_documentCache loadDocumentsWithFieldsByDocumentID:@{@"lovelace": @{@"name": @"Ada Lovelace"}} intoCollectionWithName:@"players"];
+  [_documentCache removeDocumentWithKey:[METDocumentKey keyWithCollectionName:@"fruits" documentID:@"apple"]];
+  [_documentCache removeDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"]];
+  
+  [_documentCache compact];
+  
+  XCTAssertEqual(1, [_documentCache numberOfDocumentsInCollectionWithName:@"fruits"]);
+  XCTAssertEqual(0, [_documentCache numberOfDocumentsInCollectionWithName:@"players"]);
+  [self verifyDocumentCacheContainsDocumentWithKey:[METDocumentKey keyWithCollectionName:@"fruits" documentID:@"banana"] fields:@{@"name": @"Banana"}];
+  
+  [_documentCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"shannon"] fields:@{@"name": @"Claude Shannon"}];
+  XCTAssertEqual(1, [_documentCache numberOfDocumentsInCollectionWithName:@"players"]);
+}
+
 #pragma mark - Change Tracking
 
 - (void)testTracksChangesWhenAddingDocument {
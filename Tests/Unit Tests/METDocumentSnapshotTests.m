@@ -0,0 +1,157 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#import <XCTest/XCTest.h>
+
+#import "METDocumentSnapshot.h"
+#import "METDocumentKey.h"
+#import "METDatabase.h"
+
+@interface METDocumentSnapshotTests : XCTestCase
+
+@end
+
+@implementation METDocumentSnapshotTests {
+  NSURL *_URL;
+  METDocumentSnapshot *_snapshot;
+}
+
+- (void)setUp {
+  [super setUp];
+  
+  NSString *fileName = [NSString stringWithFormat:@"%@.snapshot", [[NSUUID UUID] UUIDString]];
+  _URL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:fileName]];
+  
+  _snapshot = [[METDocumentSnapshot alloc] initWithURL:_URL];
+  NSError *error;
+  XCTAssertTrue([_snapshot openWithError:&error], @"%@", error);
+}
+
+- (void)tearDown {
+  [_snapshot close];
+  [[NSFileManager defaultManager] removeItemAtURL:_URL error:nil];
+  
+  [super tearDown];
+}
+
+- (METDocumentSnapshot *)reopenSnapshot {
+  [_snapshot close];
+  _snapshot = [[METDocumentSnapshot alloc] initWithURL:_URL];
+  NSError *error;
+  XCTAssertTrue([_snapshot openWithError:&error], @"%@", error);
+  return _snapshot;
+}
+
+- (void)testWrittenDocumentsCanBeReadAfterReopening {
+  NSDate *date = [NSDate dateWithTimeIntervalSince1970:1000];
+  [_snapshot writeFields:@{@"name": @"Ada Lovelace", @"score": @25, @"createdAt": date} forDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"]];
+  [_snapshot writeFields:@{@"name": @"Carl Friedrich Gauss"} forDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"gauss"]];
+  [_snapshot writeFields:@{@"name": @"Dining room"} forDocumentWithKey:[METDocumentKey keyWithCollectionName:@"rooms" documentID:@"dining"]];
+  
+  [self reopenSnapshot];
+  
+  XCTAssertEqualObjects(([NSSet setWithObjects:@"players", @"rooms", nil]), [_snapshot collectionNames]);
+  XCTAssertEqual(3, _snapshot.numberOfDocuments);
+  
+  NSDictionary *fieldsByDocumentID = [_snapshot fieldsByDocumentIDForCollectionWithName:@"players"];
+  XCTAssertEqualObjects((@{@"name": @"Ada Lovelace", @"score": @25, @"createdAt": date}), fieldsByDocumentID[@"lovelace"]);
+  XCTAssertEqualObjects(@{@"name": @"Carl Friedrich Gauss"}, fieldsByDocumentID[@"gauss"]);
+}
+
+- (void)testLatestWriteForDocumentWins {
+  METDocumentKey *documentKey = [METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"];
+  [_snapshot writeFields:@{@"name": @"Ada Lovelace", @"score": @25} forDocumentWithKey:documentKey];
+  [_snapshot writeFields:@{@"name": @"Ada Lovelace", @"score": @30} forDocumentWithKey:documentKey];
+  
+  [self reopenSnapshot];
+  
+  XCTAssertEqualObjects((@{@"name": @"Ada Lovelace", @"score": @30}), [_snapshot fieldsByDocumentIDForCollectionWithName:@"players"][@"lovelace"]);
+  XCTAssertEqual(2, _snapshot.numberOfRecords);
+}
+
+- (void)testRemovedDocumentsAreNotRead {
+  METDocumentKey *documentKey = [METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"];
+  [_snapshot writeFields:@{@"name": @"Ada Lovelace"} forDocumentWithKey:documentKey];
+  [_snapshot writeFields:nil forDocumentWithKey:documentKey];
+  
+  [self reopenSnapshot];
+  
+  XCTAssertEqual(0, _snapshot.numberOfDocuments);
+  XCTAssertNil([_snapshot fieldsByDocumentIDForCollectionWithName:@"players"]);
+}
+
+- (void)testPartiallyWrittenRecordIsDiscardedWhenOpening {
+  [_snapshot writeFields:@{@"name": @"Ada Lovelace"} forDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"]];
+  [_snapshot close];
+  unsigned long long validLength = [[[NSFileManager defaultManager] attributesOfItemAtPath:_URL.path error:nil] fileSize];
+  
+  NSFileHandle *fileHandle = [NSFileHandle fileHandleForWritingToURL:_URL error:nil];
+  [fileHandle seekToEndOfFile];
+  uint8_t garbage[] = {0xFF, 0x00, 0x00, 0x00, 0x01};
+  [fileHandle writeData:[NSData dataWithBytes:garbage length:sizeof(garbage)]];
+  [fileHandle closeFile];
+  
+  [self reopenSnapshot];
+  
+  XCTAssertEqual(1, _snapshot.numberOfDocuments);
+  XCTAssertEqual(validLength, _snapshot.fileSize);
+}
+
+- (void)testCompactionOnlyKeepsLatestRecords {
+  METDocumentKey *documentKey = [METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"];
+  for (NSInteger score = 0; score < 10; score++) {
+    [_snapshot writeFields:@{@"name": @"Ada Lovelace", @"score": @(score)} forDocumentWithKey:documentKey];
+  }
+  [_snapshot writeFields:@{@"name": @"Carl Friedrich Gauss"} forDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"gauss"]];
+  [_snapshot writeFields:nil forDocumentWithKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"gauss"]];
+  
+  unsigned long long fileSizeBeforeCompaction = _snapshot.fileSize;
+  
+  NSError *error;
+  XCTAssertTrue([_snapshot compactWithError:&error], @"%@", error);
+  
+  XCTAssertEqual(1, _snapshot.numberOfRecords);
+  XCTAssertLessThan(_snapshot.fileSize, fileSizeBeforeCompaction);
+  
+  [_snapshot writeFields:@{@"name": @"Dining room"} forDocumentWithKey:[METDocumentKey keyWithCollectionName:@"rooms" documentID:@"dining"]];
+  
+  [self reopenSnapshot];
+  
+  XCTAssertEqual(2, _snapshot.numberOfDocuments);
+  XCTAssertEqualObjects((@{@"name": @"Ada Lovelace", @"score": @9}), [_snapshot fieldsByDocumentIDForCollectionWithName:@"players"][@"lovelace"]);
+  XCTAssertEqualObjects(@{@"name": @"Dining room"}, [_snapshot fieldsByDocumentIDForCollectionWithName:@"rooms"][@"dining"]);
+}
+
+- (void)testOpeningFileWithInvalidHeaderFails {
+  NSString *fileName = [NSString stringWithFormat:@"%@.snapshot", [[NSUUID UUID] UUIDString]];
+  NSURL *URL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:fileName]];
+  [[@"not a snapshot" dataUsingEncoding:NSUTF8StringEncoding] writeToURL:URL atomically:YES];
+  
+  METDocumentSnapshot *snapshot = [[METDocumentSnapshot alloc] initWithURL:URL];
+  NSError *error;
+  XCTAssertFalse([snapshot openWithError:&error]);
+  XCTAssertEqualObjects(METDatabaseErrorDomain, error.domain);
+  XCTAssertEqual(METDatabaseInvalidSnapshotError, error.code);
+  
+  [[NSFileManager defaultManager] removeItemAtURL:URL error:nil];
+}
+
+@end
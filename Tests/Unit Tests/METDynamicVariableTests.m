@@ -77,4 +77,22 @@
   XCTAssertEqualObjects(@"originalValue", valueAfterNestedBlock);
 }
 
+- (void)testGettingCurrentValueOnAnotherThread {
+  METDynamicVariable *variable = [[METDynamicVariable alloc] init];
+  
+  __block id valueOnAnotherThread = @"notSet";
+  dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+  
+  [variable performBlock:^{
+    NSThread *thread = [[NSThread alloc] initWithTarget:[NSBlockOperation blockOperationWithBlock:^{
+      valueOnAnotherThread = [variable currentValue];
+      dispatch_semaphore_signal(semaphore);
+    }] selector:@selector(main) object:nil];
+    [thread start];
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+  } withValue:@"value"];
+  
+  XCTAssertNil(valueOnAnotherThread);
+}
+
 @end
@@ -0,0 +1,94 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#import <XCTest/XCTest.h>
+
+#import "METHistogram.h"
+
+@interface METHistogramTests : XCTestCase
+
+@end
+
+@implementation METHistogramTests {
+  METHistogram *_histogram;
+}
+
+- (void)setUp {
+  [super setUp];
+  
+  _histogram = [[METHistogram alloc] initWithBaseValue:1 numberOfBuckets:8];
+}
+
+- (void)testRecordsValuesInPowerOfTwoBuckets {
+  [_histogram recordValue:0.5];
+  [_histogram recordValue:1];
+  [_histogram recordValue:2];
+  [_histogram recordValue:3];
+  [_histogram recordValue:4];
+  [_histogram recordValue:5];
+  
+  XCTAssertEqual(2, [_histogram countForBucketAtIndex:0]);
+  XCTAssertEqual(1, [_histogram countForBucketAtIndex:1]);
+  XCTAssertEqual(2, [_histogram countForBucketAtIndex:2]);
+  XCTAssertEqual(1, [_histogram countForBucketAtIndex:3]);
+  XCTAssertEqual(4, [_histogram upperBoundForBucketAtIndex:2]);
+}
+
+- (void)testRecordsValuesThatExceedTheLastBucketInTheLastBucket {
+  [_histogram recordValue:1000000];
+  
+  XCTAssertEqual(1, [_histogram countForBucketAtIndex:7]);
+}
+
+- (void)testKeepsTrackOfSummaryStatistics {
+  [_histogram recordValue:2];
+  [_histogram recordValue:4];
+  [_histogram recordValue:9];
+  
+  XCTAssertEqual(3, _histogram.count);
+  XCTAssertEqual(15, _histogram.sum);
+  XCTAssertEqual(2, _histogram.minimum);
+  XCTAssertEqual(9, _histogram.maximum);
+  XCTAssertEqual(5, _histogram.mean);
+}
+
+- (void)testValueAtPercentile {
+  for (NSUInteger i = 0; i < 90; i++) {
+    [_histogram recordValue:1];
+  }
+  for (NSUInteger i = 0; i < 10; i++) {
+    [_histogram recordValue:30];
+  }
+  
+  XCTAssertEqual(1, [_histogram valueAtPercentile:50]);
+  XCTAssertEqual(1, [_histogram valueAtPercentile:90]);
+  XCTAssertEqual(30, [_histogram valueAtPercentile:99]);
+}
+
+- (void)testResetting {
+  [_histogram recordValue:2];
+  [_histogram reset];
+  
+  XCTAssertEqual(0, _histogram.count);
+  XCTAssertEqual(0, [_histogram countForBucketAtIndex:1]);
+  XCTAssertEqual(0, [_histogram valueAtPercentile:50]);
+}
+
+@end
@@ -148,6 +148,19 @@
   XCTAssertEqualObjects(@"Ada Lovelace", [object valueForKey:@"name"]);
 }
 
+- (void)testRemovingCachedNodes {
+  NSManagedObjectID *objectID = [_store objectIDForDocumentKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"]];
+  [self existingObjectWithID:objectID];
+  XCTAssertEqual(1, [_store numberOfCachedNodes]);
+  
+  [_persistentStoreCoordinator performBlockAndWait:^{
+    [_store removeCachedNodes];
+  }];
+  
+  XCTAssertEqual(0, [_store numberOfCachedNodes]);
+  XCTAssertEqualObjects(@"Ada Lovelace", [[self existingObjectWithID:objectID] valueForKey:@"name"]);
+}
+
 - (void)testFetchingUnknownObjectByObjectID {
   NSManagedObjectID *objectID = [_store objectIDForDocumentKey:[METDocumentKey keyWithCollectionName:@"players" documentID:@"unknown"]];
   NSError *error;
@@ -30,6 +30,8 @@
 #import "METDatabaseChanges_Internal.h"
 #import "METDocumentKey.h"
 #import "METBufferedDocument.h"
+#import "METMethodInvocationScheduler.h"
+#import "METDocumentChangeDetails.h"
 #import "METDataUpdate.h"
 
 @interface METMethodInvocationCoordinatorTests : XCTAsyncTestCase
@@ -90,7 +92,9 @@
   [self waitForExpectationsWithTimeout:1.0 handler:nil];
   
   XCTAssertFalse(methodInvocation.isExecuting);
-  XCTAssertEqual(0, _coordinator.operationQueue.operationCount);
+  [self waitUntilAssertionsPass:^{
+    XCTAssertEqual(0, _coordinator.scheduler.numberOfMethodInvocations);
+  }];
 }
 
 - (void)testMethodInvocationsAreExecutedConcurrently {
@@ -230,6 +234,52 @@
   XCTAssertNil([_coordinator bufferedDocumentForKey:[METDocumentKey keyWithCollectionName:@"players" documentID: @"shannon"]].fields);
 }
 
+- (void)testRemovingMethodInvocationOnlyDropsItsOwnPatchLayer {
+  METDocumentKey *documentKey = [METDocumentKey keyWithCollectionName:@"players" documentID: @"lovelace"];
+  METBufferedDocument *bufferedDocument = [[METBufferedDocument alloc] initWithDocumentKey:documentKey fields:@{@"name": @"Ada Lovelace", @"score": @25}];
+  
+  METMethodInvocation *methodInvocation1 = [[METMethodInvocation alloc] init];
+  METDocumentChangeDetails *changeDetails1 = [[METDocumentChangeDetails alloc] initWithDocumentKey:documentKey];
+  changeDetails1.fieldsBeforeChanges = @{@"name": @"Ada Lovelace", @"score": @25};
+  changeDetails1.fieldsAfterChanges = @{@"name": @"Ada Lovelace", @"score": @20};
+  [bufferedDocument addMethodInvocation:methodInvocation1 withChangesPerformedByStub:changeDetails1];
+  
+  METMethodInvocation *methodInvocation2 = [[METMethodInvocation alloc] init];
+  METDocumentChangeDetails *changeDetails2 = [[METDocumentChangeDetails alloc] initWithDocumentKey:documentKey];
+  changeDetails2.fieldsBeforeChanges = @{@"name": @"Ada Lovelace", @"score": @20};
+  changeDetails2.fieldsAfterChanges = @{@"name": @"Ada Lovelace", @"score": @20, @"color": @"green"};
+  [bufferedDocument addMethodInvocation:methodInvocation2 withChangesPerformedByStub:changeDetails2];
+  
+  bufferedDocument.fields = @{@"name": @"Ada Lovelace", @"score": @30};
+  
+  METDataUpdate *update = [bufferedDocument dataUpdateByRemovingMethodInvocation:methodInvocation1];
+  XCTAssertEqual(METDataUpdateTypeChange, update.updateType);
+  XCTAssertEqualObjects((@{@"score": @30}), update.fields);
+  XCTAssertEqualObjects((@{@"name": @"Ada Lovelace", @"score": @30, @"color": @"green"}), bufferedDocument.composedFields);
+  XCTAssertEqual(1, bufferedDocument.numberOfMethodInvocations);
+  
+  bufferedDocument.fields = nil;
+  
+  update = [bufferedDocument dataUpdateByRemovingMethodInvocation:methodInvocation2];
+  XCTAssertEqual(METDataUpdateTypeRemove, update.updateType);
+  XCTAssertEqual(0, bufferedDocument.numberOfMethodInvocations);
+}
+
+- (void)testRemovingMethodInvocationDoesNotReturnUpdateWhenLocalCacheIsAlreadyUpToDate {
+  METDocumentKey *documentKey = [METDocumentKey keyWithCollectionName:@"players" documentID: @"lovelace"];
+  METBufferedDocument *bufferedDocument = [[METBufferedDocument alloc] initWithDocumentKey:documentKey fields:@{@"name": @"Ada Lovelace", @"score": @25}];
+  
+  METMethodInvocation *methodInvocation = [[METMethodInvocation alloc] init];
+  METDocumentChangeDetails *changeDetails = [[METDocumentChangeDetails alloc] initWithDocumentKey:documentKey];
+  changeDetails.fieldsBeforeChanges = @{@"name": @"Ada Lovelace", @"score": @25};
+  changeDetails.fieldsAfterChanges = @{@"name": @"Ada Lovelace", @"score": @20};
+  [bufferedDocument addMethodInvocation:methodInvocation withChangesPerformedByStub:changeDetails];
+  
+  bufferedDocument.fields = @{@"name": @"Ada Lovelace", @"score": @20};
+  
+  XCTAssertNil([bufferedDocument dataUpdateByRemovingMethodInvocation:methodInvocation]);
+}
+
 #pragma mark - Helper Methods
 
 - (void)finishMethodInvocation:(METMethodInvocation *)methodInvocation {
@@ -0,0 +1,152 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#import <XCTest/XCTest.h>
+#import "XCTAsyncTestCase.h"
+
+#import "METMethodInvocationLog.h"
+#import "METMethodInvocation.h"
+
+@interface METMethodInvocationLogTests : XCTAsyncTestCase
+
+@end
+
+@implementation METMethodInvocationLogTests {
+  NSURL *_URL;
+  METMethodInvocationLog *_log;
+}
+
+- (void)setUp {
+  [super setUp];
+  
+  NSString *fileName = [NSString stringWithFormat:@"%@.log", [[NSUUID UUID] UUIDString]];
+  _URL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:fileName]];
+  
+  _log = [[METMethodInvocationLog alloc] initWithURL:_URL];
+  NSError *error;
+  XCTAssertTrue([_log openWithError:&error], @"%@", error);
+}
+
+- (void)tearDown {
+  [_log close];
+  [[NSFileManager defaultManager] removeItemAtURL:_URL error:nil];
+  
+  [super tearDown];
+}
+
+- (void)reopenLog {
+  [_log close];
+  _log = [[METMethodInvocationLog alloc] initWithURL:_URL];
+  NSError *error;
+  XCTAssertTrue([_log openWithError:&error], @"%@", error);
+}
+
+- (METMethodInvocation *)methodInvocationWithID:(NSString *)methodID {
+  METMethodInvocation *methodInvocation = [[METMethodInvocation alloc] init];
+  methodInvocation.methodID = methodID;
+  methodInvocation.methodName = @"doSomething";
+  methodInvocation.parameters = @[@"someParameter", @{@"createdAt": [NSDate dateWithTimeIntervalSince1970:1000]}];
+  methodInvocation.randomSeed = [NSString stringWithFormat:@"seed-%@", methodID];
+  return methodInvocation;
+}
+
+- (void)testPendingMethodInvocationsAreReadInOrderAfterReopening {
+  [_log appendMethodInvocation:[self methodInvocationWithID:@"1"]];
+  [_log appendMethodInvocation:[self methodInvocationWithID:@"2"]];
+  
+  [self reopenLog];
+  
+  NSArray *methodInvocations = [_log pendingMethodInvocations];
+  XCTAssertEqual(2, methodInvocations.count);
+  
+  METMethodInvocation *methodInvocation = methodInvocations[0];
+  XCTAssertEqualObjects(@"1", methodInvocation.methodID);
+  XCTAssertEqualObjects(@"doSomething", methodInvocation.methodName);
+  XCTAssertEqualObjects((@[@"someParameter", @{@"createdAt": [NSDate dateWithTimeIntervalSince1970:1000]}]), methodInvocation.parameters);
+  XCTAssertEqualObjects(@"seed-1", methodInvocation.randomSeed);
+  XCTAssertEqualObjects(@"2", [methodInvocations[1] methodID]);
+}
+
+- (void)testRemovedMethodInvocationsAreNoLongerPending {
+  [_log appendMethodInvocation:[self methodInvocationWithID:@"1"]];
+  [_log appendMethodInvocation:[self methodInvocationWithID:@"2"]];
+  [_log removeMethodInvocationWithID:@"1"];
+  
+  [self reopenLog];
+  
+  XCTAssertEqual(1, _log.numberOfPendingMethodInvocations);
+  XCTAssertEqualObjects(@"2", [[_log pendingMethodInvocations][0] methodID]);
+}
+
+- (void)testPartiallyWrittenRecordIsDiscardedWhenOpening {
+  [_log appendMethodInvocation:[self methodInvocationWithID:@"1"]];
+  [_log close];
+  
+  NSFileHandle *fileHandle = [NSFileHandle fileHandleForWritingToURL:_URL error:nil];
+  [fileHandle seekToEndOfFile];
+  uint8_t garbage[] = {0xFF, 0x00, 0x00, 0x00, '{'};
+  [fileHandle writeData:[NSData dataWithBytes:garbage length:sizeof(garbage)]];
+  [fileHandle closeFile];
+  
+  [self reopenLog];
+  
+  XCTAssertEqual(1, _log.numberOfPendingMethodInvocations);
+  
+  [_log appendMethodInvocation:[self methodInvocationWithID:@"2"]];
+  
+  [self reopenLog];
+  
+  XCTAssertEqual(2, _log.numberOfPendingMethodInvocations);
+}
+
+- (void)testWritesInQuickSuccessionShareSynchronization {
+  _log.synchronizationInterval = 0.1;
+  
+  for (NSInteger i = 0; i < 10; i++) {
+    [_log appendMethodInvocation:[self methodInvocationWithID:[@(i) stringValue]]];
+  }
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertEqual(1, _log.numberOfSynchronizations);
+  }];
+}
+
+- (void)testCompactionOnlyKeepsPendingMethodInvocations {
+  for (NSInteger i = 0; i < 10; i++) {
+    NSString *methodID = [@(i) stringValue];
+    [_log appendMethodInvocation:[self methodInvocationWithID:methodID]];
+    if (i < 9) {
+      [_log removeMethodInvocationWithID:methodID];
+    }
+  }
+  XCTAssertEqual(19, _log.numberOfRecords);
+  
+  NSError *error;
+  XCTAssertTrue([_log compactWithError:&error], @"%@", error);
+  XCTAssertEqual(1, _log.numberOfRecords);
+  
+  [self reopenLog];
+  
+  XCTAssertEqual(1, _log.numberOfRecords);
+  XCTAssertEqualObjects(@"9", [[_log pendingMethodInvocations][0] methodID]);
+}
+
+@end
@@ -0,0 +1,347 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#import <XCTest/XCTest.h>
+#import "XCTAsyncTestCase.h"
+
+#import "METMethodInvocationScheduler.h"
+#import "METMethodInvocation.h"
+#import "METMethodInvocation_Internal.h"
+#import "METHistogram.h"
+
+@interface METMethodInvocationSchedulerTests : XCTAsyncTestCase
+
+@end
+
+@implementation METMethodInvocationSchedulerTests {
+  METMethodInvocationScheduler *_scheduler;
+}
+
+- (void)setUp {
+  [super setUp];
+  
+  _scheduler = [[METMethodInvocationScheduler alloc] init];
+}
+
+- (void)tearDown {
+  [_scheduler invalidate];
+  
+  [super tearDown];
+}
+
+#pragma mark - Scheduling
+
+- (void)testStartsMethodInvocationsInOrderWhenNoLongerSuspended {
+  METMethodInvocation *methodInvocation1 = [[METMethodInvocation alloc] init];
+  METMethodInvocation *methodInvocation2 = [[METMethodInvocation alloc] init];
+  [_scheduler addMethodInvocation:methodInvocation1];
+  [_scheduler addMethodInvocation:methodInvocation2];
+  
+  [self waitForTimeInterval:0.1];
+  XCTAssertFalse(methodInvocation1.isExecuting);
+  
+  _scheduler.suspended = NO;
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertTrue(methodInvocation1.isExecuting);
+    XCTAssertTrue(methodInvocation2.isExecuting);
+  }];
+  XCTAssertEqual(2, _scheduler.numberOfExecutingMethodInvocations);
+}
+
+- (void)testBarrierOnlyStartsAfterEarlierMethodInvocationsHaveFinishedAndBlocksLaterOnes {
+  _scheduler.suspended = NO;
+  
+  METMethodInvocation *methodInvocation1 = [[METMethodInvocation alloc] init];
+  METMethodInvocation *barrierMethodInvocation = [[METMethodInvocation alloc] init];
+  barrierMethodInvocation.barrier = YES;
+  METMethodInvocation *methodInvocation2 = [[METMethodInvocation alloc] init];
+  
+  [_scheduler addMethodInvocation:methodInvocation1];
+  [_scheduler addMethodInvocation:barrierMethodInvocation];
+  [_scheduler addMethodInvocation:methodInvocation2];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertTrue(methodInvocation1.isExecuting);
+  }];
+  XCTAssertFalse(barrierMethodInvocation.isExecuting);
+  XCTAssertFalse(methodInvocation2.isExecuting);
+  
+  [self finishMethodInvocation:methodInvocation1];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertTrue(barrierMethodInvocation.isExecuting);
+  }];
+  XCTAssertFalse(methodInvocation2.isExecuting);
+  
+  [self finishMethodInvocation:barrierMethodInvocation];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertTrue(methodInvocation2.isExecuting);
+  }];
+  XCTAssertEqual(1, _scheduler.numberOfMethodInvocations);
+}
+
+- (void)testInvokesFinishedHandlerWhenMethodInvocationFinishes {
+  XCTestExpectation *expectation = [self expectationWithDescription:@"finished handler invoked"];
+  METMethodInvocation *methodInvocation = [[METMethodInvocation alloc] init];
+  _scheduler = [[METMethodInvocationScheduler alloc] initWithFinishedHandler:^(METMethodInvocation *finishedMethodInvocation) {
+    XCTAssertEqual(methodInvocation, finishedMethodInvocation);
+    [expectation fulfill];
+  }];
+  _scheduler.suspended = NO;
+  
+  [_scheduler addMethodInvocation:methodInvocation];
+  [self waitUntilAssertionsPass:^{
+    XCTAssertTrue(methodInvocation.isExecuting);
+  }];
+  
+  [self finishMethodInvocation:methodInvocation];
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+  XCTAssertEqual(0, _scheduler.numberOfMethodInvocations);
+}
+
+- (void)testInvalidatingCancelsMethodInvocations {
+  METMethodInvocation *methodInvocation = [[METMethodInvocation alloc] init];
+  [_scheduler addMethodInvocation:methodInvocation];
+  
+  [_scheduler invalidate];
+  
+  XCTAssertTrue(methodInvocation.isCancelled);
+  XCTAssertEqual(0, _scheduler.numberOfMethodInvocations);
+}
+
+#pragma mark - Limits and Priorities
+
+- (void)testDoesNotStartMoreThanTheMaximumNumberOfExecutingMethodInvocations {
+  _scheduler.maximumNumberOfExecutingMethodInvocations = 2;
+  _scheduler.suspended = NO;
+  
+  METMethodInvocation *methodInvocation1 = [[METMethodInvocation alloc] init];
+  METMethodInvocation *methodInvocation2 = [[METMethodInvocation alloc] init];
+  METMethodInvocation *methodInvocation3 = [[METMethodInvocation alloc] init];
+  [_scheduler addMethodInvocations:@[methodInvocation1, methodInvocation2, methodInvocation3]];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertTrue(methodInvocation2.isExecuting);
+  }];
+  XCTAssertFalse(methodInvocation3.isExecuting);
+  
+  [self finishMethodInvocation:methodInvocation1];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertTrue(methodInvocation3.isExecuting);
+  }];
+}
+
+- (void)testDoesNotStartMoreThanTheMaximumNumberOfExecutingMethodInvocationsForAMethodName {
+  [_scheduler setMaximumNumberOfExecutingMethodInvocations:1 forMethodWithName:@"sync"];
+  _scheduler.suspended = NO;
+  
+  METMethodInvocation *syncMethodInvocation1 = [self methodInvocationWithName:@"sync" priority:NSOperationQueuePriorityNormal];
+  METMethodInvocation *syncMethodInvocation2 = [self methodInvocationWithName:@"sync" priority:NSOperationQueuePriorityNormal];
+  METMethodInvocation *otherMethodInvocation = [self methodInvocationWithName:@"other" priority:NSOperationQueuePriorityNormal];
+  [_scheduler addMethodInvocations:@[syncMethodInvocation1, syncMethodInvocation2, otherMethodInvocation]];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertTrue(syncMethodInvocation1.isExecuting);
+    XCTAssertTrue(otherMethodInvocation.isExecuting);
+  }];
+  XCTAssertFalse(syncMethodInvocation2.isExecuting);
+  
+  [self finishMethodInvocation:syncMethodInvocation1];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertTrue(syncMethodInvocation2.isExecuting);
+  }];
+}
+
+- (void)testStartsMethodInvocationsHeldBackByLimitForAMethodNameInOrder {
+  [_scheduler setMaximumNumberOfExecutingMethodInvocations:1 forMethodWithName:@"sync"];
+  _scheduler.suspended = NO;
+  
+  METMethodInvocation *syncMethodInvocation1 = [self methodInvocationWithName:@"sync" priority:NSOperationQueuePriorityNormal];
+  METMethodInvocation *syncMethodInvocation2 = [self methodInvocationWithName:@"sync" priority:NSOperationQueuePriorityNormal];
+  METMethodInvocation *syncMethodInvocation3 = [self methodInvocationWithName:@"sync" priority:NSOperationQueuePriorityNormal];
+  METMethodInvocation *otherMethodInvocation = [self methodInvocationWithName:@"other" priority:NSOperationQueuePriorityNormal];
+  [_scheduler addMethodInvocations:@[syncMethodInvocation1, syncMethodInvocation2, syncMethodInvocation3, otherMethodInvocation]];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertTrue(syncMethodInvocation1.isExecuting);
+    XCTAssertTrue(otherMethodInvocation.isExecuting);
+  }];
+  
+  [self finishMethodInvocation:syncMethodInvocation1];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertTrue(syncMethodInvocation2.isExecuting);
+  }];
+  XCTAssertFalse(syncMethodInvocation3.isExecuting);
+  
+  [_scheduler setMaximumNumberOfExecutingMethodInvocations:0 forMethodWithName:@"sync"];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertTrue(syncMethodInvocation3.isExecuting);
+  }];
+}
+
+- (void)testStartsMethodInvocationsWithHigherPriorityFirstButNotAheadOfEarlierBarrier {
+  _scheduler.maximumNumberOfExecutingMethodInvocations = 1;
+  
+  METMethodInvocation *lowPriorityMethodInvocation = [self methodInvocationWithName:@"sync" priority:NSOperationQueuePriorityLow];
+  METMethodInvocation *highPriorityMethodInvocation = [self methodInvocationWithName:@"interactive" priority:NSOperationQueuePriorityHigh];
+  METMethodInvocation *barrierMethodInvocation = [self methodInvocationWithName:@"logout" priority:NSOperationQueuePriorityNormal];
+  barrierMethodInvocation.barrier = YES;
+  METMethodInvocation *highPriorityMethodInvocationAfterBarrier = [self methodInvocationWithName:@"interactive" priority:NSOperationQueuePriorityVeryHigh];
+  [_scheduler addMethodInvocations:@[lowPriorityMethodInvocation, highPriorityMethodInvocation, barrierMethodInvocation, highPriorityMethodInvocationAfterBarrier]];
+  
+  _scheduler.suspended = NO;
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertTrue(highPriorityMethodInvocation.isExecuting);
+  }];
+  XCTAssertFalse(lowPriorityMethodInvocation.isExecuting);
+  
+  [self finishMethodInvocation:highPriorityMethodInvocation];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertTrue(lowPriorityMethodInvocation.isExecuting);
+  }];
+  XCTAssertFalse(highPriorityMethodInvocationAfterBarrier.isExecuting);
+  
+  [self finishMethodInvocation:lowPriorityMethodInvocation];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertTrue(barrierMethodInvocation.isExecuting);
+  }];
+  XCTAssertFalse(highPriorityMethodInvocationAfterBarrier.isExecuting);
+  
+  [self finishMethodInvocation:barrierMethodInvocation];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertTrue(highPriorityMethodInvocationAfterBarrier.isExecuting);
+  }];
+}
+
+- (void)testRecordsQueueWaitTimePerPriority {
+  METHistogram *highPriorityHistogram = [[METHistogram alloc] initWithBaseValue:0.001 numberOfBuckets:24];
+  METHistogram *normalPriorityHistogram = [[METHistogram alloc] initWithBaseValue:0.001 numberOfBuckets:24];
+  [_scheduler setQueueWaitTimeHistogram:highPriorityHistogram forPriority:NSOperationQueuePriorityHigh];
+  [_scheduler setQueueWaitTimeHistogram:normalPriorityHistogram forPriority:NSOperationQueuePriorityNormal];
+  
+  [_scheduler addMethodInvocation:[self methodInvocationWithName:@"interactive" priority:NSOperationQueuePriorityHigh]];
+  [self waitForTimeInterval:0.1];
+  _scheduler.suspended = NO;
+  
+  XCTAssertEqual(1, highPriorityHistogram.count);
+  XCTAssertGreaterThanOrEqual(highPriorityHistogram.minimum, 0.1);
+  XCTAssertEqual(0, normalPriorityHistogram.count);
+}
+
+#pragma mark - Performance
+
+- (void)testPerformanceOfEnqueueingAndCompletingAtQueueDepthOf10 {
+  [self measureEnqueueingAndCompletingMethodInvocationsAtQueueDepth:10];
+}
+
+- (void)testPerformanceOfEnqueueingAndCompletingAtQueueDepthOf100 {
+  [self measureEnqueueingAndCompletingMethodInvocationsAtQueueDepth:100];
+}
+
+- (void)testPerformanceOfEnqueueingAndCompletingAtQueueDepthOf1000 {
+  [self measureEnqueueingAndCompletingMethodInvocationsAtQueueDepth:1000];
+}
+
+- (void)testPerformanceOfEnqueueingAndCompletingAtQueueDepthOf10000 {
+  [self measureEnqueueingAndCompletingMethodInvocationsAtQueueDepth:10000];
+}
+
+// Every invocation but the executing one is held back by the limit for its method name
+- (void)testPerformanceOfCompletingMethodInvocationsLimitedToOneAtATimeAtQueueDepthOf10000 {
+  NSUInteger depth = 10000;
+  
+  [self measureBlock:^{
+    METMethodInvocationScheduler *scheduler = [[METMethodInvocationScheduler alloc] init];
+    [scheduler setMaximumNumberOfExecutingMethodInvocations:1 forMethodWithName:@"sync"];
+    
+    NSMutableArray *methodInvocations = [[NSMutableArray alloc] initWithCapacity:depth];
+    for (NSUInteger i = 0; i < depth; i++) {
+      [methodInvocations addObject:[self methodInvocationWithName:@"sync" priority:NSOperationQueuePriorityNormal]];
+    }
+    [scheduler addMethodInvocations:methodInvocations];
+    
+    scheduler.suspended = NO;
+    
+    for (METMethodInvocation *methodInvocation in methodInvocations) {
+      while (!methodInvocation.isExecuting) {
+        [NSThread sleepForTimeInterval:0.0001];
+      }
+      [self finishMethodInvocation:methodInvocation];
+    }
+    
+    XCTAssertEqual(0, scheduler.numberOfMethodInvocations);
+    [scheduler invalidate];
+  }];
+}
+
+#pragma mark - Helper Methods
+
+- (METMethodInvocation *)methodInvocationWithName:(NSString *)methodName priority:(NSOperationQueuePriority)priority {
+  METMethodInvocation *methodInvocation = [[METMethodInvocation alloc] init];
+  methodInvocation.methodName = methodName;
+  methodInvocation.queuePriority = priority;
+  return methodInvocation;
+}
+
+- (void)finishMethodInvocation:(METMethodInvocation *)methodInvocation {
+  [methodInvocation didReceiveResult:nil error:nil];
+  [methodInvocation didFlushUpdates];
+}
+
+// Queues up offline calls with a trailing barrier (like logging out), then completes them all
+- (void)measureEnqueueingAndCompletingMethodInvocationsAtQueueDepth:(NSUInteger)depth {
+  [self measureBlock:^{
+    METMethodInvocationScheduler *scheduler = [[METMethodInvocationScheduler alloc] init];
+    
+    NSMutableArray *methodInvocations = [[NSMutableArray alloc] initWithCapacity:depth];
+    for (NSUInteger i = 0; i < depth; i++) {
+      METMethodInvocation *methodInvocation = [[METMethodInvocation alloc] init];
+      methodInvocation.barrier = (i == depth - 1);
+      [methodInvocations addObject:methodInvocation];
+      [scheduler addMethodInvocation:methodInvocation];
+    }
+    
+    scheduler.suspended = NO;
+    
+    for (METMethodInvocation *methodInvocation in methodInvocations) {
+      while (!methodInvocation.isExecuting) {
+        [NSThread sleepForTimeInterval:0.0001];
+      }
+      [self finishMethodInvocation:methodInvocation];
+    }
+    
+    XCTAssertEqual(0, scheduler.numberOfMethodInvocations);
+    [scheduler invalidate];
+  }];
+}
+
+@end
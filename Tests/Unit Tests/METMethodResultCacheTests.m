@@ -0,0 +1,208 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#import <XCTest/XCTest.h>
+#import "XCTAsyncTestCase.h"
+
+#import "METMethodResultCache.h"
+
+@interface METMethodResultCacheTests : XCTAsyncTestCase
+
+@end
+
+@implementation METMethodResultCacheTests {
+  METMethodResultCache *_cache;
+}
+
+- (void)setUp {
+  [super setUp];
+  
+  _cache = [[METMethodResultCache alloc] init];
+  [_cache setTimeToLive:60 forMethodWithName:@"lookup"];
+}
+
+- (void)testOnlyMethodsWithTimeToLiveAreCacheable {
+  XCTAssertTrue([_cache isCacheableMethodWithName:@"lookup"]);
+  XCTAssertFalse([_cache isCacheableMethodWithName:@"doSomething"]);
+}
+
+- (void)testReturnsCachedResultForParametersThatAreEqual {
+  [self completeCallWithParameters:@[@{@"name": @"lovelace", @"fields": @[@"score"]}] result:@25];
+  
+  id result;
+  XCTAssertTrue([_cache getResult:&result forMethodWithName:@"lookup" parameters:@[@{@"fields": @[@"score"], @"name": @"lovelace"}]]);
+  XCTAssertEqualObjects(@25, result);
+  XCTAssertFalse([_cache getResult:&result forMethodWithName:@"lookup" parameters:@[@{@"name": @"shannon", @"fields": @[@"score"]}]]);
+  
+  XCTAssertEqual(1, _cache.numberOfHits);
+  XCTAssertEqual(1, _cache.numberOfMisses);
+  XCTAssertEqualWithAccuracy(0.5, _cache.hitRate, 0.001);
+}
+
+- (void)testDoesNotCacheErrors {
+  NSUInteger generation;
+  [_cache addReceivedResultHandler:nil completionHandler:nil forInFlightCallWithMethodName:@"lookup" parameters:@[@"lovelace"] generation:&generation];
+  [_cache didCompleteCallWithMethodName:@"lookup" parameters:@[@"lovelace"] generation:generation result:nil error:[NSError errorWithDomain:@"" code:1 userInfo:nil]];
+  
+  id result;
+  XCTAssertFalse([_cache getResult:&result forMethodWithName:@"lookup" parameters:@[@"lovelace"]]);
+}
+
+- (void)testDoesNotReturnExpiredResults {
+  [_cache setTimeToLive:0.05 forMethodWithName:@"lookup"];
+  [self completeCallWithParameters:@[@"lovelace"] result:@25];
+  
+  [self waitForTimeInterval:0.1];
+  
+  id result;
+  XCTAssertFalse([_cache getResult:&result forMethodWithName:@"lookup" parameters:@[@"lovelace"]]);
+  XCTAssertEqual(0, _cache.numberOfCachedResults);
+}
+
+- (void)testEvictsLeastRecentlyUsedResultWhenFull {
+  _cache.maximumNumberOfResults = 2;
+  [self completeCallWithParameters:@[@"lovelace"] result:@25];
+  [self completeCallWithParameters:@[@"shannon"] result:@30];
+  
+  id result;
+  [_cache getResult:&result forMethodWithName:@"lookup" parameters:@[@"lovelace"]];
+  [self completeCallWithParameters:@[@"turing"] result:@35];
+  
+  XCTAssertEqual(2, _cache.numberOfCachedResults);
+  XCTAssertTrue([_cache getResult:&result forMethodWithName:@"lookup" parameters:@[@"lovelace"]]);
+  XCTAssertFalse([_cache getResult:&result forMethodWithName:@"lookup" parameters:@[@"shannon"]]);
+}
+
+- (void)testCoalescesIdenticalCallsThatAreInFlight {
+  __block NSUInteger numberOfCompletionHandlersInvoked = 0;
+  METMethodCompletionHandler completionHandler = ^(id result, NSError *error) {
+    XCTAssertEqualObjects(@25, result);
+    numberOfCompletionHandlersInvoked++;
+  };
+  
+  NSUInteger generation;
+  XCTAssertFalse([_cache addReceivedResultHandler:nil completionHandler:completionHandler forInFlightCallWithMethodName:@"lookup" parameters:@[@"lovelace"] generation:&generation]);
+  XCTAssertTrue([_cache addReceivedResultHandler:nil completionHandler:completionHandler forInFlightCallWithMethodName:@"lookup" parameters:@[@"lovelace"] generation:&generation]);
+  XCTAssertFalse([_cache addReceivedResultHandler:nil completionHandler:completionHandler forInFlightCallWithMethodName:@"lookup" parameters:@[@"shannon"] generation:&generation]);
+  
+  [_cache didCompleteCallWithMethodName:@"lookup" parameters:@[@"lovelace"] generation:generation result:@25 error:nil];
+  
+  XCTAssertEqual(2, numberOfCompletionHandlersInvoked);
+  XCTAssertEqual(1, _cache.numberOfCoalescedCalls);
+}
+
+- (void)testInvokesReceivedResultHandlersOfCoalescedCalls {
+  __block NSUInteger numberOfReceivedResultHandlersInvoked = 0;
+  METMethodCompletionHandler receivedResultHandler = ^(id result, NSError *error) {
+    XCTAssertEqualObjects(@25, result);
+    numberOfReceivedResultHandlersInvoked++;
+  };
+  
+  NSUInteger generation;
+  [_cache addReceivedResultHandler:receivedResultHandler completionHandler:nil forInFlightCallWithMethodName:@"lookup" parameters:@[@"lovelace"] generation:&generation];
+  [_cache addReceivedResultHandler:receivedResultHandler completionHandler:nil forInFlightCallWithMethodName:@"lookup" parameters:@[@"lovelace"] generation:&generation];
+  
+  [_cache didReceiveResultForCallWithMethodName:@"lookup" parameters:@[@"lovelace"] generation:generation result:@25 error:nil];
+  
+  XCTAssertEqual(2, numberOfReceivedResultHandlersInvoked);
+}
+
+- (void)testInvokesReceivedResultHandlerOfCallCoalescedAfterResultHasBeenReceived {
+  NSUInteger generation;
+  [_cache addReceivedResultHandler:nil completionHandler:nil forInFlightCallWithMethodName:@"lookup" parameters:@[@"lovelace"] generation:&generation];
+  [_cache didReceiveResultForCallWithMethodName:@"lookup" parameters:@[@"lovelace"] generation:generation result:@25 error:nil];
+  
+  XCTestExpectation *expectation = [self expectationWithDescription:@"received result handler invoked"];
+  XCTAssertTrue([_cache addReceivedResultHandler:^(id result, NSError *error) {
+    XCTAssertEqualObjects(@25, result);
+    [expectation fulfill];
+  } completionHandler:nil forInFlightCallWithMethodName:@"lookup" parameters:@[@"lovelace"] generation:&generation]);
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+}
+
+- (void)testHandsOutImmutableCopiesOfResults {
+  NSMutableArray *result = [NSMutableArray arrayWithObject:[NSMutableDictionary dictionaryWithObject:@25 forKey:@"score"]];
+  
+  __block id completionHandlerResult;
+  NSUInteger generation;
+  [_cache addReceivedResultHandler:nil completionHandler:^(id result, NSError *error) {
+    completionHandlerResult = result;
+  } forInFlightCallWithMethodName:@"lookup" parameters:@[@"lovelace"] generation:&generation];
+  [_cache didCompleteCallWithMethodName:@"lookup" parameters:@[@"lovelace"] generation:generation result:result error:nil];
+  
+  [result[0] setObject:@30 forKey:@"score"];
+  [result addObject:@"turing"];
+  
+  id cachedResult;
+  [_cache getResult:&cachedResult forMethodWithName:@"lookup" parameters:@[@"lovelace"]];
+  XCTAssertEqualObjects((@[@{@"score": @25}]), cachedResult);
+  XCTAssertEqualObjects((@[@{@"score": @25}]), completionHandlerResult);
+  XCTAssertFalse([cachedResult isKindOfClass:[NSMutableArray class]]);
+  XCTAssertFalse([cachedResult[0] isKindOfClass:[NSMutableDictionary class]]);
+}
+
+- (void)testInvalidatingRemovesResultsAndDoesNotCacheResultsOfCallsInFlight {
+  [self completeCallWithParameters:@[@"lovelace"] result:@25];
+  NSUInteger generation;
+  [_cache addReceivedResultHandler:nil completionHandler:nil forInFlightCallWithMethodName:@"lookup" parameters:@[@"shannon"] generation:&generation];
+  
+  [_cache invalidate];
+  [_cache didCompleteCallWithMethodName:@"lookup" parameters:@[@"shannon"] generation:generation result:@30 error:nil];
+  
+  XCTAssertEqual(0, _cache.numberOfCachedResults);
+}
+
+- (void)testDoesNotCoalesceCallsWithCallsMadeBeforeInvalidating {
+  __block id resultBeforeInvalidating;
+  __block id resultAfterInvalidating;
+  
+  NSUInteger generationBeforeInvalidating;
+  XCTAssertFalse([_cache addReceivedResultHandler:nil completionHandler:^(id result, NSError *error) {
+    resultBeforeInvalidating = result;
+  } forInFlightCallWithMethodName:@"lookup" parameters:@[@"lovelace"] generation:&generationBeforeInvalidating]);
+  
+  [_cache invalidate];
+  
+  NSUInteger generationAfterInvalidating;
+  XCTAssertFalse([_cache addReceivedResultHandler:nil completionHandler:^(id result, NSError *error) {
+    resultAfterInvalidating = result;
+  } forInFlightCallWithMethodName:@"lookup" parameters:@[@"lovelace"] generation:&generationAfterInvalidating]);
+  
+  [_cache didCompleteCallWithMethodName:@"lookup" parameters:@[@"lovelace"] generation:generationBeforeInvalidating result:@25 error:nil];
+  XCTAssertEqualObjects(@25, resultBeforeInvalidating);
+  XCTAssertNil(resultAfterInvalidating);
+  XCTAssertEqual(0, _cache.numberOfCachedResults);
+  
+  [_cache didCompleteCallWithMethodName:@"lookup" parameters:@[@"lovelace"] generation:generationAfterInvalidating result:@30 error:nil];
+  XCTAssertEqualObjects(@30, resultAfterInvalidating);
+  XCTAssertEqual(1, _cache.numberOfCachedResults);
+  XCTAssertEqual(0, _cache.numberOfCoalescedCalls);
+}
+
+#pragma mark - Helper Methods
+
+- (void)completeCallWithParameters:(NSArray *)parameters result:(id)result {
+  NSUInteger generation;
+  [_cache addReceivedResultHandler:nil completionHandler:nil forInFlightCallWithMethodName:@"lookup" parameters:parameters generation:&generation];
+  [_cache didCompleteCallWithMethodName:@"lookup" parameters:parameters generation:generation result:result error:nil];
+}
+
+@end
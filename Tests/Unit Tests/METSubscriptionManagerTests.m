@@ -22,9 +22,49 @@
 #import "XCTAsyncTestCase.h"
 
 #import "METSubscriptionManager.h"
+#import "METSubscriptionRetentionPolicy.h"
+#import "METSubscriptionLoadStatistics.h"
+#import "METHistogram.h"
 
 #import "METDDPClient.h"
 #import "METDDPClient_Internal.h"
+#import "METDatabase.h"
+#import "METDatabase_Internal.h"
+#import "METDataUpdate.h"
+#import "METDocument.h"
+#import "METDocumentKey.h"
+#import "METDocumentCache.h"
+
+// Counts how often parameters are compared, so we can tell a hash lookup from a scan
+@interface METEqualityCountingParameter : NSObject
+
+- (instancetype)initWithValue:(NSString *)value;
+@property (copy, nonatomic, readonly) NSString *value;
+
+@end
+
+static NSUInteger METNumberOfParameterComparisons = 0;
+
+@implementation METEqualityCountingParameter
+
+- (instancetype)initWithValue:(NSString *)value {
+  self = [super init];
+  if (self) {
+    _value = [value copy];
+  }
+  return self;
+}
+
+- (BOOL)isEqual:(id)object {
+  METNumberOfParameterComparisons++;
+  return [object isKindOfClass:[METEqualityCountingParameter class]] && [_value isEqualToString:((METEqualityCountingParameter *)object).value];
+}
+
+- (NSUInteger)hash {
+  return [_value hash];
+}
+
+@end
 
 @interface METSubscriptionManagerTests : XCTAsyncTestCase
 
@@ -96,6 +136,43 @@
   XCTAssertNotEqual(subscription1, subscription2);
 }
 
+- (void)testReturnsExistingSubscriptionIfParametersContainDictionariesWithKeysInDifferentOrder {
+  NSMutableDictionary *options1 = [[NSMutableDictionary alloc] init];
+  options1[@"limit"] = @10;
+  options1[@"sort"] = @{@"createdAt": @-1};
+  NSMutableDictionary *options2 = [[NSMutableDictionary alloc] init];
+  options2[@"sort"] = @{@"createdAt": @-1};
+  options2[@"limit"] = @10;
+  
+  METSubscription *subscription1 = [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@"bla", options1] completionHandler:nil];
+  
+  METSubscription *subscription2 = [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@"bla", options2] completionHandler:nil];
+  
+  XCTAssertEqual(subscription1, subscription2);
+}
+
+- (void)testFindsExistingSubscriptionWithoutComparingParametersOfOtherSubscriptions {
+  for (NSUInteger i = 0; i < 100; i++) {
+    NSString *value = [NSString stringWithFormat:@"list%lu", (unsigned long)i];
+    [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[[[METEqualityCountingParameter alloc] initWithValue:value]] completionHandler:nil];
+  }
+  METSubscription *subscription1 = [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[[[METEqualityCountingParameter alloc] initWithValue:@"list50"]] completionHandler:nil];
+  
+  METNumberOfParameterComparisons = 0;
+  METSubscription *subscription2 = [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[[[METEqualityCountingParameter alloc] initWithValue:@"list50"]] completionHandler:nil];
+  
+  XCTAssertEqual(subscription1, subscription2);
+  XCTAssertLessThan(METNumberOfParameterComparisons, 5);
+}
+
+- (void)testDoesNotReturnExistingSubscriptionIfNestedParametersDontMatch {
+  METSubscription *subscription1 = [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@{@"listId": @"1"}] completionHandler:nil];
+  
+  METSubscription *subscription2 = [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@{@"listId": @"2"}] completionHandler:nil];
+  
+  XCTAssertNotEqual(subscription1, subscription2);
+}
+
 - (void)testReturningExistingSubscriptionInvokesCompletionHandlerImmediatelyIfSubscriptionIsReady {
   METSubscription *subscription1 = [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@"bla"] completionHandler:nil];
   [_subscriptionManager didReceiveReadyForSubscriptionWithID:subscription1.identifier];
@@ -235,4 +312,303 @@
   XCTAssertEqual(subscription1, subscription2);
 }
 
+- (void)testRemovingSubscriptionsNotInUseRemovesThemBeforeTimeout {
+  _subscriptionManager.defaultNotInUseTimeout = 10;
+  
+  METSubscription *subscription1 = [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@"bla"] completionHandler:nil];
+  METSubscription *subscription2 = [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@"foo"] completionHandler:nil];
+  [_subscriptionManager removeSubscription:subscription1];
+  
+  XCTAssertEqual(1, [_subscriptionManager removeSubscriptionsNotInUse]);
+  
+  XCTAssertNotEqual(subscription1, [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@"bla"] completionHandler:nil]);
+  XCTAssertEqual(subscription2, [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@"foo"] completionHandler:nil]);
+}
+
+#pragma mark - Retention
+
+- (void)testReusingSubscriptionBeforeTimeoutCountsAsHit {
+  _subscriptionManager.defaultNotInUseTimeout = 1;
+  
+  METSubscription *subscription = [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@"bla"] completionHandler:nil];
+  [_subscriptionManager removeSubscription:subscription];
+  [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@"bla"] completionHandler:nil];
+  
+  XCTAssertEqual(1, _subscriptionManager.numberOfReuseHits);
+  XCTAssertEqual(0, _subscriptionManager.numberOfReuseMisses);
+}
+
+- (void)testAddingSubscriptionAgainAfterTimeoutCountsAsMiss {
+  _subscriptionManager.defaultNotInUseTimeout = 0.1;
+  
+  METSubscription *subscription = [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@"bla"] completionHandler:nil];
+  [_subscriptionManager removeSubscription:subscription];
+  
+  [self waitForTimeInterval:0.2];
+  
+  [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@"bla"] completionHandler:nil];
+  
+  XCTAssertEqual(0, _subscriptionManager.numberOfReuseHits);
+  XCTAssertEqual(1, _subscriptionManager.numberOfReuseMisses);
+}
+
+- (void)testOnlyOldestExpiredSubscriptionIsForgottenWhenRememberingTooMany {
+  _subscriptionManager.defaultNotInUseTimeout = 10;
+  
+  for (NSUInteger i = 0; i <= 1000; i++) {
+    METSubscription *subscription = [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@(i)] completionHandler:nil];
+    [_subscriptionManager removeSubscription:subscription];
+    [_subscriptionManager removeSubscriptionsNotInUse];
+  }
+  
+  [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@0] completionHandler:nil];
+  XCTAssertEqual(0, _subscriptionManager.numberOfReuseMisses);
+  
+  [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@1] completionHandler:nil];
+  XCTAssertEqual(1, _subscriptionManager.numberOfReuseMisses);
+}
+
+- (void)testAdaptiveRetentionIncreasesTimeoutAfterMiss {
+  _subscriptionManager.defaultNotInUseTimeout = 0.1;
+  METSubscriptionRetentionPolicy *retentionPolicy = [[METSubscriptionRetentionPolicy alloc] init];
+  retentionPolicy.adaptive = YES;
+  retentionPolicy.minimumNotInUseTimeout = 0.05;
+  retentionPolicy.maximumNotInUseTimeout = 10;
+  _subscriptionManager.retentionPolicy = retentionPolicy;
+  
+  METSubscription *subscription = [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@"bla"] completionHandler:nil];
+  [_subscriptionManager removeSubscription:subscription];
+  
+  [self waitForTimeInterval:0.2];
+  
+  [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@"bla"] completionHandler:nil];
+  
+  XCTAssertGreaterThan([_subscriptionManager notInUseTimeoutForSubscriptionWithName:@"todos"], 0.2);
+}
+
+- (void)testAdaptiveRetentionDecreasesTimeoutWhenSubscriptionExpiresWithinBounds {
+  _subscriptionManager.defaultNotInUseTimeout = 0.1;
+  METSubscriptionRetentionPolicy *retentionPolicy = [[METSubscriptionRetentionPolicy alloc] init];
+  retentionPolicy.adaptive = YES;
+  retentionPolicy.minimumNotInUseTimeout = 0.09;
+  retentionPolicy.maximumNotInUseTimeout = 10;
+  _subscriptionManager.retentionPolicy = retentionPolicy;
+  
+  METSubscription *subscription = [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@"bla"] completionHandler:nil];
+  [_subscriptionManager removeSubscription:subscription];
+  
+  [self waitForTimeInterval:0.2];
+  
+  XCTAssertEqualWithAccuracy(0.09, [_subscriptionManager notInUseTimeoutForSubscriptionWithName:@"todos"], 0.001);
+}
+
+- (void)testSubscriptionsNoLongerInUseAreRemovedWhenExceedingDocumentBudget {
+  _subscriptionManager.defaultNotInUseTimeout = 10;
+  METSubscriptionRetentionPolicy *retentionPolicy = [[METSubscriptionRetentionPolicy alloc] init];
+  retentionPolicy.maximumNumberOfRetainedDocuments = 1;
+  _subscriptionManager.retentionPolicy = retentionPolicy;
+  
+  METSubscription *subscription1 = [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@"bla"] completionHandler:nil];
+  [_client.database performUpdatesInLocalCacheWithoutTrackingChanges:^(METDocumentCache *localCache) {
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"todos" documentID:@"1"] fields:@{}];
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"todos" documentID:@"2"] fields:@{}];
+  }];
+  [_subscriptionManager didReceiveReadyForSubscriptionWithID:subscription1.identifier];
+  
+  [_subscriptionManager removeSubscription:subscription1];
+  
+  [self waitForTimeInterval:0.1];
+  
+  XCTAssertEqual(0, _subscriptionManager.numberOfRetainedSubscriptions);
+  
+  METSubscription *subscription2 = [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@"bla"] completionHandler:nil];
+  
+  XCTAssertNotEqual(subscription1, subscription2);
+}
+
+- (void)testSubscriptionsNoLongerInUseAreRetainedWhileLocalCacheIsWithinDocumentBudget {
+  _subscriptionManager.defaultNotInUseTimeout = 10;
+  METSubscriptionRetentionPolicy *retentionPolicy = [[METSubscriptionRetentionPolicy alloc] init];
+  retentionPolicy.maximumNumberOfRetainedDocuments = 2;
+  _subscriptionManager.retentionPolicy = retentionPolicy;
+  
+  // Other subscriptions loading at the same time used to count towards the budget of the removed subscription
+  [_subscriptionManager didReceiveDataUpdateWithType:METDataUpdateTypeAdd];
+  [_subscriptionManager didReceiveDataUpdateWithType:METDataUpdateTypeAdd];
+  [_subscriptionManager didReceiveDataUpdateWithType:METDataUpdateTypeAdd];
+  
+  METSubscription *subscription1 = [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@"bla"] completionHandler:nil];
+  [_client.database performUpdatesInLocalCacheWithoutTrackingChanges:^(METDocumentCache *localCache) {
+    [localCache addDocumentWithKey:[METDocumentKey keyWithCollectionName:@"todos" documentID:@"1"] fields:@{}];
+  }];
+  [_subscriptionManager didReceiveDataUpdateWithType:METDataUpdateTypeAdd];
+  [_subscriptionManager didReceiveDataUpdateWithType:METDataUpdateTypeAdd];
+  [_subscriptionManager didReceiveDataUpdateWithType:METDataUpdateTypeAdd];
+  [_subscriptionManager didReceiveReadyForSubscriptionWithID:subscription1.identifier];
+  
+  [_subscriptionManager removeSubscription:subscription1];
+  
+  [self waitForTimeInterval:0.1];
+  
+  XCTAssertEqual(1, _subscriptionManager.numberOfRetainedSubscriptions);
+  
+  METSubscription *subscription2 = [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@"bla"] completionHandler:nil];
+  
+  XCTAssertEqual(subscription1, subscription2);
+}
+
+#pragma mark - Bulk Loading
+
+- (void)testSubscriptionIsOnlyReadyOnceItsBulkLoadedDocumentsHaveBeenAdded {
+  METDatabase *database = _client.database;
+  database.loadsCollectionsInBulk = YES;
+  METDocumentKey *documentKey = [METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"];
+  
+  __block BOOL documentWasAddedWhenReady = NO;
+  XCTestExpectation *expectation = [self expectationWithDescription:@"completion handler invoked"];
+  METSubscription *subscription1 = [_subscriptionManager addSubscriptionWithName:@"players" parameters:nil completionHandler:^(NSError *error) {
+    documentWasAddedWhenReady = [database documentWithKey:documentKey] != nil;
+    [expectation fulfill];
+  }];
+  METSubscription *subscription2 = [_subscriptionManager addSubscriptionWithName:@"scores" parameters:nil completionHandler:nil];
+  
+  [database applyDataUpdate:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeAdd documentKey:documentKey fields:@{@"name": @"Ada Lovelace"}]];
+  [_subscriptionManager didReceiveReadyForSubscriptionWithID:subscription1.identifier];
+  
+  // Collections are only complete once no subscription is loading, so subscription1 can't be ready before subscription2 is
+  [self waitWhileAssertionsPass:^{
+    XCTAssertFalse(subscription1.ready);
+  }];
+  
+  [_subscriptionManager didReceiveReadyForSubscriptionWithID:subscription2.identifier];
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+  XCTAssertTrue(documentWasAddedWhenReady);
+}
+
+- (void)testDocumentsAreNotLoadedInBulkByDefault {
+  METDocumentKey *documentKey = [METDocumentKey keyWithCollectionName:@"players" documentID:@"lovelace"];
+  
+  [_subscriptionManager addSubscriptionWithName:@"players" parameters:nil completionHandler:nil];
+  [_client.database applyDataUpdate:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeAdd documentKey:documentKey fields:@{@"name": @"Ada Lovelace"}]];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertNotNil([_client.database documentWithKey:documentKey]);
+  }];
+}
+
+#pragma mark - Snapshots
+
+- (void)testSnapshotReconciliationOnlyFinishesAfterGracePeriodWithoutLoadingSubscriptions {
+  NSString *fileName = [NSString stringWithFormat:@"%@.snapshot", [[NSUUID UUID] UUIDString]];
+  NSURL *URL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:fileName]];
+  METDatabase *database = _client.database;
+  XCTAssertTrue([database openSnapshotAtURL:URL error:nil]);
+  database.snapshotReconciliationGracePeriod = 0.3;
+  [database reset];
+  
+  METSubscription *subscription1 = [_subscriptionManager addSubscriptionWithName:@"players" parameters:nil completionHandler:nil];
+  [_subscriptionManager didReceiveReadyForSubscriptionWithID:subscription1.identifier];
+  
+  [self waitForTimeInterval:0.2];
+  
+  // Adding another subscription restarts the grace period once it is ready
+  METSubscription *subscription2 = [_subscriptionManager addSubscriptionWithName:@"scores" parameters:nil completionHandler:nil];
+  [_subscriptionManager didReceiveReadyForSubscriptionWithID:subscription2.identifier];
+  
+  [self waitWhileAssertionsPass:^{
+    XCTAssertTrue(database.reconcilingSnapshot);
+  }];
+  
+  NSTimeInterval waitTime = [self waitUntilAssertionsPass:^{
+    XCTAssertFalse(database.reconcilingSnapshot);
+  }];
+  XCTAssertEqualWithAccuracy(0.2, waitTime, 0.1);
+  
+  [[NSFileManager defaultManager] removeItemAtURL:URL error:nil];
+}
+
+- (void)testSnapshotReconciliationCanBeFinishedExplicitly {
+  NSString *fileName = [NSString stringWithFormat:@"%@.snapshot", [[NSUUID UUID] UUIDString]];
+  NSURL *URL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:fileName]];
+  METDatabase *database = _client.database;
+  XCTAssertTrue([database openSnapshotAtURL:URL error:nil]);
+  [database reset];
+  
+  METSubscription *subscription = [_subscriptionManager addSubscriptionWithName:@"players" parameters:nil completionHandler:nil];
+  [_subscriptionManager didReceiveReadyForSubscriptionWithID:subscription.identifier];
+  
+  [self waitWhileAssertionsPass:^{
+    XCTAssertTrue(database.reconcilingSnapshot);
+  }];
+  
+  [database finishReconcilingSnapshot];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertFalse(database.reconcilingSnapshot);
+  }];
+  
+  [[NSFileManager defaultManager] removeItemAtURL:URL error:nil];
+}
+
+#pragma mark - Load Metrics
+
+- (void)testRecordsLoadMetricsWhenSubscriptionBecomesReady {
+  XCTestExpectation *expectation = [self expectationWithDescription:@"completion handler invoked"];
+  METSubscription *subscription = [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@"bla"] completionHandler:^(NSError *error) {
+    [expectation fulfill];
+  }];
+  
+  [_subscriptionManager didReceiveDataUpdateWithType:METDataUpdateTypeAdd];
+  [_subscriptionManager didReceiveDataUpdateWithType:METDataUpdateTypeAdd];
+  [_subscriptionManager didReceiveDataUpdateWithType:METDataUpdateTypeChange];
+  [_subscriptionManager didReceiveDataUpdateWithType:METDataUpdateTypeRemove];
+  [_client.database applyDataUpdate:[[METDataUpdate alloc] initWithUpdateType:METDataUpdateTypeAdd documentKey:[METDocumentKey keyWithCollectionName:@"todos" documentID:@"1"] fields:@{@"text": @"Buy milk"}]];
+  [_subscriptionManager didReceiveReadyForSubscriptionWithID:subscription.identifier];
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+  
+  // Time spent applying data messages is only known once they have been flushed
+  [self waitUntilAssertionsPass:^{
+    XCTAssertGreaterThan(subscription.timeSpentApplyingDataMessages, 0);
+    XCTAssertEqual(1, [_subscriptionManager loadStatisticsForSubscriptionWithName:@"todos"].timeSpentApplyingDataMessagesHistogram.count);
+  }];
+  
+  XCTAssertEqual(2, subscription.numberOfAddedMessages);
+  XCTAssertEqual(1, subscription.numberOfChangedMessages);
+  XCTAssertEqual(1, subscription.numberOfRemovedMessages);
+  XCTAssertGreaterThan(subscription.timeToReady, 0);
+  
+  METSubscriptionLoadStatistics *loadStatistics = [_subscriptionManager loadStatisticsForSubscriptionWithName:@"todos"];
+  XCTAssertEqual(1, loadStatistics.timeToReadyHistogram.count);
+  XCTAssertEqual(1, loadStatistics.numberOfDataMessagesHistogram.count);
+}
+
+- (void)testAccumulatesLoadMetricsWhenSubscriptionIsLoadedAgainAfterReconnecting {
+  METSubscription *subscription = [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@"bla"] completionHandler:nil];
+  [_subscriptionManager didReceiveDataUpdateWithType:METDataUpdateTypeAdd];
+  [_subscriptionManager didReceiveDataUpdateWithType:METDataUpdateTypeAdd];
+  [_subscriptionManager didReceiveReadyForSubscriptionWithID:subscription.identifier];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertEqual(1, [_subscriptionManager loadStatisticsForSubscriptionWithName:@"todos"].numberOfDataMessagesHistogram.count);
+  }];
+  
+  [_subscriptionManager reviveReadySubscriptionsAfterReconnect];
+  [_subscriptionManager didReceiveDataUpdateWithType:METDataUpdateTypeAdd];
+  [_subscriptionManager didReceiveReadyForSubscriptionWithID:subscription.identifier];
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertEqual(2, [_subscriptionManager loadStatisticsForSubscriptionWithName:@"todos"].numberOfDataMessagesHistogram.count);
+  }];
+  
+  XCTAssertEqual(3, subscription.numberOfAddedMessages);
+}
+
+- (void)testDoesNotReportLoadStatisticsBeforeSubscriptionBecomesReady {
+  [_subscriptionManager addSubscriptionWithName:@"todos" parameters:@[@"bla"] completionHandler:nil];
+  
+  XCTAssertNil([_subscriptionManager loadStatisticsForSubscriptionWithName:@"todos"]);
+}
+
 @end
@@ -22,6 +22,9 @@
 #import "XCTAsyncTestCase.h"
 
 #import "METTimer.h"
+#import "METTimerWheel.h"
+
+static const NSUInteger METNumberOfLiveTimers = 100000;
 
 @interface METTimerTests : XCTAsyncTestCase
 
@@ -141,4 +144,106 @@
   XCTAssertEqualWithAccuracy(0.2, waitTime, 0.1);
 }
 
+- (void)testTimerWithToleranceBelowTimerWheelResolutionFiresAfterTimeoutInterval {
+  __block BOOL timerFired = NO;
+  METTimer *timer = [[METTimer alloc] initWithQueue:dispatch_get_main_queue() block:^void() {
+    timerFired = YES;
+  }];
+  timer.tolerance = 0;
+  
+  [timer startWithTimeInterval:0.2];
+  
+  NSTimeInterval waitTime = [self waitUntilAssertionsPass:^{
+    XCTAssertTrue(timerFired);
+  }];
+  XCTAssertEqualWithAccuracy(0.2, waitTime, 0.1);
+}
+
+- (void)testTimerOnlyFiresOnceWhenRestartedAfterChangingTolerance {
+  __block NSUInteger numberOfTimesTimerFired = 0;
+  METTimer *timer = [[METTimer alloc] initWithQueue:dispatch_get_main_queue() block:^void() {
+    numberOfTimesTimerFired++;
+  }];
+  
+  [timer startWithTimeInterval:0.1];
+  timer.tolerance = 0;
+  [timer startWithTimeInterval:0.2];
+  timer.tolerance = 0.1;
+  [timer startWithTimeInterval:0.3];
+  
+  [self waitForTimeInterval:0.6];
+  
+  XCTAssertEqual(1, numberOfTimesTimerFired);
+}
+
+#pragma mark - Performance
+
+- (NSArray *)timersWithTimerWheel:(METTimerWheel *)timerWheel block:(void (^)())block {
+  dispatch_queue_t queue = dispatch_queue_create("com.meteor.TimerTests", DISPATCH_QUEUE_SERIAL);
+  NSMutableArray *timers = [[NSMutableArray alloc] initWithCapacity:METNumberOfLiveTimers];
+  for (NSUInteger i = 0; i < METNumberOfLiveTimers; i++) {
+    [timers addObject:[[METTimer alloc] initWithQueue:queue timerWheel:timerWheel block:block]];
+  }
+  return timers;
+}
+
+// Spreads expirations between 10 seconds and an hour out, so they end up on different levels of the wheel but don't fire during the test
+- (void)startTimers:(NSArray *)timers {
+  NSUInteger i = 0;
+  for (METTimer *timer in timers) {
+    [timer startWithTimeInterval:10 + (i++ % 3600)];
+  }
+}
+
+- (void)testPerformanceRestartingTimersWithManyLiveTimers {
+  METTimerWheel *timerWheel = [[METTimerWheel alloc] init];
+  NSArray *timers = [self timersWithTimerWheel:timerWheel block:^{}];
+  [self startTimers:timers];
+  
+  [self measureBlock:^{
+    [self startTimers:timers];
+  }];
+  
+  for (METTimer *timer in timers) {
+    [timer stop];
+  }
+}
+
+- (void)testPerformanceStoppingTimersWithManyLiveTimers {
+  METTimerWheel *timerWheel = [[METTimerWheel alloc] init];
+  NSArray *timers = [self timersWithTimerWheel:timerWheel block:^{}];
+  
+  [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+    [self startTimers:timers];
+    
+    [self startMeasuring];
+    for (METTimer *timer in timers) {
+      [timer stop];
+    }
+    [self stopMeasuring];
+  }];
+}
+
+// Includes starting the timers, so subtract the cost measured above to get the cost of firing
+- (void)testPerformanceFiringManyLiveTimers {
+  METTimerWheel *timerWheel = [[METTimerWheel alloc] init];
+  
+  [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+    __block NSUInteger numberOfTimesTimersFired = 0;
+    NSArray *timers = [self timersWithTimerWheel:timerWheel block:^{
+      if (++numberOfTimesTimersFired == METNumberOfLiveTimers) {
+        dispatch_semaphore_signal(semaphore);
+      }
+    }];
+    
+    [self startMeasuring];
+    for (METTimer *timer in timers) {
+      [timer startWithTimeInterval:0];
+    }
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    [self stopMeasuring];
+  }];
+}
+
 @end
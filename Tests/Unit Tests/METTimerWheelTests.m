@@ -0,0 +1,113 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#import <XCTest/XCTest.h>
+#import "XCTAsyncTestCase.h"
+
+#import "METTimerWheel.h"
+
+@interface METTimerWheelTests : XCTAsyncTestCase
+
+@end
+
+@implementation METTimerWheelTests {
+  METTimerWheel *_timerWheel;
+}
+
+- (void)setUp {
+  [super setUp];
+  
+  _timerWheel = [[METTimerWheel alloc] initWithResolution:0.001];
+}
+
+- (void)tearDown {
+  [super tearDown];
+}
+
+- (void)testInvokesBlockAfterTimeInterval {
+  XCTestExpectation *expectation = [self expectationWithDescription:@"block invoked"];
+  NSDate *startDate = [NSDate date];
+  __block NSTimeInterval elapsedTime;
+  [_timerWheel scheduleBlock:^{
+    elapsedTime = -[startDate timeIntervalSinceNow];
+    [expectation fulfill];
+  } afterTimeInterval:0.2];
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+  
+  XCTAssertGreaterThanOrEqual(elapsedTime, 0.2);
+  XCTAssertEqualWithAccuracy(0.2, elapsedTime, 0.1);
+}
+
+- (void)testDoesNotInvokeBlockAfterEntryIsCancelled {
+  __block BOOL blockInvoked = NO;
+  METTimerWheelEntry *entry = [_timerWheel scheduleBlock:^{
+    blockInvoked = YES;
+  } afterTimeInterval:0.1];
+  
+  [_timerWheel cancelEntry:entry];
+  
+  [self waitWhileAssertionsPass:^{
+    XCTAssertFalse(blockInvoked);
+  }];
+  XCTAssertEqual(0, _timerWheel.numberOfScheduledEntries);
+}
+
+- (void)testInvokesBlocksOnDifferentLevelsInOrderOfExpiration {
+  XCTestExpectation *expectation = [self expectationWithDescription:@"blocks invoked"];
+  NSMutableArray *invokedIntervals = [[NSMutableArray alloc] init];
+  NSArray *timeIntervals = @[@0.3, @0.005, @0.1, @0.05];
+  
+  // With a resolution of 1 ms, these span the first two levels of the wheel
+  for (NSNumber *timeInterval in timeIntervals) {
+    [_timerWheel scheduleBlock:^{
+      @synchronized(invokedIntervals) {
+        [invokedIntervals addObject:timeInterval];
+        if (invokedIntervals.count == timeIntervals.count) {
+          [expectation fulfill];
+        }
+      }
+    } afterTimeInterval:timeInterval.doubleValue];
+  }
+  
+  [self waitForExpectationsWithTimeout:1.0 handler:nil];
+  
+  NSArray *expectedIntervals = @[@0.005, @0.05, @0.1, @0.3];
+  XCTAssertEqualObjects(expectedIntervals, invokedIntervals);
+}
+
+- (void)testKeepsTrackOfNumberOfScheduledEntries {
+  METTimerWheelEntry *entry1 = [_timerWheel scheduleBlock:^{} afterTimeInterval:10];
+  [_timerWheel scheduleBlock:^{} afterTimeInterval:3600];
+  [_timerWheel scheduleBlock:^{} afterTimeInterval:0.01];
+  
+  XCTAssertEqual(3, _timerWheel.numberOfScheduledEntries);
+  
+  [_timerWheel cancelEntry:entry1];
+  [_timerWheel cancelEntry:entry1];
+  
+  XCTAssertEqual(2, _timerWheel.numberOfScheduledEntries);
+  
+  [self waitUntilAssertionsPass:^{
+    XCTAssertEqual(1, _timerWheel.numberOfScheduledEntries);
+  }];
+}
+
+@end
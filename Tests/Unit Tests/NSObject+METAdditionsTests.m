@@ -0,0 +1,128 @@
+// Copyright (c) 2014-2015 Martijn Walraven
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#import <XCTest/XCTest.h>
+
+#import "NSObject+METAdditions.h"
+
+@interface NSObject_METAdditionsTests : XCTestCase
+
+@end
+
+@implementation NSObject_METAdditionsTests
+
+#pragma mark - Deep Immutable Copy
+
+- (void)testDeepImmutableCopyReturnsImmutableObjectGraphIndependentOfOriginal {
+  NSMutableDictionary *address = [@{@"city": @"London"} mutableCopy];
+  NSMutableArray *scores = [@[@10, @20] mutableCopy];
+  NSMutableDictionary *player = [@{@"name": [@"Ada Lovelace" mutableCopy], @"address": address, @"scores": scores} mutableCopy];
+  
+  NSDictionary *copy = [player deepImmutableCopy];
+  
+  XCTAssertEqualObjects(player, copy);
+  XCTAssertFalse([copy isKindOfClass:[NSMutableDictionary class]]);
+  XCTAssertFalse([copy[@"address"] isKindOfClass:[NSMutableDictionary class]]);
+  XCTAssertFalse([copy[@"scores"] isKindOfClass:[NSMutableArray class]]);
+  
+  address[@"city"] = @"Paris";
+  [scores addObject:@30];
+  
+  XCTAssertEqualObjects(@"London", copy[@"address"][@"city"]);
+  XCTAssertEqual(2, [copy[@"scores"] count]);
+}
+
+- (void)testDeepImmutableCopyReturnsAlreadyImmutableSubtreesAsIs {
+  NSDictionary *address = @{@"city": @"London", @"location": @[@51.5, @-0.1]};
+  NSDate *createdAt = [NSDate date];
+  NSArray *parameters = @[@{@"name": @"Ada Lovelace", @"address": address, @"createdAt": createdAt, @"nickname": [NSNull null]}];
+  
+  XCTAssertEqual(parameters, [parameters deepImmutableCopy]);
+  
+  NSMutableArray *mutableParameters = [parameters mutableCopy];
+  NSArray *copy = [mutableParameters deepImmutableCopy];
+  XCTAssertNotEqual(mutableParameters, copy);
+  XCTAssertEqual(parameters[0], copy[0]);
+}
+
+- (void)testDeepImmutableCopyCopiesImmutableContainersWithMutableChildrenAfterOtherChildren {
+  NSDictionary *address = @{@"city": @"London"};
+  NSMutableArray *scores = [@[@10, @20] mutableCopy];
+  NSDictionary *player = @{@"name": @"Ada Lovelace", @"address": address, @"scores": scores, @"score": @25};
+  NSArray *players = @[address, player, @"gauss"];
+  
+  NSArray *copy = [players deepImmutableCopy];
+  
+  XCTAssertNotEqual(players, copy);
+  XCTAssertEqualObjects(players, copy);
+  XCTAssertEqual(address, copy[0]);
+  XCTAssertEqual(address, copy[1][@"address"]);
+  XCTAssertFalse([copy[1][@"scores"] isKindOfClass:[NSMutableArray class]]);
+}
+
+- (void)testDeepImmutableCopyReturnsObjectsThatDoNotSupportCopyingAsIs {
+  id object = [[NSObject alloc] init];
+  NSArray *parameters = @[object];
+  
+  XCTAssertEqual(object, [object deepImmutableCopy]);
+  XCTAssertEqual(parameters, [parameters deepImmutableCopy]);
+}
+
+#pragma mark - Performance
+
+- (void)testPerformanceOfDeepImmutableCopy {
+  NSArray *parameters = [self largeParameters];
+  
+  [self measureBlock:^{
+    for (NSUInteger i = 0; i < 10; i++) {
+      [parameters deepImmutableCopy];
+    }
+  }];
+}
+
+- (void)testPerformanceOfCopyingThroughKeyedArchiver {
+  NSArray *parameters = [self largeParameters];
+  
+  [self measureBlock:^{
+    for (NSUInteger i = 0; i < 10; i++) {
+      [NSKeyedUnarchiver unarchiveObjectWithData:[NSKeyedArchiver archivedDataWithRootObject:parameters]];
+    }
+  }];
+}
+
+#pragma mark - Helper Methods
+
+// Resembles inserting a batch of documents, partly built up from mutable containers
+- (NSArray *)largeParameters {
+  NSMutableArray *documents = [[NSMutableArray alloc] init];
+  for (NSUInteger i = 0; i < 1000; i++) {
+    NSMutableDictionary *document = [[NSMutableDictionary alloc] init];
+    document[@"_id"] = [NSString stringWithFormat:@"document%lu", (unsigned long)i];
+    document[@"score"] = @(i);
+    document[@"createdAt"] = [NSDate dateWithTimeIntervalSince1970:i];
+    document[@"tags"] = @[@"red", @"green", @"blue"];
+    document[@"address"] = [@{@"street": @"Baker Street", @"number": @(i)} mutableCopy];
+    [documents addObject:document];
+  }
+  return @[documents];
+}
+
+@end